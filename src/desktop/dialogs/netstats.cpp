@@ -6,10 +6,13 @@ extern "C" {
 }
 
 #include "desktop/dialogs/netstats.h"
+#include "libclient/canvas/paintengine.h"
 #include "libclient/drawdance/global.h"
 #include "ui_netstats.h"
 
 #include <QTimer>
+#include <QVector>
+#include <algorithm>
 
 namespace dialogs {
 
@@ -52,11 +55,18 @@ void NetStats::updateMemoryUsage()
 	m_ui->contextMemoryLabel->setText(QStringLiteral("%1 / %2").arg(
 		formatDataSize(dpcs.bytesUsed), formatDataSize(dpcs.bytesTotal)));
 
+	updatePaintEngineStats();
+
 	if(!m_updateMemoryTimer->isActive()) {
 		m_updateMemoryTimer->start();
 	}
 }
 
+void NetStats::setPaintEngine(canvas::PaintEngine *paintEngine)
+{
+	m_paintEngine = paintEngine;
+}
+
 void NetStats::setRecvBytes(int bytes)
 {
 	m_ui->recvLabel->setText(formatDataSize(bytes));
@@ -86,6 +96,53 @@ void NetStats::updateMemoryUsagePeriodic()
 	}
 }
 
+void NetStats::updatePaintEngineStats()
+{
+	if(!m_paintEngine) {
+		QString none = tr("no canvas");
+		m_ui->paintQueueLabel->setText(none);
+		m_ui->paintHandledLabel->setText(none);
+		m_ui->historyLabel->setText(none);
+		m_ui->busiestUsersLabel->setText(none);
+		return;
+	}
+
+	DP_PaintEngineStats stats = m_paintEngine->stats();
+	m_ui->paintQueueLabel->setText(tr("%1 local, %2 remote")
+									   .arg(stats.local_queue_depth)
+									   .arg(stats.remote_queue_depth));
+	m_ui->paintHandledLabel->setText(tr("%1 messages, %2 dabs")
+										 .arg(stats.messages_handled)
+										 .arg(stats.dabs_handled));
+	m_ui->historyLabel->setText(
+		tr("%1 entries, %2 save points, %3")
+			.arg(stats.history.entries)
+			.arg(stats.history.save_points)
+			.arg(formatDataSize(stats.history.retained_bytes)));
+
+	// Context ids are user ids, so this shows who's keeping the engine busy.
+	QVector<int> contextIds;
+	for(int i = 0; i < DP_DRAW_CONTEXT_ID_COUNT; ++i) {
+		if(stats.messages_by_context[i] != 0) {
+			contextIds.append(i);
+		}
+	}
+	std::sort(contextIds.begin(), contextIds.end(), [&](int a, int b) {
+		return stats.messages_by_context[a] > stats.messages_by_context[b];
+	});
+
+	QStringList busiest;
+	for(int i = 0, count = qMin(contextIds.size(), 3); i < count; ++i) {
+		int contextId = contextIds[i];
+		busiest.append(tr("#%1: %2 messages, %3 dabs")
+						   .arg(contextId)
+						   .arg(stats.messages_by_context[contextId])
+						   .arg(stats.dabs_by_context[contextId]));
+	}
+	m_ui->busiestUsersLabel->setText(
+		busiest.isEmpty() ? tr("none") : busiest.join(QChar('\n')));
+}
+
 QString NetStats::formatDataSize(size_t bytes)
 {
 	return QLocale::c().formattedDataSize(bytes);
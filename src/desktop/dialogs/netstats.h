@@ -4,10 +4,15 @@
 #define NETSTATS_H
 
 #include <QDialog>
+#include <QPointer>
 
 class QTimer;
 class Ui_NetStats;
 
+namespace canvas {
+class PaintEngine;
+}
+
 namespace dialogs {
 
 class NetStats final : public QDialog {
@@ -17,6 +22,7 @@ public:
 	~NetStats() override;
 
 	void updateMemoryUsage();
+	void setPaintEngine(canvas::PaintEngine *paintEngine);
 
 public slots:
 	void setSentBytes(int bytes);
@@ -28,10 +34,13 @@ private slots:
 	void updateMemoryUsagePeriodic();
 
 private:
+	void updatePaintEngineStats();
+
 	static QString formatDataSize(size_t bytes);
 
 	Ui_NetStats *m_ui;
 	QTimer *m_updateMemoryTimer;
+	QPointer<canvas::PaintEngine> m_paintEngine;
 };
 
 }
@@ -59,6 +59,11 @@ void General::initAutosave(
 	snapshotCountLayout->setControlTypes(QSizePolicy::CheckBox);
 	form->addRow(tr("Autosave:"), snapshotCountLayout);
 
+	auto *fastCompression =
+		new QCheckBox(tr("Compress autosaves faster, but make them larger"));
+	settings.bindAutoSaveFastCompression(fastCompression);
+	form->addRow(nullptr, fastCompression);
+
 	form->addRow(
 		nullptr,
 		utils::formNote(tr("Autosave can be enabled for the current file under "
@@ -244,6 +249,17 @@ void General::initUndo(desktop::settings::Settings &settings, QFormLayout *form)
 		utils::encapsulate(tr("Use %1 undo levels by default"), undoLimit);
 	undoLimitLayout->setControlTypes(QSizePolicy::CheckBox);
 	form->addRow(tr("Session history:"), undoLimitLayout);
+
+	auto *historyColdBudget = new QSpinBox;
+	historyColdBudget->setRange(0, 65536);
+	historyColdBudget->setSingleStep(64);
+	historyColdBudget->setSuffix(tr(" MiB"));
+	historyColdBudget->setSpecialValueText(tr("Unlimited"));
+	settings.bindEngineHistoryColdBudget(historyColdBudget);
+	form->addRow(tr("Uncompressed undo memory:"), historyColdBudget);
+	form->addRow(
+		nullptr, utils::formNote(tr("Older undo steps beyond this are kept "
+									"compressed and take longer to undo to.")));
 }
 
 } // namespace settingsdialog
@@ -542,6 +542,7 @@ void MainWindow::autoJoin(const QUrl &url, const QString &autoRecordPath)
 void MainWindow::onCanvasChanged(canvas::CanvasModel *canvas)
 {
 	m_canvasView->setCanvas(canvas);
+	m_netstatus->setPaintEngine(canvas->paintEngine());
 
 	connect(canvas->aclState(), &canvas::AclState::localOpChanged, this, &MainWindow::onOperatorModeChange);
 	connect(canvas->aclState(), &canvas::AclState::localLockChanged, this, &MainWindow::updateLockWidget);
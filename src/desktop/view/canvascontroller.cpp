@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 extern "C" {
+#include "dpengine/renderer.h"
 #include "dpmsg/blend_mode.h"
 }
 #include "desktop/main.h"
@@ -2253,12 +2254,24 @@ void CanvasController::emitViewRectChanged()
 			QPoint(area.right() / DP_TILE_SIZE, area.bottom() / DP_TILE_SIZE));
 		emit viewChanged(view);
 		if(m_canvasModel) {
-			m_canvasModel->paintEngine()->setCanvasViewTileArea(
-				m_canvasViewTileArea);
+			canvas::PaintEngine *pe = m_canvasModel->paintEngine();
+			pe->setRenderLod(renderLod());
+			pe->setCanvasViewTileArea(m_canvasViewTileArea);
 		}
 	}
 }
 
+int CanvasController::renderLod() const
+{
+	// Pick the lowest level of detail that still has at least one rendered
+	// pixel per device pixel, so that zooming out doesn't lose any detail.
+	int lod = 0;
+	while(lod < DP_RENDERER_LOD_MAX && m_zoom * qreal(2 << lod) <= 1.0) {
+		++lod;
+	}
+	return lod;
+}
+
 void CanvasController::emitScrollAreaChanged()
 {
 	if(!m_canvasSizeChanging) {
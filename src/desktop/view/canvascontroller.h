@@ -308,6 +308,8 @@ private:
 	void emitViewRectChanged();
 	void emitScrollAreaChanged();
 
+	int renderLod() const;
+
 	QRect canvasRect() const;
 	QRectF canvasRectF() const;
 	QPointF viewCenterF() const;
@@ -647,9 +647,12 @@ void main()
 			f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
 			f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
 		}
+		// At a reduced level of detail, the textures are scaled up to cover
+		// the full canvas area.
+		int scale = 1 << textureLod;
 		f->glUniform4f(
-			canvasShader.rectLocation, rect.x(), rect.y(), rect.width(),
-			rect.height());
+			canvasShader.rectLocation, rect.x() * scale, rect.y() * scale,
+			rect.width() * scale, rect.height() * scale);
 		f->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	}
 
@@ -660,8 +663,8 @@ void main()
 		QRect tileRect = QRect(
 			QPoint(rect.left() / DP_TILE_SIZE, rect.top() / DP_TILE_SIZE),
 			QPoint(rect.right() / DP_TILE_SIZE, rect.bottom() / DP_TILE_SIZE));
-		QRect visibleTileRect =
-			tileRect.intersected(controller->canvasViewTileArea());
+		QRect visibleTileRect = tileRect.intersected(
+			tileCache.lodTileArea(controller->canvasViewTileArea()));
 		if(!visibleTileRect.isEmpty()) {
 			// This is zero after a resize because the the textures will already
 			// be bound from actually setting their size beforehand. If we're
@@ -760,10 +763,12 @@ void main()
 		setUpCanvasShader(f);
 		updateCanvasTextureFilter(f);
 
-		QSize size = tileCache.size();
-		bool textureSizeChanged = totalTextureSize != size;
+		QSize size = tileCache.lodSize();
+		int lod = tileCache.lod();
+		bool textureSizeChanged = totalTextureSize != size || textureLod != lod;
 		if(textureSizeChanged) {
 			totalTextureSize = size;
+			textureLod = lod;
 			renderCanvasDirtyTexturesResize(f, tileCache);
 		} else {
 			int textureCount = canvasTextures.size();
@@ -891,6 +896,7 @@ void main()
 	QVector<QRect> canvasRects;
 	QVector<GLint> canvasFilters;
 	QSize totalTextureSize;
+	int textureLod = 0;
 	bool textureFilterLinear = false;
 	GLfloat translationX;
 	GLfloat translationY;
@@ -33,11 +33,12 @@ struct SoftwareCanvas::Private {
 		if(!canvasViewTileArea.isEmpty()) {
 			const QTransform &tf = controller->transform();
 			tileCache.eachDirtyTileReset(
-				canvasViewTileArea,
+				tileCache.lodTileArea(canvasViewTileArea),
 				[&](const QRect &pixelRect, const void *pixels) {
 					Q_UNUSED(pixels);
-					QRect viewRect = tf.mapRect(pixelRect).marginsAdded(
-						QMargins(1, 1, 1, 1));
+					QRect viewRect =
+						tf.mapRect(tileCache.lodToCanvasRect(pixelRect))
+							.marginsAdded(QMargins(1, 1, 1, 1));
 					region |= viewRect;
 				});
 		}
@@ -116,7 +117,11 @@ struct SoftwareCanvas::Private {
 			if(pixmap) {
 				painter->save();
 				const QTransform &tf = controller->transform();
-				QRectF canvasRect = QRectF(pixmap->rect());
+				// At a reduced level of detail, the pixmap is smaller than the
+				// canvas and gets scaled up to cover it.
+				qreal scale = qreal(1 << tileCache.lod());
+				QRectF canvasRect =
+					QRectF(QPointF(0.0, 0.0), QSizeF(pixmap->size()) * scale);
 
 				if(checkersVisible) {
 					painter->setBrush(getCheckerBrush());
@@ -131,7 +136,9 @@ struct SoftwareCanvas::Private {
 									 .map(QRectF(rect))
 									 .boundingRect()
 									 .intersected(canvasRect);
-				painter->drawPixmap(exposed, *pixmap, exposed);
+				painter->drawPixmap(
+					exposed, *pixmap,
+					QRectF(exposed.topLeft() / scale, exposed.size() / scale));
 
 				if(pixelGridVisible) {
 					QPen pen;
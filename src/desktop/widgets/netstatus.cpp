@@ -5,6 +5,7 @@
 #include "desktop/dialogs/netstats.h"
 #include "desktop/main.h"
 #include "desktop/widgets/popupmessage.h"
+#include "libclient/canvas/paintengine.h"
 #include "libshared/util/whatismyip.h"
 
 #include <QAction>
@@ -419,6 +420,7 @@ void NetStatus::showNetStats()
 		m_netstats->setWindowFlags(Qt::Tool);
 		m_netstats->setAttribute(Qt::WA_DeleteOnClose);
 	}
+	m_netstats->setPaintEngine(m_paintEngine);
 	m_netstats->setRecvBytes(m_recvbytes);
 	m_netstats->setSentBytes(m_sentbytes);
 	if(!m_address.isEmpty()) {
@@ -428,6 +430,14 @@ void NetStatus::showNetStats()
 	m_netstats->show();
 }
 
+void NetStatus::setPaintEngine(canvas::PaintEngine *paintEngine)
+{
+	m_paintEngine = paintEngine;
+	if(m_netstats) {
+		m_netstats->setPaintEngine(paintEngine);
+	}
+}
+
 void NetStatus::showCGNAlert()
 {
 	auto &settings = dpApp().settings();
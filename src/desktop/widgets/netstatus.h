@@ -11,6 +11,10 @@ class QLabel;
 class QTimer;
 class QProgressBar;
 
+namespace canvas {
+class PaintEngine;
+}
+
 namespace dialogs {
 class NetStats;
 }
@@ -74,6 +78,7 @@ public slots:
 	void discoverAddress();
 
 	void showNetStats();
+	void setPaintEngine(canvas::PaintEngine *paintEngine);
 
 private slots:
 	void externalIpDiscovered(const QString &ip);
@@ -88,6 +93,7 @@ private:
 	QString fullAddress() const;
 
 	QPointer<dialogs::NetStats> m_netstats;
+	QPointer<canvas::PaintEngine> m_paintEngine;
 	QProgressBar *m_download;
 
 	QLabel *m_label, *m_security;
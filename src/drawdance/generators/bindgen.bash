@@ -3,7 +3,7 @@
 # Generates C to Rust bindings in Drawdance.
 set -ueo pipefail
 
-if ! command -v cbindgen &> /dev/null; then
+if ! command -v bindgen &> /dev/null; then
     echo 1>&2
     echo 'bindgen not found, you probably need to install it first:' 1>&2
     echo '    cargo install --force --locked bindgen-cli' 1>&2
@@ -150,3 +150,35 @@ void DP_cpu_support_init(void)
                 (int)actual_cpu_support, (int)DP_cpu_support_value);
     }
 }
+
+bool DP_cpu_support_force(DP_CpuSupport support)
+{
+    DP_ASSERT(support >= 0);
+    DP_ASSERT(support < DP_CPU_SUPPORT_COUNT);
+    switch (support) {
+#ifdef DP_CPU_X64
+    case DP_CPU_SUPPORT_AVX2:
+        if (!supports_avx2()) {
+            return false;
+        }
+        break;
+    case DP_CPU_SUPPORT_AVX:
+        if (!supports_avx()) {
+            return false;
+        }
+        break;
+    case DP_CPU_SUPPORT_SSE42:
+        if (!supports_sse42()) {
+            return false;
+        }
+        break;
+#endif
+    default:
+        break;
+    }
+    DP_cpu_support_value = support;
+#ifndef NDEBUG
+    init_called = true;
+#endif
+    return DP_cpu_support == support;
+}
@@ -115,6 +115,11 @@ typedef enum DP_CpuSupport {
 
 void DP_cpu_support_init(void);
 
+// Switches to the given support level, for benchmarking the different code
+// paths against each other. Returns false if the processor can't do it or if
+// the level was fixed at compile-time, see below.
+bool DP_cpu_support_force(DP_CpuSupport support);
+
 // If AVX2, AVX or SSE 4.2 are requested at compile-time, we switch to those at
 // compile-time instead of doing a dynamic check. If your processor supports
 // AVX2 but you ask for SSE 4.2 at compile-time then you only get the latter.
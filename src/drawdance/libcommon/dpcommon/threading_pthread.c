@@ -38,6 +38,10 @@ struct DP_Semaphore {
     sem_t value;
 };
 
+struct DP_ThreadLocal {
+    pthread_key_t key;
+};
+
 struct DP_Thread {
     pthread_t value;
 };
@@ -285,6 +289,32 @@ void DP_thread_free_join(DP_Thread *thread)
 }
 
 
+DP_ThreadLocal *DP_thread_local_new(DP_ThreadLocalFreeFn free_fn)
+{
+    DP_ThreadLocal *tl = DP_malloc(sizeof(*tl));
+    int error = pthread_key_create(&tl->key, free_fn);
+    if (error != 0) {
+        DP_panic("Error creating thread-local key: %s", strerror(error));
+    }
+    return tl;
+}
+
+void *DP_thread_local_get(DP_ThreadLocal *tl)
+{
+    DP_ASSERT(tl);
+    return pthread_getspecific(tl->key);
+}
+
+void DP_thread_local_set(DP_ThreadLocal *tl, void *value)
+{
+    DP_ASSERT(tl);
+    int error = pthread_setspecific(tl->key, value);
+    if (error != 0) {
+        DP_panic("Error setting thread-local: %s", strerror(error));
+    }
+}
+
+
 typedef struct DP_PthreadErrorState {
     unsigned int count;
     size_t buffer_size;
@@ -171,6 +171,69 @@ extern "C" void DP_thread_free_join(DP_Thread *thread)
 }
 
 
+// QThreadStorage deletes pointers stored in it when the thread exits, so this
+// wrapper gets to call the free function from its destructor.
+class DP_QtThreadLocalValue final {
+  public:
+    DP_QtThreadLocalValue(DP_ThreadLocalFreeFn free_fn)
+        : m_free_fn{free_fn}, m_value{nullptr}
+    {
+    }
+
+    ~DP_QtThreadLocalValue()
+    {
+        if (m_value) {
+            m_free_fn(m_value);
+        }
+    }
+
+    DP_QtThreadLocalValue(const DP_QtThreadLocalValue &) = delete;
+    DP_QtThreadLocalValue &operator=(const DP_QtThreadLocalValue &) = delete;
+
+    void *get() const
+    {
+        return m_value;
+    }
+
+    void set(void *value)
+    {
+        m_value = value;
+    }
+
+  private:
+    DP_ThreadLocalFreeFn m_free_fn;
+    void *m_value;
+};
+
+struct DP_ThreadLocal {
+    DP_ThreadLocalFreeFn free_fn;
+    QThreadStorage<DP_QtThreadLocalValue *> storage;
+};
+
+extern "C" DP_ThreadLocal *DP_thread_local_new(DP_ThreadLocalFreeFn free_fn)
+{
+    DP_ThreadLocal *tl = new DP_ThreadLocal;
+    tl->free_fn = free_fn;
+    return tl;
+}
+
+extern "C" void *DP_thread_local_get(DP_ThreadLocal *tl)
+{
+    DP_ASSERT(tl);
+    return tl->storage.hasLocalData() ? tl->storage.localData()->get()
+                                      : nullptr;
+}
+
+extern "C" void DP_thread_local_set(DP_ThreadLocal *tl, void *value)
+{
+    DP_ASSERT(tl);
+    if (!tl->storage.hasLocalData()) {
+        tl->storage.setLocalData(new DP_QtThreadLocalValue{tl->free_fn});
+    }
+    tl->storage.localData()->set(value);
+}
+
+
 class DP_QtErrorState final {
   public:
     DP_QtErrorState()
@@ -187,6 +187,67 @@ void DP_thread_free_join(DP_Thread *thread)
     }
 }
 
+
+// Fiber-local storage is used because, unlike TlsAlloc, it takes a callback
+// that gets invoked when a thread exits. It only passes the value though, so
+// that needs to be wrapped to get at the free function.
+struct DP_ThreadLocal {
+    DWORD index;
+    DP_ThreadLocalFreeFn free_fn;
+};
+
+typedef struct DP_Win32ThreadLocalValue {
+    DP_ThreadLocalFreeFn free_fn;
+    void *value;
+} DP_Win32ThreadLocalValue;
+
+static VOID NTAPI free_thread_local_value(PVOID arg)
+{
+    DP_Win32ThreadLocalValue *tlv = arg;
+    if (tlv) {
+        if (tlv->value) {
+            tlv->free_fn(tlv->value);
+        }
+        DP_free(tlv);
+    }
+}
+
+DP_ThreadLocal *DP_thread_local_new(DP_ThreadLocalFreeFn free_fn)
+{
+    DWORD index = FlsAlloc(free_thread_local_value);
+    if (index == FLS_OUT_OF_INDEXES) {
+        DP_panic("Error allocating fiber-local index: %lu",
+                 (unsigned long)GetLastError());
+    }
+    DP_ThreadLocal *tl = DP_malloc(sizeof(*tl));
+    tl->index = index;
+    tl->free_fn = free_fn;
+    return tl;
+}
+
+void *DP_thread_local_get(DP_ThreadLocal *tl)
+{
+    DP_ASSERT(tl);
+    DP_Win32ThreadLocalValue *tlv = FlsGetValue(tl->index);
+    return tlv ? tlv->value : NULL;
+}
+
+void DP_thread_local_set(DP_ThreadLocal *tl, void *value)
+{
+    DP_ASSERT(tl);
+    DP_Win32ThreadLocalValue *tlv = FlsGetValue(tl->index);
+    if (!tlv) {
+        tlv = DP_malloc(sizeof(*tlv));
+        tlv->free_fn = tl->free_fn;
+        if (!FlsSetValue(tl->index, tlv)) {
+            DP_panic("Error setting fiber-local value: %lu",
+                     (unsigned long)GetLastError());
+        }
+    }
+    tlv->value = value;
+}
+
+
 #ifdef _MSC_VER
 #    define THREAD_LOCAL __declspec(thread)
 #else
@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 #include "worker.h"
+#include "atomic.h"
 #include "common.h"
 #include "conversions.h"
 #include "queue.h"
@@ -36,6 +37,8 @@ typedef struct DP_Worker {
     DP_Thread *threads[];
 } DP_Worker;
 
+static DP_Atomic cpu_limit;
+
 struct DP_WorkerParams {
     DP_Worker *worker;
     int thread_index;
@@ -44,6 +47,10 @@ struct DP_WorkerParams {
 
 int DP_worker_cpu_count(int max)
 {
+    int limit = DP_atomic_get(&cpu_limit);
+    if (limit > 0) {
+        max = DP_min_int(limit, max);
+    }
 #ifdef __EMSCRIPTEN__
     // In the browser, "thread" overhead for web workers is very high. On mobile
     // devices, especially iOS, we're also under memory pressure. So we'll keep
@@ -54,6 +61,11 @@ int DP_worker_cpu_count(int max)
 #endif
 }
 
+void DP_worker_cpu_limit_set(int limit)
+{
+    DP_atomic_set(&cpu_limit, limit);
+}
+
 
 static bool shift_worker_element(DP_Mutex *queue_mutex, DP_Queue *queue,
                                  size_t element_size, void *out_element)
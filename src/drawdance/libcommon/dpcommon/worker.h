@@ -30,6 +30,12 @@ typedef void (*DP_WorkerJobFn)(void *element, int thread_index);
 
 int DP_worker_cpu_count(int max);
 
+// Caps what DP_worker_cpu_count returns for the whole process, for when
+// several independent jobs run side by side and would otherwise each size
+// their threads to the entire machine. A limit of 0 or less removes the cap.
+// Only affects thread counts determined after the call.
+void DP_worker_cpu_limit_set(int limit);
+
 DP_Worker *DP_worker_new(size_t initial_capacity, size_t element_size,
                          int thread_count, DP_WorkerJobFn job_fn);
 
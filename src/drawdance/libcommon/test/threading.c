@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: MIT
+#include <dpcommon/atomic.h>
+#include <dpcommon/common.h>
+#include <dpcommon/threading.h>
+#include <dptest.h>
+
+#define THREAD_COUNT 8
+
+
+// Thread-local slots can't be freed, so this is kept around to not leak it.
+static DP_ThreadLocal *tl;
+static DP_Atomic freed_count;
+
+static void free_counted(void *value)
+{
+    DP_atomic_inc(&freed_count);
+    DP_free(value);
+}
+
+static void set_thread_local(DP_UNUSED void *data)
+{
+    if (!DP_thread_local_get(tl)) {
+        DP_thread_local_set(tl, DP_malloc(sizeof(int)));
+    }
+}
+
+static void thread_local_values(TEST_PARAMS)
+{
+    DP_atomic_set(&freed_count, 0);
+    tl = DP_thread_local_new(free_counted);
+
+    NULL_OK(DP_thread_local_get(tl), "thread-local starts out NULL");
+    int value;
+    DP_thread_local_set(tl, &value);
+    PTR_EQ_OK(DP_thread_local_get(tl), &value, "got value back after setting");
+
+    DP_Thread *threads[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        threads[i] = DP_thread_new(set_thread_local, NULL);
+    }
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        DP_thread_free_join(threads[i]);
+    }
+
+    INT_EQ_OK(DP_atomic_get(&freed_count), THREAD_COUNT,
+              "value of each exited thread was freed");
+    PTR_EQ_OK(DP_thread_local_get(tl), &value,
+              "value is unaffected by other threads");
+    DP_thread_local_set(tl, NULL);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(thread_local_values);
+}
+
+int main(int argc, char **argv)
+{
+    DP_test_main(argc, argv, register_tests, NULL);
+}
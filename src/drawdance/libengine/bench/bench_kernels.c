@@ -0,0 +1,544 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/cpu.h>
+#include <dpcommon/perf.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/flood_fill.h>
+#include <dpengine/image.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/layer_list.h>
+#include <dpengine/layer_props.h>
+#include <dpengine/layer_props_list.h>
+#include <dpengine/paint.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpengine/view_mode.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <stdio.h>
+#include "../test/random_common.h"
+#include <stdlib.h>
+
+// Micro-benchmarks for the engine's hot paths, each one run at every SIMD level
+// the processor supports. All inputs come from a fixed seed and are generated
+// only once, so every level works on exactly the same data. Results go to
+// stdout as CSV, one row per kernel and level. The pixel count of the dab
+// kernels is an estimate, namely the area of the bounding square of each dab.
+
+
+#define SEED             0x5eedu
+#define CANVAS_WIDTH     1024
+#define CANVAS_HEIGHT    1024
+#define LAYER_COUNT      4
+#define FIRST_LAYER_ID   0x100
+#define STROKE_COUNT     64
+#define DABS_PER_STROKE  128
+#define MASK_SIZE        64
+#define COMPRESS_TILES   64
+#define COMPRESS_BUFSIZE (DP_TILE_COMPRESSED_BYTES * 2)
+
+typedef struct BenchFixture {
+    DP_DrawContext *dc;
+    DP_Message *classic_strokes[STROKE_COUNT];
+    DP_Message *mypaint_strokes[STROKE_COUNT];
+    long long classic_pixels;
+    long long mypaint_pixels;
+    DP_CanvasState *cs;
+    DP_Tile *tiles[COMPRESS_TILES];
+    uint16_t *mask;
+    DP_Pixel15 *blend_dst;
+    DP_Pixel15 *convert_src;
+    DP_Pixel8 *convert_dst;
+    DP_Pixel8 *compress_pixels;
+    unsigned char *compress_output;
+} BenchFixture;
+
+typedef struct BenchResult {
+    long long calls;
+    long long pixels;
+    long long dabs;
+} BenchResult;
+
+typedef struct BenchKernel {
+    const char *name;
+    int rounds;
+    void (*run)(BenchFixture *f, int rounds, BenchResult *out_result);
+} BenchKernel;
+
+
+static int random_offset(unsigned int *state, int max)
+{
+    return DP_uint_to_int(next_random(state) % DP_int_to_uint(max * 2 + 1))
+         - max;
+}
+
+static uint32_t random_color(unsigned int *state)
+{
+    return (next_random(state) | (next_random(state) << 16u)) & 0xffffffu;
+}
+
+
+struct StrokeParams {
+    unsigned int *state;
+    int base_size;
+    long long pixels;
+};
+
+static void set_classic_dabs(int count, DP_ClassicDab *cds, void *user)
+{
+    struct StrokeParams *sp = user;
+    for (int i = 0; i < count; ++i) {
+        int size = sp->base_size + random_offset(sp->state, sp->base_size / 4);
+        int diameter = size * 2 / 256 + 1;
+        sp->pixels += DP_square_int(diameter);
+        DP_classic_dab_init(
+            cds, i, DP_int_to_int8(random_offset(sp->state, 24)),
+            DP_int_to_int8(random_offset(sp->state, 24)),
+            DP_int_to_uint16(size),
+            DP_uint_to_uint8(next_random(sp->state) % 256u),
+            DP_uint_to_uint8(32u + next_random(sp->state) % 224u));
+    }
+}
+
+static void set_mypaint_dabs(int count, DP_MyPaintDab *mpds, void *user)
+{
+    struct StrokeParams *sp = user;
+    for (int i = 0; i < count; ++i) {
+        // Keep the size the same for a few dabs at a time, since the stamp is
+        // only recalculated when it changes, like with a real brush.
+        if (i % 4 == 0) {
+            sp->base_size += random_offset(sp->state, sp->base_size / 8);
+        }
+        int diameter = sp->base_size / 256 + 1;
+        sp->pixels += DP_square_int(diameter);
+        DP_mypaint_dab_init(
+            mpds, i, DP_int_to_int8(random_offset(sp->state, 24)),
+            DP_int_to_int8(random_offset(sp->state, 24)),
+            DP_int_to_uint16(sp->base_size),
+            DP_uint_to_uint8(next_random(sp->state) % 256u),
+            DP_uint_to_uint8(32u + next_random(sp->state) % 224u),
+            DP_uint_to_uint8(next_random(sp->state) % 256u),
+            DP_uint_to_uint8(next_random(sp->state) % 256u));
+    }
+}
+
+static void generate_strokes(BenchFixture *f, unsigned int *state)
+{
+    f->classic_pixels = 0;
+    f->mypaint_pixels = 0;
+    for (int i = 0; i < STROKE_COUNT; ++i) {
+        int32_t x = DP_uint_to_int32(next_random(state) % CANVAS_WIDTH) * 4;
+        int32_t y = DP_uint_to_int32(next_random(state) % CANVAS_HEIGHT) * 4;
+        struct StrokeParams sp = {
+            state, DP_uint_to_int(256u + next_random(state) % 8192u), 0};
+        f->classic_strokes[i] = DP_msg_draw_dabs_classic_new(
+            1, FIRST_LAYER_ID, x, y, random_color(state), DP_BLEND_MODE_NORMAL,
+            set_classic_dabs, DABS_PER_STROKE, &sp);
+        f->classic_pixels += sp.pixels;
+
+        sp.base_size = DP_uint_to_int(512u + next_random(state) % 16384u);
+        sp.pixels = 0;
+        f->mypaint_strokes[i] = DP_msg_draw_dabs_mypaint_new(
+            1, FIRST_LAYER_ID, x, y, random_color(state), 0, 0, 0, 0,
+            set_mypaint_dabs, DABS_PER_STROKE, &sp);
+        f->mypaint_pixels += sp.pixels;
+    }
+}
+
+static void draw_classic_stroke(DP_DrawContext *dc, DP_Message *msg,
+                                DP_TransientLayerContent *tlc)
+{
+    DP_MsgDrawDabsClassic *mddc = DP_message_internal(msg);
+    int dab_count;
+    const DP_ClassicDab *dabs = DP_msg_draw_dabs_classic_dabs(mddc, &dab_count);
+    DP_PaintDrawDabsParams params = {DP_MSG_DRAW_DABS_CLASSIC,
+                                     DP_message_context_id(msg),
+                                     DP_msg_draw_dabs_classic_layer(mddc),
+                                     DP_msg_draw_dabs_classic_x(mddc),
+                                     DP_msg_draw_dabs_classic_y(mddc),
+                                     DP_msg_draw_dabs_classic_color(mddc),
+                                     DP_msg_draw_dabs_classic_mode(mddc),
+                                     false,
+                                     false,
+                                     dab_count,
+                                     {.classic = {dabs}}};
+    DP_paint_draw_dabs(dc, NULL, NULL, &params, tlc);
+}
+
+static void draw_mypaint_stroke(DP_DrawContext *dc, DP_Message *msg,
+                                DP_TransientLayerContent *tlc)
+{
+    DP_MsgDrawDabsMyPaint *mddmp = DP_message_internal(msg);
+    int dab_count;
+    const DP_MyPaintDab *dabs =
+        DP_msg_draw_dabs_mypaint_dabs(mddmp, &dab_count);
+    DP_PaintDrawDabsParams params = {
+        DP_MSG_DRAW_DABS_MYPAINT,
+        DP_message_context_id(msg),
+        DP_msg_draw_dabs_mypaint_layer(mddmp),
+        DP_msg_draw_dabs_mypaint_x(mddmp),
+        DP_msg_draw_dabs_mypaint_y(mddmp),
+        DP_msg_draw_dabs_mypaint_color(mddmp),
+        DP_BLEND_MODE_NORMAL,
+        false,
+        false,
+        dab_count,
+        {.mypaint = {dabs, 0, 0, 0, 0}}};
+    DP_paint_draw_dabs(dc, NULL, NULL, &params, tlc);
+}
+
+// A few layers with strokes on them and different blend modes on top of a
+// white background, for flattening and flood filling. The background is part
+// of the bottom layer, so the fill on it is bounded by the strokes.
+static DP_CanvasState *generate_canvas_state(BenchFixture *f)
+{
+    static const int blend_modes[LAYER_COUNT] = {
+        DP_BLEND_MODE_NORMAL, DP_BLEND_MODE_MULTIPLY, DP_BLEND_MODE_SCREEN,
+        DP_BLEND_MODE_NORMAL};
+    static const uint16_t opacities[LAYER_COUNT] = {DP_BIT15, DP_BIT15,
+                                                    DP_BIT15 / 2, DP_BIT15};
+
+    DP_TransientCanvasState *tcs = DP_transient_canvas_state_new_init();
+    DP_transient_canvas_state_width_set(tcs, CANVAS_WIDTH);
+    DP_transient_canvas_state_height_set(tcs, CANVAS_HEIGHT);
+
+    DP_TransientLayerList *tll =
+        DP_transient_canvas_state_transient_layers(tcs, LAYER_COUNT);
+    DP_TransientLayerPropsList *tlpl =
+        DP_transient_canvas_state_transient_layer_props(tcs, LAYER_COUNT);
+
+    DP_Tile *t = DP_tile_new_from_bgra(0, 0xffffffff);
+    for (int i = 0; i < LAYER_COUNT; ++i) {
+        DP_TransientLayerContent *tlc = DP_transient_layer_content_new_init(
+            CANVAS_WIDTH, CANVAS_HEIGHT, i == 0 ? t : NULL);
+        for (int j = i; j < STROKE_COUNT; j += LAYER_COUNT) {
+            draw_classic_stroke(f->dc, f->classic_strokes[j], tlc);
+        }
+
+        DP_TransientLayerProps *tlp =
+            DP_transient_layer_props_new_init(FIRST_LAYER_ID + i, false);
+        DP_transient_layer_props_blend_mode_set(tlp, blend_modes[i]);
+        DP_transient_layer_props_opacity_set(tlp, opacities[i]);
+
+        DP_transient_layer_list_insert_transient_content_noinc(tll, tlc, i);
+        DP_transient_layer_props_list_insert_transient_noinc(tlpl, tlp, i);
+    }
+    DP_tile_decref(t);
+
+    DP_transient_canvas_state_layer_routes_reindex(tcs, f->dc);
+    return DP_transient_canvas_state_persist(tcs);
+}
+
+static void generate_compress_tiles(BenchFixture *f)
+{
+    DP_LayerList *ll = DP_canvas_state_layers_noinc(f->cs);
+    DP_LayerPropsList *lpl = DP_canvas_state_layer_props_noinc(f->cs);
+    DP_ViewModeContext vmc = DP_view_mode_context_make_default();
+    int tile_count = DP_tile_total_round(CANVAS_WIDTH, CANVAS_HEIGHT);
+    for (int i = 0; i < COMPRESS_TILES; ++i) {
+        DP_TransientTile *tt = DP_layer_list_flatten_tile_to(
+            ll, lpl, i * tile_count / COMPRESS_TILES, NULL, DP_BIT15, true,
+            false, &vmc);
+        f->tiles[i] = tt ? DP_transient_tile_persist(tt) : NULL;
+    }
+}
+
+static void generate_pixels(BenchFixture *f, unsigned int *state)
+{
+    int mask_length = MASK_SIZE * MASK_SIZE;
+    f->mask = DP_malloc(sizeof(*f->mask) * DP_int_to_size(mask_length));
+    f->blend_dst =
+        DP_malloc(sizeof(*f->blend_dst) * DP_int_to_size(mask_length));
+    for (int i = 0; i < mask_length; ++i) {
+        f->mask[i] = DP_uint_to_uint16(next_random(state) % (DP_BIT15 + 1u));
+        DP_UPixel15 pixel = {
+            DP_uint_to_uint16(next_random(state) % (DP_BIT15 + 1u)),
+            DP_uint_to_uint16(next_random(state) % (DP_BIT15 + 1u)),
+            DP_uint_to_uint16(next_random(state) % (DP_BIT15 + 1u)),
+            DP_uint_to_uint16(next_random(state) % (DP_BIT15 + 1u)),
+        };
+        f->blend_dst[i] = DP_pixel15_premultiply(pixel);
+    }
+
+    f->convert_src =
+        DP_malloc_simd(sizeof(*f->convert_src) * DP_TILE_LENGTH);
+    f->convert_dst =
+        DP_malloc_simd(sizeof(*f->convert_dst) * DP_TILE_LENGTH);
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        f->convert_src[i] = f->blend_dst[i % mask_length];
+    }
+
+    f->compress_pixels =
+        DP_malloc(sizeof(*f->compress_pixels) * DP_TILE_LENGTH);
+    f->compress_output = DP_malloc(COMPRESS_BUFSIZE);
+}
+
+static void init_fixture(BenchFixture *f)
+{
+    unsigned int state = SEED;
+    f->dc = DP_draw_context_new();
+    generate_strokes(f, &state);
+    f->cs = generate_canvas_state(f);
+    generate_compress_tiles(f);
+    generate_pixels(f, &state);
+}
+
+static void dispose_fixture(BenchFixture *f)
+{
+    DP_free(f->compress_output);
+    DP_free(f->compress_pixels);
+    DP_free_simd(f->convert_dst);
+    DP_free_simd(f->convert_src);
+    DP_free(f->blend_dst);
+    DP_free(f->mask);
+    for (int i = 0; i < COMPRESS_TILES; ++i) {
+        DP_tile_decref_nullable(f->tiles[i]);
+    }
+    DP_canvas_state_decref(f->cs);
+    for (int i = 0; i < STROKE_COUNT; ++i) {
+        DP_message_decref(f->mypaint_strokes[i]);
+        DP_message_decref(f->classic_strokes[i]);
+    }
+    DP_draw_context_free(f->dc);
+}
+
+
+static void run_blend_mask(BenchFixture *f, int blend_mode, int rounds,
+                           BenchResult *out_result)
+{
+    DP_UPixel15 src = {DP_BIT15 / 4, DP_BIT15 / 2, DP_BIT15, DP_BIT15};
+    for (int i = 0; i < rounds; ++i) {
+        DP_blend_mask(f->blend_dst, src, blend_mode, f->mask, DP_BIT15 / 2,
+                      MASK_SIZE, MASK_SIZE, 0, 0);
+    }
+    out_result->calls = rounds;
+    out_result->pixels = (long long)rounds * MASK_SIZE * MASK_SIZE;
+}
+
+static void run_blend_mask_normal(BenchFixture *f, int rounds,
+                                  BenchResult *out_result)
+{
+    run_blend_mask(f, DP_BLEND_MODE_NORMAL, rounds, out_result);
+}
+
+static void run_blend_mask_multiply(BenchFixture *f, int rounds,
+                                    BenchResult *out_result)
+{
+    run_blend_mask(f, DP_BLEND_MODE_MULTIPLY, rounds, out_result);
+}
+
+static void run_pixels15_to_8_tile(BenchFixture *f, int rounds,
+                                   BenchResult *out_result)
+{
+    for (int i = 0; i < rounds; ++i) {
+        DP_pixels15_to_8_tile(f->convert_dst, f->convert_src);
+    }
+    out_result->calls = rounds;
+    out_result->pixels = (long long)rounds * DP_TILE_LENGTH;
+}
+
+static void run_draw_dabs(BenchFixture *f, int rounds, BenchResult *out_result,
+                          DP_Message **strokes, long long pixels,
+                          void (*draw)(DP_DrawContext *, DP_Message *,
+                                       DP_TransientLayerContent *))
+{
+    for (int i = 0; i < rounds; ++i) {
+        DP_TransientLayerContent *tlc = DP_transient_layer_content_new_init(
+            CANVAS_WIDTH, CANVAS_HEIGHT, NULL);
+        for (int j = 0; j < STROKE_COUNT; ++j) {
+            draw(f->dc, strokes[j], tlc);
+        }
+        DP_transient_layer_content_decref(tlc);
+    }
+    out_result->calls = (long long)rounds * STROKE_COUNT;
+    out_result->pixels = (long long)rounds * pixels;
+    out_result->dabs = (long long)rounds * STROKE_COUNT * DABS_PER_STROKE;
+}
+
+static void run_draw_dabs_classic(BenchFixture *f, int rounds,
+                                  BenchResult *out_result)
+{
+    run_draw_dabs(f, rounds, out_result, f->classic_strokes, f->classic_pixels,
+                  draw_classic_stroke);
+}
+
+static void run_draw_dabs_mypaint(BenchFixture *f, int rounds,
+                                  BenchResult *out_result)
+{
+    run_draw_dabs(f, rounds, out_result, f->mypaint_strokes, f->mypaint_pixels,
+                  draw_mypaint_stroke);
+}
+
+static void run_flatten_tile(BenchFixture *f, int rounds,
+                             BenchResult *out_result)
+{
+    DP_LayerList *ll = DP_canvas_state_layers_noinc(f->cs);
+    DP_LayerPropsList *lpl = DP_canvas_state_layer_props_noinc(f->cs);
+    DP_ViewModeContext vmc = DP_view_mode_context_make_default();
+    int tile_count = DP_tile_total_round(CANVAS_WIDTH, CANVAS_HEIGHT);
+    for (int i = 0; i < rounds; ++i) {
+        for (int j = 0; j < tile_count; ++j) {
+            DP_transient_tile_decref_nullable(DP_layer_list_flatten_tile_to(
+                ll, lpl, j, NULL, DP_BIT15, true, false, &vmc));
+        }
+    }
+    out_result->calls = (long long)rounds * tile_count;
+    out_result->pixels = (long long)rounds * tile_count * DP_TILE_LENGTH;
+}
+
+static void run_flood_fill(BenchFixture *f, int rounds,
+                           BenchResult *out_result)
+{
+    DP_UPixelFloat fill_color = DP_upixel_float_from_color(0xff3366ccu);
+    for (int i = 0; i < rounds; ++i) {
+        DP_Image *img;
+        int x, y;
+        DP_FloodFillResult result = DP_flood_fill(
+            f->cs, 1, 0, CANVAS_WIDTH / 2, CANVAS_HEIGHT / 2, fill_color, 0.1,
+            FIRST_LAYER_ID, -1, 0, 0, 0, false, true, DP_VIEW_MODE_NORMAL,
+            FIRST_LAYER_ID, 0, &img, &x, &y, NULL, NULL);
+        if (result == DP_FLOOD_FILL_SUCCESS) {
+            DP_image_free(img);
+        }
+        else {
+            DP_warn("Flood fill failed: %s", DP_error());
+        }
+    }
+    out_result->calls = rounds;
+    out_result->pixels = (long long)rounds * CANVAS_WIDTH * CANVAS_HEIGHT;
+}
+
+static unsigned char *get_compress_buffer(size_t size, void *user)
+{
+    return size <= COMPRESS_BUFSIZE ? user : NULL;
+}
+
+static void run_tile_compress(BenchFixture *f, int rounds,
+                              BenchResult *out_result)
+{
+    long long calls = 0;
+    for (int i = 0; i < rounds; ++i) {
+        for (int j = 0; j < COMPRESS_TILES; ++j) {
+            DP_Tile *t = f->tiles[j];
+            if (t) {
+                DP_tile_compress(t, f->compress_pixels, get_compress_buffer,
+                                 f->compress_output);
+                ++calls;
+            }
+        }
+    }
+    out_result->calls = calls;
+    out_result->pixels = calls * DP_TILE_LENGTH;
+}
+
+
+static const BenchKernel kernels[] = {
+    {"blend_mask_normal", 2000, run_blend_mask_normal},
+    {"blend_mask_multiply", 2000, run_blend_mask_multiply},
+    {"pixels15_to_8_tile", 2000, run_pixels15_to_8_tile},
+    {"draw_dabs_classic", 2, run_draw_dabs_classic},
+    {"draw_dabs_mypaint", 2, run_draw_dabs_mypaint},
+    {"layer_list_flatten_tile_to", 4, run_flatten_tile},
+    {"flood_fill", 4, run_flood_fill},
+    {"tile_compress", 16, run_tile_compress},
+};
+
+static const char *cpu_support_name(DP_CpuSupport support)
+{
+    switch (support) {
+    case DP_CPU_SUPPORT_DEFAULT:
+        return "default";
+#ifdef DP_CPU_X64
+    case DP_CPU_SUPPORT_SSE42:
+        return "sse42";
+    case DP_CPU_SUPPORT_AVX:
+        return "avx";
+    case DP_CPU_SUPPORT_AVX2:
+        return "avx2";
+#endif
+    default:
+        return "unknown";
+    }
+}
+
+static void bench_kernel(BenchFixture *f, const BenchKernel *kernel,
+                         DP_CpuSupport support, int scale)
+{
+    // One untimed round first to warm up caches and allocators.
+    BenchResult result = {0, 0, 0};
+    kernel->run(f, 1, &result);
+
+    result = (BenchResult){0, 0, 0};
+    unsigned long long start = DP_perf_time();
+    kernel->run(f, kernel->rounds * scale, &result);
+    unsigned long long ns = DP_perf_time() - start;
+
+    double ns_per_pixel =
+        result.pixels == 0 ? 0.0 : (double)ns / (double)result.pixels;
+    double dabs_per_sec =
+        ns == 0 ? 0.0 : (double)result.dabs * 1000000000.0 / (double)ns;
+    printf("%s,%s,%lld,%lld,%lld,%llu,%.4f,%.1f\n", kernel->name,
+           cpu_support_name(support), result.calls, result.pixels, result.dabs,
+           ns, ns_per_pixel, dabs_per_sec);
+    fflush(stdout);
+}
+
+static bool parse_arguments(int argc, char **argv, int *out_scale,
+                            const char **out_filter)
+{
+    if (argc > 3) {
+        DP_warn("Usage: %s [SCALE [KERNEL]]", argv[0]);
+        return false;
+    }
+
+    *out_scale = 1;
+    if (argc > 1) {
+        char *end;
+        long value = strtol(argv[1], &end, 10);
+        if (*end != '\0' || value < 1 || value > 10000) {
+            DP_warn("Invalid scale '%s', must be between 1 and 10000", argv[1]);
+            return false;
+        }
+        *out_scale = (int)value;
+    }
+
+    *out_filter = argc > 2 ? argv[2] : NULL;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int scale;
+    const char *filter;
+    if (!parse_arguments(argc, argv, &scale, &filter)) {
+        return 2;
+    }
+
+    DP_cpu_support_init();
+    DP_CpuSupport detected = DP_cpu_support;
+
+    // The fixture gets generated at the detected level and then shared, so the
+    // inputs are bit-identical for all levels.
+    BenchFixture f;
+    init_fixture(&f);
+
+    printf("kernel,simd,calls,pixels,dabs,ns,ns_per_pixel,dabs_per_sec\n");
+    for (int support = 0; support < DP_CPU_SUPPORT_COUNT; ++support) {
+        if (!DP_cpu_support_force((DP_CpuSupport)support)) {
+            DP_warn("Skipping SIMD level %s, not available",
+                    cpu_support_name((DP_CpuSupport)support));
+            continue;
+        }
+        for (size_t i = 0; i < DP_ARRAY_LENGTH(kernels); ++i) {
+            if (!filter || DP_str_equal(filter, kernels[i].name)) {
+                bench_kernel(&f, &kernels[i], (DP_CpuSupport)support, scale);
+            }
+        }
+    }
+    DP_cpu_support_force(detected);
+
+    dispose_fixture(&f);
+    return 0;
+}
@@ -21,8 +21,12 @@
  */
 #include "canvas_history.h"
 #include "canvas_state.h"
+#include "layer_content.h"
+#include "layer_group.h"
+#include "layer_list.h"
 #include "recorder.h"
 #include "snapshots.h"
+#include "tile.h"
 #include <dpcommon/atomic.h>
 #include <dpcommon/binary.h>
 #include <dpcommon/conversions.h>
@@ -30,6 +34,7 @@
 #include <dpcommon/perf.h>
 #include <dpcommon/queue.h>
 #include <dpcommon/threading.h>
+#include <dpcommon/vector.h>
 #include <dpmsg/acl.h>
 #include <dpmsg/local_match.h>
 #include <dpmsg/message.h>
@@ -49,6 +54,9 @@
 // some reasonable size to store plenty of messages for that purpose.
 #define REPLAY_BUFFER_CAPACITY 8192
 
+// Initial capacity for the cold storage bookkeeping vectors.
+#define COLD_INITIAL_CAPACITY 16
+
 typedef enum DP_ForkAction {
     DP_FORK_ACTION_CONCURRENT,
     DP_FORK_ACTION_ALREADY_DONE,
@@ -89,8 +97,46 @@ struct DP_CanvasHistory {
         size_t buffer_size;
         unsigned char *buffer;
     } dump;
+    struct {
+        size_t budget;
+        unsigned int thaws;
+        DP_Vector points;
+        DP_Vector warm;
+        DP_Vector warm_next;
+        DP_Vector collect;
+        size_t buffer_size;
+        unsigned char *buffer;
+        DP_CanvasHistoryColdStats stats;
+    } cold;
+    struct {
+        int save_points;
+        size_t retained_bytes;
+    } totals;
+    DP_CanvasHistoryStats stats;
 };
 
+typedef struct DP_CanvasHistoryColdTile {
+    int content;
+    int index;
+    unsigned int context_id;
+    DP_Tile *tile; // Only set while collecting, before compression.
+    size_t size;
+    unsigned char *data;
+} DP_CanvasHistoryColdTile;
+
+typedef struct DP_CanvasHistoryColdPoint {
+    DP_CanvasState *cs;
+    int tile_count;
+    DP_CanvasHistoryColdTile *tiles;
+    size_t compressed_bytes;
+} DP_CanvasHistoryColdPoint;
+
+typedef struct DP_CanvasHistoryWarmPoint {
+    DP_CanvasState *cs; // Not a reference, only used to recognize the state.
+    int index;
+    size_t bytes;
+} DP_CanvasHistoryWarmPoint;
+
 struct DP_CanvasHistorySnapshot {
     DP_Atomic refcount;
     struct {
@@ -410,11 +456,39 @@ static void call_save_point_fn(DP_CanvasHistory *ch, DP_CanvasState *cs,
     }
 }
 
+// The totals are kept up to date as entries come and go, so that publishing the
+// stats doesn't have to walk the whole history every time.
+static void entry_set_state_inc(DP_CanvasHistory *ch,
+                                DP_CanvasHistoryEntry *entry,
+                                DP_CanvasState *cs)
+{
+    if (entry->state) {
+        DP_canvas_state_decref(entry->state);
+    }
+    else {
+        ++ch->totals.save_points;
+    }
+    entry->state = DP_canvas_state_incref(cs);
+}
+
+static void entry_clear_state(DP_CanvasHistory *ch,
+                              DP_CanvasHistoryEntry *entry)
+{
+    DP_CanvasState *cs = entry->state;
+    if (cs) {
+        DP_canvas_state_decref(cs);
+        entry->state = NULL;
+        --ch->totals.save_points;
+    }
+}
+
 static void set_initial_entry(DP_CanvasHistory *ch, DP_CanvasState *cs)
 {
     HISTORY_DEBUG("Set initial history entry");
-    ch->entries[0] = (DP_CanvasHistoryEntry){
-        DP_UNDO_DONE, DP_msg_undo_point_new(0), DP_canvas_state_incref(cs)};
+    DP_Message *msg = DP_msg_undo_point_new(0);
+    ch->entries[0] = (DP_CanvasHistoryEntry){DP_UNDO_DONE, msg, NULL};
+    ch->totals.retained_bytes += DP_message_length(msg);
+    entry_set_state_inc(ch, &ch->entries[0], cs);
     call_save_point_fn(ch, cs, false);
 }
 
@@ -449,6 +523,8 @@ static void validate_history(DP_UNUSED DP_CanvasHistory *ch,
     DP_CanvasHistoryEntry *entries = ch->entries;
     int used = ch->used;
     bool have_save_point = false;
+    int save_points = 0;
+    size_t retained_bytes = 0;
     for (int i = 0; i < used; ++i) {
         DP_CanvasHistoryEntry *entry = &entries[i];
         DP_ASSERT(entry->undo == DP_UNDO_DONE || entry->undo == DP_UNDO_UNDONE
@@ -457,13 +533,18 @@ static void validate_history(DP_UNUSED DP_CanvasHistory *ch,
         DP_ASSERT(msg); // Message must not be null.
         DP_MessageType type = DP_message_type(msg);
         DP_ASSERT(type != DP_MSG_UNDO); // Undos and redos aren't historized.
+        retained_bytes += DP_message_length(msg);
         if (entry->state) {
             DP_ASSERT(is_valid_save_point_entry(entry));
             have_save_point = true;
+            ++save_points;
         }
     }
     // There must exist at least one save point.
     DP_ASSERT(have_save_point);
+    // The running totals must match what's actually in the history.
+    DP_ASSERT(ch->totals.save_points == save_points);
+    DP_ASSERT(ch->totals.retained_bytes == retained_bytes);
     // If the local fork contains entries, it must also be consistent.
     if (check_fork && have_local_fork(ch)) {
         // Fork start can't be beyond the truncation point.
@@ -473,6 +554,393 @@ static void validate_history(DP_UNUSED DP_CanvasHistory *ch,
 }
 
 
+// Cold storage for save points. With a memory budget set, the tiles that only
+// older save points hold onto get compressed and those save points' states get
+// swapped out for skeletons that have those tiles blanked out. The tiles get
+// inflated back in when a save point is needed again. Exclusivity is decided
+// by reference counts, so anything shared with another state, such as the
+// current one or a snapshot, stays as it is. Cold points hold a reference to
+// their skeleton, so once that's the only one left, the save point is gone.
+
+static unsigned char *cold_get_buffer(size_t size, void *user)
+{
+    DP_CanvasHistory *ch = user;
+    if (ch->cold.buffer_size < size) {
+        ch->cold.buffer = DP_realloc(ch->cold.buffer, size);
+        ch->cold.buffer_size = size;
+    }
+    return ch->cold.buffer;
+}
+
+static void cold_collect_content(DP_LayerContent *lc, int content,
+                                 DP_Vector *tiles)
+{
+    int xtiles = DP_tile_count_round(DP_layer_content_width(lc));
+    int ytiles = DP_tile_count_round(DP_layer_content_height(lc));
+    for (int y = 0; y < ytiles; ++y) {
+        for (int x = 0; x < xtiles; ++x) {
+            DP_Tile *t = DP_layer_content_tile_at_noinc(lc, x, y);
+            if (t && DP_tile_refcount(t) == 1 && !DP_tile_solid(t)) {
+                DP_VECTOR_PUSH_TYPE(tiles, DP_CanvasHistoryColdTile,
+                                    ((DP_CanvasHistoryColdTile){
+                                        content, y * xtiles + x,
+                                        DP_tile_context_id(t), t, 0, NULL}));
+            }
+        }
+    }
+}
+
+// Contents are numbered depth-first across the whole layer tree, including
+// the shared parts, so that the numbers match up when rebuilding the state.
+static void cold_collect_list(DP_LayerList *ll, bool exclusive,
+                              int *in_out_content, DP_Vector *tiles)
+{
+    exclusive = exclusive && DP_layer_list_refcount(ll) == 1;
+    int count = DP_layer_list_count(ll);
+    for (int i = 0; i < count; ++i) {
+        DP_LayerListEntry *lle = DP_layer_list_at_noinc(ll, i);
+        if (DP_layer_list_entry_is_group(lle)) {
+            DP_LayerGroup *lg = DP_layer_list_entry_group_noinc(lle);
+            cold_collect_list(DP_layer_group_children_noinc(lg),
+                              exclusive && DP_layer_group_refcount(lg) == 1,
+                              in_out_content, tiles);
+        }
+        else {
+            int content = (*in_out_content)++;
+            DP_LayerContent *lc = DP_layer_list_entry_content_noinc(lle);
+            if (exclusive && DP_layer_content_refcount(lc) == 1) {
+                cold_collect_content(lc, content, tiles);
+            }
+        }
+    }
+}
+
+static int cold_collect(DP_CanvasHistory *ch, DP_CanvasState *cs)
+{
+    DP_Vector *tiles = &ch->cold.collect;
+    tiles->used = 0;
+    if (DP_canvas_state_refcount(cs) == 1) {
+        int content = 0;
+        cold_collect_list(DP_canvas_state_layers_noinc(cs), true, &content,
+                          tiles);
+    }
+    return DP_size_to_int(tiles->used);
+}
+
+struct DP_CanvasHistoryColdRebuild {
+    DP_CanvasHistoryColdTile *tiles;
+    int count;
+    int next;
+    bool thaw;
+};
+
+static DP_Tile *cold_tile_get(struct DP_CanvasHistoryColdRebuild *cr,
+                              DP_CanvasHistoryColdTile *ct)
+{
+    if (cr->thaw) {
+        DP_Tile *t = DP_tile_new_from_compressed_lossless(ct->context_id,
+                                                          ct->data, ct->size);
+        if (!t) {
+            DP_warn("Error thawing save point tile: %s", DP_error());
+        }
+        return t;
+    }
+    else {
+        return NULL;
+    }
+}
+
+static DP_TransientLayerList *
+cold_rebuild_list(DP_LayerList *ll, int *in_out_content,
+                  struct DP_CanvasHistoryColdRebuild *cr)
+{
+    DP_TransientLayerList *tll = NULL;
+    int count = DP_layer_list_count(ll);
+    for (int i = 0; i < count && cr->next < cr->count; ++i) {
+        DP_LayerListEntry *lle = DP_layer_list_at_noinc(ll, i);
+        if (DP_layer_list_entry_is_group(lle)) {
+            DP_LayerGroup *lg = DP_layer_list_entry_group_noinc(lle);
+            DP_TransientLayerList *tchildren = cold_rebuild_list(
+                DP_layer_group_children_noinc(lg), in_out_content, cr);
+            if (tchildren) {
+                if (!tll) {
+                    tll = DP_transient_layer_list_new(ll, 0);
+                }
+                DP_transient_layer_list_transient_group_at_with_children_noinc(
+                    tll, i, tchildren);
+            }
+        }
+        else {
+            int content = (*in_out_content)++;
+            if (cr->tiles[cr->next].content == content) {
+                if (!tll) {
+                    tll = DP_transient_layer_list_new(ll, 0);
+                }
+                DP_TransientLayerContent *tlc =
+                    DP_transient_layer_list_transient_content_at_noinc(tll, i);
+                do {
+                    DP_CanvasHistoryColdTile *ct = &cr->tiles[cr->next++];
+                    DP_transient_layer_content_tile_set_noinc(
+                        tlc, cold_tile_get(cr, ct), ct->index);
+                } while (cr->next < cr->count
+                         && cr->tiles[cr->next].content == content);
+            }
+        }
+    }
+    return tll;
+}
+
+// Makes a copy of the given state with the given tiles either blanked out or,
+// if thawing, inflated back in. Everything else is shared with the original.
+static DP_CanvasState *cold_rebuild(DP_CanvasState *cs,
+                                    DP_CanvasHistoryColdTile *tiles, int count,
+                                    bool thaw)
+{
+    DP_ASSERT(count > 0);
+    struct DP_CanvasHistoryColdRebuild cr = {tiles, count, 0, thaw};
+    int content = 0;
+    DP_TransientLayerList *tll =
+        cold_rebuild_list(DP_canvas_state_layers_noinc(cs), &content, &cr);
+    DP_ASSERT(tll);
+    DP_ASSERT(cr.next == count);
+    DP_TransientCanvasState *tcs = DP_transient_canvas_state_new(cs);
+    DP_transient_canvas_state_transient_layers_set_noinc(tcs, tll);
+    return DP_transient_canvas_state_persist(tcs);
+}
+
+static void cold_tiles_free(DP_CanvasHistoryColdTile *tiles, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        DP_free(tiles[i].data);
+    }
+}
+
+static void cold_point_dispose(DP_CanvasHistoryColdPoint *cp)
+{
+    DP_canvas_state_decref(cp->cs);
+    cold_tiles_free(cp->tiles, cp->tile_count);
+    DP_free(cp->tiles);
+}
+
+static void dispose_cold_point(void *element)
+{
+    cold_point_dispose(element);
+}
+
+static int cold_search(DP_CanvasHistory *ch, DP_CanvasState *cs)
+{
+    DP_CanvasHistoryColdPoint *points = ch->cold.points.elements;
+    int count = DP_size_to_int(ch->cold.points.used);
+    for (int i = 0; i < count; ++i) {
+        if (points[i].cs == cs) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the number of uncompressed bytes frozen, zero if there was nothing
+// exclusive to the save point or if compression failed.
+static size_t cold_freeze(DP_CanvasHistory *ch, DP_CanvasHistoryEntry *entry)
+{
+    DP_CanvasState *cs = entry->state;
+    int count = cold_collect(ch, cs);
+    if (count == 0) {
+        return 0;
+    }
+
+    DP_PERF_BEGIN_DETAIL(fn, "cold_freeze", "tiles=%d", count);
+    DP_CanvasHistoryColdTile *tiles = ch->cold.collect.elements;
+    size_t compressed_bytes = 0;
+    for (int i = 0; i < count; ++i) {
+        DP_CanvasHistoryColdTile *ct = &tiles[i];
+        size_t size = DP_tile_compress_lossless(ct->tile, cold_get_buffer, ch);
+        if (size == 0) {
+            DP_warn("Error freezing save point tile: %s", DP_error());
+            cold_tiles_free(tiles, i);
+            DP_PERF_END(fn);
+            return 0;
+        }
+        ct->tile = NULL;
+        ct->size = size;
+        ct->data = DP_malloc(size);
+        memcpy(ct->data, ch->cold.buffer, size);
+        compressed_bytes += size;
+    }
+
+    DP_CanvasState *skeleton = cold_rebuild(cs, tiles, count, false);
+    size_t tiles_size = sizeof(*tiles) * DP_int_to_size(count);
+    DP_CanvasHistoryColdTile *stored_tiles = DP_malloc(tiles_size);
+    memcpy(stored_tiles, tiles, tiles_size);
+    DP_VECTOR_PUSH_TYPE(&ch->cold.points, DP_CanvasHistoryColdPoint,
+                        ((DP_CanvasHistoryColdPoint){
+                            DP_canvas_state_incref(skeleton), count,
+                            stored_tiles, compressed_bytes}));
+
+    HISTORY_DEBUG("Froze %d tiles of save point %p into %zu bytes", count,
+                  (void *)cs, compressed_bytes);
+    entry->state = skeleton;
+    DP_canvas_state_decref(cs);
+    DP_PERF_END(fn);
+    return DP_int_to_size(count) * DP_TILE_BYTES;
+}
+
+static DP_CanvasState *cold_thaw(DP_CanvasHistory *ch,
+                                 DP_CanvasHistoryColdPoint *cp)
+{
+    DP_PERF_BEGIN_DETAIL(fn, "cold_thaw", "tiles=%d", cp->tile_count);
+    DP_CanvasState *cs = cold_rebuild(cp->cs, cp->tiles, cp->tile_count, true);
+    ++ch->cold.thaws;
+    DP_PERF_END(fn);
+    return cs;
+}
+
+static void cold_publish_stats(DP_CanvasHistory *ch, int warm_points,
+                               size_t warm_bytes)
+{
+    DP_CanvasHistoryColdStats stats = {
+        warm_points, 0, 0, warm_bytes, 0, 0, ch->cold.thaws,
+    };
+    DP_CanvasHistoryColdPoint *points = ch->cold.points.elements;
+    int count = DP_size_to_int(ch->cold.points.used);
+    for (int i = 0; i < count; ++i) {
+        ++stats.cold_points;
+        stats.cold_tiles += points[i].tile_count;
+        stats.cold_compressed_bytes += points[i].compressed_bytes;
+    }
+    stats.cold_raw_bytes = DP_int_to_size(stats.cold_tiles) * DP_TILE_BYTES;
+
+    DP_Mutex *mutex = ch->mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    ch->cold.stats = stats;
+    DP_MUTEX_MUST_UNLOCK(mutex);
+}
+
+// Thaws the state of the given entry in place if it's cold, since it's about
+// to be used for replaying. Later budget enforcement may freeze it again.
+static DP_CanvasState *cold_thaw_entry(DP_CanvasHistory *ch,
+                                       DP_CanvasHistoryEntry *entry)
+{
+    DP_CanvasState *cs = entry->state;
+    int index = cold_search(ch, cs);
+    if (index != -1) {
+        DP_CanvasHistoryColdPoint *cp = &DP_VECTOR_AT_TYPE(
+            &ch->cold.points, DP_CanvasHistoryColdPoint, index);
+        entry->state = cold_thaw(ch, cp);
+        DP_canvas_state_decref(cs);
+        cold_point_dispose(cp);
+        DP_VECTOR_REMOVE_TYPE(&ch->cold.points, DP_CanvasHistoryColdPoint,
+                              index);
+        cold_publish_stats(ch, ch->cold.stats.warm_points,
+                           ch->cold.stats.warm_bytes);
+    }
+    return entry->state;
+}
+
+static void cold_sweep(DP_CanvasHistory *ch)
+{
+    DP_Vector *points = &ch->cold.points;
+    size_t i = 0;
+    while (i < points->used) {
+        DP_CanvasHistoryColdPoint *cp =
+            &DP_VECTOR_AT_TYPE(points, DP_CanvasHistoryColdPoint, i);
+        if (DP_canvas_state_refcount(cp->cs) == 1) {
+            cold_point_dispose(cp);
+            DP_VECTOR_REMOVE_TYPE(points, DP_CanvasHistoryColdPoint, i);
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+static size_t cold_warm_bytes(DP_CanvasHistory *ch, DP_CanvasState *cs)
+{
+    // Measurements are cached by state, since walking all the tiles of every
+    // save point on every undo point would get expensive. The cache may
+    // underestimate, since other states letting go of shared tiles makes more
+    // of them exclusive, but the state is measured again before freezing.
+    DP_CanvasHistoryWarmPoint *prev = ch->cold.warm.elements;
+    int prev_count = DP_size_to_int(ch->cold.warm.used);
+    for (int i = 0; i < prev_count; ++i) {
+        if (prev[i].cs == cs) {
+            return prev[i].bytes;
+        }
+    }
+    return DP_int_to_size(cold_collect(ch, cs)) * DP_TILE_BYTES;
+}
+
+static void cold_enforce_budget(DP_CanvasHistory *ch, size_t budget)
+{
+    DP_PERF_BEGIN(fn, "cold_enforce_budget");
+    DP_Vector *warm = &ch->cold.warm_next;
+    warm->used = 0;
+    size_t total = 0;
+    DP_CanvasHistoryEntry *entries = ch->entries;
+    DP_CanvasState *current_state = ch->current_state;
+    int used = ch->used;
+    for (int i = 0; i < used; ++i) {
+        DP_CanvasState *cs = entries[i].state;
+        if (cs && cs != current_state && cold_search(ch, cs) == -1) {
+            size_t bytes = cold_warm_bytes(ch, cs);
+            DP_VECTOR_PUSH_TYPE(warm, DP_CanvasHistoryWarmPoint,
+                                ((DP_CanvasHistoryWarmPoint){cs, i, bytes}));
+            total += bytes;
+        }
+    }
+
+    // Oldest save points are the least likely to be needed again.
+    DP_CanvasHistoryWarmPoint *points = warm->elements;
+    int count = DP_size_to_int(warm->used);
+    int warm_points = count;
+    for (int i = 0; i < count && total > budget; ++i) {
+        DP_CanvasHistoryWarmPoint *wp = &points[i];
+        total -= wp->bytes;
+        if (cold_freeze(ch, &entries[wp->index]) == 0) {
+            wp->bytes = 0;
+        }
+        else {
+            wp->cs = NULL;
+            --warm_points;
+        }
+    }
+
+    DP_Vector prev = ch->cold.warm;
+    ch->cold.warm = *warm;
+    ch->cold.warm_next = prev;
+    cold_publish_stats(ch, warm_points, total);
+    DP_PERF_END(fn);
+}
+
+static void cold_maintain(DP_CanvasHistory *ch)
+{
+    DP_Mutex *mutex = ch->mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    size_t budget = ch->cold.budget;
+    DP_MUTEX_MUST_UNLOCK(mutex);
+
+    if (budget != 0) {
+        cold_sweep(ch);
+        cold_enforce_budget(ch, budget);
+    }
+    else if (ch->cold.points.used != 0 || ch->cold.warm.used != 0) {
+        ch->cold.warm.used = 0;
+        cold_sweep(ch);
+        cold_publish_stats(ch, 0, 0);
+    }
+}
+
+static void publish_stats(DP_CanvasHistory *ch)
+{
+    DP_CanvasHistoryStats stats = {ch->used, ch->totals.save_points,
+                                   ch->totals.retained_bytes};
+    DP_Mutex *mutex = ch->mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    ch->stats = stats;
+    DP_MUTEX_MUST_UNLOCK(mutex);
+}
+
+
 DP_CanvasHistory *
 DP_canvas_history_new(DP_CanvasHistorySavePointFn save_point_fn,
                       void *save_point_user, bool want_dump,
@@ -513,7 +981,18 @@ DP_CanvasHistory *DP_canvas_history_new_inc(
         {0, {0}},
         DP_ATOMIC_INIT(0),
         {want_dump, DP_strdup(dump_dir), NULL, 0, NULL},
+        {0},
+        {0, 0},
+        {0, 0, 0},
     };
+    DP_VECTOR_INIT_TYPE(&ch->cold.points, DP_CanvasHistoryColdPoint,
+                        COLD_INITIAL_CAPACITY);
+    DP_VECTOR_INIT_TYPE(&ch->cold.warm, DP_CanvasHistoryWarmPoint,
+                        COLD_INITIAL_CAPACITY);
+    DP_VECTOR_INIT_TYPE(&ch->cold.warm_next, DP_CanvasHistoryWarmPoint,
+                        COLD_INITIAL_CAPACITY);
+    DP_VECTOR_INIT_TYPE(&ch->cold.collect, DP_CanvasHistoryColdTile,
+                        COLD_INITIAL_CAPACITY);
     DP_user_cursors_init(&ch->ucs);
     DP_effective_user_cursors_init(&ch->eucs);
     DP_affected_indirect_areas_clear(&ch->aia);
@@ -525,15 +1004,18 @@ DP_CanvasHistory *DP_canvas_history_new_inc(
 
     DP_queue_init(&ch->fork.queue, INITIAL_CAPACITY, sizeof(DP_ForkEntry));
     set_initial_entry(ch, cs);
+    publish_stats(ch);
     validate_history(ch, true);
     return ch;
 }
 
 
-static void dispose_entry(DP_CanvasHistoryEntry *entry)
+static void dispose_entry(DP_CanvasHistory *ch, DP_CanvasHistoryEntry *entry)
 {
-    DP_message_decref(entry->msg);
-    DP_canvas_state_decref_nullable(entry->state);
+    DP_Message *msg = entry->msg;
+    ch->totals.retained_bytes -= DP_message_length(msg);
+    DP_message_decref(msg);
+    entry_clear_state(ch, entry);
 }
 
 static void truncate_history_without_fork_check(DP_CanvasHistory *ch, int until)
@@ -542,7 +1024,7 @@ static void truncate_history_without_fork_check(DP_CanvasHistory *ch, int until)
     DP_ASSERT(until <= ch->used);
     DP_CanvasHistoryEntry *entries = ch->entries;
     for (int i = 0; i < until; ++i) {
-        dispose_entry(&entries[i]);
+        dispose_entry(ch, &entries[i]);
     }
     ch->used -= until;
     ch->offset += until;
@@ -565,6 +1047,13 @@ void DP_canvas_history_free(DP_CanvasHistory *ch)
         truncate_history(ch, ch->used);
         DP_free(ch->entries);
         DP_canvas_state_decref(ch->current_state);
+        DP_VECTOR_CLEAR_DISPOSE_TYPE(&ch->cold.points,
+                                     DP_CanvasHistoryColdPoint,
+                                     dispose_cold_point);
+        DP_vector_dispose(&ch->cold.warm);
+        DP_vector_dispose(&ch->cold.warm_next);
+        DP_vector_dispose(&ch->cold.collect);
+        DP_free(ch->cold.buffer);
         DP_mutex_free(ch->mutex);
         DP_free(ch->dump.buffer);
         DP_output_free(ch->dump.output);
@@ -598,6 +1087,45 @@ void DP_canvas_history_want_dump_set(DP_CanvasHistory *ch, bool want_dump)
     ch->dump.want = want_dump;
 }
 
+size_t DP_canvas_history_cold_budget(DP_CanvasHistory *ch)
+{
+    DP_ASSERT(ch);
+    DP_Mutex *mutex = ch->mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    size_t budget = ch->cold.budget;
+    DP_MUTEX_MUST_UNLOCK(mutex);
+    return budget;
+}
+
+void DP_canvas_history_cold_budget_set(DP_CanvasHistory *ch, size_t budget)
+{
+    DP_ASSERT(ch);
+    DP_Mutex *mutex = ch->mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    ch->cold.budget = budget;
+    DP_MUTEX_MUST_UNLOCK(mutex);
+}
+
+DP_CanvasHistoryColdStats DP_canvas_history_cold_stats(DP_CanvasHistory *ch)
+{
+    DP_ASSERT(ch);
+    DP_Mutex *mutex = ch->mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    DP_CanvasHistoryColdStats stats = ch->cold.stats;
+    DP_MUTEX_MUST_UNLOCK(mutex);
+    return stats;
+}
+
+DP_CanvasHistoryStats DP_canvas_history_stats(DP_CanvasHistory *ch)
+{
+    DP_ASSERT(ch);
+    DP_Mutex *mutex = ch->mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    DP_CanvasHistoryStats stats = ch->stats;
+    DP_MUTEX_MUST_UNLOCK(mutex);
+    return stats;
+}
+
 DP_CanvasState *DP_canvas_history_get(DP_CanvasHistory *ch)
 {
     DP_ASSERT(ch);
@@ -667,10 +1195,12 @@ static void reset_to_state_noinc(DP_CanvasHistory *ch, DP_CanvasState *cs,
         truncate_history_without_fork_check(ch, ch->used);
     }
     DP_affected_indirect_areas_clear(&ch->aia);
+    cold_maintain(ch);
     set_initial_entry(ch, cs);
     ch->used = 1;
     ch->offset = 0;
     ch->mark_command_done = true;
+    publish_stats(ch);
     validate_history(ch, clear_fork);
 }
 
@@ -831,8 +1361,7 @@ static void replay_from_inc(DP_CanvasHistory *ch, DP_DrawContext *dc,
                 if (ch->replay.used != 0) {
                     cs = flush_replay_buffer(ch, cs, dc);
                 }
-                DP_canvas_state_decref_nullable(entry->state);
-                entry->state = DP_canvas_state_incref(cs);
+                entry_set_state_inc(ch, entry, cs);
             }
             else if (undo == DP_UNDO_DONE) {
                 cs = replay_drawing_command_dec(ch, cs, dc, msg, type);
@@ -855,7 +1384,8 @@ static bool search_and_replay_from(DP_CanvasHistory *ch, DP_DrawContext *dc,
     int start_index = search_save_point_index(ch, target_index);
     HISTORY_DEBUG("Replay from target %d, start %d", target_index, start_index);
     if (start_index >= 0) {
-        replay_from_inc(ch, dc, start_index, ch->entries[start_index].state,
+        replay_from_inc(ch, dc, start_index,
+                        cold_thaw_entry(ch, &ch->entries[start_index]),
                         with_fork);
         return true;
     }
@@ -903,7 +1433,7 @@ DP_CanvasState *DP_canvas_history_stream_start_state_inc(DP_CanvasHistory *ch)
     for (int i = 0; i < used; ++i) {
         DP_CanvasState *cs = ch->entries->state;
         if (cs) {
-            return DP_canvas_state_incref(cs);
+            return DP_canvas_state_incref(cold_thaw_entry(ch, ch->entries));
         }
     }
     DP_UNREACHABLE();
@@ -972,7 +1502,7 @@ static void make_save_point(DP_CanvasHistory *ch, int index,
         HISTORY_DEBUG("Create %s save point at %d",
                       snapshot_requested ? "requested" : "regular", index);
         DP_CanvasState *cs = ch->current_state;
-        entry->state = DP_canvas_state_incref(cs);
+        entry_set_state_inc(ch, entry, cs);
         call_save_point_fn(ch, cs, snapshot_requested);
     }
 }
@@ -1026,6 +1556,7 @@ static int append_to_history_noinc(DP_CanvasHistory *ch, DP_Message *msg,
     HISTORY_DEBUG("Append history entry %d", index);
     ch->entries[index] = (DP_CanvasHistoryEntry){undo, msg, NULL};
     ch->used = index + 1;
+    ch->totals.retained_bytes += DP_message_length(msg);
     return index;
 }
 
@@ -1060,11 +1591,7 @@ static int mark_undone_actions_gone(DP_CanvasHistory *ch, int index,
             else if (undo == DP_UNDO_UNDONE) {
                 entry->undo = DP_UNDO_GONE;
                 // Undone undo points still have a state for redo purposes.
-                DP_CanvasState *cs = entry->state;
-                if (cs) {
-                    DP_canvas_state_decref(cs);
-                    entry->state = NULL;
-                }
+                entry_clear_state(ch, entry);
             }
         }
     }
@@ -1108,6 +1635,8 @@ static void handle_undo_point(DP_CanvasHistory *ch, int index)
     int depth;
     int i = mark_undone_actions_gone(ch, index, &depth);
     truncate_unreachable(ch, i, depth);
+    cold_maintain(ch);
+    publish_stats(ch);
 }
 
 
@@ -1190,11 +1719,7 @@ static void mark_entries_undone(DP_CanvasHistory *ch, unsigned int context_id,
         // happen too frequently to update them all on every undo/redo. Instead
         // only undo points get to keep their states and get updated.
         if (!is_undo_point_entry(entry)) {
-            DP_CanvasState *cs = entry->state;
-            if (cs) {
-                DP_canvas_state_decref_nullable(cs);
-                entry->state = NULL;
-            }
+            entry_clear_state(ch, entry);
         }
     }
 }
@@ -1361,8 +1886,7 @@ static void clear_fork_fallbehind(DP_CanvasHistory *ch)
     DP_ASSERT(index >= 0 && index < ch->used);
     DP_CanvasHistoryEntry *entry = &ch->entries[index];
     if (!ch->fork.starts_at_undo_point && !is_undo_point_entry(entry)) {
-        DP_canvas_state_decref_nullable(entry->state);
-        entry->state = NULL;
+        entry_clear_state(ch, entry);
     }
 }
 
@@ -1579,6 +2103,21 @@ bool DP_canvas_history_handle_local(DP_CanvasHistory *ch, DP_DrawContext *dc,
 }
 
 
+// The type shared by all messages of a multidab batch, or -1 if they're mixed.
+// Only used for perf details, so that time can be attributed per message type.
+// The detail arguments are evaluated even when perf isn't recording, so the
+// caller only walks the batch when it's open.
+static int multidab_type(int count, DP_Message **msgs)
+{
+    DP_MessageType type = DP_message_type(msgs[0]);
+    for (int i = 1; i < count; ++i) {
+        if (DP_message_type(msgs[i]) != type) {
+            return -1;
+        }
+    }
+    return (int)type;
+}
+
 void DP_canvas_history_handle_multidab_dec(DP_CanvasHistory *ch,
                                            DP_DrawContext *dc, int count,
                                            DP_Message **msgs)
@@ -1593,8 +2132,10 @@ void DP_canvas_history_handle_multidab_dec(DP_CanvasHistory *ch,
                   local_drawing_in_progress
                       ? DP_DUMP_REMOTE_MULTIDAB_LOCAL_DRAWING_IN_PROGRESS
                       : DP_DUMP_REMOTE_MULTIDAB);
-    DP_PERF_BEGIN_DETAIL(fn, "handle_multidab", "count=%d,local_drawing=%d",
-                         count, local_drawing_in_progress);
+    DP_PERF_BEGIN_DETAIL(fn, "handle_multidab",
+                         "count=%d,local_drawing=%d,type=%d", count,
+                         local_drawing_in_progress,
+                         DP_perf_is_open() ? multidab_type(count, msgs) : -1);
 
     int offset = 0;
     for (int i = 0; i < count; ++i) {
@@ -1663,10 +2204,10 @@ void DP_canvas_history_handle_local_multidab_dec(DP_CanvasHistory *ch,
 }
 
 
-static int find_first_reachable_state_index(DP_CanvasHistoryEntry *entries,
-                                            int entries_used,
-                                            int undo_depth_limit,
-                                            DP_CanvasState **out_cs)
+static int
+find_first_reachable_state_index(DP_CanvasHistoryEntry *entries,
+                                 int entries_used, int undo_depth_limit,
+                                 DP_CanvasHistoryEntry **out_entry)
 {
     int start = entries_used - 1;
     int depth = 0;
@@ -1682,7 +2223,7 @@ static int find_first_reachable_state_index(DP_CanvasHistoryEntry *entries,
 
     DP_CanvasHistoryEntry *entry = &entries[start];
     DP_ASSERT(entry->state);
-    *out_cs = entry->state;
+    *out_entry = entry;
     // If the starting point is not an undo point, the command inside the entry
     // has already been applied to the canvas state, so don't record it again.
     return is_undo_point_entry(entry) ? start : start + 1;
@@ -1700,10 +2241,10 @@ bool DP_canvas_history_reset_image_new(
     int entries_used = ch->used;
     int undo_depth_limit = ch->undo_depth_limit;
 
-    DP_CanvasState *cs;
-    int start = find_first_reachable_state_index(entries, entries_used,
-                                                 undo_depth_limit, &cs);
-    if (!accept_state(user, cs)) {
+    DP_CanvasHistoryEntry *start_entry;
+    int start = find_first_reachable_state_index(
+        entries, entries_used, undo_depth_limit, &start_entry);
+    if (!accept_state(user, cold_thaw_entry(ch, start_entry))) {
         return false;
     }
 
@@ -1791,6 +2332,22 @@ DP_Recorder *DP_canvas_history_recorder_new(
 }
 
 
+// Cold save points only hold a skeleton with their tiles blanked out, which is
+// useless outside of the history, so snapshots get a thawed copy instead. The
+// history's own save point stays cold.
+static DP_CanvasState *snapshot_state(DP_CanvasHistory *ch, DP_CanvasState *cs)
+{
+    int index = cold_search(ch, cs);
+    if (index == -1) {
+        return DP_canvas_state_incref(cs);
+    }
+    else {
+        DP_CanvasHistoryColdPoint *cp = &DP_VECTOR_AT_TYPE(
+            &ch->cold.points, DP_CanvasHistoryColdPoint, index);
+        return cold_thaw(ch, cp);
+    }
+}
+
 static DP_CanvasHistoryEntry *snapshot_history(DP_CanvasHistory *ch)
 {
     int count = ch->used;
@@ -1798,9 +2355,10 @@ static DP_CanvasHistoryEntry *snapshot_history(DP_CanvasHistory *ch)
         count == 0 ? NULL : DP_malloc(sizeof(*entries) * DP_int_to_size(count));
     for (int i = 0; i < count; ++i) {
         DP_CanvasHistoryEntry *entry = &ch->entries[i];
+        DP_CanvasState *cs = entry->state;
         entries[i] = (DP_CanvasHistoryEntry){
             entry->undo, DP_message_incref(entry->msg),
-            DP_canvas_state_incref_nullable(entry->state)};
+            cs ? snapshot_state(ch, cs) : NULL};
     }
     return entries;
 }
@@ -58,6 +58,27 @@ typedef struct DP_ForkEntry {
     DP_AffectedArea aa;
 } DP_ForkEntry;
 
+// Warm figures are only tracked while a cold budget is set. Raw bytes are what
+// the cold tiles would take up uncompressed.
+typedef struct DP_CanvasHistoryColdStats {
+    int warm_points;
+    int cold_points;
+    int cold_tiles;
+    size_t warm_bytes;
+    size_t cold_raw_bytes;
+    size_t cold_compressed_bytes;
+    unsigned int thaws;
+} DP_CanvasHistoryColdStats;
+
+// Published on every undo point and reset, so these lag behind by whatever
+// messages came in since. Retained bytes are the length of the messages held
+// onto, the canvas states of save points aren't counted.
+typedef struct DP_CanvasHistoryStats {
+    int entries;
+    int save_points;
+    size_t retained_bytes;
+} DP_CanvasHistoryStats;
+
 typedef void (*DP_CanvasHistorySavePointFn)(void *user, DP_CanvasState *cs,
                                             bool snapshot_requested);
 typedef void (*DP_CanvasHistorySoftResetFn)(void *user, unsigned int context_id,
@@ -98,6 +119,17 @@ bool DP_canvas_history_want_dump(DP_CanvasHistory *ch);
 
 void DP_canvas_history_want_dump_set(DP_CanvasHistory *ch, bool want_dump);
 
+// When the tiles exclusive to older save points take up more than this many
+// bytes, they get compressed, oldest save points first, and inflated again
+// when the save point is needed for an undo. Zero disables it, the default.
+size_t DP_canvas_history_cold_budget(DP_CanvasHistory *ch);
+
+void DP_canvas_history_cold_budget_set(DP_CanvasHistory *ch, size_t budget);
+
+DP_CanvasHistoryColdStats DP_canvas_history_cold_stats(DP_CanvasHistory *ch);
+
+DP_CanvasHistoryStats DP_canvas_history_stats(DP_CanvasHistory *ch);
+
 DP_CanvasState *DP_canvas_history_get(DP_CanvasHistory *ch);
 
 DP_CanvasState *
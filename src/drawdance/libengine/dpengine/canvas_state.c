@@ -1514,8 +1514,7 @@ static DP_Tile *get_flat_background_tile_or_null(DP_CanvasState *cs,
 static void init_flattening_tile(DP_TransientTile *tt, DP_Tile *background_tile)
 {
     if (background_tile) {
-        memcpy(DP_transient_tile_pixels(tt), DP_tile_pixels(background_tile),
-               DP_TILE_BYTES);
+        DP_transient_tile_copy(tt, background_tile);
     }
     else {
         memset(DP_transient_tile_pixels(tt), 0, DP_TILE_BYTES);
@@ -112,11 +112,21 @@ size_t DP_compress_deflate(const unsigned char *in, size_t in_size,
                            unsigned char *(*get_output_buffer)(size_t, void *),
                            void *user)
 {
+    return DP_compress_deflate_level(in, in_size, 9, get_output_buffer, user);
+}
+
+size_t
+DP_compress_deflate_level(const unsigned char *in, size_t in_size, int level,
+                          unsigned char *(*get_output_buffer)(size_t, void *),
+                          void *user)
+{
+    DP_ASSERT(level >= 1);
+    DP_ASSERT(level <= 9);
     z_stream stream = {0};
     stream.zalloc = malloc_z;
     stream.zfree = free_z;
 
-    int ret = deflateInit(&stream, 9);
+    int ret = deflateInit(&stream, level);
     if (ret != Z_OK) {
         DP_error_set("Deflate init error %d: %s", ret, get_z_error(&stream));
         return 0;
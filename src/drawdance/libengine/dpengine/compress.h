@@ -32,5 +32,12 @@ size_t DP_compress_deflate(const unsigned char *in, size_t in_size,
                            unsigned char *(*get_output_buffer)(size_t, void *),
                            void *user);
 
+// Level is a zlib compression level from 1 (fastest) to 9 (smallest), plain
+// DP_compress_deflate uses 9.
+size_t
+DP_compress_deflate_level(const unsigned char *in, size_t in_size, int level,
+                          unsigned char *(*get_output_buffer)(size_t, void *),
+                          void *user);
+
 
 #endif
@@ -28,6 +28,7 @@
  */
 #include "draw_context.h"
 #include "pixels.h"
+#include "stamp_queue.h"
 #include "tile.h"
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
@@ -61,6 +62,8 @@ struct DP_DrawContext {
     // through malloc, so it's always going to be maximally aligned.
     size_t pool_size;
     void *pool;
+    // Optional worker pool to apply brush stamps on, see stamp_queue.h.
+    DP_StampQueue *stamp_queue;
 };
 
 
@@ -69,12 +72,14 @@ DP_DrawContext *DP_draw_context_new(void)
     DP_DrawContext *dc = DP_malloc_simd(sizeof(*dc));
     dc->pool_size = 0;
     dc->pool = NULL;
+    dc->stamp_queue = NULL;
     return dc;
 }
 
 void DP_draw_context_free(DP_DrawContext *dc)
 {
     if (dc) {
+        DP_stamp_queue_free(dc->stamp_queue);
         DP_free(dc->pool);
         DP_free_simd(dc);
     }
@@ -88,6 +93,31 @@ DP_DrawContextStatistics DP_draw_context_statistics(DP_DrawContext *dc)
 }
 
 
+void DP_draw_context_stamp_threads_set(DP_DrawContext *dc, int thread_count)
+{
+    DP_ASSERT(dc);
+    DP_StampQueue *sq = dc->stamp_queue;
+    if (!sq || DP_stamp_queue_thread_count(sq) != thread_count) {
+        DP_stamp_queue_free(sq);
+        if (thread_count > 1) {
+            dc->stamp_queue = DP_stamp_queue_new(thread_count);
+            if (!dc->stamp_queue) {
+                DP_warn("Error starting stamp threads: %s", DP_error());
+            }
+        }
+        else {
+            dc->stamp_queue = NULL;
+        }
+    }
+}
+
+DP_StampQueue *DP_draw_context_stamp_queue(DP_DrawContext *dc)
+{
+    DP_ASSERT(dc);
+    return dc->stamp_queue;
+}
+
+
 uint16_t *DP_draw_context_stamp_buffer1(DP_DrawContext *dc)
 {
     DP_ASSERT(dc);
@@ -33,6 +33,7 @@
 typedef struct DP_LayerListEntry DP_LayerListEntry;
 typedef struct DP_LayerProps DP_LayerProps;
 typedef union DP_Pixel8 DP_Pixel8;
+typedef struct DP_StampQueue DP_StampQueue;
 
 
 #define DP_DRAW_CONTEXT_STAMP_MAX_DIAMETER 260
@@ -69,6 +70,14 @@ void DP_draw_context_free(DP_DrawContext *dc);
 DP_DrawContextStatistics DP_draw_context_statistics(DP_DrawContext *dc);
 
 
+// Sets the number of threads that brush stamps get applied on. With one
+// thread or less, stamps are applied directly on the calling thread.
+void DP_draw_context_stamp_threads_set(DP_DrawContext *dc, int thread_count);
+
+// Returns NULL if stamps should be applied directly.
+DP_StampQueue *DP_draw_context_stamp_queue(DP_DrawContext *dc);
+
+
 // All of the following operations share the same memory, their use can't be
 // intermixed within the same operation, they must be used in sequence.
 
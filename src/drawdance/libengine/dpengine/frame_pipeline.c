@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "frame_pipeline.h"
+#include "canvas_state.h"
+#include "image.h"
+#include "view_mode.h"
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/geom.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/worker.h>
+
+// Upper bound on the number of threads picked automatically. Each thread gets
+// a couple of slots, each of which holds a full flattened image.
+#define THREADS_MAX      16
+#define EXTRA_SLOT_COUNT 2
+
+typedef struct DP_FramePipelineSlot {
+    DP_Semaphore *done_sem;
+    DP_ViewModeBuffer vmb;
+    DP_Image *img;
+    int frame_index;
+    bool pending;
+    char *error;
+} DP_FramePipelineSlot;
+
+struct DP_FramePipelineJob {
+    DP_FramePipeline *fp;
+    DP_FramePipelineSlot *slot;
+};
+
+struct DP_FramePipeline {
+    DP_CanvasState *cs;
+    bool have_crop;
+    DP_Rect crop;
+    DP_Worker *worker; // NULL when flattening on demand.
+    int count;
+    int position;
+    int *frame_indexes;
+    bool *reused;
+    int render_count;
+    int render_position;
+    int *renders;
+    int slot_count;
+    DP_FramePipelineSlot slots[];
+};
+
+
+static void flatten_slot(DP_FramePipeline *fp, DP_FramePipelineSlot *slot)
+{
+    DP_ViewModeFilter vmf = DP_view_mode_filter_make_frame_render(
+        &slot->vmb, fp->cs, slot->frame_index);
+    if (!DP_canvas_state_into_flat_image(fp->cs, DP_FLAT_IMAGE_RENDER_FLAGS,
+                                         fp->have_crop ? &fp->crop : NULL, &vmf,
+                                         &slot->img)) {
+        // Errors are thread-local, so the message has to be carried over.
+        slot->error = DP_strdup(DP_error());
+    }
+}
+
+static void run_job(void *element, DP_UNUSED int thread_index)
+{
+    struct DP_FramePipelineJob *job = element;
+    DP_FramePipelineSlot *slot = job->slot;
+    flatten_slot(job->fp, slot);
+    DP_SEMAPHORE_MUST_POST(slot->done_sem);
+}
+
+static void schedule_render(DP_FramePipeline *fp, int render)
+{
+    if (render < fp->render_count) {
+        DP_FramePipelineSlot *slot = &fp->slots[render % fp->slot_count];
+        DP_ASSERT(!slot->pending);
+        DP_free(slot->error);
+        slot->error = NULL;
+        slot->frame_index = fp->renders[render];
+        slot->pending = true;
+        if (fp->worker) {
+            DP_worker_push(fp->worker,
+                           &(struct DP_FramePipelineJob){fp, slot});
+        }
+    }
+}
+
+static void wait_slot(DP_FramePipeline *fp, DP_FramePipelineSlot *slot)
+{
+    if (slot->pending) {
+        if (fp->worker) {
+            DP_SEMAPHORE_MUST_WAIT(slot->done_sem);
+        }
+        else {
+            flatten_slot(fp, slot);
+        }
+        slot->pending = false;
+    }
+}
+
+
+static int count_renders(DP_CanvasState *cs, int count,
+                         const int *frame_indexes, bool *out_reused)
+{
+    int render_count = 0;
+    for (int i = 0; i < count; ++i) {
+        bool reused = i != 0
+                   && DP_canvas_state_same_frame(cs, frame_indexes[i - 1],
+                                                 frame_indexes[i]);
+        out_reused[i] = reused;
+        if (!reused) {
+            ++render_count;
+        }
+    }
+    return render_count;
+}
+
+static DP_Worker *start_worker(int thread_count)
+{
+    DP_Worker *worker =
+        DP_worker_new(DP_int_to_size(thread_count + EXTRA_SLOT_COUNT),
+                      sizeof(struct DP_FramePipelineJob), thread_count,
+                      run_job);
+    if (!worker) {
+        DP_warn("Frame pipeline: can't start workers, flattening on demand: "
+                "%s",
+                DP_error());
+    }
+    return worker;
+}
+
+DP_FramePipeline *DP_frame_pipeline_new(DP_CanvasState *cs,
+                                        const DP_Rect *crop_or_null,
+                                        int count, const int *frame_indexes,
+                                        int thread_count)
+{
+    DP_ASSERT(cs);
+    DP_ASSERT(count >= 0);
+    DP_ASSERT(count == 0 || frame_indexes);
+    if (thread_count <= 0) {
+        thread_count = DP_worker_cpu_count(THREADS_MAX);
+    }
+
+    DP_Worker *worker = start_worker(thread_count);
+    int slot_count =
+        worker ? DP_worker_thread_count(worker) + EXTRA_SLOT_COUNT : 1;
+    DP_FramePipeline *fp = DP_malloc(DP_FLEX_SIZEOF(
+        DP_FramePipeline, slots, DP_int_to_size(slot_count)));
+    fp->cs = DP_canvas_state_incref(cs);
+    fp->have_crop = crop_or_null != NULL;
+    fp->crop = crop_or_null ? *crop_or_null : (DP_Rect){0, 0, 0, 0};
+    fp->worker = worker;
+    fp->count = count;
+    fp->position = 0;
+
+    size_t scount = DP_int_to_size(DP_max_int(count, 1));
+    fp->frame_indexes = DP_malloc(sizeof(*fp->frame_indexes) * scount);
+    if (count != 0) {
+        memcpy(fp->frame_indexes, frame_indexes,
+               sizeof(*fp->frame_indexes) * DP_int_to_size(count));
+    }
+    fp->reused = DP_malloc(sizeof(*fp->reused) * scount);
+    int render_count = count_renders(cs, count, frame_indexes, fp->reused);
+    fp->render_count = render_count;
+    fp->render_position = -1;
+    fp->renders = DP_malloc(sizeof(*fp->renders)
+                            * DP_int_to_size(DP_max_int(render_count, 1)));
+    for (int i = 0, j = 0; i < count; ++i) {
+        if (!fp->reused[i]) {
+            fp->renders[j++] = frame_indexes[i];
+        }
+    }
+
+    fp->slot_count = slot_count;
+    bool semaphores_ok = true;
+    for (int i = 0; i < slot_count; ++i) {
+        DP_FramePipelineSlot *slot = &fp->slots[i];
+        slot->done_sem = worker ? DP_semaphore_new(0) : NULL;
+        semaphores_ok = semaphores_ok && (!worker || slot->done_sem);
+        DP_view_mode_buffer_init(&slot->vmb);
+        slot->img = NULL;
+        slot->frame_index = -1;
+        slot->pending = false;
+        slot->error = NULL;
+    }
+
+    if (!semaphores_ok) {
+        DP_warn("Frame pipeline: can't create semaphores, flattening on "
+                "demand: %s",
+                DP_error());
+        DP_worker_free_join(worker);
+        fp->worker = NULL;
+    }
+
+    // Get all the slots started right away.
+    for (int i = 0; i < slot_count; ++i) {
+        schedule_render(fp, i);
+    }
+    return fp;
+}
+
+void DP_frame_pipeline_free(DP_FramePipeline *fp)
+{
+    if (fp) {
+        int slot_count = fp->slot_count;
+        for (int i = 0; i < slot_count; ++i) {
+            DP_FramePipelineSlot *slot = &fp->slots[i];
+            if (slot->pending && fp->worker) {
+                DP_SEMAPHORE_MUST_WAIT(slot->done_sem);
+            }
+        }
+        DP_worker_free_join(fp->worker);
+        for (int i = 0; i < slot_count; ++i) {
+            DP_FramePipelineSlot *slot = &fp->slots[i];
+            DP_free(slot->error);
+            DP_image_free(slot->img);
+            DP_view_mode_buffer_dispose(&slot->vmb);
+            DP_semaphore_free(slot->done_sem);
+        }
+        DP_free(fp->renders);
+        DP_free(fp->reused);
+        DP_free(fp->frame_indexes);
+        DP_canvas_state_decref(fp->cs);
+        DP_free(fp);
+    }
+}
+
+int DP_frame_pipeline_thread_count(DP_FramePipeline *fp)
+{
+    DP_ASSERT(fp);
+    return fp->worker ? DP_worker_thread_count(fp->worker) : 0;
+}
+
+DP_Image *DP_frame_pipeline_next(DP_FramePipeline *fp, bool *out_reused)
+{
+    DP_ASSERT(fp);
+    int position = fp->position;
+    if (position >= fp->count) {
+        DP_error_set("Frame pipeline: no more frames");
+        return NULL;
+    }
+    fp->position = position + 1;
+
+    bool reused = fp->reused[position];
+    if (!reused) {
+        // The previous image is done with, so its slot can start working on
+        // the next frame that doesn't fit into the pipeline yet.
+        int previous = fp->render_position++;
+        if (previous >= 0) {
+            schedule_render(fp, previous + fp->slot_count);
+        }
+    }
+
+    DP_FramePipelineSlot *slot =
+        &fp->slots[fp->render_position % fp->slot_count];
+    wait_slot(fp, slot);
+    if (out_reused) {
+        *out_reused = reused;
+    }
+
+    if (slot->error) {
+        DP_error_set("%s", slot->error);
+        return NULL;
+    }
+    else {
+        return slot->img;
+    }
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DPENGINE_FRAME_PIPELINE_H
+#define DPENGINE_FRAME_PIPELINE_H
+#include <dpcommon/common.h>
+
+typedef struct DP_CanvasState DP_CanvasState;
+typedef struct DP_Image DP_Image;
+typedef struct DP_Rect DP_Rect;
+
+
+// Flattens animation frames ahead of time on a pool of worker threads and
+// hands them out in order, so that flattening the next few frames overlaps
+// with whatever the caller does with the current one, like encoding it. Only
+// a bounded number of images are held at once. A frame that's the same as
+// the one before it reuses the previous image instead of flattening again.
+typedef struct DP_FramePipeline DP_FramePipeline;
+
+
+// Takes a reference to the canvas state, the crop and frame indexes are
+// copied. A thread count of 0 or less picks one based on the number of cores.
+// If the worker threads can't be started, frames are flattened on demand.
+DP_FramePipeline *DP_frame_pipeline_new(DP_CanvasState *cs,
+                                        const DP_Rect *crop_or_null,
+                                        int count, const int *frame_indexes,
+                                        int thread_count);
+
+// Waits for any frames still being flattened before freeing the pipeline.
+void DP_frame_pipeline_free(DP_FramePipeline *fp);
+
+int DP_frame_pipeline_thread_count(DP_FramePipeline *fp);
+
+// Returns the image for the next frame index, waiting for it to be flattened
+// if necessary. The image belongs to the pipeline and stays valid until the
+// next call. If the image is the same as the one returned last time, the
+// reused out parameter is set to true. Returns NULL on error or when the
+// pipeline has run out of frames.
+DP_Image *DP_frame_pipeline_next(DP_FramePipeline *fp, bool *out_reused);
+
+
+#endif
@@ -27,6 +27,7 @@
 #include "layer_props.h"
 #include "layer_props_list.h"
 #include "paint.h"
+#include "stamp_queue.h"
 #include "tile.h"
 #include "tile_iterator.h"
 #include "view_mode.h"
@@ -1380,7 +1381,7 @@ DP_transient_layer_content_persist(DP_TransientLayerContent *tlc)
                 tlc->elements[i].transient_tile = NULL;
             }
             else {
-                DP_transient_tile_persist(tt);
+                tlc->elements[i].tile = DP_transient_tile_persist_compact(tt);
             }
         }
     }
@@ -1852,11 +1853,13 @@ void DP_transient_layer_content_put_tile_inc(DP_TransientLayerContent *tlc,
 }
 
 
-typedef void (*DP_ApplyBrushStampFn)(DP_TransientTile *tt, const uint16_t *mask,
+typedef void (*DP_ApplyBrushStampFn)(DP_StampQueue *sq_or_null,
+                                     DP_TransientTile *tt, const uint16_t *mask,
                                      uint16_t opacity, int x, int y, int w,
                                      int h, int skip, void *user);
 
 static void apply_brush_stamp_with(DP_TransientLayerContent *tlc,
+                                   DP_StampQueue *sq_or_null,
                                    unsigned int context_id, uint16_t opacity,
                                    DP_BrushStamp *stamp, bool blend_blank,
                                    DP_ApplyBrushStampFn apply_fn, void *user)
@@ -1878,7 +1881,11 @@ static void apply_brush_stamp_with(DP_TransientLayerContent *tlc,
     int bottom = DP_min_int(top + d, height);
     int right = DP_min_int(left + d, width);
     int xtiles = DP_tile_count_round(width);
-    uint16_t *mask = stamp->data;
+    // When queueing, the stamp buffer will be overwritten by the next dab
+    // before the queue gets around to it, so the mask must be copied. That
+    // only happens once a tile is actually hit though.
+    const uint16_t *mask = stamp->data;
+    bool need_mask_copy = sq_or_null;
 
     int y = top < 0 ? 0 : top;
     int yb = top < 0 ? -top : 0;
@@ -1910,8 +1917,13 @@ static void apply_brush_stamp_with(DP_TransientLayerContent *tlc,
                 continue;
             }
 
-            apply_fn(tt, mask + mask_offset, opacity, xt, yt, wb, hb, d - wb,
-                     user);
+            if (need_mask_copy) {
+                mask = DP_stamp_queue_mask_copy(sq_or_null, mask, d);
+                need_mask_copy = false;
+            }
+
+            apply_fn(sq_or_null, tt, mask + mask_offset, opacity, xt, yt, wb,
+                     hb, d - wb, user);
         }
         y = (yindex + 1) * DP_TILE_SIZE;
         yb = yb + hb;
@@ -1924,40 +1936,55 @@ struct DP_ApplyStampParams {
     int blend_mode;
 };
 
-static void apply_stamp(DP_TransientTile *tt, const uint16_t *mask,
-                        uint16_t opacity, int x, int y, int w, int h, int skip,
-                        void *user)
+static void apply_stamp(DP_StampQueue *sq_or_null, DP_TransientTile *tt,
+                        const uint16_t *mask, uint16_t opacity, int x, int y,
+                        int w, int h, int skip, void *user)
 {
     struct DP_ApplyStampParams *params = user;
-    DP_transient_tile_brush_apply(tt, params->pixel, params->blend_mode, mask,
-                                  opacity, x, y, w, h, skip);
+    if (sq_or_null) {
+        DP_stamp_queue_push(sq_or_null, tt, params->pixel, params->blend_mode,
+                            mask, opacity, x, y, w, h, skip);
+    }
+    else {
+        DP_transient_tile_brush_apply(tt, params->pixel, params->blend_mode,
+                                      mask, opacity, x, y, w, h, skip);
+    }
 }
 
 void DP_transient_layer_content_brush_stamp_apply(
-    DP_TransientLayerContent *tlc, unsigned int context_id, DP_UPixel15 pixel,
-    uint16_t opacity, int blend_mode, DP_BrushStamp *stamp)
+    DP_TransientLayerContent *tlc, DP_StampQueue *sq_or_null,
+    unsigned int context_id, DP_UPixel15 pixel, uint16_t opacity,
+    int blend_mode, DP_BrushStamp *stamp)
 {
     struct DP_ApplyStampParams params = {pixel, blend_mode};
-    apply_brush_stamp_with(tlc, context_id, opacity, stamp,
+    apply_brush_stamp_with(tlc, sq_or_null, context_id, opacity, stamp,
                            can_blend_blank_pixel(blend_mode, opacity, pixel),
                            apply_stamp, &params);
 }
 
 
-static void apply_stamp_posterize(DP_TransientTile *tt, const uint16_t *mask,
+static void apply_stamp_posterize(DP_StampQueue *sq_or_null,
+                                  DP_TransientTile *tt, const uint16_t *mask,
                                   uint16_t opacity, int x, int y, int w, int h,
                                   int skip, void *user)
 {
     int *posterize_num_ptr = user;
-    DP_transient_tile_brush_apply_posterize(tt, *posterize_num_ptr, mask,
-                                            opacity, x, y, w, h, skip);
+    if (sq_or_null) {
+        DP_stamp_queue_push_posterize(sq_or_null, tt, *posterize_num_ptr, mask,
+                                      opacity, x, y, w, h, skip);
+    }
+    else {
+        DP_transient_tile_brush_apply_posterize(tt, *posterize_num_ptr, mask,
+                                                opacity, x, y, w, h, skip);
+    }
 }
 
 void DP_transient_layer_content_brush_stamp_apply_posterize(
-    DP_TransientLayerContent *tlc, unsigned int context_id, uint16_t opacity,
-    int posterize_num, DP_BrushStamp *stamp)
+    DP_TransientLayerContent *tlc, DP_StampQueue *sq_or_null,
+    unsigned int context_id, uint16_t opacity, int posterize_num,
+    DP_BrushStamp *stamp)
 {
-    apply_brush_stamp_with(tlc, context_id, opacity, stamp, true,
+    apply_brush_stamp_with(tlc, sq_or_null, context_id, opacity, stamp, true,
                            apply_stamp_posterize, &posterize_num);
 }
 
@@ -29,6 +29,7 @@ typedef struct DP_CanvasDiff DP_CanvasDiff;
 typedef struct DP_CanvasState DP_CanvasState;
 typedef struct DP_Image DP_Image;
 typedef struct DP_Rect DP_Rect;
+typedef struct DP_StampQueue DP_StampQueue;
 typedef struct DP_Tile DP_Tile;
 typedef struct DP_ViewModeFilter DP_ViewModeFilter;
 
@@ -234,13 +235,17 @@ void DP_transient_layer_content_put_tile_inc(DP_TransientLayerContent *tlc,
                                              DP_Tile *tile, int x, int y,
                                              int repeat);
 
+// If a stamp queue is given, the stamp is only queued and will be applied
+// when the queue is flushed, the layer content must be kept alive until then.
 void DP_transient_layer_content_brush_stamp_apply(
-    DP_TransientLayerContent *tlc, unsigned int context_id, DP_UPixel15 pixel,
-    uint16_t opacity, int blend_mode, DP_BrushStamp *stamp);
+    DP_TransientLayerContent *tlc, DP_StampQueue *sq_or_null,
+    unsigned int context_id, DP_UPixel15 pixel, uint16_t opacity,
+    int blend_mode, DP_BrushStamp *stamp);
 
 void DP_transient_layer_content_brush_stamp_apply_posterize(
-    DP_TransientLayerContent *tlc, unsigned int context_id, uint16_t opacity,
-    int posterize_num, DP_BrushStamp *stamp);
+    DP_TransientLayerContent *tlc, DP_StampQueue *sq_or_null,
+    unsigned int context_id, uint16_t opacity, int posterize_num,
+    DP_BrushStamp *stamp);
 
 void DP_transient_layer_content_transient_sublayer_at(
     DP_TransientLayerContent *tlc, int sublayer_index,
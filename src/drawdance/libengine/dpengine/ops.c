@@ -36,6 +36,7 @@
 #include "paint.h"
 #include "selection.h"
 #include "selection_set.h"
+#include "stamp_queue.h"
 #include "tile.h"
 #include "timeline.h"
 #include "track.h"
@@ -1471,6 +1472,7 @@ DP_CanvasState *DP_ops_draw_dabs(DP_CanvasState *cs, DP_DrawContext *dc,
     // bunches, so we support batching them for the sake of speed. This makes
     // this operation kinda complicated, but the speedup is worth it.
     DP_LayerRoutes *lr = DP_canvas_state_layer_routes_noinc(cs);
+    DP_StampQueue *sq = DP_draw_context_stamp_queue(dc);
     DP_TransientCanvasState *tcs = NULL;
     DP_TransientLayerContent *tlc = NULL;
     DP_TransientLayerContent *sub_tlc = NULL;
@@ -1541,10 +1543,20 @@ DP_CanvasState *DP_ops_draw_dabs(DP_CanvasState *cs, DP_DrawContext *dc,
             target = tlc;
         }
 
-        DP_paint_draw_dabs(dc, ucs_or_null, &params, target);
+        DP_paint_draw_dabs(dc, sq, ucs_or_null, &params, target);
     }
 
-    return tcs ? DP_transient_canvas_state_persist(tcs) : NULL;
+    if (tcs) {
+        // Stamps on different tiles are independent of each other, so they
+        // get queued up and then applied in parallel, sharded by tile.
+        if (sq) {
+            DP_stamp_queue_flush(sq);
+        }
+        return DP_transient_canvas_state_persist(tcs);
+    }
+    else {
+        return NULL;
+    }
 }
 
 
@@ -290,7 +290,8 @@ static void get_classic_offset_stamp(DP_BrushStamp *offset_stamp,
     offset_mask(offset_stamp, mask_stamp, xfrac, yfrac);
 }
 
-static void draw_dabs_classic(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
+static void draw_dabs_classic(DP_DrawContext *dc, DP_StampQueue *sq_or_null,
+                              DP_UserCursors *ucs_or_null,
                               DP_PaintDrawDabsParams *params,
                               DP_TransientLayerContent *tlc)
 {
@@ -320,8 +321,8 @@ static void draw_dabs_classic(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
             get_classic_offset_stamp(&offset_stamp, &mask_stamp, x, y);
 
             DP_transient_layer_content_brush_stamp_apply(
-                tlc, context_id, pixel, DP_channel8_to_15(opacity), blend_mode,
-                &offset_stamp);
+                tlc, sq_or_null, context_id, pixel, DP_channel8_to_15(opacity),
+                blend_mode, &offset_stamp);
         }
 
         last_x = x;
@@ -369,7 +370,8 @@ static void get_square_pixel_mask_stamp(DP_BrushStamp *stamp, int diameter)
     }
 }
 
-static void draw_dabs_pixel(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
+static void draw_dabs_pixel(DP_DrawContext *dc, DP_StampQueue *sq_or_null,
+                            DP_UserCursors *ucs_or_null,
                             DP_PaintDrawDabsParams *params,
                             DP_TransientLayerContent *tlc,
                             void (*get_stamp)(DP_BrushStamp *, int))
@@ -404,8 +406,8 @@ static void draw_dabs_pixel(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
             stamp.top = y - offset;
 
             DP_transient_layer_content_brush_stamp_apply(
-                tlc, context_id, pixel, DP_channel8_to_15(opacity), blend_mode,
-                &stamp);
+                tlc, sq_or_null, context_id, pixel, DP_channel8_to_15(opacity),
+                blend_mode, &stamp);
         }
 
         last_x = x;
@@ -899,6 +901,7 @@ static uint16_t scale_opacity(float ratio, float opacity)
 }
 
 static void apply_mypaint_dab(DP_TransientLayerContent *tlc,
+                              DP_StampQueue *sq_or_null,
                               unsigned int context_id, bool indirect,
                               DP_UPixel15 pixel, float normal, float lock_alpha,
                               float colorize, float posterize,
@@ -907,7 +910,7 @@ static void apply_mypaint_dab(DP_TransientLayerContent *tlc,
 {
     if (indirect) {
         DP_transient_layer_content_brush_stamp_apply(
-            tlc, context_id, pixel, DP_channel8_to_15(dab_opacity),
+            tlc, sq_or_null, context_id, pixel, DP_channel8_to_15(dab_opacity),
             DP_BLEND_MODE_ALPHA_DARKEN, stamp);
     }
     else {
@@ -915,7 +918,8 @@ static void apply_mypaint_dab(DP_TransientLayerContent *tlc,
 
         if (normal > 0.0f) {
             DP_transient_layer_content_brush_stamp_apply(
-                tlc, context_id, pixel, scale_opacity(normal, opacity),
+                tlc, sq_or_null, context_id, pixel,
+                scale_opacity(normal, opacity),
                 pixel.a == DP_BIT15 ? DP_BLEND_MODE_NORMAL
                                     : DP_BLEND_MODE_NORMAL_AND_ERASER,
                 stamp);
@@ -923,25 +927,27 @@ static void apply_mypaint_dab(DP_TransientLayerContent *tlc,
 
         if (lock_alpha > 0.0f && pixel.a != 0) {
             DP_transient_layer_content_brush_stamp_apply(
-                tlc, context_id, pixel, scale_opacity(lock_alpha, opacity),
-                DP_BLEND_MODE_RECOLOR, stamp);
+                tlc, sq_or_null, context_id, pixel,
+                scale_opacity(lock_alpha, opacity), DP_BLEND_MODE_RECOLOR,
+                stamp);
         }
 
         if (colorize > 0.0f) {
             DP_transient_layer_content_brush_stamp_apply(
-                tlc, context_id, pixel, scale_opacity(colorize, opacity),
-                DP_BLEND_MODE_COLOR, stamp);
+                tlc, sq_or_null, context_id, pixel,
+                scale_opacity(colorize, opacity), DP_BLEND_MODE_COLOR, stamp);
         }
 
         if (posterize > 0.0f) {
             DP_transient_layer_content_brush_stamp_apply_posterize(
-                tlc, context_id, scale_opacity(posterize, opacity),
+                tlc, sq_or_null, context_id, scale_opacity(posterize, opacity),
                 posterize_num, stamp);
         }
     }
 }
 
-static void draw_dabs_mypaint(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
+static void draw_dabs_mypaint(DP_DrawContext *dc, DP_StampQueue *sq_or_null,
+                              DP_UserCursors *ucs_or_null,
                               DP_PaintDrawDabsParams *params,
                               DP_TransientLayerContent *tlc)
 {
@@ -975,8 +981,8 @@ static void draw_dabs_mypaint(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
     float radius =
         get_mypaint_brush_stamp(&stamp, dc, last_x, last_y, last_size,
                                 last_hardness, last_aspect_ratio, last_angle);
-    apply_mypaint_dab(tlc, context_id, indirect, pixel, normal, lock_alpha,
-                      colorize, posterize, posterize_num, &stamp,
+    apply_mypaint_dab(tlc, sq_or_null, context_id, indirect, pixel, normal,
+                      lock_alpha, colorize, posterize, posterize_num, &stamp,
                       DP_mypaint_dab_opacity(first_dab));
     if (ucs_or_null) {
         DP_user_cursors_activate(ucs_or_null, context_id);
@@ -1012,9 +1018,9 @@ static void draw_dabs_mypaint(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
             get_mypaint_brush_stamp_offsets(&stamp, xf, yf, radius);
         }
 
-        apply_mypaint_dab(tlc, context_id, indirect, pixel, normal, lock_alpha,
-                          colorize, posterize, posterize_num, &stamp,
-                          DP_mypaint_dab_opacity(dab));
+        apply_mypaint_dab(tlc, sq_or_null, context_id, indirect, pixel, normal,
+                          lock_alpha, colorize, posterize, posterize_num,
+                          &stamp, DP_mypaint_dab_opacity(dab));
 
         if (ucs_or_null) {
             DP_user_cursors_move_smooth(ucs_or_null, context_id,
@@ -1027,7 +1033,8 @@ static void draw_dabs_mypaint(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
 }
 
 
-void DP_paint_draw_dabs(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
+void DP_paint_draw_dabs(DP_DrawContext *dc, DP_StampQueue *sq_or_null,
+                        DP_UserCursors *ucs_or_null,
                         DP_PaintDrawDabsParams *params,
                         DP_TransientLayerContent *tlc)
 {
@@ -1038,18 +1045,18 @@ void DP_paint_draw_dabs(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
     int type = params->type;
     switch (type) {
     case DP_MSG_DRAW_DABS_CLASSIC:
-        draw_dabs_classic(dc, ucs_or_null, params, tlc);
+        draw_dabs_classic(dc, sq_or_null, ucs_or_null, params, tlc);
         break;
     case DP_MSG_DRAW_DABS_PIXEL:
-        draw_dabs_pixel(dc, ucs_or_null, params, tlc,
+        draw_dabs_pixel(dc, sq_or_null, ucs_or_null, params, tlc,
                         get_round_pixel_mask_stamp);
         break;
     case DP_MSG_DRAW_DABS_PIXEL_SQUARE:
-        draw_dabs_pixel(dc, ucs_or_null, params, tlc,
+        draw_dabs_pixel(dc, sq_or_null, ucs_or_null, params, tlc,
                         get_square_pixel_mask_stamp);
         break;
     case DP_MSG_DRAW_DABS_MYPAINT:
-        draw_dabs_mypaint(dc, ucs_or_null, params, tlc);
+        draw_dabs_mypaint(dc, sq_or_null, ucs_or_null, params, tlc);
         break;
     default:
         DP_UNREACHABLE();
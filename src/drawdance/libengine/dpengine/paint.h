@@ -29,6 +29,7 @@ typedef struct DP_ClassicDab DP_ClassicDab;
 typedef struct DP_DrawContext DP_DrawContext;
 typedef struct DP_MyPaintDab DP_MyPaintDab;
 typedef struct DP_PixelDab DP_PixelDab;
+typedef struct DP_StampQueue DP_StampQueue;
 typedef struct DP_UserCursors DP_UserCursors;
 
 #ifdef DP_NO_STRICT_ALIASING
@@ -74,7 +75,9 @@ typedef struct DP_PaintDrawDabsParams {
 } DP_PaintDrawDabsParams;
 
 
-void DP_paint_draw_dabs(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
+// With a stamp queue, the dabs are only queued, see stamp_queue.h.
+void DP_paint_draw_dabs(DP_DrawContext *dc, DP_StampQueue *sq_or_null,
+                        DP_UserCursors *ucs_or_null,
                         DP_PaintDrawDabsParams *params,
                         DP_TransientLayerContent *tlc);
 
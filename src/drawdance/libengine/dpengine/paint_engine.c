@@ -110,6 +110,7 @@ struct DP_PaintEngine {
         unsigned int inspect_context_id;
         DP_Pixel8 checker_color1;
         DP_Pixel8 checker_color2;
+        int render_lod;
         struct {
             DP_LayerPropsList *prev_lpl;
             DP_Timeline *prev_tl;
@@ -135,6 +136,19 @@ struct DP_PaintEngine {
     DP_Atomic default_layer_id;
     DP_Atomic undo_depth_limit;
     DP_Atomic just_reset;
+    // Written by the paint thread and while holding the queue mutex, read
+    // without locking by DP_paint_engine_stats.
+    struct {
+        DP_Atomic local_queue_depth;
+        DP_Atomic remote_queue_depth;
+        DP_Atomic messages_handled;
+        DP_Atomic dabs_handled;
+        DP_Atomic messages_by_context[DP_DRAW_CONTEXT_ID_COUNT];
+        DP_Atomic dabs_by_context[DP_DRAW_CONTEXT_ID_COUNT];
+        DP_Atomic ticks;
+        DP_Atomic messages_per_tick[DP_PAINT_ENGINE_TICK_BUCKETS];
+        unsigned int last_tick_messages;
+    } stats;
     bool catching_up;
     bool reset_locked;
     DP_Thread *paint_thread;
@@ -160,6 +174,14 @@ struct DP_PaintEngine {
 };
 
 
+static void update_queue_depths(DP_PaintEngine *pe)
+{
+    DP_atomic_set(&pe->stats.local_queue_depth,
+                  DP_size_to_int(pe->local_queue.used));
+    DP_atomic_set(&pe->stats.remote_queue_depth,
+                  DP_size_to_int(pe->remote_queue.used));
+}
+
 static void push_cleanup_message(void *user, DP_Message *msg)
 {
     DP_PaintEngine *pe = user;
@@ -303,6 +325,7 @@ static void handle_internal(DP_PaintEngine *pe, DP_DrawContext *dc,
         // We might have gotten disconnected while catching up after joining the
         // session or during a reset, so say we're 100% caught up after cleanup.
         push_cleanup_message(pe, DP_msg_internal_catchup_new(0, 100));
+        update_queue_depths(pe);
         DP_MUTEX_MUST_UNLOCK(pe->queue_mutex);
         break;
     case DP_MSG_INTERNAL_TYPE_PREVIEW: {
@@ -571,6 +594,44 @@ static void handle_multidab(DP_PaintEngine *pe, DP_DrawContext *dc, bool local,
     }
 }
 
+static int count_dabs(DP_Message *msg)
+{
+    int count;
+    switch (DP_message_type(msg)) {
+    case DP_MSG_DRAW_DABS_CLASSIC:
+        DP_msg_draw_dabs_classic_dabs(DP_message_internal(msg), &count);
+        return count;
+    case DP_MSG_DRAW_DABS_PIXEL:
+    case DP_MSG_DRAW_DABS_PIXEL_SQUARE:
+        DP_msg_draw_dabs_pixel_dabs(DP_message_internal(msg), &count);
+        return count;
+    case DP_MSG_DRAW_DABS_MYPAINT:
+        DP_msg_draw_dabs_mypaint_dabs(DP_message_internal(msg), &count);
+        return count;
+    default:
+        return 0;
+    }
+}
+
+static void count_handled(DP_PaintEngine *pe, int count, DP_Message **msgs)
+{
+    int dabs = 0;
+    for (int i = 0; i < count; ++i) {
+        DP_Message *msg = msgs[i];
+        unsigned int context_id = DP_message_context_id(msg);
+        int msg_dabs = count_dabs(msg);
+        DP_atomic_inc(&pe->stats.messages_by_context[context_id]);
+        if (msg_dabs != 0) {
+            DP_atomic_add(&pe->stats.dabs_by_context[context_id], msg_dabs);
+            dabs += msg_dabs;
+        }
+    }
+    DP_atomic_add(&pe->stats.messages_handled, count);
+    if (dabs != 0) {
+        DP_atomic_add(&pe->stats.dabs_handled, dabs);
+    }
+}
+
 static void handle_message(DP_PaintEngine *pe, DP_DrawContext *dc,
                            DP_Message **msgs)
 {
@@ -579,10 +640,13 @@ static void handle_message(DP_PaintEngine *pe, DP_DrawContext *dc,
     DP_Message *first = msgs[0];
     DP_MessageType type = DP_message_type(first);
     int count = maybe_shift_more_messages(pe, local, type, msgs);
+    update_queue_depths(pe);
     DP_MUTEX_MUST_UNLOCK(pe->queue_mutex);
 
     DP_ASSERT(count > 0);
     DP_ASSERT(count <= MAX_MULTIDAB_MESSAGES);
+    // Count before handling, since that drops the references to the messages.
+    count_handled(pe, count, msgs);
     if (count == 1) {
         handle_single_message(pe, dc, local, type, first);
     }
@@ -708,12 +772,15 @@ DP_PaintEngine *DP_paint_engine_new_inc(
     pe->local_view.layers_can_decrease_opacity = true;
     pe->local_view.checker_color1 = (DP_Pixel8){checker_color1};
     pe->local_view.checker_color2 = (DP_Pixel8){checker_color2};
+    pe->local_view.render_lod = 0;
     pe->local_view.layers.prev_lpl = NULL;
     pe->local_view.layers.prev_tl = NULL;
     pe->local_view.layers.lpl = NULL;
     pe->local_view.tracks.prev_tl = NULL;
     pe->local_view.tracks.tl = NULL;
     pe->paint_dc = paint_dc;
+    // Must happen before the paint thread starts, since it uses the context.
+    DP_draw_context_stamp_threads_set(paint_dc, DP_worker_cpu_count(128));
     pe->main_dc = main_dc;
     for (int i = 0; i < DP_PREVIEW_COUNT; ++i) {
         pe->previews[i] = NULL;
@@ -732,6 +799,19 @@ DP_PaintEngine *DP_paint_engine_new_inc(
     DP_atomic_set(&pe->undo_depth_limit,
                   DP_canvas_history_undo_depth_limit(pe->ch));
     DP_atomic_set(&pe->just_reset, false);
+    DP_atomic_set(&pe->stats.local_queue_depth, 0);
+    DP_atomic_set(&pe->stats.remote_queue_depth, 0);
+    DP_atomic_set(&pe->stats.messages_handled, 0);
+    DP_atomic_set(&pe->stats.dabs_handled, 0);
+    for (int i = 0; i < DP_DRAW_CONTEXT_ID_COUNT; ++i) {
+        DP_atomic_set(&pe->stats.messages_by_context[i], 0);
+        DP_atomic_set(&pe->stats.dabs_by_context[i], 0);
+    }
+    DP_atomic_set(&pe->stats.ticks, 0);
+    for (int i = 0; i < DP_PAINT_ENGINE_TICK_BUCKETS; ++i) {
+        DP_atomic_set(&pe->stats.messages_per_tick[i], 0);
+    }
+    pe->stats.last_tick_messages = 0;
     pe->catching_up = false;
     pe->reset_locked = false;
     pe->paint_thread = DP_thread_new(run_paint_engine, pe);
@@ -846,6 +926,52 @@ void DP_paint_engine_want_canvas_history_dump_set(DP_PaintEngine *pe,
     DP_canvas_history_want_dump_set(pe->ch, want_canvas_history_dump);
 }
 
+size_t DP_paint_engine_history_cold_budget(DP_PaintEngine *pe)
+{
+    DP_ASSERT(pe);
+    return DP_canvas_history_cold_budget(pe->ch);
+}
+
+void DP_paint_engine_history_cold_budget_set(DP_PaintEngine *pe, size_t budget)
+{
+    DP_ASSERT(pe);
+    DP_canvas_history_cold_budget_set(pe->ch, budget);
+}
+
+DP_CanvasHistoryColdStats
+DP_paint_engine_history_cold_stats(DP_PaintEngine *pe)
+{
+    DP_ASSERT(pe);
+    return DP_canvas_history_cold_stats(pe->ch);
+}
+
+DP_PaintEngineStats DP_paint_engine_stats(DP_PaintEngine *pe)
+{
+    DP_ASSERT(pe);
+    DP_PaintEngineStats stats;
+    stats.local_queue_depth = DP_atomic_get(&pe->stats.local_queue_depth);
+    stats.remote_queue_depth = DP_atomic_get(&pe->stats.remote_queue_depth);
+    stats.messages_handled =
+        (unsigned int)DP_atomic_get(&pe->stats.messages_handled);
+    stats.dabs_handled = (unsigned int)DP_atomic_get(&pe->stats.dabs_handled);
+    for (int i = 0; i < DP_DRAW_CONTEXT_ID_COUNT; ++i) {
+        stats.messages_by_context[i] =
+            (unsigned int)DP_atomic_get(&pe->stats.messages_by_context[i]);
+        stats.dabs_by_context[i] =
+            (unsigned int)DP_atomic_get(&pe->stats.dabs_by_context[i]);
+    }
+    stats.ticks = (unsigned int)DP_atomic_get(&pe->stats.ticks);
+    for (int i = 0; i < DP_PAINT_ENGINE_TICK_BUCKETS; ++i) {
+        stats.messages_per_tick[i] =
+            (unsigned int)DP_atomic_get(&pe->stats.messages_per_tick[i]);
+    }
+    stats.renderer = DP_renderer_stats(pe->renderer);
+    stats.tile_memory = DP_tile_memory_usage();
+    stats.history = DP_canvas_history_stats(pe->ch);
+    stats.history_cold = DP_canvas_history_cold_stats(pe->ch);
+    return stats;
+}
+
 
 bool DP_paint_engine_local_state_reset_image_build(
     DP_PaintEngine *pe, DP_LocalStateAcceptResetMessageFn fn, void *user)
@@ -971,6 +1097,21 @@ void DP_paint_engine_checker_color2_set(DP_PaintEngine *pe, uint32_t color2)
     }
 }
 
+int DP_paint_engine_render_lod(DP_PaintEngine *pe)
+{
+    DP_ASSERT(pe);
+    return pe->local_view.render_lod;
+}
+
+void DP_paint_engine_render_lod_set(DP_PaintEngine *pe, int lod)
+{
+    DP_ASSERT(pe);
+    DP_ASSERT(lod >= 0);
+    DP_ASSERT(lod <= DP_RENDERER_LOD_MAX);
+    // The renderer takes care of re-rendering everything on the next apply.
+    pe->local_view.render_lod = lod;
+}
+
 
 DP_Tile *DP_paint_engine_local_background_tile_noinc(DP_PaintEngine *pe)
 {
@@ -1263,6 +1404,7 @@ static int push_more_messages(DP_PaintEngine *pe, DP_Queue *queue,
             DP_UNREACHABLE();
         }
     }
+    update_queue_depths(pe);
     DP_SEMAPHORE_MUST_POST_N(pe->queue_sem, pushed);
     return pushed;
 }
@@ -1714,7 +1856,8 @@ emit_changes(DP_PaintEngine *pe, DP_CanvasState *prev, DP_CanvasState *cs,
                       pe->local_view.layers_can_decrease_opacity,
                       pe->local_view.checker_color1,
                       pe->local_view.checker_color2, tile_bounds,
-                      render_outside_tile_bounds, DP_RENDERER_CONTINUOUS);
+                      render_outside_tile_bounds, pe->local_view.render_lod,
+                      DP_RENDERER_CONTINUOUS);
 
     if (!catching_up) {
         if (DP_canvas_diff_layer_props_changed_reset(diff) || catchup_done) {
@@ -1753,6 +1896,21 @@ emit_changes(DP_PaintEngine *pe, DP_CanvasState *prev, DP_CanvasState *cs,
     ucb->count = 0;
 }
 
+static void count_tick(DP_PaintEngine *pe)
+{
+    unsigned int handled =
+        (unsigned int)DP_atomic_get(&pe->stats.messages_handled);
+    unsigned int delta = handled - pe->stats.last_tick_messages;
+    pe->stats.last_tick_messages = handled;
+    int bucket = 0;
+    while (delta != 0 && bucket < DP_PAINT_ENGINE_TICK_BUCKETS - 1) {
+        delta >>= 1u;
+        ++bucket;
+    }
+    DP_atomic_inc(&pe->stats.messages_per_tick[bucket]);
+    DP_atomic_inc(&pe->stats.ticks);
+}
+
 void DP_paint_engine_tick(
     DP_PaintEngine *pe, DP_Rect tile_bounds, bool render_outside_tile_bounds,
     DP_PaintEngineCatchupFn catchup,
@@ -1772,6 +1930,7 @@ void DP_paint_engine_tick(
     DP_ASSERT(catchup);
     DP_ASSERT(layer_props_changed);
     DP_PERF_BEGIN(fn, "tick");
+    count_tick(pe);
 
     int progress = DP_atomic_xch(&pe->catchup, -1);
     bool was_catching_up = pe->catching_up;
@@ -1899,7 +2058,8 @@ void DP_paint_engine_render_continuous(DP_PaintEngine *pe, DP_Rect tile_bounds,
                       pe->local_view.layers_can_decrease_opacity,
                       pe->local_view.checker_color1,
                       pe->local_view.checker_color2, tile_bounds,
-                      render_outside_tile_bounds, DP_RENDERER_CONTINUOUS);
+                      render_outside_tile_bounds, pe->local_view.render_lod,
+                      DP_RENDERER_CONTINUOUS);
 }
 
 void DP_paint_engine_change_bounds(DP_PaintEngine *pe, DP_Rect tile_bounds,
@@ -1909,7 +2069,7 @@ void DP_paint_engine_change_bounds(DP_PaintEngine *pe, DP_Rect tile_bounds,
                       pe->local_view.layers_can_decrease_opacity,
                       pe->local_view.checker_color1,
                       pe->local_view.checker_color2, tile_bounds,
-                      render_outside_tile_bounds,
+                      render_outside_tile_bounds, pe->local_view.render_lod,
                       DP_RENDERER_VIEW_BOUNDS_CHANGED);
 }
 
@@ -1920,7 +2080,17 @@ void DP_paint_engine_render_everything(DP_PaintEngine *pe)
                       pe->local_view.checker_color1,
                       pe->local_view.checker_color2,
                       DP_rect_make(0, 0, UINT16_MAX, UINT16_MAX), false,
-                      DP_RENDERER_EVERYTHING);
+                      pe->local_view.render_lod, DP_RENDERER_EVERYTHING);
+}
+
+void DP_paint_engine_render_changes(DP_PaintEngine *pe)
+{
+    DP_renderer_apply(pe->renderer, pe->view_cs, pe->local_state, pe->diff,
+                      pe->local_view.layers_can_decrease_opacity,
+                      pe->local_view.checker_color1,
+                      pe->local_view.checker_color2,
+                      DP_rect_make(0, 0, UINT16_MAX, UINT16_MAX), false,
+                      pe->local_view.render_lod, DP_RENDERER_CHANGES);
 }
 
 
@@ -22,6 +22,7 @@
 #ifndef DPENGINE_PAINT_ENGINE
 #define DPENGINE_PAINT_ENGINE
 #include "canvas_history.h"
+#include "draw_context.h"
 #include "local_state.h"
 #include "player.h"
 #include "preview.h"
@@ -30,6 +31,7 @@
 #include "view_mode.h"
 #include <dpcommon/common.h>
 #include <dpcommon/geom.h>
+#include <dpcommon/memory_pool.h>
 
 typedef struct DP_AclState DP_AclState;
 typedef struct DP_AnnotationList DP_AnnotationList;
@@ -99,6 +101,30 @@ typedef struct DP_PaintEnginePlayback {
     void *user;
 } DP_PaintEnginePlayback;
 
+// Number of buckets in the messages per tick histogram. Bucket 0 counts ticks
+// during which no messages were handled, bucket i those that saw [2^(i-1), 2^i)
+// messages. The last bucket also catches everything above that.
+#define DP_PAINT_ENGINE_TICK_BUCKETS 16
+
+// Queue depths are a snapshot, the other counters only ever go up and wrap
+// around, so compare successive snapshots using unsigned arithmetic. Multidab
+// batches count each of their messages individually. The per-context counters
+// are indexed by the context id of the messages.
+typedef struct DP_PaintEngineStats {
+    int local_queue_depth;
+    int remote_queue_depth;
+    unsigned int messages_handled;
+    unsigned int dabs_handled;
+    unsigned int messages_by_context[DP_DRAW_CONTEXT_ID_COUNT];
+    unsigned int dabs_by_context[DP_DRAW_CONTEXT_ID_COUNT];
+    unsigned int ticks;
+    unsigned int messages_per_tick[DP_PAINT_ENGINE_TICK_BUCKETS];
+    DP_RendererStats renderer;
+    DP_MemoryPoolStatistics tile_memory;
+    DP_CanvasHistoryStats history;
+    DP_CanvasHistoryColdStats history_cold;
+} DP_PaintEngineStats;
+
 DP_PaintEngine *DP_paint_engine_new_inc(
     DP_DrawContext *paint_dc, DP_DrawContext *main_dc,
     DP_DrawContext *preview_dc, DP_AclState *acls, DP_CanvasState *cs_or_null,
@@ -126,6 +152,16 @@ bool DP_paint_engine_want_canvas_history_dump(DP_PaintEngine *pe);
 void DP_paint_engine_want_canvas_history_dump_set(
     DP_PaintEngine *pe, bool want_canvas_history_dump);
 
+// See DP_canvas_history_cold_budget_set. Takes effect on the next undo point.
+size_t DP_paint_engine_history_cold_budget(DP_PaintEngine *pe);
+void DP_paint_engine_history_cold_budget_set(DP_PaintEngine *pe, size_t budget);
+DP_CanvasHistoryColdStats
+DP_paint_engine_history_cold_stats(DP_PaintEngine *pe);
+
+// Live performance counters. Safe to call from any thread. The history and tile
+// memory figures take locks that the paint and render threads use too.
+DP_PaintEngineStats DP_paint_engine_stats(DP_PaintEngine *pe);
+
 bool DP_paint_engine_local_state_reset_image_build(
     DP_PaintEngine *pe, DP_LocalStateAcceptResetMessageFn fn, void *user);
 
@@ -159,6 +195,11 @@ uint32_t DP_paint_engine_checker_color2(DP_PaintEngine *pe);
 void DP_paint_engine_checker_color1_set(DP_PaintEngine *pe, uint32_t color1);
 void DP_paint_engine_checker_color2_set(DP_PaintEngine *pe, uint32_t color2);
 
+// Level of detail to render at, see DP_renderer_apply. Takes effect on the
+// next render.
+int DP_paint_engine_render_lod(DP_PaintEngine *pe);
+void DP_paint_engine_render_lod_set(DP_PaintEngine *pe, int lod);
+
 DP_Tile *DP_paint_engine_local_background_tile_noinc(DP_PaintEngine *pe);
 
 // Takes ownership of the header, path is copied.
@@ -202,6 +243,11 @@ void DP_paint_engine_change_bounds(DP_PaintEngine *pe, DP_Rect tile_bounds,
 
 void DP_paint_engine_render_everything(DP_PaintEngine *pe);
 
+// Renders only the tiles that changed since the last render and calls the
+// renderer's unlock function once they're done. Meant for headless users that
+// keep their own copy of the rendered image around between frames.
+void DP_paint_engine_render_changes(DP_PaintEngine *pe);
+
 void DP_paint_engine_preview_cut(DP_PaintEngine *pe, int x, int y, int width,
                                  int height, const DP_Pixel8 *mask_or_null,
                                  int layer_id_count, const int *layer_ids);
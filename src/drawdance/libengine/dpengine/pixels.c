@@ -998,6 +998,332 @@ static void blend_mask_pixels_recolor_sse42(DP_Pixel15 *dst, DP_UPixel15 src,
     }
     // clang-format on
 }
+
+// Floor division of n by d for 0 <= n < 2^31 and 0 < d <= 2^15 + 1, which is
+// what all the divisions in the blend modes below need. There's no integer
+// division in SSE, so this goes via float and then corrects the quotient by
+// one in either direction to get exactly the same result as integer division.
+// The result is clamped to DP_BIT15 + 1 (plus one for the correction), since
+// every caller clamps to DP_BIT15 anyway.
+DP_FORCE_INLINE __m128i div_clamped_sse42(__m128i n, __m128i d)
+{
+    __m128 qf = _mm_min_ps(_mm_div_ps(_mm_cvtepi32_ps(n), _mm_cvtepi32_ps(d)),
+                           _mm_set1_ps((float)(DP_BIT15 + 1)));
+    __m128i q = _mm_cvttps_epi32(qf);
+    __m128i r = _mm_sub_epi32(n, _mm_mullo_epi32(q, d));
+    __m128i too_large = _mm_cmpgt_epi32(_mm_setzero_si128(), r);
+    __m128i too_small =
+        _mm_cmpgt_epi32(r, _mm_sub_epi32(d, _mm_set1_epi32(1)));
+    return _mm_sub_epi32(_mm_add_epi32(q, too_large), too_small);
+}
+
+// Equivalent to fix15_sqrt, which works out to floor(sqrt(x << 15)).
+static __m128i sqrt_sse42(__m128i x)
+{
+    __m128i s = _mm_slli_epi32(x, 15);
+    __m128i n = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(s)));
+    return _mm_add_epi32(n, _mm_cmpgt_epi32(_mm_mullo_epi32(n, n), s));
+}
+
+// Lanes with zero alpha give garbage, the caller must mask those out.
+static __m128i unpremultiply_sse42(__m128i c, __m128i a)
+{
+    return div_clamped_sse42(_mm_slli_epi32(c, 15),
+                             _mm_max_epi32(a, _mm_set1_epi32(1)));
+}
+
+static __m128i premultiply_sse42(__m128i c, __m128i a)
+{
+    return mul_sse42(c, a);
+}
+
+static __m128i comp_multiply_sse42(__m128i a, __m128i b)
+{
+    return mul_sse42(a, b);
+}
+
+static __m128i comp_divide_sse42(__m128i a, __m128i b)
+{
+    __m128i n = _mm_add_epi32(_mm_mullo_epi32(a, _mm_set1_epi32(DP_BIT15 + 1)),
+                              _mm_srli_epi32(b, 1));
+    __m128i d = _mm_add_epi32(b, _mm_set1_epi32(1));
+    return _mm_min_epi32(div_clamped_sse42(n, d), _mm_set1_epi32(DP_BIT15));
+}
+
+static __m128i comp_burn_sse42(__m128i a, __m128i b)
+{
+    __m128i n = _mm_mullo_epi32(_mm_sub_epi32(_mm_set1_epi32(DP_BIT15), a),
+                                _mm_set1_epi32(DP_BIT15 + 1));
+    __m128i d = _mm_add_epi32(b, _mm_set1_epi32(1));
+    return _mm_max_epi32(
+        _mm_sub_epi32(_mm_set1_epi32(DP_BIT15), div_clamped_sse42(n, d)),
+        _mm_setzero_si128());
+}
+
+static __m128i comp_dodge_sse42(__m128i a, __m128i b)
+{
+    __m128i n = _mm_mullo_epi32(a, _mm_set1_epi32(DP_BIT15 + 1));
+    __m128i d = _mm_sub_epi32(_mm_set1_epi32(DP_BIT15 + 1), b);
+    return _mm_min_epi32(div_clamped_sse42(n, d), _mm_set1_epi32(DP_BIT15));
+}
+
+static __m128i comp_darken_sse42(__m128i a, __m128i b)
+{
+    return _mm_min_epi32(a, b);
+}
+
+static __m128i comp_lighten_sse42(__m128i a, __m128i b)
+{
+    return _mm_max_epi32(a, b);
+}
+
+static __m128i comp_subtract_sse42(__m128i a, __m128i b)
+{
+    return _mm_max_epi32(_mm_sub_epi32(a, b), _mm_setzero_si128());
+}
+
+static __m128i comp_add_sse42(__m128i a, __m128i b)
+{
+    return _mm_min_epi32(_mm_add_epi32(a, b), _mm_set1_epi32(DP_BIT15));
+}
+
+static __m128i comp_screen_sse42(__m128i a, __m128i b)
+{
+    __m128i bit15 = _mm_set1_epi32(DP_BIT15);
+    return _mm_sub_epi32(
+        bit15, mul_sse42(_mm_sub_epi32(bit15, a), _mm_sub_epi32(bit15, b)));
+}
+
+static __m128i comp_hard_light_sse42(__m128i a, __m128i b)
+{
+    __m128i bit15 = _mm_set1_epi32(DP_BIT15);
+    __m128i b2 = _mm_slli_epi32(b, 1);
+    return _mm_blendv_epi8(comp_multiply_sse42(a, b2),
+                           comp_screen_sse42(a, _mm_sub_epi32(b2, bit15)),
+                           _mm_cmpgt_epi32(b2, bit15));
+}
+
+static __m128i comp_overlay_sse42(__m128i a, __m128i b)
+{
+    return comp_hard_light_sse42(b, a);
+}
+
+static __m128i comp_soft_light_sse42(__m128i a, __m128i b)
+{
+    __m128i bit15 = _mm_set1_epi32(DP_BIT15);
+    __m128i b2 = _mm_slli_epi32(b, 1);
+    __m128i a4 = _mm_slli_epi32(a, 2);
+
+    __m128i dark = _mm_sub_epi32(
+        a, mul_sse42(mul_sse42(_mm_sub_epi32(bit15, b2), a),
+                     _mm_sub_epi32(bit15, a)));
+
+    __m128i squared = mul_sse42(a, a);
+    __m128i d_low = _mm_sub_epi32(
+        _mm_add_epi32(a4, _mm_slli_epi32(mul_sse42(squared, a), 4)),
+        _mm_mullo_epi32(squared, _mm_set1_epi32(12)));
+    __m128i d =
+        _mm_blendv_epi8(d_low, sqrt_sse42(a), _mm_cmpgt_epi32(a4, bit15));
+    __m128i light = _mm_add_epi32(
+        a, mul_sse42(_mm_sub_epi32(b2, bit15), _mm_sub_epi32(d, a)));
+
+    return _mm_blendv_epi8(dark, light, _mm_cmpgt_epi32(b2, bit15));
+}
+
+static __m128i comp_linear_burn_sse42(__m128i a, __m128i b)
+{
+    return _mm_max_epi32(
+        _mm_sub_epi32(_mm_add_epi32(a, b), _mm_set1_epi32(DP_BIT15)),
+        _mm_setzero_si128());
+}
+
+static __m128i comp_linear_light_sse42(__m128i a, __m128i b)
+{
+    __m128i c = _mm_sub_epi32(_mm_add_epi32(a, _mm_slli_epi32(b, 1)),
+                              _mm_set1_epi32(DP_BIT15));
+    return _mm_min_epi32(_mm_max_epi32(c, _mm_setzero_si128()),
+                         _mm_set1_epi32(DP_BIT15));
+}
+
+static __m128i comp_luminosity_shine_sai_sse42(__m128i a, __m128i b,
+                                               __m128i o)
+{
+    return comp_add_sse42(a, mul_sse42(b, o));
+}
+
+// Alpha-preserving separable blending of 4 pixels, the result for each
+// channel is lerped from the unpremultiplied destination towards the result
+// of comp_op by o. Pixels with zero alpha are left alone.
+DP_FORCE_INLINE void
+composite_separable_sse42(__m128i *dstB, __m128i *dstG, __m128i *dstR,
+                          __m128i dstA, __m128i srcB, __m128i srcG,
+                          __m128i srcR, __m128i o,
+                          __m128i (*comp_op)(__m128i, __m128i))
+{
+    __m128i cbB = unpremultiply_sse42(*dstB, dstA);
+    __m128i cbG = unpremultiply_sse42(*dstG, dstA);
+    __m128i cbR = unpremultiply_sse42(*dstR, dstA);
+    __m128i o1 = _mm_sub_epi32(_mm_set1_epi32(DP_BIT15), o);
+    __m128i keep = _mm_cmpeq_epi32(dstA, _mm_setzero_si128());
+    // clang-format off
+    *dstB = _mm_blendv_epi8(premultiply_sse42(sumprods_sse42(o1, cbB, o, comp_op(cbB, srcB)), dstA), *dstB, keep);
+    *dstG = _mm_blendv_epi8(premultiply_sse42(sumprods_sse42(o1, cbG, o, comp_op(cbG, srcG)), dstA), *dstG, keep);
+    *dstR = _mm_blendv_epi8(premultiply_sse42(sumprods_sse42(o1, cbR, o, comp_op(cbR, srcR)), dstA), *dstR, keep);
+    // clang-format on
+}
+
+DP_FORCE_INLINE void composite_separable_with_opacity_sse42(
+    __m128i *dstB, __m128i *dstG, __m128i *dstR, __m128i dstA, __m128i srcB,
+    __m128i srcG, __m128i srcR, __m128i o,
+    __m128i (*comp_op)(__m128i, __m128i, __m128i))
+{
+    __m128i cbB = unpremultiply_sse42(*dstB, dstA);
+    __m128i cbG = unpremultiply_sse42(*dstG, dstA);
+    __m128i cbR = unpremultiply_sse42(*dstR, dstA);
+    __m128i keep = _mm_cmpeq_epi32(dstA, _mm_setzero_si128());
+    // clang-format off
+    *dstB = _mm_blendv_epi8(premultiply_sse42(comp_op(cbB, srcB, o), dstA), *dstB, keep);
+    *dstG = _mm_blendv_epi8(premultiply_sse42(comp_op(cbG, srcG, o), dstA), *dstG, keep);
+    *dstR = _mm_blendv_epi8(premultiply_sse42(comp_op(cbR, srcR, o), dstA), *dstR, keep);
+    // clang-format on
+}
+
+DP_FORCE_INLINE void
+blend_tile_composite_separable_sse42(DP_Pixel15 *DP_RESTRICT dst,
+                                     const DP_Pixel15 *DP_RESTRICT src,
+                                     uint16_t opacity,
+                                     __m128i (*comp_op)(__m128i, __m128i))
+{
+    __m128i opacity4 = _mm_set1_epi32(opacity);
+
+    for (int i = 0; i < DP_TILE_LENGTH; i += 4) {
+        __m128i srcB, srcG, srcR, srcA;
+        load_aligned_sse42(&src[i], &srcB, &srcG, &srcR, &srcA);
+
+        __m128i dstB, dstG, dstR, dstA;
+        load_aligned_sse42(&dst[i], &dstB, &dstG, &dstR, &dstA);
+
+        // Source lanes with zero alpha get garbage when unpremultiplied, but
+        // their opacity is zero too, so they don't affect the result.
+        composite_separable_sse42(&dstB, &dstG, &dstR, dstA,
+                                  unpremultiply_sse42(srcB, srcA),
+                                  unpremultiply_sse42(srcG, srcA),
+                                  unpremultiply_sse42(srcR, srcA),
+                                  mul_sse42(srcA, opacity4), comp_op);
+
+        store_aligned_sse42(dstB, dstG, dstR, dstA, &dst[i]);
+    }
+}
+
+DP_FORCE_INLINE void blend_tile_composite_separable_with_opacity_sse42(
+    DP_Pixel15 *DP_RESTRICT dst, const DP_Pixel15 *DP_RESTRICT src,
+    uint16_t opacity, __m128i (*comp_op)(__m128i, __m128i, __m128i))
+{
+    __m128i opacity4 = _mm_set1_epi32(opacity);
+
+    for (int i = 0; i < DP_TILE_LENGTH; i += 4) {
+        __m128i srcB, srcG, srcR, srcA;
+        load_aligned_sse42(&src[i], &srcB, &srcG, &srcR, &srcA);
+
+        __m128i dstB, dstG, dstR, dstA;
+        load_aligned_sse42(&dst[i], &dstB, &dstG, &dstR, &dstA);
+
+        composite_separable_with_opacity_sse42(
+            &dstB, &dstG, &dstR, dstA, unpremultiply_sse42(srcB, srcA),
+            unpremultiply_sse42(srcG, srcA), unpremultiply_sse42(srcR, srcA),
+            mul_sse42(srcA, opacity4), comp_op);
+
+        store_aligned_sse42(dstB, dstG, dstR, dstA, &dst[i]);
+    }
+}
+
+DP_FORCE_INLINE void blend_mask_pixels_composite_separable_sse42(
+    DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask_int,
+    Fix15 opacity_int, int count, __m128i (*comp_op)(__m128i, __m128i))
+{
+    DP_ASSERT(count % 4 == 0);
+
+    __m128i srcB = _mm_set1_epi32(src.b);
+    __m128i srcG = _mm_set1_epi32(src.g);
+    __m128i srcR = _mm_set1_epi32(src.r);
+
+    __m128i opacity = _mm_set1_epi32((int)opacity_int);
+
+    for (int x = 0; x < count; x += 4, dst += 4, mask_int += 4) {
+        __m128i mask = _mm_cvtepu16_epi32(_mm_loadl_epi64((void *)mask_int));
+
+        __m128i dstB, dstG, dstR, dstA;
+        load_unaligned_sse42(dst, &dstB, &dstG, &dstR, &dstA);
+
+        composite_separable_sse42(&dstB, &dstG, &dstR, dstA, srcB, srcG, srcR,
+                                  mul_sse42(mask, opacity), comp_op);
+
+        store_unaligned_sse42(dstB, dstG, dstR, dstA, dst);
+    }
+}
+
+DP_FORCE_INLINE void blend_mask_pixels_composite_separable_with_opacity_sse42(
+    DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask_int,
+    Fix15 opacity_int, int count, __m128i (*comp_op)(__m128i, __m128i, __m128i))
+{
+    DP_ASSERT(count % 4 == 0);
+
+    __m128i srcB = _mm_set1_epi32(src.b);
+    __m128i srcG = _mm_set1_epi32(src.g);
+    __m128i srcR = _mm_set1_epi32(src.r);
+
+    __m128i opacity = _mm_set1_epi32((int)opacity_int);
+
+    for (int x = 0; x < count; x += 4, dst += 4, mask_int += 4) {
+        __m128i mask = _mm_cvtepu16_epi32(_mm_loadl_epi64((void *)mask_int));
+
+        __m128i dstB, dstG, dstR, dstA;
+        load_unaligned_sse42(dst, &dstB, &dstG, &dstR, &dstA);
+
+        composite_separable_with_opacity_sse42(&dstB, &dstG, &dstR, dstA, srcB,
+                                               srcG, srcR,
+                                               mul_sse42(mask, opacity),
+                                               comp_op);
+
+        store_unaligned_sse42(dstB, dstG, dstR, dstA, dst);
+    }
+}
+
+// Instantiates the tile and mask kernels for each separable blend mode, so
+// that the comp_op gets inlined into the loops instead of being called
+// through a function pointer.
+#define DEFINE_SEPARABLE_SSE42(NAME, KIND)                                    \
+    static void blend_tile_##NAME##_sse42(DP_Pixel15 *DP_RESTRICT dst,       \
+                                          const DP_Pixel15 *DP_RESTRICT src, \
+                                          uint16_t opacity)                  \
+    {                                                                        \
+        blend_tile_##KIND##_sse42(dst, src, opacity, comp_##NAME##_sse42);   \
+    }                                                                        \
+                                                                             \
+    static void blend_mask_pixels_##NAME##_sse42(                            \
+        DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask_int,          \
+        Fix15 opacity_int, int count)                                        \
+    {                                                                        \
+        blend_mask_pixels_##KIND##_sse42(dst, src, mask_int, opacity_int,    \
+                                         count, comp_##NAME##_sse42);        \
+    }
+
+DEFINE_SEPARABLE_SSE42(multiply, composite_separable)
+DEFINE_SEPARABLE_SSE42(divide, composite_separable)
+DEFINE_SEPARABLE_SSE42(burn, composite_separable)
+DEFINE_SEPARABLE_SSE42(dodge, composite_separable)
+DEFINE_SEPARABLE_SSE42(darken, composite_separable)
+DEFINE_SEPARABLE_SSE42(lighten, composite_separable)
+DEFINE_SEPARABLE_SSE42(subtract, composite_separable)
+DEFINE_SEPARABLE_SSE42(add, composite_separable)
+DEFINE_SEPARABLE_SSE42(screen, composite_separable)
+DEFINE_SEPARABLE_SSE42(overlay, composite_separable)
+DEFINE_SEPARABLE_SSE42(hard_light, composite_separable)
+DEFINE_SEPARABLE_SSE42(soft_light, composite_separable)
+DEFINE_SEPARABLE_SSE42(linear_burn, composite_separable)
+DEFINE_SEPARABLE_SSE42(linear_light, composite_separable)
+DEFINE_SEPARABLE_SSE42(luminosity_shine_sai,
+                       composite_separable_with_opacity)
 DP_TARGET_END
 
 DP_TARGET_BEGIN("avx2")
@@ -1290,6 +1616,335 @@ static void blend_mask_pixels_recolor_avx2(DP_Pixel15 *dst, DP_UPixel15 src,
     _mm256_zeroupper();
     // clang-format on
 }
+
+// See div_clamped_sse42.
+DP_FORCE_INLINE __m256i div_clamped_avx2(__m256i n, __m256i d)
+{
+    __m256 qf = _mm256_min_ps(
+        _mm256_div_ps(_mm256_cvtepi32_ps(n), _mm256_cvtepi32_ps(d)),
+        _mm256_set1_ps((float)(DP_BIT15 + 1)));
+    __m256i q = _mm256_cvttps_epi32(qf);
+    __m256i r = _mm256_sub_epi32(n, _mm256_mullo_epi32(q, d));
+    __m256i too_large = _mm256_cmpgt_epi32(_mm256_setzero_si256(), r);
+    __m256i too_small =
+        _mm256_cmpgt_epi32(r, _mm256_sub_epi32(d, _mm256_set1_epi32(1)));
+    return _mm256_sub_epi32(_mm256_add_epi32(q, too_large), too_small);
+}
+
+static __m256i sqrt_avx2(__m256i x)
+{
+    __m256i s = _mm256_slli_epi32(x, 15);
+    __m256i n = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(s)));
+    return _mm256_add_epi32(n,
+                            _mm256_cmpgt_epi32(_mm256_mullo_epi32(n, n), s));
+}
+
+static __m256i unpremultiply_avx2(__m256i c, __m256i a)
+{
+    return div_clamped_avx2(_mm256_slli_epi32(c, 15),
+                            _mm256_max_epi32(a, _mm256_set1_epi32(1)));
+}
+
+static __m256i premultiply_avx2(__m256i c, __m256i a)
+{
+    return mul_avx2(c, a);
+}
+
+static __m256i comp_multiply_avx2(__m256i a, __m256i b)
+{
+    return mul_avx2(a, b);
+}
+
+static __m256i comp_divide_avx2(__m256i a, __m256i b)
+{
+    __m256i n = _mm256_add_epi32(
+        _mm256_mullo_epi32(a, _mm256_set1_epi32(DP_BIT15 + 1)),
+        _mm256_srli_epi32(b, 1));
+    __m256i d = _mm256_add_epi32(b, _mm256_set1_epi32(1));
+    return _mm256_min_epi32(div_clamped_avx2(n, d),
+                            _mm256_set1_epi32(DP_BIT15));
+}
+
+static __m256i comp_burn_avx2(__m256i a, __m256i b)
+{
+    __m256i n = _mm256_mullo_epi32(
+        _mm256_sub_epi32(_mm256_set1_epi32(DP_BIT15), a),
+        _mm256_set1_epi32(DP_BIT15 + 1));
+    __m256i d = _mm256_add_epi32(b, _mm256_set1_epi32(1));
+    return _mm256_max_epi32(
+        _mm256_sub_epi32(_mm256_set1_epi32(DP_BIT15), div_clamped_avx2(n, d)),
+        _mm256_setzero_si256());
+}
+
+static __m256i comp_dodge_avx2(__m256i a, __m256i b)
+{
+    __m256i n = _mm256_mullo_epi32(a, _mm256_set1_epi32(DP_BIT15 + 1));
+    __m256i d = _mm256_sub_epi32(_mm256_set1_epi32(DP_BIT15 + 1), b);
+    return _mm256_min_epi32(div_clamped_avx2(n, d),
+                            _mm256_set1_epi32(DP_BIT15));
+}
+
+static __m256i comp_darken_avx2(__m256i a, __m256i b)
+{
+    return _mm256_min_epi32(a, b);
+}
+
+static __m256i comp_lighten_avx2(__m256i a, __m256i b)
+{
+    return _mm256_max_epi32(a, b);
+}
+
+static __m256i comp_subtract_avx2(__m256i a, __m256i b)
+{
+    return _mm256_max_epi32(_mm256_sub_epi32(a, b), _mm256_setzero_si256());
+}
+
+static __m256i comp_add_avx2(__m256i a, __m256i b)
+{
+    return _mm256_min_epi32(_mm256_add_epi32(a, b),
+                            _mm256_set1_epi32(DP_BIT15));
+}
+
+static __m256i comp_screen_avx2(__m256i a, __m256i b)
+{
+    __m256i bit15 = _mm256_set1_epi32(DP_BIT15);
+    return _mm256_sub_epi32(bit15, mul_avx2(_mm256_sub_epi32(bit15, a),
+                                            _mm256_sub_epi32(bit15, b)));
+}
+
+static __m256i comp_hard_light_avx2(__m256i a, __m256i b)
+{
+    __m256i bit15 = _mm256_set1_epi32(DP_BIT15);
+    __m256i b2 = _mm256_slli_epi32(b, 1);
+    return _mm256_blendv_epi8(comp_multiply_avx2(a, b2),
+                              comp_screen_avx2(a, _mm256_sub_epi32(b2, bit15)),
+                              _mm256_cmpgt_epi32(b2, bit15));
+}
+
+static __m256i comp_overlay_avx2(__m256i a, __m256i b)
+{
+    return comp_hard_light_avx2(b, a);
+}
+
+static __m256i comp_soft_light_avx2(__m256i a, __m256i b)
+{
+    __m256i bit15 = _mm256_set1_epi32(DP_BIT15);
+    __m256i b2 = _mm256_slli_epi32(b, 1);
+    __m256i a4 = _mm256_slli_epi32(a, 2);
+
+    __m256i dark = _mm256_sub_epi32(
+        a, mul_avx2(mul_avx2(_mm256_sub_epi32(bit15, b2), a),
+                    _mm256_sub_epi32(bit15, a)));
+
+    __m256i squared = mul_avx2(a, a);
+    __m256i d_low = _mm256_sub_epi32(
+        _mm256_add_epi32(a4, _mm256_slli_epi32(mul_avx2(squared, a), 4)),
+        _mm256_mullo_epi32(squared, _mm256_set1_epi32(12)));
+    __m256i d = _mm256_blendv_epi8(d_low, sqrt_avx2(a),
+                                   _mm256_cmpgt_epi32(a4, bit15));
+    __m256i light = _mm256_add_epi32(
+        a, mul_avx2(_mm256_sub_epi32(b2, bit15), _mm256_sub_epi32(d, a)));
+
+    return _mm256_blendv_epi8(dark, light, _mm256_cmpgt_epi32(b2, bit15));
+}
+
+static __m256i comp_linear_burn_avx2(__m256i a, __m256i b)
+{
+    return _mm256_max_epi32(
+        _mm256_sub_epi32(_mm256_add_epi32(a, b), _mm256_set1_epi32(DP_BIT15)),
+        _mm256_setzero_si256());
+}
+
+static __m256i comp_linear_light_avx2(__m256i a, __m256i b)
+{
+    __m256i c = _mm256_sub_epi32(_mm256_add_epi32(a, _mm256_slli_epi32(b, 1)),
+                                 _mm256_set1_epi32(DP_BIT15));
+    return _mm256_min_epi32(_mm256_max_epi32(c, _mm256_setzero_si256()),
+                            _mm256_set1_epi32(DP_BIT15));
+}
+
+static __m256i comp_luminosity_shine_sai_avx2(__m256i a, __m256i b,
+                                              __m256i o)
+{
+    return comp_add_avx2(a, mul_avx2(b, o));
+}
+
+// See composite_separable_sse42.
+DP_FORCE_INLINE void
+composite_separable_avx2(__m256i *dstB, __m256i *dstG, __m256i *dstR,
+                         __m256i dstA, __m256i srcB, __m256i srcG,
+                         __m256i srcR, __m256i o,
+                         __m256i (*comp_op)(__m256i, __m256i))
+{
+    __m256i cbB = unpremultiply_avx2(*dstB, dstA);
+    __m256i cbG = unpremultiply_avx2(*dstG, dstA);
+    __m256i cbR = unpremultiply_avx2(*dstR, dstA);
+    __m256i o1 = _mm256_sub_epi32(_mm256_set1_epi32(DP_BIT15), o);
+    __m256i keep = _mm256_cmpeq_epi32(dstA, _mm256_setzero_si256());
+    // clang-format off
+    *dstB = _mm256_blendv_epi8(premultiply_avx2(sumprods_avx2(o1, cbB, o, comp_op(cbB, srcB)), dstA), *dstB, keep);
+    *dstG = _mm256_blendv_epi8(premultiply_avx2(sumprods_avx2(o1, cbG, o, comp_op(cbG, srcG)), dstA), *dstG, keep);
+    *dstR = _mm256_blendv_epi8(premultiply_avx2(sumprods_avx2(o1, cbR, o, comp_op(cbR, srcR)), dstA), *dstR, keep);
+    // clang-format on
+}
+
+DP_FORCE_INLINE void composite_separable_with_opacity_avx2(
+    __m256i *dstB, __m256i *dstG, __m256i *dstR, __m256i dstA, __m256i srcB,
+    __m256i srcG, __m256i srcR, __m256i o,
+    __m256i (*comp_op)(__m256i, __m256i, __m256i))
+{
+    __m256i cbB = unpremultiply_avx2(*dstB, dstA);
+    __m256i cbG = unpremultiply_avx2(*dstG, dstA);
+    __m256i cbR = unpremultiply_avx2(*dstR, dstA);
+    __m256i keep = _mm256_cmpeq_epi32(dstA, _mm256_setzero_si256());
+    // clang-format off
+    *dstB = _mm256_blendv_epi8(premultiply_avx2(comp_op(cbB, srcB, o), dstA), *dstB, keep);
+    *dstG = _mm256_blendv_epi8(premultiply_avx2(comp_op(cbG, srcG, o), dstA), *dstG, keep);
+    *dstR = _mm256_blendv_epi8(premultiply_avx2(comp_op(cbR, srcR, o), dstA), *dstR, keep);
+    // clang-format on
+}
+
+DP_FORCE_INLINE void
+blend_tile_composite_separable_avx2(DP_Pixel15 *DP_RESTRICT dst,
+                                    const DP_Pixel15 *DP_RESTRICT src,
+                                    uint16_t opacity,
+                                    __m256i (*comp_op)(__m256i, __m256i))
+{
+    __m256i opacity8 = _mm256_set1_epi32(opacity);
+
+    for (int i = 0; i < DP_TILE_LENGTH; i += 8) {
+        __m256i srcB, srcG, srcR, srcA;
+        load_aligned_avx2(&src[i], &srcB, &srcG, &srcR, &srcA);
+
+        __m256i dstB, dstG, dstR, dstA;
+        load_aligned_avx2(&dst[i], &dstB, &dstG, &dstR, &dstA);
+
+        composite_separable_avx2(&dstB, &dstG, &dstR, dstA,
+                                 unpremultiply_avx2(srcB, srcA),
+                                 unpremultiply_avx2(srcG, srcA),
+                                 unpremultiply_avx2(srcR, srcA),
+                                 mul_avx2(srcA, opacity8), comp_op);
+
+        store_aligned_avx2(dstB, dstG, dstR, dstA, &dst[i]);
+    }
+    _mm256_zeroupper();
+}
+
+DP_FORCE_INLINE void blend_tile_composite_separable_with_opacity_avx2(
+    DP_Pixel15 *DP_RESTRICT dst, const DP_Pixel15 *DP_RESTRICT src,
+    uint16_t opacity, __m256i (*comp_op)(__m256i, __m256i, __m256i))
+{
+    __m256i opacity8 = _mm256_set1_epi32(opacity);
+
+    for (int i = 0; i < DP_TILE_LENGTH; i += 8) {
+        __m256i srcB, srcG, srcR, srcA;
+        load_aligned_avx2(&src[i], &srcB, &srcG, &srcR, &srcA);
+
+        __m256i dstB, dstG, dstR, dstA;
+        load_aligned_avx2(&dst[i], &dstB, &dstG, &dstR, &dstA);
+
+        composite_separable_with_opacity_avx2(
+            &dstB, &dstG, &dstR, dstA, unpremultiply_avx2(srcB, srcA),
+            unpremultiply_avx2(srcG, srcA), unpremultiply_avx2(srcR, srcA),
+            mul_avx2(srcA, opacity8), comp_op);
+
+        store_aligned_avx2(dstB, dstG, dstR, dstA, &dst[i]);
+    }
+    _mm256_zeroupper();
+}
+
+DP_FORCE_INLINE void blend_mask_pixels_composite_separable_avx2(
+    DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask_int,
+    Fix15 opacity_int, int count, __m256i (*comp_op)(__m256i, __m256i))
+{
+    DP_ASSERT(count % 8 == 0);
+
+    __m256i srcB = _mm256_set1_epi32(src.b);
+    __m256i srcG = _mm256_set1_epi32(src.g);
+    __m256i srcR = _mm256_set1_epi32(src.r);
+
+    __m256i opacity = _mm256_set1_epi32((int)opacity_int);
+
+    for (int x = 0; x < count; x += 8, dst += 8, mask_int += 8) {
+        __m256i mask = _mm256_cvtepu16_epi32(_mm_loadu_si128((void *)mask_int));
+        // Permute mask to fit pixel load order (15263748)
+        mask = _mm256_permutevar8x32_epi32(
+            mask, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+
+        __m256i dstB, dstG, dstR, dstA;
+        load_unaligned_avx2(dst, &dstB, &dstG, &dstR, &dstA);
+
+        composite_separable_avx2(&dstB, &dstG, &dstR, dstA, srcB, srcG, srcR,
+                                 mul_avx2(mask, opacity), comp_op);
+
+        store_unaligned_avx2(dstB, dstG, dstR, dstA, dst);
+    }
+    _mm256_zeroupper();
+}
+
+DP_FORCE_INLINE void blend_mask_pixels_composite_separable_with_opacity_avx2(
+    DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask_int,
+    Fix15 opacity_int, int count,
+    __m256i (*comp_op)(__m256i, __m256i, __m256i))
+{
+    DP_ASSERT(count % 8 == 0);
+
+    __m256i srcB = _mm256_set1_epi32(src.b);
+    __m256i srcG = _mm256_set1_epi32(src.g);
+    __m256i srcR = _mm256_set1_epi32(src.r);
+
+    __m256i opacity = _mm256_set1_epi32((int)opacity_int);
+
+    for (int x = 0; x < count; x += 8, dst += 8, mask_int += 8) {
+        __m256i mask = _mm256_cvtepu16_epi32(_mm_loadu_si128((void *)mask_int));
+        // Permute mask to fit pixel load order (15263748)
+        mask = _mm256_permutevar8x32_epi32(
+            mask, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+
+        __m256i dstB, dstG, dstR, dstA;
+        load_unaligned_avx2(dst, &dstB, &dstG, &dstR, &dstA);
+
+        composite_separable_with_opacity_avx2(&dstB, &dstG, &dstR, dstA, srcB,
+                                              srcG, srcR,
+                                              mul_avx2(mask, opacity), comp_op);
+
+        store_unaligned_avx2(dstB, dstG, dstR, dstA, dst);
+    }
+    _mm256_zeroupper();
+}
+
+#define DEFINE_SEPARABLE_AVX2(NAME, KIND)                                    \
+    static void blend_tile_##NAME##_avx2(DP_Pixel15 *DP_RESTRICT dst,        \
+                                         const DP_Pixel15 *DP_RESTRICT src,  \
+                                         uint16_t opacity)                   \
+    {                                                                        \
+        blend_tile_##KIND##_avx2(dst, src, opacity, comp_##NAME##_avx2);     \
+    }                                                                        \
+                                                                             \
+    static void blend_mask_pixels_##NAME##_avx2(                             \
+        DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask_int,          \
+        Fix15 opacity_int, int count)                                        \
+    {                                                                        \
+        blend_mask_pixels_##KIND##_avx2(dst, src, mask_int, opacity_int,     \
+                                        count, comp_##NAME##_avx2);          \
+    }
+
+DEFINE_SEPARABLE_AVX2(multiply, composite_separable)
+DEFINE_SEPARABLE_AVX2(divide, composite_separable)
+DEFINE_SEPARABLE_AVX2(burn, composite_separable)
+DEFINE_SEPARABLE_AVX2(dodge, composite_separable)
+DEFINE_SEPARABLE_AVX2(darken, composite_separable)
+DEFINE_SEPARABLE_AVX2(lighten, composite_separable)
+DEFINE_SEPARABLE_AVX2(subtract, composite_separable)
+DEFINE_SEPARABLE_AVX2(add, composite_separable)
+DEFINE_SEPARABLE_AVX2(screen, composite_separable)
+DEFINE_SEPARABLE_AVX2(overlay, composite_separable)
+DEFINE_SEPARABLE_AVX2(hard_light, composite_separable)
+DEFINE_SEPARABLE_AVX2(soft_light, composite_separable)
+DEFINE_SEPARABLE_AVX2(linear_burn, composite_separable)
+DEFINE_SEPARABLE_AVX2(linear_light, composite_separable)
+DEFINE_SEPARABLE_AVX2(luminosity_shine_sai,
+                      composite_separable_with_opacity)
 DP_TARGET_END
 #endif
 
@@ -1614,16 +2269,14 @@ static void blend_mask_color_erase(DP_Pixel15 *dst, DP_UPixel15 src,
     });
 }
 
-static void blend_mask_composite_separable(DP_Pixel15 *dst, DP_UPixel15 src,
-                                           const uint16_t *mask, Fix15 opacity,
-                                           int w, int h, int mask_skip,
-                                           int base_skip,
-                                           Fix15 (*comp_op)(Fix15, Fix15))
+static void blend_mask_pixels_composite_separable(
+    DP_Pixel15 *dst, BGR15 cs, const uint16_t *mask, Fix15 opacity, int count,
+    Fix15 (*comp_op)(Fix15, Fix15))
 {
-    BGR15 cs = to_ubgr(src);
-    FOR_MASK_PIXEL(dst, mask, opacity, w, h, mask_skip, base_skip, x, y, o, {
+    for (int x = 0; x < count; ++x, ++dst, ++mask) {
         DP_Pixel15 bp = *dst;
         if (bp.a != 0) {
+            Fix15 o = fix15_mul(*mask, opacity);
             BGR15 cb = to_ubgr(DP_pixel15_unpremultiply(bp));
             Fix15 o1 = BIT15_FIX - o;
             *dst = DP_pixel15_premultiply((DP_UPixel15){
@@ -1633,18 +2286,17 @@ static void blend_mask_composite_separable(DP_Pixel15 *dst, DP_UPixel15 src,
                 bp.a,
             });
         }
-    });
+    }
 }
 
-static void blend_mask_composite_separable_with_opacity(
-    DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask, Fix15 opacity,
-    int w, int h, int mask_skip, int base_skip,
+static void blend_mask_pixels_composite_separable_with_opacity(
+    DP_Pixel15 *dst, BGR15 cs, const uint16_t *mask, Fix15 opacity, int count,
     Fix15 (*comp_op)(Fix15, Fix15, Fix15))
 {
-    BGR15 cs = to_ubgr(src);
-    FOR_MASK_PIXEL(dst, mask, opacity, w, h, mask_skip, base_skip, x, y, o, {
+    for (int x = 0; x < count; ++x, ++dst, ++mask) {
         DP_Pixel15 bp = *dst;
         if (bp.a != 0) {
+            Fix15 o = fix15_mul(*mask, opacity);
             BGR15 cb = to_ubgr(DP_pixel15_unpremultiply(bp));
             *dst = DP_pixel15_premultiply((DP_UPixel15){
                 from_fix(comp_op(cb.b, cs.b, o)),
@@ -1653,7 +2305,125 @@ static void blend_mask_composite_separable_with_opacity(
                 bp.a,
             });
         }
-    });
+    }
+}
+
+typedef void (*BlendMaskPixelsFn)(DP_Pixel15 *, DP_UPixel15, const uint16_t *,
+                                  Fix15, int);
+
+// The vectorized kernels for separable blend modes, see DEFINE_SEPARABLE_SSE42
+// and DEFINE_SEPARABLE_AVX2. On other architectures there are none.
+#ifdef DP_CPU_X64
+#    define SEPARABLE_MASK_OPS(NAME)                  \
+        comp_##NAME, blend_mask_pixels_##NAME##_avx2, \
+            blend_mask_pixels_##NAME##_sse42
+#else
+#    define SEPARABLE_MASK_OPS(NAME) comp_##NAME, NULL, NULL
+#endif
+
+static void blend_mask_composite_separable(
+    DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask, Fix15 opacity,
+    int w, int h, int mask_skip, int base_skip, Fix15 (*comp_op)(Fix15, Fix15),
+    DP_UNUSED BlendMaskPixelsFn pixels_avx2,
+    DP_UNUSED BlendMaskPixelsFn pixels_sse42)
+{
+    BGR15 cs = to_ubgr(src);
+#ifdef DP_CPU_X64
+    for (int y = 0; y < h; ++y) {
+        int remaining = w;
+
+        if (DP_cpu_support >= DP_CPU_SUPPORT_AVX2) {
+            int remaining_after_avx_width = remaining % 8;
+            int avx_width = remaining - remaining_after_avx_width;
+
+            pixels_avx2(dst, src, mask, opacity, avx_width);
+
+            remaining -= avx_width;
+            dst += avx_width;
+            mask += avx_width;
+        }
+
+        if (DP_cpu_support >= DP_CPU_SUPPORT_SSE42) {
+            int remaining_after_sse_width = remaining % 4;
+            int sse_width = remaining - remaining_after_sse_width;
+
+            pixels_sse42(dst, src, mask, opacity, sse_width);
+
+            remaining -= sse_width;
+            dst += sse_width;
+            mask += sse_width;
+        }
+
+        blend_mask_pixels_composite_separable(dst, cs, mask, opacity,
+                                              remaining, comp_op);
+        dst += remaining;
+        mask += remaining;
+
+        dst += base_skip;
+        mask += mask_skip;
+    }
+#else
+    for (int y = 0; y < h; ++y) {
+        blend_mask_pixels_composite_separable(dst, cs, mask, opacity, w,
+                                              comp_op);
+
+        dst += w + base_skip;
+        mask += w + mask_skip;
+    }
+#endif
+}
+
+static void blend_mask_composite_separable_with_opacity(
+    DP_Pixel15 *dst, DP_UPixel15 src, const uint16_t *mask, Fix15 opacity,
+    int w, int h, int mask_skip, int base_skip,
+    Fix15 (*comp_op)(Fix15, Fix15, Fix15),
+    DP_UNUSED BlendMaskPixelsFn pixels_avx2,
+    DP_UNUSED BlendMaskPixelsFn pixels_sse42)
+{
+    BGR15 cs = to_ubgr(src);
+#ifdef DP_CPU_X64
+    for (int y = 0; y < h; ++y) {
+        int remaining = w;
+
+        if (DP_cpu_support >= DP_CPU_SUPPORT_AVX2) {
+            int remaining_after_avx_width = remaining % 8;
+            int avx_width = remaining - remaining_after_avx_width;
+
+            pixels_avx2(dst, src, mask, opacity, avx_width);
+
+            remaining -= avx_width;
+            dst += avx_width;
+            mask += avx_width;
+        }
+
+        if (DP_cpu_support >= DP_CPU_SUPPORT_SSE42) {
+            int remaining_after_sse_width = remaining % 4;
+            int sse_width = remaining - remaining_after_sse_width;
+
+            pixels_sse42(dst, src, mask, opacity, sse_width);
+
+            remaining -= sse_width;
+            dst += sse_width;
+            mask += sse_width;
+        }
+
+        blend_mask_pixels_composite_separable_with_opacity(
+            dst, cs, mask, opacity, remaining, comp_op);
+        dst += remaining;
+        mask += remaining;
+
+        dst += base_skip;
+        mask += mask_skip;
+    }
+#else
+    for (int y = 0; y < h; ++y) {
+        blend_mask_pixels_composite_separable_with_opacity(dst, cs, mask,
+                                                           opacity, w, comp_op);
+
+        dst += w + base_skip;
+        mask += w + mask_skip;
+    }
+#endif
 }
 
 static void blend_mask_composite_nonseparable(DP_Pixel15 *dst, DP_UPixel15 src,
@@ -1954,35 +2724,35 @@ void DP_blend_mask(DP_Pixel15 *dst, DP_UPixel15 src, int blend_mode,
     // Alpha-preserving separable blend modes (each channel handled separately)
     case DP_BLEND_MODE_MULTIPLY:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_multiply);
+                                       base_skip, SEPARABLE_MASK_OPS(multiply));
         break;
     case DP_BLEND_MODE_DIVIDE:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_divide);
+                                       base_skip, SEPARABLE_MASK_OPS(divide));
         break;
     case DP_BLEND_MODE_BURN:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_burn);
+                                       base_skip, SEPARABLE_MASK_OPS(burn));
         break;
     case DP_BLEND_MODE_DODGE:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_dodge);
+                                       base_skip, SEPARABLE_MASK_OPS(dodge));
         break;
     case DP_BLEND_MODE_DARKEN:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_darken);
+                                       base_skip, SEPARABLE_MASK_OPS(darken));
         break;
     case DP_BLEND_MODE_LIGHTEN:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_lighten);
+                                       base_skip, SEPARABLE_MASK_OPS(lighten));
         break;
     case DP_BLEND_MODE_SUBTRACT:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_subtract);
+                                       base_skip, SEPARABLE_MASK_OPS(subtract));
         break;
     case DP_BLEND_MODE_ADD:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_add);
+                                       base_skip, SEPARABLE_MASK_OPS(add));
         break;
     case DP_BLEND_MODE_RECOLOR:
         blend_mask_recolor(dst, src, mask, to_fix(opacity), w, h, mask_skip,
@@ -1990,33 +2760,37 @@ void DP_blend_mask(DP_Pixel15 *dst, DP_UPixel15 src, int blend_mode,
         break;
     case DP_BLEND_MODE_SCREEN:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_screen);
+                                       base_skip, SEPARABLE_MASK_OPS(screen));
         break;
     case DP_BLEND_MODE_OVERLAY:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_overlay);
+                                       base_skip, SEPARABLE_MASK_OPS(overlay));
         break;
     case DP_BLEND_MODE_HARD_LIGHT:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_hard_light);
+                                       base_skip,
+                                       SEPARABLE_MASK_OPS(hard_light));
         break;
     case DP_BLEND_MODE_SOFT_LIGHT:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_soft_light);
+                                       base_skip,
+                                       SEPARABLE_MASK_OPS(soft_light));
         break;
     case DP_BLEND_MODE_LINEAR_BURN:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_linear_burn);
+                                       base_skip,
+                                       SEPARABLE_MASK_OPS(linear_burn));
         break;
     case DP_BLEND_MODE_LINEAR_LIGHT:
         blend_mask_composite_separable(dst, src, mask, opacity, w, h, mask_skip,
-                                       base_skip, comp_linear_light);
+                                       base_skip,
+                                       SEPARABLE_MASK_OPS(linear_light));
         break;
     // Alpha-preserving separable blend modes where the opacity affects blending
     case DP_BLEND_MODE_LUMINOSITY_SHINE_SAI:
-        blend_mask_composite_separable_with_opacity(dst, src, mask, opacity, w,
-                                                    h, mask_skip, base_skip,
-                                                    comp_luminosity_shine_sai);
+        blend_mask_composite_separable_with_opacity(
+            dst, src, mask, opacity, w, h, mask_skip, base_skip,
+            SEPARABLE_MASK_OPS(luminosity_shine_sai));
         break;
     // Alpha-preserving non-separable blend modes (channels interact)
     case DP_BLEND_MODE_HUE:
@@ -2255,6 +3029,20 @@ void DP_blend_pixels(DP_Pixel15 *DP_RESTRICT dst,
     }
 }
 
+#ifdef DP_CPU_X64
+#    define BLEND_TILE_SEPARABLE_CASE(MODE, NAME)                             \
+        case MODE:                                                            \
+            if (DP_cpu_support >= DP_CPU_SUPPORT_AVX2) {                      \
+                blend_tile_##NAME##_avx2(aligned_dst, aligned_src, opacity);  \
+                return;                                                       \
+            }                                                                 \
+            else if (DP_cpu_support >= DP_CPU_SUPPORT_SSE42) {                \
+                blend_tile_##NAME##_sse42(aligned_dst, aligned_src, opacity); \
+                return;                                                       \
+            }                                                                 \
+            break;
+#endif
+
 void DP_blend_tile(DP_Pixel15 *DP_RESTRICT dst,
                    const DP_Pixel15 *DP_RESTRICT src, uint16_t opacity,
                    int blend_mode)
@@ -2288,6 +3076,24 @@ void DP_blend_tile(DP_Pixel15 *DP_RESTRICT dst,
             break;
         }
         break;
+    // Alpha-preserving separable blend modes (each channel handled separately)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_MULTIPLY, multiply)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_DIVIDE, divide)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_BURN, burn)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_DODGE, dodge)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_DARKEN, darken)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_LIGHTEN, lighten)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_SUBTRACT, subtract)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_ADD, add)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_SCREEN, screen)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_OVERLAY, overlay)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_HARD_LIGHT, hard_light)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_SOFT_LIGHT, soft_light)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_LINEAR_BURN, linear_burn)
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_LINEAR_LIGHT, linear_light)
+    // Alpha-preserving separable blend modes where the opacity affects blending
+    BLEND_TILE_SEPARABLE_CASE(DP_BLEND_MODE_LUMINOSITY_SHINE_SAI,
+                              luminosity_shine_sai)
     default:
         break;
     }
@@ -2296,6 +3102,35 @@ void DP_blend_tile(DP_Pixel15 *DP_RESTRICT dst,
                     blend_mode);
 }
 
+static void fill_pixels15(DP_Pixel15 *dst, DP_Pixel15 pixel, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        dst[i] = pixel;
+    }
+}
+
+void DP_blend_tile_solid(DP_Pixel15 *dst, DP_Pixel15 src, uint16_t opacity,
+                         int blend_mode)
+{
+    bool normal = blend_mode == DP_BLEND_MODE_NORMAL;
+    if (normal && (opacity == 0 || DP_pixel15_equal(src, DP_pixel15_zero()))) {
+        return; // Nothing to blend.
+    }
+
+    bool replace =
+        opacity == DP_BIT15
+        && (blend_mode == DP_BLEND_MODE_REPLACE
+            || (normal && src.a == DP_BIT15));
+    if (replace) {
+        fill_pixels15(dst, src, DP_TILE_LENGTH);
+    }
+    else {
+        DP_ALIGNAS_SIMD DP_Pixel15 src_pixels[DP_TILE_LENGTH];
+        fill_pixels15(src_pixels, src, DP_TILE_LENGTH);
+        DP_blend_tile(dst, src_pixels, opacity, blend_mode);
+    }
+}
+
 
 // Posterization adapted from libmypaint, see license above.
 
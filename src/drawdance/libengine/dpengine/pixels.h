@@ -172,6 +172,10 @@ void DP_blend_tile(DP_Pixel15 *DP_RESTRICT dst,
                    const DP_Pixel15 *DP_RESTRICT src, uint16_t opacity,
                    int blend_mode);
 
+// Same as DP_blend_tile with a tile where every pixel is the given one.
+void DP_blend_tile_solid(DP_Pixel15 *dst, DP_Pixel15 src, uint16_t opacity,
+                         int blend_mode);
+
 
 void DP_posterize_mask(DP_Pixel15 *dst, int posterize_num, const uint16_t *mask,
                        uint16_t opacity, int w, int h, int mask_skip,
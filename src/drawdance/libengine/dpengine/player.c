@@ -34,6 +34,7 @@
 #include <dpmsg/acl.h>
 #include <dpmsg/binary_reader.h>
 #include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
 #include <dpmsg/protover.h>
 #include <dpmsg/text_reader.h>
 #include <ctype.h>
@@ -53,6 +54,7 @@ struct DP_Player {
     DP_PlayerType type;
     DP_PlayerReader reader;
     DP_AclState *acls;
+    DP_MessageArena *arena;
     JSON_Value *text_reader_header_value;
     long long position;
     DP_ProtocolVersion *protover;
@@ -154,6 +156,7 @@ static DP_Player *make_player(DP_PlayerType type, char *recording_path,
                           type,
                           reader,
                           DP_acl_state_new_playback(),
+                          DP_message_arena_new(),
                           header_value,
                           0,
                           protover,
@@ -238,6 +241,7 @@ static DP_Player *new_debug_dump_player(DP_Input *input)
                           {.dump = DP_dump_reader_new(input)},
                           NULL,
                           NULL,
+                          NULL,
                           0,
                           NULL,
                           false,
@@ -305,6 +309,7 @@ void DP_player_free(DP_Player *player)
     if (player) {
         player_index_dispose(&player->index);
         DP_acl_state_free(player->acls);
+        DP_message_arena_free(player->arena);
         switch (player->type) {
         case DP_PLAYER_TYPE_BINARY:
             DP_binary_reader_free(player->reader.binary);
@@ -596,7 +601,12 @@ DP_PlayerResult DP_player_step(DP_Player *player, DP_Message **out_msg)
         return DP_PLAYER_RECORDING_END;
     }
     else {
-        return step_valid_message(player, out_msg);
+        // Recorded messages get created and dropped again in bulk, so they're
+        // allocated from the player's arena rather than one by one.
+        DP_MessageArena *prev_arena = DP_message_arena_use(player->arena);
+        DP_PlayerResult result = step_valid_message(player, out_msg);
+        DP_message_arena_use(prev_arena);
+        return result;
     }
 }
 
@@ -2,17 +2,25 @@
 #include "canvas_diff.h"
 #include "canvas_state.h"
 #include "layer_content.h"
+#include "layer_list.h"
+#include "layer_props.h"
+#include "layer_props_list.h"
+#include "layer_routes.h"
 #include "local_state.h"
 #include "pixels.h"
 #include "tile.h"
 #include "view_mode.h"
+#include <dpcommon/atomic.h>
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
 #include <dpcommon/geom.h>
+#include <dpcommon/perf.h>
 #include <dpcommon/queue.h>
 #include <dpcommon/threading.h>
 #include <dpmsg/blend_mode.h>
 
+#define DP_PERF_CONTEXT "renderer"
+
 #define TILE_QUEUE_INITIAL_CAPACITY 1024
 
 #define TILE_QUEUED_NONE 0
@@ -25,6 +33,17 @@
 #define CHANGE_LOCAL_STATE (1u << 2u)
 #define CHANGE_UNLOCK      (1u << 3u)
 
+// Documents with fewer top-level layers than this are cheap enough to
+// composite from scratch, caching wouldn't gain anything.
+#define CACHE_MIN_LAYERS 4
+// Upper limit of tiles with cached composites. At most two full tiles of 64
+// by 64 pixels are kept per tile, so this comes out to 64 MiB at worst.
+#define CACHE_MAX_TILES 1024
+// Tiles at reduced levels of detail are built up from multiple canvas tiles,
+// which may be rendered by different threads. Each tile is guarded by one of
+// these mutexes, picked by its index.
+#define LOD_MUTEX_COUNT 16
+
 typedef struct DP_RenderContext {
     DP_ALIGNAS_SIMD DP_Pixel8 pixels[DP_TILE_LENGTH];
     DP_TransientTile *tt;
@@ -50,17 +69,40 @@ typedef struct DP_RendererTileCoords {
     int tile_x, tile_y;
 } DP_RendererTileCoords;
 
+typedef struct DP_RendererCacheKey {
+    // Top-level index of the layer or group containing the active layer, -1
+    // if composites aren't being cached.
+    int index;
+    // Whether the layers above are all blended normally, so their composite
+    // can be cached and merged in one go.
+    bool above;
+    uint64_t generation;
+} DP_RendererCacheKey;
+
+typedef struct DP_RendererCacheEntry {
+    DP_Tile *below;
+    DP_Tile *above;
+    // Last generation in which the layers around the active one changed here.
+    uint64_t invalidated;
+} DP_RendererCacheEntry;
+
 typedef struct DP_RendererTileJob {
     int tile_x, tile_y;
     int tile_index;
+    int lod;
+    // Canvas tiles within a reduced level of detail tile that need to be
+    // rendered, bit (y << lod | x) is set for each of them.
+    uint64_t dirty;
     DP_CanvasState *cs;
     bool needs_checkers;
+    DP_RendererCacheKey cache;
 } DP_RendererTileJob;
 
 typedef struct DP_RendererResize {
     int width, height;
     int prev_width, prev_height;
     int offset_x, offset_y;
+    int lod;
 } DP_RendererResize;
 
 typedef struct DP_RendererChecker {
@@ -97,14 +139,43 @@ struct DP_Renderer {
         DP_Queue queue_low;
         size_t map_capacity;
         char *map;
+        uint64_t *dirty;
     } tile;
     DP_Pixel8 checker_color1;
     DP_Pixel8 checker_color2;
     DP_TransientTile *checker;
     DP_CanvasState *cs;
     bool checkers_visible;
+    int lod;
     int xtiles;
+    int ytiles;
     DP_RendererLocalState local_state;
+    // Downsampled tiles of the current level of detail. Only touched by tile
+    // jobs while holding the respective mutex and by blocking jobs.
+    struct {
+        DP_Pixel8 *pixels;
+        DP_Mutex *mutexes[LOD_MUTEX_COUNT];
+    } lod_tiles;
+    // Composites of everything below and above the active layer for each
+    // tile, so that drawing on it only needs to blend that layer in between.
+    // Entries are invalidated through the canvas diff when anything but the
+    // active layer changes. The generation is bumped on every invalidation,
+    // composites from jobs that started before are stale and get discarded.
+    struct {
+        DP_Mutex *mutex;
+        DP_RendererCacheEntry *entries;
+        int count;
+        int used;
+        int layer_id;
+        uint64_t generation;
+        uint64_t valid_since;
+        DP_RendererCacheKey key;
+    } cache;
+    // Only ever incremented by tile jobs, read by DP_renderer_stats.
+    struct {
+        DP_Atomic tiles_rendered;
+        DP_Atomic tile_latency[DP_RENDERER_LATENCY_BUCKETS];
+    } stats;
     DP_Mutex *queue_mutex;
     DP_Semaphore *queue_sem;
     DP_Semaphore *wait_ready_sem;
@@ -114,11 +185,8 @@ struct DP_Renderer {
 };
 
 
-static void handle_tile_job(DP_Renderer *renderer, DP_RenderContext *rc,
-                            DP_RendererTileJob *job)
+static void copy_background_tile(DP_TransientTile *tt, DP_CanvasState *cs)
 {
-    DP_TransientTile *tt = rc->tt;
-    DP_CanvasState *cs = job->cs;
     DP_Tile *background_tile = DP_canvas_state_background_tile_noinc(cs);
     if (background_tile) {
         DP_transient_tile_copy(tt, background_tile);
@@ -126,24 +194,263 @@ static void handle_tile_job(DP_Renderer *renderer, DP_RenderContext *rc,
     else {
         DP_transient_tile_clear(tt);
     }
+}
+
+// Flattens the given range of top-level layers, same as normal view mode.
+static void flatten_layer_range(DP_CanvasState *cs, int tile_index,
+                                DP_TransientTile *tt, int start, int end)
+{
+    DP_LayerList *ll = DP_canvas_state_layers_noinc(cs);
+    DP_LayerPropsList *lpl = DP_canvas_state_layer_props_noinc(cs);
+    DP_ViewModeContext vmc = DP_view_mode_context_make_default();
+    for (int i = start; i < end; ++i) {
+        DP_layer_list_entry_flatten_tile_to(
+            DP_layer_list_at_noinc(ll, i), DP_layer_props_list_at_noinc(lpl, i),
+            tile_index, tt, DP_BIT15, true, false, &vmc);
+    }
+}
+
+static bool cache_usable(DP_Renderer *renderer, DP_RendererCacheEntry *entry,
+                         uint64_t generation)
+{
+    return generation >= renderer->cache.valid_since
+        && generation >= entry->invalidated;
+}
+
+static void cache_lookup(DP_Renderer *renderer, int tile_index,
+                         const DP_RendererCacheKey *key, DP_Tile **out_below,
+                         DP_Tile **out_above)
+{
+    DP_Mutex *mutex = renderer->cache.mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    if (tile_index < renderer->cache.count) {
+        DP_RendererCacheEntry *entry = &renderer->cache.entries[tile_index];
+        if (cache_usable(renderer, entry, key->generation)) {
+            *out_below = DP_tile_incref_nullable(entry->below);
+            *out_above = DP_tile_incref_nullable(entry->above);
+        }
+    }
+    DP_MUTEX_MUST_UNLOCK(mutex);
+}
 
-    DP_ViewModeFilter vmf = DP_view_mode_filter_make_from_active(
-        &rc->vmb, renderer->local_state.view_mode, cs,
-        renderer->local_state.active, renderer->local_state.oss);
+static void cache_store(DP_Renderer *renderer, int tile_index,
+                        const DP_RendererCacheKey *key, DP_Tile *below,
+                        DP_Tile *above_or_null)
+{
+    DP_Mutex *mutex = renderer->cache.mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+    // If anything changed since this job started, the composites are stale.
+    if (tile_index < renderer->cache.count) {
+        DP_RendererCacheEntry *entry = &renderer->cache.entries[tile_index];
+        if (cache_usable(renderer, entry, key->generation)) {
+            bool was_empty = !entry->below && !entry->above;
+            if (!was_empty || renderer->cache.used < CACHE_MAX_TILES) {
+                if (!entry->below) {
+                    entry->below = DP_tile_incref(below);
+                }
+                if (!entry->above && above_or_null) {
+                    entry->above = DP_tile_incref(above_or_null);
+                }
+                if (was_empty) {
+                    ++renderer->cache.used;
+                }
+            }
+        }
+    }
+    DP_MUTEX_MUST_UNLOCK(mutex);
+}
 
-    DP_canvas_state_flatten_tile_to(cs, job->tile_index, tt, true, &vmf);
+static void flatten_tile_cached(DP_Renderer *renderer, DP_TransientTile *tt,
+                                DP_RendererTileJob *job, int tile_index)
+{
+    DP_CanvasState *cs = job->cs;
+    const DP_RendererCacheKey *key = &job->cache;
+    int index = key->index;
+    int count = DP_layer_list_count(DP_canvas_state_layers_noinc(cs));
+
+    DP_Tile *below = NULL;
+    DP_Tile *above = NULL;
+    cache_lookup(renderer, tile_index, key, &below, &above);
+    bool store = false;
+
+    if (below) {
+        DP_transient_tile_copy(tt, below);
+    }
+    else {
+        copy_background_tile(tt, cs);
+        flatten_layer_range(cs, tile_index, tt, 0, index);
+        below = DP_transient_tile_persist_compact(
+            DP_transient_tile_new((DP_Tile *)tt, 0));
+        store = true;
+    }
+
+    flatten_layer_range(cs, tile_index, tt, index, index + 1);
+
+    if (key->above) {
+        if (!above) {
+            DP_TransientTile *above_tt = DP_transient_tile_new_blank(0);
+            flatten_layer_range(cs, tile_index, above_tt, index + 1, count);
+            above = DP_transient_tile_persist_compact(above_tt);
+            store = true;
+        }
+        // Normal blending is associative, so the layers above can be merged
+        // as a single tile. Nothing to do if they're all empty here.
+        if (!DP_tile_solid(above) || !DP_tile_blank(above)) {
+            DP_transient_tile_merge(tt, above, DP_BIT15, DP_BLEND_MODE_NORMAL);
+        }
+    }
+    else {
+        flatten_layer_range(cs, tile_index, tt, index + 1, count);
+    }
+
+    if (store) {
+        cache_store(renderer, tile_index, key, below, above);
+    }
+    DP_tile_decref(below);
+    DP_tile_decref_nullable(above);
+}
+
+static void flatten_tile(DP_Renderer *renderer, DP_RenderContext *rc,
+                         DP_RendererTileJob *job, int tile_index)
+{
+    DP_TransientTile *tt = rc->tt;
+    DP_CanvasState *cs = job->cs;
+    if (job->cache.index >= 0) {
+        flatten_tile_cached(renderer, tt, job, tile_index);
+    }
+    else {
+        copy_background_tile(tt, cs);
+        DP_ViewModeFilter vmf = DP_view_mode_filter_make_from_active(
+            &rc->vmb, renderer->local_state.view_mode, cs,
+            renderer->local_state.active, renderer->local_state.oss);
+        DP_canvas_state_flatten_tile_to(cs, tile_index, tt, true, &vmf);
+    }
 
     if (job->needs_checkers) {
         DP_transient_tile_merge(tt, (DP_Tile *)renderer->checker, DP_BIT15,
                                 DP_BLEND_MODE_BEHIND);
     }
+}
+
+// Box-filters a flattened canvas tile down into its part of a reduced level of
+// detail tile. Averaging happens on the premultiplied 15 bit pixels, so this
+// comes out the same as downsampling the full resolution image would.
+static void downsample_tile(DP_Pixel8 *DP_RESTRICT dst,
+                            const DP_Pixel15 *DP_RESTRICT src, int lod,
+                            int sub_x, int sub_y)
+{
+    int n = 1 << lod;
+    int size = DP_TILE_SIZE >> lod;
+    int shift = lod * 2;
+    uint32_t half = (1u << shift) >> 1u;
+    DP_Pixel8 *dst_start = dst + sub_y * size * DP_TILE_SIZE + sub_x * size;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            uint32_t b = 0, g = 0, r = 0, a = 0;
+            for (int sy = 0; sy < n; ++sy) {
+                const DP_Pixel15 *row =
+                    src + (y * n + sy) * DP_TILE_SIZE + x * n;
+                for (int sx = 0; sx < n; ++sx) {
+                    b += row[sx].b;
+                    g += row[sx].g;
+                    r += row[sx].r;
+                    a += row[sx].a;
+                }
+            }
+            dst_start[y * DP_TILE_SIZE + x] = DP_pixel15_to_8((DP_Pixel15){
+                .b = DP_uint32_to_uint16((b + half) >> shift),
+                .g = DP_uint32_to_uint16((g + half) >> shift),
+                .r = DP_uint32_to_uint16((r + half) >> shift),
+                .a = DP_uint32_to_uint16((a + half) >> shift),
+            });
+        }
+    }
+}
+
+static void handle_tile_job_lod(DP_Renderer *renderer, DP_RenderContext *rc,
+                                DP_RendererTileJob *job)
+{
+    int lod = job->lod;
+    int n = 1 << lod;
+    DP_CanvasState *cs = job->cs;
+    int xtiles = DP_tile_count_round(DP_canvas_state_width(cs));
+    int ytiles = DP_tile_count_round(DP_canvas_state_height(cs));
+    int tile_index = job->tile_index;
+    DP_Pixel8 *pixels = renderer->lod_tiles.pixels
+                      + DP_int_to_size(tile_index) * DP_TILE_LENGTH;
+
+    DP_Mutex *mutex = renderer->lod_tiles.mutexes[tile_index % LOD_MUTEX_COUNT];
+    DP_MUTEX_MUST_LOCK(mutex);
+    uint64_t dirty = job->dirty;
+    for (int sub_y = 0; sub_y < n; ++sub_y) {
+        int tile_y = job->tile_y * n + sub_y;
+        for (int sub_x = 0; sub_x < n; ++sub_x) {
+            int tile_x = job->tile_x * n + sub_x;
+            uint64_t bit = (uint64_t)1 << (unsigned int)(sub_y << lod | sub_x);
+            if ((dirty & bit) && tile_x < xtiles && tile_y < ytiles) {
+                flatten_tile(renderer, rc, job, tile_y * xtiles + tile_x);
+                downsample_tile(pixels, DP_transient_tile_pixels(rc->tt), lod,
+                                sub_x, sub_y);
+            }
+        }
+    }
+    renderer->fn.tile(renderer->fn.user, job->tile_x, job->tile_y, pixels);
+    DP_MUTEX_MUST_UNLOCK(mutex);
+}
+
+static int latency_bucket(unsigned long long ns)
+{
+    unsigned long long us = ns / 1000ull;
+    int bucket = 0;
+    while (us != 0 && bucket < DP_RENDERER_LATENCY_BUCKETS - 1) {
+        us >>= 1ull;
+        ++bucket;
+    }
+    return bucket;
+}
+
+static void handle_tile_job(DP_Renderer *renderer, DP_RenderContext *rc,
+                            DP_RendererTileJob *job)
+{
+    DP_PERF_BEGIN_DETAIL(fn, "tile", "lod=%d", job->lod);
+    unsigned long long start = DP_perf_time();
+    if (job->lod == 0) {
+        flatten_tile(renderer, rc, job, job->tile_index);
+        DP_Pixel8 *pixel_buffer = rc->pixels;
+        DP_pixels15_to_8_tile(pixel_buffer, DP_transient_tile_pixels(rc->tt));
+        renderer->fn.tile(renderer->fn.user, job->tile_x, job->tile_y,
+                          pixel_buffer);
+    }
+    else {
+        handle_tile_job_lod(renderer, rc, job);
+    }
+    DP_canvas_state_decref(job->cs);
+    int bucket = latency_bucket(DP_perf_time() - start);
+    DP_atomic_inc(&renderer->stats.tile_latency[bucket]);
+    DP_atomic_inc(&renderer->stats.tiles_rendered);
+    DP_PERF_END(fn);
+}
 
-    DP_Pixel8 *pixel_buffer = rc->pixels;
-    DP_pixels15_to_8_tile(pixel_buffer, DP_transient_tile_pixels(tt));
-    renderer->fn.tile(renderer->fn.user, job->tile_x, job->tile_y,
-                      pixel_buffer);
 
-    DP_canvas_state_decref(cs);
+static void resize_lod_tiles(DP_Renderer *renderer, DP_RendererResize *resize)
+{
+    int lod = resize->lod;
+    if (lod == 0) {
+        DP_free(renderer->lod_tiles.pixels);
+        renderer->lod_tiles.pixels = NULL;
+    }
+    else {
+        size_t count =
+            DP_int_to_size(DP_tile_count_round(
+                DP_renderer_lod_size(resize->width, lod)))
+            * DP_int_to_size(DP_tile_count_round(
+                DP_renderer_lod_size(resize->height, lod)))
+            * DP_TILE_LENGTH;
+        size_t size = sizeof(*renderer->lod_tiles.pixels) * count;
+        renderer->lod_tiles.pixels =
+            DP_realloc(renderer->lod_tiles.pixels, size);
+        memset(renderer->lod_tiles.pixels, 0, size);
+    }
 }
 
 
@@ -157,10 +464,11 @@ static void handle_blocking_job(DP_Renderer *renderer, DP_Mutex *queue_mutex,
 
     unsigned int changes = job->changes;
     if (changes & CHANGE_RESIZE) {
+        resize_lod_tiles(renderer, &job->resize);
         renderer->fn.resize(renderer->fn.user, job->resize.width,
                             job->resize.height, job->resize.prev_width,
                             job->resize.prev_height, job->resize.offset_x,
-                            job->resize.offset_y);
+                            job->resize.offset_y, job->resize.lod);
     }
 
     if (changes & CHANGE_CHECKER) {
@@ -240,11 +548,14 @@ static bool dequeue_job_tile(DP_Renderer *renderer, DP_Queue *queue,
         if (tile_x >= 0) {
             int tile_index = tile_y * renderer->xtiles + tile_x;
             renderer->tile.map[tile_index] = TILE_QUEUED_NONE;
+            uint64_t dirty = renderer->tile.dirty[tile_index];
+            renderer->tile.dirty[tile_index] = 0;
             out_job->type = DP_RENDER_JOB_TILE;
             out_job->tile = (DP_RendererTileJob){
-                tile_x, tile_y, tile_index,
+                tile_x, tile_y, tile_index, renderer->lod, dirty,
                 DP_canvas_state_incref(renderer->cs),
-                renderer->checker && renderer->checkers_visible};
+                renderer->checker && renderer->checkers_visible,
+                renderer->cache.key};
         }
         else {
             if (tile_y == DP_RENDER_JOB_UNLOCK) {
@@ -340,6 +651,18 @@ DP_Renderer *DP_renderer_new(int thread_count, bool checker,
     renderer->fn.resize = resize_fn;
     renderer->fn.user = user;
     renderer->thread_count = thread_count;
+    renderer->cache.mutex = NULL;
+    renderer->cache.entries = NULL;
+    renderer->cache.count = 0;
+    renderer->cache.used = 0;
+    renderer->cache.layer_id = 0;
+    renderer->cache.generation = 0;
+    renderer->cache.valid_since = 0;
+    renderer->cache.key = (DP_RendererCacheKey){-1, false, 0};
+    DP_atomic_set(&renderer->stats.tiles_rendered, 0);
+    for (int i = 0; i < DP_RENDERER_LATENCY_BUCKETS; ++i) {
+        DP_atomic_set(&renderer->stats.tile_latency[i], 0);
+    }
     renderer->queue_mutex = NULL;
     renderer->queue_sem = NULL;
     renderer->wait_ready_sem = NULL;
@@ -352,6 +675,7 @@ DP_Renderer *DP_renderer_new(int thread_count, bool checker,
                   sizeof(DP_RendererTileCoords));
     renderer->tile.map_capacity = 0;
     renderer->tile.map = NULL;
+    renderer->tile.dirty = NULL;
     renderer->checker_color1 = checker_color1;
     renderer->checker_color2 = checker_color2;
     renderer->checker =
@@ -360,7 +684,13 @@ DP_Renderer *DP_renderer_new(int thread_count, bool checker,
                 : NULL;
     renderer->cs = DP_canvas_state_new();
     renderer->checkers_visible = false;
+    renderer->lod = 0;
     renderer->xtiles = 0;
+    renderer->ytiles = 0;
+    renderer->lod_tiles.pixels = NULL;
+    for (int i = 0; i < LOD_MUTEX_COUNT; ++i) {
+        renderer->lod_tiles.mutexes[i] = NULL;
+    }
     renderer->local_state =
         (DP_RendererLocalState){DP_VIEW_MODE_NORMAL, 0, NULL};
     renderer->contexts = DP_malloc_simd(sizeof(*renderer->contexts)
@@ -371,10 +701,14 @@ DP_Renderer *DP_renderer_new(int thread_count, bool checker,
         renderer->threads[i] = NULL;
     }
 
-    bool ok = (renderer->queue_mutex = DP_mutex_new()) != NULL
+    bool ok = (renderer->cache.mutex = DP_mutex_new()) != NULL
+           && (renderer->queue_mutex = DP_mutex_new()) != NULL
            && (renderer->queue_sem = DP_semaphore_new(0)) != NULL
            && (renderer->wait_ready_sem = DP_semaphore_new(0)) != NULL
            && (renderer->wait_done_sem = DP_semaphore_new(0)) != NULL;
+    for (int i = 0; ok && i < LOD_MUTEX_COUNT; ++i) {
+        ok = (renderer->lod_tiles.mutexes[i] = DP_mutex_new()) != NULL;
+    }
     if (!ok) {
         DP_renderer_free(renderer);
         return NULL;
@@ -424,8 +758,19 @@ void DP_renderer_free(DP_Renderer *renderer)
         DP_semaphore_free(renderer->queue_sem);
         DP_mutex_free(renderer->queue_mutex);
         DP_onion_skins_free(renderer->local_state.oss);
+        for (int i = 0; i < LOD_MUTEX_COUNT; ++i) {
+            DP_mutex_free(renderer->lod_tiles.mutexes[i]);
+        }
+        DP_free(renderer->lod_tiles.pixels);
+        for (int i = 0; i < renderer->cache.count; ++i) {
+            DP_tile_decref_nullable(renderer->cache.entries[i].below);
+            DP_tile_decref_nullable(renderer->cache.entries[i].above);
+        }
+        DP_free(renderer->cache.entries);
+        DP_mutex_free(renderer->cache.mutex);
         DP_canvas_state_decref(renderer->cs);
         DP_transient_tile_decref_nullable(renderer->checker);
+        DP_free(renderer->tile.dirty);
         DP_free(renderer->tile.map);
         DP_queue_dispose(&renderer->tile.queue_low);
         DP_queue_dispose(&renderer->tile.queue_high);
@@ -457,6 +802,19 @@ bool DP_renderer_checkers_visible(DP_Renderer *renderer)
     return renderer->checkers_visible;
 }
 
+DP_RendererStats DP_renderer_stats(DP_Renderer *renderer)
+{
+    DP_ASSERT(renderer);
+    DP_RendererStats stats;
+    stats.tiles_rendered =
+        (unsigned int)DP_atomic_get(&renderer->stats.tiles_rendered);
+    for (int i = 0; i < DP_RENDERER_LATENCY_BUCKETS; ++i) {
+        stats.tile_latency[i] =
+            (unsigned int)DP_atomic_get(&renderer->stats.tile_latency[i]);
+    }
+    return stats;
+}
+
 
 static bool local_state_params_differ(DP_RendererLocalState *rls,
                                       DP_LocalState *ls)
@@ -496,6 +854,168 @@ static DP_RendererLocalState clone_local_state(DP_LocalState *ls)
 }
 
 
+static bool can_cache_above(DP_LayerPropsList *lpl, int start, int end)
+{
+    for (int i = start; i < end; ++i) {
+        DP_LayerProps *lp = DP_layer_props_list_at_noinc(lpl, i);
+        if (DP_layer_props_visible(lp)) {
+            DP_LayerPropsList *child_lpl = DP_layer_props_children_noinc(lp);
+            if (child_lpl && !DP_layer_props_isolated(lp)) {
+                // Pass-through groups blend their children individually.
+                if (!can_cache_above(child_lpl, 0,
+                                     DP_layer_props_list_count(child_lpl))) {
+                    return false;
+                }
+            }
+            else if (DP_layer_props_blend_mode(lp) != DP_BLEND_MODE_NORMAL) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static DP_RendererCacheKey make_cache_key(DP_CanvasState *cs,
+                                          DP_LocalState *ls,
+                                          int *out_layer_id)
+{
+    DP_LayerList *ll = DP_canvas_state_layers_noinc(cs);
+    int count = DP_layer_list_count(ll);
+    int layer_id = DP_local_state_active_layer_id(ls);
+    if (DP_local_state_view_mode(ls) == DP_VIEW_MODE_NORMAL
+        && count >= CACHE_MIN_LAYERS && layer_id != 0) {
+        DP_LayerRoutesEntry *lre = DP_layer_routes_search(
+            DP_canvas_state_layer_routes_noinc(cs), layer_id);
+        if (lre) {
+            int index = DP_layer_routes_entry_index_at(lre, 0);
+            bool above = can_cache_above(DP_canvas_state_layer_props_noinc(cs),
+                                         index + 1, count);
+            *out_layer_id = layer_id;
+            return (DP_RendererCacheKey){index, above, 0};
+        }
+    }
+    *out_layer_id = 0;
+    return (DP_RendererCacheKey){-1, false, 0};
+}
+
+static bool layer_entries_equal(DP_LayerListEntry *a, DP_LayerListEntry *b)
+{
+    bool is_group = DP_layer_list_entry_is_group(a);
+    if (is_group != DP_layer_list_entry_is_group(b)) {
+        return false;
+    }
+    else if (is_group) {
+        return DP_layer_list_entry_group_noinc(a)
+            == DP_layer_list_entry_group_noinc(b);
+    }
+    else {
+        return DP_layer_list_entry_content_noinc(a)
+            == DP_layer_list_entry_content_noinc(b);
+    }
+}
+
+// Checks if nothing but the top-level layer at the given index differs.
+static bool only_layer_changed(DP_CanvasState *prev_cs, DP_CanvasState *cs,
+                               int index)
+{
+    if (DP_canvas_state_background_tile_noinc(prev_cs)
+        != DP_canvas_state_background_tile_noinc(cs)) {
+        return false;
+    }
+
+    DP_LayerList *prev_ll = DP_canvas_state_layers_noinc(prev_cs);
+    DP_LayerList *ll = DP_canvas_state_layers_noinc(cs);
+    int count = DP_layer_list_count(ll);
+    if (DP_layer_list_count(prev_ll) != count) {
+        return false;
+    }
+
+    DP_LayerPropsList *prev_lpl = DP_canvas_state_layer_props_noinc(prev_cs);
+    DP_LayerPropsList *lpl = DP_canvas_state_layer_props_noinc(cs);
+    for (int i = 0; i < count; ++i) {
+        if (i != index
+            && (DP_layer_props_list_at_noinc(prev_lpl, i)
+                    != DP_layer_props_list_at_noinc(lpl, i)
+                || !layer_entries_equal(DP_layer_list_at_noinc(prev_ll, i),
+                                        DP_layer_list_at_noinc(ll, i)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void clear_cache_entry(DP_Renderer *renderer,
+                              DP_RendererCacheEntry *entry)
+{
+    if (entry->below || entry->above) {
+        DP_tile_decref_nullable(entry->below);
+        DP_tile_decref_nullable(entry->above);
+        entry->below = NULL;
+        entry->above = NULL;
+        --renderer->cache.used;
+    }
+}
+
+static void clear_cache(DP_Renderer *renderer)
+{
+    renderer->cache.valid_since = ++renderer->cache.generation;
+    int count = renderer->cache.count;
+    for (int i = 0; renderer->cache.used != 0 && i < count; ++i) {
+        clear_cache_entry(renderer, &renderer->cache.entries[i]);
+    }
+}
+
+static void invalidate_cache_entry(void *user, int tile_index)
+{
+    DP_Renderer *renderer = user;
+    if (tile_index < renderer->cache.count) {
+        DP_RendererCacheEntry *entry = &renderer->cache.entries[tile_index];
+        clear_cache_entry(renderer, entry);
+        entry->invalidated = renderer->cache.generation;
+    }
+}
+
+static void update_cache(DP_Renderer *renderer, DP_CanvasState *prev_cs,
+                         DP_CanvasState *cs, DP_LocalState *ls,
+                         DP_CanvasDiff *diff)
+{
+    int layer_id;
+    DP_RendererCacheKey key = make_cache_key(cs, ls, &layer_id);
+
+    DP_Mutex *mutex = renderer->cache.mutex;
+    DP_MUTEX_MUST_LOCK(mutex);
+
+    int tile_count = DP_tile_total_round(DP_canvas_state_width(cs),
+                                         DP_canvas_state_height(cs));
+    DP_RendererCacheKey *prev_key = &renderer->cache.key;
+    if (tile_count != renderer->cache.count) {
+        clear_cache(renderer);
+        size_t size = sizeof(*renderer->cache.entries)
+                    * DP_int_to_size(tile_count);
+        renderer->cache.entries = DP_realloc(renderer->cache.entries, size);
+        for (int i = 0; i < tile_count; ++i) {
+            renderer->cache.entries[i] = (DP_RendererCacheEntry){NULL, NULL, 0};
+        }
+        renderer->cache.count = tile_count;
+    }
+    else if (layer_id != renderer->cache.layer_id || key.index != prev_key->index
+             || key.above != prev_key->above) {
+        clear_cache(renderer);
+    }
+    else if (key.index >= 0 && prev_cs != cs
+             && !only_layer_changed(prev_cs, cs, key.index)) {
+        ++renderer->cache.generation;
+        DP_canvas_diff_each_index(diff, invalidate_cache_entry, renderer);
+    }
+
+    renderer->cache.layer_id = layer_id;
+    key.generation = renderer->cache.generation;
+    *prev_key = key;
+
+    DP_MUTEX_MUST_UNLOCK(mutex);
+}
+
+
 static void invalidate_tile_coords(void *element, DP_UNUSED void *user)
 {
     DP_RendererTileCoords *coords = element;
@@ -514,21 +1034,30 @@ static int push_blocking(DP_Renderer *renderer, DP_RendererBlocking *blocking)
     DP_queue_each(&renderer->tile.queue_low, sizeof(DP_RendererTileCoords),
                   invalidate_tile_coords, NULL);
 
-    // If there was a resize, update the tile priority lookup map and horizontal
-    // tile stride for any upcoming tiles to be added to the queues.
-    int width = blocking->resize.width;
-    int height = blocking->resize.height;
-    size_t required_capacity = DP_int_to_size(width) * DP_int_to_size(height);
+    // If there was a resize, update the tile priority lookup map and tile
+    // dimensions for any upcoming tiles to be added to the queues.
+    int lod = blocking->resize.lod;
+    int xtiles =
+        DP_tile_count_round(DP_renderer_lod_size(blocking->resize.width, lod));
+    int ytiles =
+        DP_tile_count_round(DP_renderer_lod_size(blocking->resize.height, lod));
+    size_t required_capacity = DP_int_to_size(xtiles) * DP_int_to_size(ytiles);
     if (blocking->changes & CHANGE_RESIZE) {
         if (renderer->tile.map_capacity < required_capacity) {
             renderer->tile.map =
                 DP_realloc(renderer->tile.map, required_capacity);
+            renderer->tile.dirty =
+                DP_realloc(renderer->tile.dirty,
+                           sizeof(*renderer->tile.dirty) * required_capacity);
             renderer->tile.map_capacity = required_capacity;
         }
 
-        renderer->xtiles = DP_tile_count_round(width);
+        renderer->xtiles = xtiles;
+        renderer->ytiles = ytiles;
     }
     memset(renderer->tile.map, TILE_QUEUED_NONE, required_capacity);
+    memset(renderer->tile.dirty, 0,
+           sizeof(*renderer->tile.dirty) * required_capacity);
 
     return pushed;
 }
@@ -583,10 +1112,28 @@ static void upgrade_tile_priority(DP_Renderer *renderer, int tile_x, int tile_y,
     remove_tile(&renderer->tile.queue_low, tile_x, tile_y);
 }
 
+// Maps the given canvas tile coordinates to the tile at the current level of
+// detail containing them and marks that part of it as needing to be rendered.
+// Returns the index of the tile in the priority map.
+static int mark_tile_dirty(DP_Renderer *renderer, int *in_out_tile_x,
+                           int *in_out_tile_y)
+{
+    int lod = renderer->lod;
+    int mask = (1 << lod) - 1;
+    int tile_x = *in_out_tile_x;
+    int tile_y = *in_out_tile_y;
+    *in_out_tile_x = tile_x >> lod;
+    *in_out_tile_y = tile_y >> lod;
+    int tile_index = *in_out_tile_y * renderer->xtiles + *in_out_tile_x;
+    renderer->tile.dirty[tile_index] |=
+        (uint64_t)1 << (unsigned int)((tile_y & mask) << lod | (tile_x & mask));
+    return tile_index;
+}
+
 static void push_tile_high_priority(DP_Renderer *renderer, int tile_x,
                                     int tile_y, int *out_pushed)
 {
-    int tile_index = tile_y * renderer->xtiles + tile_x;
+    int tile_index = mark_tile_dirty(renderer, &tile_x, &tile_y);
     char status = renderer->tile.map[tile_index];
     if (status == TILE_QUEUED_NONE) {
         enqueue_tile(&renderer->tile.queue_high, renderer->tile.map, tile_x,
@@ -612,7 +1159,7 @@ static void push_tile(void *user, int tile_x, int tile_y)
         push_tile_high_priority(renderer, tile_x, tile_y, &params->pushed);
     }
     else {
-        int tile_index = tile_y * renderer->xtiles + tile_x;
+        int tile_index = mark_tile_dirty(renderer, &tile_x, &tile_y);
         char status = renderer->tile.map[tile_index];
         if (status == TILE_QUEUED_NONE) {
             enqueue_tile(&renderer->tile.queue_low, renderer->tile.map, tile_x,
@@ -634,13 +1181,14 @@ static void push_tile_in_view(void *user, int tile_x, int tile_y)
     push_tile_high_priority(renderer, tile_x, tile_y, &params->pushed);
 }
 
-static bool reprioritize_tiles(DP_Renderer *renderer, DP_CanvasDiff *diff,
-                               DP_Rect tile_bounds)
+static bool reprioritize_tiles(DP_Renderer *renderer, DP_Rect tile_bounds)
 {
-    int left, top, right, bottom, xtiles;
-    DP_canvas_diff_bounds_clamp(diff, tile_bounds.x1, tile_bounds.y1,
-                                tile_bounds.x2, tile_bounds.y2, &left, &top,
-                                &right, &bottom, &xtiles);
+    int lod = renderer->lod;
+    int xtiles = renderer->xtiles;
+    int left = DP_max_int(0, tile_bounds.x1 >> lod);
+    int top = DP_max_int(0, tile_bounds.y1 >> lod);
+    int right = DP_min_int(xtiles - 1, tile_bounds.x2 >> lod);
+    int bottom = DP_min_int(renderer->ytiles - 1, tile_bounds.y2 >> lod);
     char *tile_map = renderer->tile.map;
     bool was_queued = false;
     for (int tile_y = top; tile_y <= bottom; ++tile_y) {
@@ -666,11 +1214,14 @@ void DP_renderer_apply(DP_Renderer *renderer, DP_CanvasState *cs,
                        bool layers_can_decrease_opacity,
                        DP_Pixel8 checker_color1, DP_Pixel8 checker_color2,
                        DP_Rect view_tile_bounds, bool render_outside_view,
-                       DP_RendererMode mode)
+                       int lod, DP_RendererMode mode)
 {
     DP_ASSERT(renderer);
     DP_ASSERT(cs);
     DP_ASSERT(diff);
+    DP_ASSERT(lod >= 0);
+    DP_ASSERT(lod <= DP_RENDERER_LOD_MAX);
+    DP_PERF_BEGIN_DETAIL(fn, "apply", "mode=%d", (int)mode);
 
     DP_CanvasState *prev_cs = renderer->cs;
     int prev_width = DP_canvas_state_width(prev_cs);
@@ -682,6 +1233,7 @@ void DP_renderer_apply(DP_Renderer *renderer, DP_CanvasState *cs,
     DP_MUTEX_MUST_LOCK(queue_mutex);
 
     renderer->cs = DP_canvas_state_incref(cs);
+    update_cache(renderer, prev_cs, cs, ls, diff);
     // It's very rare in practice for the checkerboard background to actually be
     // visible behind the canvas. Only if the canvas background is set to a
     // non-opaque value or there's weird blend modes like Erase at top-level.
@@ -697,6 +1249,13 @@ void DP_renderer_apply(DP_Renderer *renderer, DP_CanvasState *cs,
     if (width != prev_width || height != prev_height) {
         blocking.changes |= CHANGE_RESIZE;
     }
+    // A different level of detail changes the size of the rendered image and
+    // every tile in it, so it's handled like a resize of the canvas.
+    if (lod != renderer->lod) {
+        renderer->lod = lod;
+        blocking.changes |= CHANGE_RESIZE;
+        DP_canvas_diff_check_all(diff);
+    }
     blocking.resize = (DP_RendererResize){
         width,
         height,
@@ -704,6 +1263,7 @@ void DP_renderer_apply(DP_Renderer *renderer, DP_CanvasState *cs,
         prev_height,
         DP_canvas_state_offset_x(prev_cs) - DP_canvas_state_offset_x(cs),
         DP_canvas_state_offset_y(prev_cs) - DP_canvas_state_offset_y(cs),
+        lod,
     };
 
     if (has_checker
@@ -750,14 +1310,16 @@ void DP_renderer_apply(DP_Renderer *renderer, DP_CanvasState *cs,
     }
 
     if (mode != DP_RENDERER_CONTINUOUS) {
-        bool was_queued = reprioritize_tiles(renderer, diff, view_tile_bounds);
+        bool was_queued = reprioritize_tiles(renderer, view_tile_bounds);
         // Block the main thread if there's new high-priority tiles to render.
         // This avoids tiles flickering in when the user moves the view
         // elsewhere at the expense of possibly chugging for a moment. But since
         // the user is currently manipulating the view, they're not doing
         // anything else important, so a bit of chug feels better than tiles
         // stumbling into view, which may be miscronstrued as them "glitching".
-        if (mode != DP_RENDERER_EVERYTHING && !was_queued
+        bool always_unlock =
+            mode == DP_RENDERER_EVERYTHING || mode == DP_RENDERER_CHANGES;
+        if (!always_unlock && !was_queued
             && tile_queue_high->used == tile_queue_high_used_before) {
             renderer->fn.unlock(renderer->fn.user);
         }
@@ -771,4 +1333,5 @@ void DP_renderer_apply(DP_Renderer *renderer, DP_CanvasState *cs,
 
     DP_SEMAPHORE_MUST_POST_N(renderer->queue_sem, pushed);
     DP_MUTEX_MUST_UNLOCK(queue_mutex);
+    DP_PERF_END(fn);
 }
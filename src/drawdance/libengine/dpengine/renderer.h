@@ -13,9 +13,17 @@ typedef union DP_Pixel8 DP_Pixel8;
 typedef struct DP_Renderer DP_Renderer;
 typedef void (*DP_RendererTileFn)(void *user, int x, int y, DP_Pixel8 *pixels);
 typedef void (*DP_RendererUnlockFn)(void *user);
+// Width and height are always those of the canvas, the level of detail
+// determines the size of the rendered image, see DP_renderer_lod_size.
 typedef void (*DP_RendererResizeFn)(void *user, int width, int height,
                                     int prev_width, int prev_height,
-                                    int offset_x, int offset_y);
+                                    int offset_x, int offset_y, int lod);
+
+// Zoomed out views can be rendered at a reduced level of detail, where each
+// rendered tile covers 2^lod by 2^lod tiles of the canvas, downsampled to fit.
+// Tile coordinates passed to the tile function are then in terms of those
+// reduced tiles. Level 0 renders the canvas at full resolution.
+#define DP_RENDERER_LOD_MAX 3
 
 typedef enum DP_RendererMode {
     // Normal, asynchronous rendering. Don't call the unlock function.
@@ -27,8 +35,22 @@ typedef enum DP_RendererMode {
     // Render the whole canvas. Calls the unlock function on a render thread
     // after the render queue has drained, even if nothing changed on it.
     DP_RENDERER_EVERYTHING,
+    // Render only what changed, like continuous mode. Calls the unlock
+    // function on a render thread after the render queue has drained, even if
+    // nothing changed on it, so the caller can wait for a finished image.
+    DP_RENDERER_CHANGES,
 } DP_RendererMode;
 
+// Number of buckets in the tile render latency histogram. Bucket 0 counts tiles
+// that took less than a microsecond, bucket i those that took [2^(i-1), 2^i)
+// microseconds. The last bucket also catches everything slower than that.
+#define DP_RENDERER_LATENCY_BUCKETS 16
+
+typedef struct DP_RendererStats {
+    unsigned int tiles_rendered;
+    unsigned int tile_latency[DP_RENDERER_LATENCY_BUCKETS];
+} DP_RendererStats;
+
 DP_Renderer *DP_renderer_new(int thread_count, bool checkers,
                              DP_Pixel8 checker_color1, DP_Pixel8 checker_color2,
                              DP_RendererTileFn tile_fn,
@@ -37,17 +59,33 @@ DP_Renderer *DP_renderer_new(int thread_count, bool checkers,
 
 void DP_renderer_free(DP_Renderer *renderer);
 
+// Size of the rendered image for the given canvas width or height.
+DP_INLINE int DP_renderer_lod_size(int size, int lod)
+{
+    DP_ASSERT(lod >= 0);
+    DP_ASSERT(lod <= DP_RENDERER_LOD_MAX);
+    return (size + (1 << lod) - 1) >> lod;
+}
+
 int DP_renderer_thread_count(DP_Renderer *renderer);
 
 bool DP_renderer_checkers(DP_Renderer *renderer);
 bool DP_renderer_checkers_visible(DP_Renderer *renderer);
 
-// Increments refcount on the given canvas state, resets the given diff.
+// Snapshot of the running counters, can be called from any thread without
+// locking. The counters wrap around, so compare successive snapshots using
+// unsigned arithmetic instead of looking at the absolute values.
+DP_RendererStats DP_renderer_stats(DP_Renderer *renderer);
+
+// Increments refcount on the given canvas state, resets the given diff. The
+// view tile bounds are in canvas tiles, regardless of the level of detail.
+// Changing the level of detail resizes the rendered image and marks the whole
+// canvas as changed.
 void DP_renderer_apply(DP_Renderer *renderer, DP_CanvasState *cs,
                        DP_LocalState *ls, DP_CanvasDiff *diff,
                        bool layers_can_decrease_opacity,
                        DP_Pixel8 checker_color1, DP_Pixel8 checker_color2,
                        DP_Rect view_tile_bounds, bool render_outside_view,
-                       DP_RendererMode mode);
+                       int lod, DP_RendererMode mode);
 
 #endif
@@ -34,7 +34,10 @@
 #include <dpcommon/conversions.h>
 #include <dpcommon/queue.h>
 #include <dpcommon/threading.h>
+#include <dpcommon/vector.h>
+#include <dpcommon/worker.h>
 #include <dpmsg/message.h>
+#include <uthash_inc.h>
 
 
 #define ELEMENT_SIZE (sizeof(DP_Snapshot))
@@ -215,29 +218,295 @@ void DP_snapshot_queue_get_with(DP_SnapshotQueue *sq, DP_SnapshotsGetFn get_fn,
 }
 
 
-struct DP_ResetImageContext {
-    unsigned int context_id;
-    void (*push_message)(void *, DP_Message *);
-    void *push_message_user;
+// Building a reset image happens in two passes. The first one walks the canvas
+// and records the messages in order, with placeholders where compressed tiles
+// go. Tiles with the same content are only recorded once. The second pass
+// compresses the recorded tiles, in parallel if there's enough of them, and
+// then pushes the messages in the order they were recorded. Since the order
+// doesn't depend on which tile finishes compressing first, the output is the
+// same no matter how many threads were involved.
+
+#define RESET_IMAGE_MAX_THREADS          32
+#define RESET_IMAGE_MIN_TILES_PER_THREAD 16
+// Tiles get compressed in batches, which are flushed as soon as they're done.
+// While one batch is being flushed, the next one is being compressed, so only
+// that many compressed tiles are held at a time, plus those that are still
+// needed for duplicates further down.
+#define RESET_IMAGE_BATCH_TILES_PER_THREAD 32
+#define RESET_IMAGE_BATCHES_IN_FLIGHT      2
+
+typedef enum DP_ResetImageEntryType {
+    DP_RESET_IMAGE_ENTRY_MESSAGE,
+    DP_RESET_IMAGE_ENTRY_BACKGROUND,
+    DP_RESET_IMAGE_ENTRY_PUT_TILE,
+    // Sublayer attributes are only pushed if any of the sublayer's tiles were.
+    DP_RESET_IMAGE_ENTRY_SUBLAYER_ATTRIBUTES,
+} DP_ResetImageEntryType;
+
+typedef struct DP_ResetImageEntry {
+    DP_ResetImageEntryType type;
+    DP_Message *msg;
+    // Index of the unique tile for backgrounds and put tiles, first put tile
+    // entry for sublayer attributes.
+    int index;
+    // Put tile entry end index for sublayer attributes.
+    int end;
+    uint16_t layer_id;
+    uint8_t sublayer_id;
+    uint16_t x, y;
+} DP_ResetImageEntry;
+
+typedef struct DP_ResetImageTile {
+    DP_Tile *tile;
+    // Next unique tile with the same hash, but different content, or -1.
+    int next_same_hash;
+    // Last entry using this tile, its data is freed after that's flushed.
+    int last_use;
+    size_t size;
+    unsigned char *data;
+} DP_ResetImageTile;
+
+typedef struct DP_ResetImageTileHash {
+    UT_hash_handle hh;
+    uint64_t hash;
+    int index;
+} DP_ResetImageTileHash;
+
+typedef struct DP_ResetImageBuffers {
     DP_Pixel8 *pixel_buffer;
     size_t capacity;
-    void *output_buffer;
+    unsigned char *output_buffer;
+} DP_ResetImageBuffers;
+
+struct DP_ResetImageContext {
+    unsigned int context_id;
+    DP_Vector entries;
+    DP_Vector tiles;
+    DP_ResetImageTileHash *tile_hashes;
+    DP_ResetImageBuffers *buffers;
+    struct {
+        DP_Worker *worker;
+        int size;
+        int started;
+        int done;
+        int count_started;
+        int count_done;
+        int ends[RESET_IMAGE_BATCHES_IN_FLIGHT];
+        DP_Semaphore *sems[RESET_IMAGE_BATCHES_IN_FLIGHT];
+    } batch;
 };
 
+static DP_ResetImageEntry *reset_image_entry_at(struct DP_ResetImageContext *c,
+                                                int index)
+{
+    return &DP_VECTOR_AT_TYPE(&c->entries, DP_ResetImageEntry, index);
+}
+
+static DP_ResetImageTile *reset_image_tile_at(struct DP_ResetImageContext *c,
+                                              int index)
+{
+    return &DP_VECTOR_AT_TYPE(&c->tiles, DP_ResetImageTile, index);
+}
+
+static int reset_image_entry_count(struct DP_ResetImageContext *c)
+{
+    return DP_size_to_int(c->entries.used);
+}
+
+static void reset_image_push_entry(struct DP_ResetImageContext *c,
+                                   DP_ResetImageEntry entry)
+{
+    if (entry.type == DP_RESET_IMAGE_ENTRY_BACKGROUND
+        || entry.type == DP_RESET_IMAGE_ENTRY_PUT_TILE) {
+        reset_image_tile_at(c, entry.index)->last_use =
+            reset_image_entry_count(c);
+    }
+    DP_VECTOR_PUSH_TYPE(&c->entries, DP_ResetImageEntry, entry);
+}
+
 static void reset_image_push(struct DP_ResetImageContext *c, DP_Message *msg)
 {
-    c->push_message(c->push_message_user, msg);
+    reset_image_push_entry(
+        c, (DP_ResetImageEntry){DP_RESET_IMAGE_ENTRY_MESSAGE, msg, -1, -1, 0,
+                                0, 0, 0});
+}
+
+static int reset_image_add_tile(struct DP_ResetImageContext *c, DP_Tile *tile)
+{
+    uint64_t hash = DP_tile_content_hash(tile);
+    DP_ResetImageTileHash *th;
+    HASH_FIND(hh, c->tile_hashes, &hash, sizeof(hash), th);
+    if (th) {
+        for (int i = th->index; i != -1;
+             i = reset_image_tile_at(c, i)->next_same_hash) {
+            if (DP_tile_same_content(reset_image_tile_at(c, i)->tile, tile)) {
+                return i;
+            }
+        }
+    }
+    else {
+        th = DP_malloc(sizeof(*th));
+        th->hash = hash;
+        th->index = -1;
+        HASH_ADD(hh, c->tile_hashes, hash, sizeof(th->hash), th);
+    }
+
+    int index = DP_size_to_int(c->tiles.used);
+    DP_VECTOR_PUSH_TYPE(&c->tiles, DP_ResetImageTile,
+                        ((DP_ResetImageTile){tile, th->index, -1, 0, NULL}));
+    th->index = index;
+    return index;
 }
 
 static unsigned char *reset_image_get_output_buffer(size_t size, void *user)
 {
-    struct DP_ResetImageContext *c = user;
-    if (c->capacity < size) {
-        DP_free(c->output_buffer);
-        c->output_buffer = DP_malloc(size);
-        c->capacity = size;
+    DP_ResetImageBuffers *b = user;
+    if (b->capacity < size) {
+        DP_free(b->output_buffer);
+        b->output_buffer = DP_malloc(size);
+        b->capacity = size;
+    }
+    return b->output_buffer;
+}
+
+static void reset_image_compress_tile(struct DP_ResetImageContext *c,
+                                      int index, int thread_index)
+{
+    DP_ResetImageBuffers *b = &c->buffers[thread_index];
+    DP_ResetImageTile *rit = reset_image_tile_at(c, index);
+    size_t size = DP_tile_compress(rit->tile, b->pixel_buffer,
+                                   reset_image_get_output_buffer, b);
+    if (size == 0) {
+        DP_warn("Reset image: error tile: %s", DP_error());
+    }
+    else {
+        rit->data = DP_malloc(size);
+        memcpy(rit->data, b->output_buffer, size);
+        rit->size = size;
     }
-    return c->output_buffer;
+}
+
+struct DP_ResetImageCompressParams {
+    struct DP_ResetImageContext *c;
+    int index;
+    DP_Semaphore *done_sem;
+};
+
+static void reset_image_compress_job(void *element, int thread_index)
+{
+    struct DP_ResetImageCompressParams *params = element;
+    reset_image_compress_tile(params->c, params->index, thread_index);
+    DP_SEMAPHORE_MUST_POST(params->done_sem);
+}
+
+static void reset_image_compress_init(struct DP_ResetImageContext *c,
+                                      int max_threads)
+{
+    int tile_count = DP_size_to_int(c->tiles.used);
+    int thread_count = DP_min_int(
+        tile_count / RESET_IMAGE_MIN_TILES_PER_THREAD, max_threads);
+    int batch_size = DP_max_int(thread_count, 1)
+                   * RESET_IMAGE_BATCH_TILES_PER_THREAD;
+    DP_Worker *worker =
+        thread_count > 1
+            ? DP_worker_new(
+                  DP_int_to_size(batch_size * RESET_IMAGE_BATCHES_IN_FLIGHT),
+                  sizeof(struct DP_ResetImageCompressParams), thread_count,
+                  reset_image_compress_job)
+            : NULL;
+
+    int buffer_count = worker ? DP_worker_thread_count(worker) : 1;
+    c->buffers = DP_malloc(sizeof(*c->buffers) * DP_int_to_size(buffer_count));
+    for (int i = 0; i < buffer_count; ++i) {
+        c->buffers[i] = (DP_ResetImageBuffers){
+            DP_malloc(sizeof(*c->buffers[i].pixel_buffer) * DP_TILE_LENGTH), 0,
+            NULL};
+    }
+
+    c->batch.worker = worker;
+    c->batch.size = batch_size;
+    for (int i = 0; i < RESET_IMAGE_BATCHES_IN_FLIGHT; ++i) {
+        c->batch.sems[i] = worker ? DP_semaphore_new(0) : NULL;
+    }
+}
+
+static void reset_image_compress_dispose(struct DP_ResetImageContext *c)
+{
+    DP_Worker *worker = c->batch.worker;
+    int buffer_count = 1;
+    if (worker) {
+        buffer_count = DP_worker_thread_count(worker);
+        DP_worker_free_join(worker);
+        for (int i = 0; i < RESET_IMAGE_BATCHES_IN_FLIGHT; ++i) {
+            DP_semaphore_free(c->batch.sems[i]);
+        }
+    }
+
+    for (int i = 0; i < buffer_count; ++i) {
+        DP_free(c->buffers[i].output_buffer);
+        DP_free(c->buffers[i].pixel_buffer);
+    }
+    DP_free(c->buffers);
+    c->buffers = NULL;
+}
+
+// Without a worker, the batch gets compressed right here.
+static void reset_image_start_batch(struct DP_ResetImageContext *c)
+{
+    int start = c->batch.started;
+    int end =
+        DP_min_int(start + c->batch.size, DP_size_to_int(c->tiles.used));
+    int slot = c->batch.count_started % RESET_IMAGE_BATCHES_IN_FLIGHT;
+    DP_Worker *worker = c->batch.worker;
+    if (worker) {
+        DP_Semaphore *done_sem = c->batch.sems[slot];
+        for (int i = start; i < end; ++i) {
+            struct DP_ResetImageCompressParams params = {c, i, done_sem};
+            DP_worker_push(worker, &params);
+        }
+    }
+    else {
+        for (int i = start; i < end; ++i) {
+            reset_image_compress_tile(c, i, 0);
+        }
+    }
+    c->batch.ends[slot] = end;
+    c->batch.started = end;
+    ++c->batch.count_started;
+}
+
+static void reset_image_fill_batches(struct DP_ResetImageContext *c)
+{
+    int tile_count = DP_size_to_int(c->tiles.used);
+    while (c->batch.started < tile_count
+           && c->batch.count_started - c->batch.count_done
+                  < RESET_IMAGE_BATCHES_IN_FLIGHT) {
+        reset_image_start_batch(c);
+    }
+}
+
+static void reset_image_wait_batch(struct DP_ResetImageContext *c)
+{
+    DP_ASSERT(c->batch.count_done < c->batch.count_started);
+    int slot = c->batch.count_done % RESET_IMAGE_BATCHES_IN_FLIGHT;
+    int end = c->batch.ends[slot];
+    if (c->batch.worker) {
+        DP_SEMAPHORE_MUST_WAIT_N(c->batch.sems[slot], end - c->batch.done);
+    }
+    c->batch.done = end;
+    ++c->batch.count_done;
+}
+
+// Makes sure all tiles before the given index are compressed, keeping the
+// worker busy with the next batch in the meantime.
+static void reset_image_compress_until(struct DP_ResetImageContext *c,
+                                       int tile_end)
+{
+    while (c->batch.done < tile_end) {
+        reset_image_fill_batches(c);
+        reset_image_wait_batch(c);
+    }
+    reset_image_fill_batches(c);
 }
 
 static void set_tile_data(size_t size, unsigned char *out, void *bytes)
@@ -245,19 +514,74 @@ static void set_tile_data(size_t size, unsigned char *out, void *bytes)
     memcpy(out, bytes, size);
 }
 
-static size_t reset_image_maybe_compress_tile(struct DP_ResetImageContext *c,
-                                              DP_Tile *tile_or_null)
+static bool reset_image_any_tile_pushed(struct DP_ResetImageContext *c,
+                                        int start, int end)
 {
-    if (tile_or_null) {
-        size_t size = DP_tile_compress(tile_or_null, c->pixel_buffer,
-                                       reset_image_get_output_buffer, c);
-        if (size == 0) {
-            DP_warn("Reset image: error tile: %s", DP_error());
+    for (int i = start; i < end; ++i) {
+        DP_ResetImageEntry *entry = reset_image_entry_at(c, i);
+        if (reset_image_tile_at(c, entry->index)->size != 0) {
+            return true;
         }
-        return size;
     }
-    else {
-        return 0;
+    return false;
+}
+
+static void reset_image_release_tile(DP_ResetImageTile *rit, int entry_index)
+{
+    if (rit->last_use == entry_index) {
+        DP_free(rit->data);
+        rit->data = NULL;
+    }
+}
+
+// Unique tiles are numbered in the order of the entries that first use them,
+// so entries can be pushed as soon as the batch up to their tile is done.
+static void reset_image_flush(struct DP_ResetImageContext *c,
+                              void (*push_message)(void *, DP_Message *),
+                              void *user)
+{
+    unsigned int context_id = c->context_id;
+    int entry_count = reset_image_entry_count(c);
+    for (int i = 0; i < entry_count; ++i) {
+        DP_ResetImageEntry *entry = reset_image_entry_at(c, i);
+        switch (entry->type) {
+        case DP_RESET_IMAGE_ENTRY_MESSAGE:
+            push_message(user, entry->msg);
+            break;
+        case DP_RESET_IMAGE_ENTRY_BACKGROUND: {
+            reset_image_compress_until(c, entry->index + 1);
+            DP_ResetImageTile *rit = reset_image_tile_at(c, entry->index);
+            if (rit->size != 0) {
+                push_message(user, DP_msg_canvas_background_new(
+                                       context_id, set_tile_data, rit->size,
+                                       rit->data));
+            }
+            reset_image_release_tile(rit, i);
+            break;
+        }
+        case DP_RESET_IMAGE_ENTRY_PUT_TILE: {
+            reset_image_compress_until(c, entry->index + 1);
+            DP_ResetImageTile *rit = reset_image_tile_at(c, entry->index);
+            if (rit->size != 0) {
+                push_message(user,
+                             DP_msg_put_tile_new(
+                                 context_id, entry->layer_id,
+                                 entry->sublayer_id, entry->x, entry->y, 0,
+                                 set_tile_data, rit->size, rit->data));
+            }
+            reset_image_release_tile(rit, i);
+            break;
+        }
+        case DP_RESET_IMAGE_ENTRY_SUBLAYER_ATTRIBUTES:
+            // The put tiles come before this entry, so they're already done.
+            if (reset_image_any_tile_pushed(c, entry->index, entry->end)) {
+                push_message(user, entry->msg);
+            }
+            else {
+                DP_message_decref(entry->msg);
+            }
+            break;
+        }
     }
 }
 
@@ -272,19 +596,19 @@ static void layers_to_reset_image(struct DP_ResetImageContext *c,
                                   uint16_t target_id, DP_LayerList *ll,
                                   DP_LayerPropsList *lpl);
 
-static void layer_props_to_reset_image(struct DP_ResetImageContext *c,
-                                       DP_LayerProps *lp, bool group,
-                                       uint16_t layer_id, uint8_t sublayer_id)
+static DP_Message *layer_attributes_new(struct DP_ResetImageContext *c,
+                                        DP_LayerProps *lp, bool group,
+                                        uint16_t layer_id, uint8_t sublayer_id)
 {
     uint8_t attr_flags = 0;
     SET_FLAG_IF(attr_flags, DP_layer_props_censored(lp),
                 DP_MSG_LAYER_ATTRIBUTES_FLAGS_CENSOR);
     SET_FLAG_IF(attr_flags, group && DP_layer_props_isolated(lp),
                 DP_MSG_LAYER_ATTRIBUTES_FLAGS_ISOLATED);
-    reset_image_push(c, DP_msg_layer_attributes_new(
-                            c->context_id, layer_id, sublayer_id, attr_flags,
-                            DP_channel15_to_8(DP_layer_props_opacity(lp)),
-                            (uint8_t)DP_layer_props_blend_mode(lp)));
+    return DP_msg_layer_attributes_new(
+        c->context_id, layer_id, sublayer_id, attr_flags,
+        DP_channel15_to_8(DP_layer_props_opacity(lp)),
+        (uint8_t)DP_layer_props_blend_mode(lp));
 }
 
 static uint16_t layer_to_reset_image(struct DP_ResetImageContext *c,
@@ -301,35 +625,30 @@ static uint16_t layer_to_reset_image(struct DP_ResetImageContext *c,
     reset_image_push(
         c, DP_msg_layer_tree_create_new(c->context_id, layer_id, 0, target_id,
                                         fill, create_flags, name, name_len));
-    layer_props_to_reset_image(c, lp, group, layer_id, 0);
+    reset_image_push(c, layer_attributes_new(c, lp, group, layer_id, 0));
     return layer_id;
 }
 
-static bool tiles_to_reset_image(struct DP_ResetImageContext *c,
+static void tiles_to_reset_image(struct DP_ResetImageContext *c,
                                  DP_LayerContent *lc, uint16_t layer_id,
                                  uint8_t sublayer_id)
 {
     // TODO: use tile runs and layer fill to optimize this.
     DP_TileCounts counts = DP_tile_counts_round(DP_layer_content_width(lc),
                                                 DP_layer_content_height(lc));
-    bool pushed = false;
     for (int y = 0; y < counts.y; ++y) {
         for (int x = 0; x < counts.x; ++x) {
             DP_Tile *t = DP_layer_content_tile_at_noinc(lc, x, y);
             if (t && !DP_tile_blank(t)) {
-                size_t size = reset_image_maybe_compress_tile(c, t);
-                if (size != 0) {
-                    pushed = true;
-                    reset_image_push(
-                        c, DP_msg_put_tile_new(
-                               c->context_id, layer_id, sublayer_id,
-                               DP_int_to_uint16(x), DP_int_to_uint16(y), 0,
-                               set_tile_data, size, c->output_buffer));
-                }
+                reset_image_push_entry(
+                    c, (DP_ResetImageEntry){
+                           DP_RESET_IMAGE_ENTRY_PUT_TILE, NULL,
+                           reset_image_add_tile(c, t), -1, layer_id,
+                           sublayer_id, DP_int_to_uint16(x),
+                           DP_int_to_uint16(y)});
             }
         }
     }
-    return pushed;
 }
 
 static void layer_content_to_reset_image(struct DP_ResetImageContext *c,
@@ -350,9 +669,16 @@ static void layer_content_to_reset_image(struct DP_ResetImageContext *c,
             DP_LayerContent *sub_lc = DP_layer_list_entry_content_noinc(
                 DP_layer_list_at_noinc(sub_ll, i));
             uint8_t sublayer_id = DP_int_to_uint8(sub_id);
-            if (tiles_to_reset_image(c, sub_lc, layer_id, sublayer_id)) {
-                layer_props_to_reset_image(c, sub_lp, false, layer_id,
-                                           sublayer_id);
+            int start = reset_image_entry_count(c);
+            tiles_to_reset_image(c, sub_lc, layer_id, sublayer_id);
+            int end = reset_image_entry_count(c);
+            if (start != end) {
+                reset_image_push_entry(
+                    c, (DP_ResetImageEntry){
+                           DP_RESET_IMAGE_ENTRY_SUBLAYER_ATTRIBUTES,
+                           layer_attributes_new(c, sub_lp, false, layer_id,
+                                                sublayer_id),
+                           start, end, 0, 0, 0, 0});
             }
         }
     }
@@ -525,12 +851,12 @@ static void canvas_state_to_reset_image(struct DP_ResetImageContext *c,
                                 DP_int_to_int32(height), 0));
     }
 
-    size_t size = reset_image_maybe_compress_tile(
-        c, DP_canvas_state_background_tile_noinc(cs));
-    if (size != 0) {
-        reset_image_push(c, DP_msg_canvas_background_new(c->context_id,
-                                                         set_tile_data, size,
-                                                         c->output_buffer));
+    DP_Tile *background_tile = DP_canvas_state_background_tile_noinc(cs);
+    if (background_tile) {
+        reset_image_push_entry(
+            c, (DP_ResetImageEntry){DP_RESET_IMAGE_ENTRY_BACKGROUND, NULL,
+                                    reset_image_add_tile(c, background_tile),
+                                    -1, 0, 0, 0, 0});
     }
 
     layers_to_reset_image(c, 0, DP_canvas_state_layers_noinc(cs),
@@ -544,11 +870,33 @@ void DP_reset_image_build(DP_CanvasState *cs, unsigned int context_id,
                           void (*push_message)(void *, DP_Message *),
                           void *user)
 {
-    struct DP_ResetImageContext c = {
-        context_id, push_message,
-        user,       DP_malloc(sizeof(*c.pixel_buffer) * DP_TILE_LENGTH),
-        0,          NULL};
+    DP_reset_image_build_with_threads(
+        cs, context_id, DP_worker_cpu_count(RESET_IMAGE_MAX_THREADS),
+        push_message, user);
+}
+
+void DP_reset_image_build_with_threads(
+    DP_CanvasState *cs, unsigned int context_id, int max_threads,
+    void (*push_message)(void *, DP_Message *), void *user)
+{
+    struct DP_ResetImageContext c = {context_id, DP_VECTOR_NULL,
+                                     DP_VECTOR_NULL, NULL, NULL, {0}};
+    DP_VECTOR_INIT_TYPE(&c.entries, DP_ResetImageEntry, 64);
+    DP_VECTOR_INIT_TYPE(&c.tiles, DP_ResetImageTile, 64);
     canvas_state_to_reset_image(&c, cs);
-    DP_free(c.output_buffer);
-    DP_free(c.pixel_buffer);
+
+    DP_ResetImageTileHash *th, *tmp;
+    HASH_ITER(hh, c.tile_hashes, th, tmp) {
+        HASH_DEL(c.tile_hashes, th);
+        DP_free(th);
+    }
+
+    reset_image_compress_init(&c, max_threads);
+    reset_image_flush(&c, push_message, user);
+    reset_image_compress_dispose(&c);
+
+    // Every tile is used by some entry, so flushing released all of them.
+    DP_ASSERT(c.batch.done == DP_size_to_int(c.tiles.used));
+    DP_vector_dispose(&c.tiles);
+    DP_vector_dispose(&c.entries);
 }
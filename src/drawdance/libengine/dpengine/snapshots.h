@@ -62,5 +62,11 @@ void DP_reset_image_build(DP_CanvasState *cs, unsigned int context_id,
                           void (*push_message)(void *, DP_Message *),
                           void *user);
 
+// Same as above, but compresses tiles on at most the given number of threads.
+// The resulting messages don't depend on how many threads were used.
+void DP_reset_image_build_with_threads(
+    DP_CanvasState *cs, unsigned int context_id, int max_threads,
+    void (*push_message)(void *, DP_Message *), void *user);
+
 
 #endif
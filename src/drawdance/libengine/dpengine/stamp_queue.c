@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "stamp_queue.h"
+#include "draw_context.h"
+#include "tile.h"
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/perf.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/vector.h>
+#include <dpcommon/worker.h>
+
+#define DP_PERF_CONTEXT "stamp_queue"
+
+
+// Each mask block fits a few of the largest possible stamps.
+#define MASK_BLOCK_SIZE (DP_DRAW_CONTEXT_STAMP_BUFFER_SIZE * 4)
+#define MASK_BLOCK_MAX  16
+// Upper bound on the number of queued operations before forcing a flush.
+#define OPS_MAX 65536
+// Below this many operations, it's not worth waking up the worker threads.
+#define PARALLEL_OPS_MIN 64
+// Number of jobs to split the work into per thread, to even out the load.
+#define JOBS_PER_THREAD 4
+
+typedef struct DP_StampQueueOp {
+    DP_TransientTile *tt;
+    const uint16_t *mask;
+    int index;
+    int blend_mode; // -1 for posterize.
+    DP_UPixel15 pixel;
+    int posterize_num;
+    uint16_t opacity;
+    int x, y, w, h, skip;
+} DP_StampQueueOp;
+
+struct DP_StampQueueJob {
+    DP_StampQueue *sq;
+    size_t start, end;
+};
+
+struct DP_StampQueue {
+    DP_Worker *worker;
+    DP_Semaphore *done_sem;
+    DP_Vector ops;
+    struct {
+        uint16_t *blocks[MASK_BLOCK_MAX];
+        int count;
+        int index;
+        size_t used;
+    } masks;
+};
+
+
+static void apply_op(DP_StampQueueOp *op)
+{
+    if (op->blend_mode < 0) {
+        DP_transient_tile_brush_apply_posterize(op->tt, op->posterize_num,
+                                                op->mask, op->opacity, op->x,
+                                                op->y, op->w, op->h, op->skip);
+    }
+    else {
+        DP_transient_tile_brush_apply(op->tt, op->pixel, op->blend_mode,
+                                      op->mask, op->opacity, op->x, op->y,
+                                      op->w, op->h, op->skip);
+    }
+}
+
+static void apply_ops(DP_StampQueueOp *ops, size_t start, size_t end)
+{
+    for (size_t i = start; i < end; ++i) {
+        apply_op(&ops[i]);
+    }
+}
+
+static void run_job(void *element, DP_UNUSED int thread_index)
+{
+    struct DP_StampQueueJob *job = element;
+    DP_StampQueue *sq = job->sq;
+    apply_ops(sq->ops.elements, job->start, job->end);
+    DP_SEMAPHORE_MUST_POST(sq->done_sem);
+}
+
+
+DP_StampQueue *DP_stamp_queue_new(int thread_count)
+{
+    DP_ASSERT(thread_count > 0);
+    DP_StampQueue *sq = DP_malloc(sizeof(*sq));
+    sq->done_sem = DP_semaphore_new(0);
+    if (!sq->done_sem) {
+        DP_free(sq);
+        return NULL;
+    }
+
+    sq->worker = DP_worker_new(DP_int_to_size(thread_count * JOBS_PER_THREAD),
+                               sizeof(struct DP_StampQueueJob), thread_count,
+                               run_job);
+    if (!sq->worker) {
+        DP_semaphore_free(sq->done_sem);
+        DP_free(sq);
+        return NULL;
+    }
+
+    DP_VECTOR_INIT_TYPE(&sq->ops, DP_StampQueueOp, 1024);
+    sq->masks.count = 0;
+    sq->masks.index = 0;
+    sq->masks.used = 0;
+    return sq;
+}
+
+void DP_stamp_queue_free(DP_StampQueue *sq)
+{
+    if (sq) {
+        DP_stamp_queue_flush(sq);
+        for (int i = 0; i < sq->masks.count; ++i) {
+            DP_free_simd(sq->masks.blocks[i]);
+        }
+        DP_vector_dispose(&sq->ops);
+        DP_worker_free_join(sq->worker);
+        DP_semaphore_free(sq->done_sem);
+        DP_free(sq);
+    }
+}
+
+int DP_stamp_queue_thread_count(DP_StampQueue *sq)
+{
+    DP_ASSERT(sq);
+    return DP_worker_thread_count(sq->worker);
+}
+
+
+static uint16_t *allocate_mask(DP_StampQueue *sq, size_t size)
+{
+    if (sq->masks.used + size > MASK_BLOCK_SIZE) {
+        if (sq->masks.index + 1 < MASK_BLOCK_MAX) {
+            ++sq->masks.index;
+            sq->masks.used = 0;
+        }
+        else {
+            // Out of mask storage, apply what we have so far and start over.
+            DP_stamp_queue_flush(sq);
+        }
+    }
+
+    int index = sq->masks.index;
+    if (index == sq->masks.count) {
+        sq->masks.blocks[index] =
+            DP_malloc_simd(sizeof(*sq->masks.blocks[index]) * MASK_BLOCK_SIZE);
+        ++sq->masks.count;
+    }
+
+    uint16_t *mask = sq->masks.blocks[index] + sq->masks.used;
+    sq->masks.used += size;
+    return mask;
+}
+
+const uint16_t *DP_stamp_queue_mask_copy(DP_StampQueue *sq,
+                                         const uint16_t *mask, int diameter)
+{
+    DP_ASSERT(sq);
+    DP_ASSERT(mask);
+    DP_ASSERT(diameter > 0);
+    DP_ASSERT(diameter <= DP_DRAW_CONTEXT_STAMP_MAX_DIAMETER);
+    if (sq->ops.used >= OPS_MAX) {
+        DP_stamp_queue_flush(sq);
+    }
+    size_t size = DP_int_to_size(diameter) * DP_int_to_size(diameter);
+    uint16_t *copy = allocate_mask(sq, size);
+    memcpy(copy, mask, sizeof(*copy) * size);
+    return copy;
+}
+
+static void push_op(DP_StampQueue *sq, DP_StampQueueOp op)
+{
+    op.index = DP_size_to_int(sq->ops.used);
+    DP_VECTOR_PUSH_TYPE(&sq->ops, DP_StampQueueOp, op);
+}
+
+void DP_stamp_queue_push(DP_StampQueue *sq, DP_TransientTile *tt,
+                         DP_UPixel15 pixel, int blend_mode,
+                         const uint16_t *mask, uint16_t opacity, int x, int y,
+                         int w, int h, int skip)
+{
+    DP_ASSERT(sq);
+    DP_ASSERT(tt);
+    DP_ASSERT(mask);
+    DP_ASSERT(blend_mode >= 0);
+    push_op(sq, (DP_StampQueueOp){tt, mask, 0, blend_mode, pixel, 0, opacity,
+                                  x, y, w, h, skip});
+}
+
+void DP_stamp_queue_push_posterize(DP_StampQueue *sq, DP_TransientTile *tt,
+                                   int posterize_num, const uint16_t *mask,
+                                   uint16_t opacity, int x, int y, int w, int h,
+                                   int skip)
+{
+    DP_ASSERT(sq);
+    DP_ASSERT(tt);
+    DP_ASSERT(mask);
+    push_op(sq, (DP_StampQueueOp){tt, mask, 0, -1, (DP_UPixel15){0},
+                                  posterize_num, opacity, x, y, w, h, skip});
+}
+
+
+static int compare_ops(const void *a, const void *b)
+{
+    const DP_StampQueueOp *op_a = a;
+    const DP_StampQueueOp *op_b = b;
+    uintptr_t tt_a = (uintptr_t)op_a->tt;
+    uintptr_t tt_b = (uintptr_t)op_b->tt;
+    if (tt_a != tt_b) {
+        return tt_a < tt_b ? -1 : 1;
+    }
+    else {
+        // Keep the original order within a tile, qsort isn't stable.
+        return op_a->index - op_b->index;
+    }
+}
+
+static void flush_parallel(DP_StampQueue *sq, size_t count)
+{
+    // Group the operations by tile, then split them into jobs along tile
+    // boundaries. Each tile is only touched by a single job, in push order.
+    DP_VECTOR_SORT_TYPE(&sq->ops, DP_StampQueueOp, compare_ops);
+    DP_StampQueueOp *ops = sq->ops.elements;
+
+    int thread_count = DP_worker_thread_count(sq->worker);
+    size_t ops_per_job =
+        DP_max_size(1, count / DP_int_to_size(thread_count * JOBS_PER_THREAD));
+
+    // The calling thread takes the last job itself instead of idling.
+    int pushed = 0;
+    size_t start = 0;
+    while (true) {
+        size_t end = DP_min_size(start + ops_per_job, count);
+        while (end < count && ops[end].tt == ops[end - 1].tt) {
+            ++end;
+        }
+
+        if (end < count) {
+            DP_worker_push(sq->worker,
+                           &(struct DP_StampQueueJob){sq, start, end});
+            ++pushed;
+            start = end;
+        }
+        else {
+            apply_ops(ops, start, end);
+            break;
+        }
+    }
+
+    DP_SEMAPHORE_MUST_WAIT_N(sq->done_sem, pushed);
+}
+
+void DP_stamp_queue_flush(DP_StampQueue *sq)
+{
+    DP_ASSERT(sq);
+    size_t count = sq->ops.used;
+    if (count != 0) {
+        DP_PERF_BEGIN_DETAIL(fn, "flush", "count=%zu", count);
+        if (count < PARALLEL_OPS_MIN) {
+            apply_ops(sq->ops.elements, 0, count);
+        }
+        else {
+            flush_parallel(sq, count);
+        }
+        sq->ops.used = 0;
+        DP_PERF_END(fn);
+    }
+    sq->masks.index = 0;
+    sq->masks.used = 0;
+}
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DPENGINE_STAMP_QUEUE_H
+#define DPENGINE_STAMP_QUEUE_H
+#include "pixels.h"
+#include <dpcommon/common.h>
+
+#ifdef DP_NO_STRICT_ALIASING
+typedef struct DP_TransientTile DP_TransientTile;
+#else
+typedef struct DP_Tile DP_TransientTile;
+#endif
+
+
+// Collects brush stamp applications to individual tiles and then carries them
+// out on a pool of worker threads, sharded by tile. Stamps hitting the same
+// tile are applied in the order they were pushed, so the result is identical
+// to applying them one after another. Tiles must stay alive and must not be
+// touched by anything else until the queue has been flushed.
+typedef struct DP_StampQueue DP_StampQueue;
+
+
+// Returns NULL if the worker threads couldn't be started.
+DP_StampQueue *DP_stamp_queue_new(int thread_count);
+
+// Flushes any pending stamps before freeing the queue.
+void DP_stamp_queue_free(DP_StampQueue *sq);
+
+int DP_stamp_queue_thread_count(DP_StampQueue *sq);
+
+// Copies a stamp mask into the queue's storage, the returned pointer stays
+// valid until the next flush. May flush the queue to make room.
+const uint16_t *DP_stamp_queue_mask_copy(DP_StampQueue *sq,
+                                         const uint16_t *mask, int diameter);
+
+void DP_stamp_queue_push(DP_StampQueue *sq, DP_TransientTile *tt,
+                         DP_UPixel15 pixel, int blend_mode,
+                         const uint16_t *mask, uint16_t opacity, int x, int y,
+                         int w, int h, int skip);
+
+void DP_stamp_queue_push_posterize(DP_StampQueue *sq, DP_TransientTile *tt,
+                                   int posterize_num, const uint16_t *mask,
+                                   uint16_t opacity, int x, int y, int w, int h,
+                                   int skip);
+
+// Applies all pending stamps and waits for them to finish.
+void DP_stamp_queue_flush(DP_StampQueue *sq);
+
+
+#endif
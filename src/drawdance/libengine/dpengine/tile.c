@@ -40,36 +40,48 @@
 #include <dpmsg/blend_mode.h>
 
 
+// The pixel array is a flexible array member because its size depends on the
+// kind of tile. Solid tiles consist of a single color, so instead of a full set
+// of pixels they only store that one color in the first element of the array.
+// They're never transient, since a transient tile can be modified in ways that
+// make it not solid anymore. Anything that accesses the pixels of a tile must
+// check for solidity first.
 #ifdef DP_NO_STRICT_ALIASING
 
 struct DP_Tile {
-    DP_ALIGNAS_SIMD DP_Pixel15 pixels[DP_TILE_LENGTH];
     DP_Atomic refcount;
     const bool transient;
     const bool maybe_blank;
+    const bool solid;
     const unsigned int context_id;
+    DP_ALIGNAS_SIMD DP_Pixel15 pixels[];
 };
 
 struct DP_TransientTile {
-    DP_ALIGNAS_SIMD DP_Pixel15 pixels[DP_TILE_LENGTH];
     DP_Atomic refcount;
     bool transient;
     bool maybe_blank;
+    bool solid;
     unsigned int context_id;
+    DP_ALIGNAS_SIMD DP_Pixel15 pixels[];
 };
 
 #else
 
 struct DP_Tile {
-    DP_ALIGNAS_SIMD DP_Pixel15 pixels[DP_TILE_LENGTH];
     DP_Atomic refcount;
     bool transient;
     bool maybe_blank;
+    bool solid;
     unsigned int context_id;
+    DP_ALIGNAS_SIMD DP_Pixel15 pixels[];
 };
 
 #endif
 
+#define FULL_TILE_SIZE  (sizeof(DP_TransientTile) + DP_TILE_BYTES)
+#define SOLID_TILE_SIZE (sizeof(DP_TransientTile) + sizeof(DP_Pixel15))
+
 
 // We want to initialize a static buffer with the same value 4096 times, so this
 // is a goofy way to achieve that at compile time without spelling it all out.
@@ -86,34 +98,145 @@ const uint16_t *DP_tile_opaque_mask(void)
     return opaque_mask;
 }
 
+// Tiles get allocated and freed from lots of threads at once, so instead of
+// taking the pool lock every time, each thread keeps a magazine of tiles around
+// that gets refilled from and drained into the pool in batches. The magazines
+// are linked together so that the statistics can count the tiles sitting in
+// them as free. Their count is only ever modified by the owning thread, but
+// may be read by others, so it's atomic. Everything else is guarded by the
+// pool lock or only accessed by the owning thread.
+#define TILE_MAGAZINE_CAPACITY 32
+#define TILE_MAGAZINE_BATCH    16
+
+typedef struct DP_TileMagazine {
+    struct DP_TileMagazine *prev;
+    struct DP_TileMagazine *next;
+    DP_Atomic count;
+    void *tiles[TILE_MAGAZINE_CAPACITY];
+} DP_TileMagazine;
+
 static DP_MemoryPool tile_memory_pool;
 static DP_Mutex *tile_memory_pool_lock = NULL;
+static DP_ThreadLocal *tile_magazine_key;
+static DP_TileMagazine *tile_magazines;
 
-static void *alloc_tile(bool transient, bool maybe_blank,
-                        unsigned int context_id)
+static void free_tile_magazine(void *value)
+{
+    DP_TileMagazine *tm = value;
+    DP_MUTEX_MUST_LOCK(tile_memory_pool_lock);
+    if (tm->prev) {
+        tm->prev->next = tm->next;
+    }
+    else {
+        tile_magazines = tm->next;
+    }
+    if (tm->next) {
+        tm->next->prev = tm->prev;
+    }
+    int count = DP_atomic_get(&tm->count);
+    for (int i = 0; i < count; ++i) {
+        DP_memory_pool_free_el(&tile_memory_pool, tm->tiles[i]);
+    }
+    DP_MUTEX_MUST_UNLOCK(tile_memory_pool_lock);
+    DP_free(tm);
+}
+
+static void init_tile_memory_pool(void)
 {
     DP_ATOMIC_DECLARE_STATIC_SPIN_LOCK(tile_memory_pool_spinlock);
     if (!tile_memory_pool_lock) {
         DP_atomic_lock(&tile_memory_pool_spinlock);
         if (!tile_memory_pool_lock) {
-            tile_memory_pool = DP_memory_pool_new_type(DP_TransientTile, 1024);
+            tile_memory_pool = DP_memory_pool_new(FULL_TILE_SIZE, 1024);
+            tile_magazine_key = DP_thread_local_new(free_tile_magazine);
             tile_memory_pool_lock = DP_mutex_new();
         }
         DP_atomic_unlock(&tile_memory_pool_spinlock);
     }
+}
 
-    DP_MUTEX_MUST_LOCK(tile_memory_pool_lock);
-    DP_TransientTile *tt = DP_memory_pool_alloc_el(&tile_memory_pool);
-    DP_MUTEX_MUST_UNLOCK(tile_memory_pool_lock);
+static DP_TileMagazine *get_tile_magazine(void)
+{
+    DP_TileMagazine *tm = DP_thread_local_get(tile_magazine_key);
+    if (!tm) {
+        tm = DP_malloc(sizeof(*tm));
+        tm->prev = NULL;
+        DP_atomic_set(&tm->count, 0);
+        DP_MUTEX_MUST_LOCK(tile_memory_pool_lock);
+        tm->next = tile_magazines;
+        if (tile_magazines) {
+            tile_magazines->prev = tm;
+        }
+        tile_magazines = tm;
+        DP_MUTEX_MUST_UNLOCK(tile_memory_pool_lock);
+        DP_thread_local_set(tile_magazine_key, tm);
+    }
+    return tm;
+}
+
+static void *alloc_tile(bool transient, bool maybe_blank,
+                        unsigned int context_id)
+{
+    init_tile_memory_pool();
+
+    DP_TileMagazine *tm = get_tile_magazine();
+    int count = DP_atomic_get(&tm->count);
+    if (count == 0) {
+        DP_MUTEX_MUST_LOCK(tile_memory_pool_lock);
+        for (int i = 0; i < TILE_MAGAZINE_BATCH; ++i) {
+            tm->tiles[i] = DP_memory_pool_alloc_el(&tile_memory_pool);
+        }
+        count = TILE_MAGAZINE_BATCH;
+        DP_atomic_set(&tm->count, count);
+        DP_MUTEX_MUST_UNLOCK(tile_memory_pool_lock);
+    }
+
+    DP_TransientTile *tt = tm->tiles[--count];
+    DP_atomic_set(&tm->count, count);
 
     DP_atomic_set(&tt->refcount, 1);
     tt->transient = transient;
     tt->maybe_blank = maybe_blank;
+    tt->solid = false;
     tt->context_id = context_id;
 
     return tt;
 }
 
+static DP_Tile *alloc_solid_tile(unsigned int context_id, DP_Pixel15 pixel)
+{
+    DP_TransientTile *tt = DP_malloc_simd(SOLID_TILE_SIZE);
+    DP_atomic_set(&tt->refcount, 1);
+    tt->transient = false;
+    tt->maybe_blank = pixel.a == 0;
+    tt->solid = true;
+    tt->context_id = context_id;
+    tt->pixels[0] = pixel;
+    return (DP_Tile *)tt;
+}
+
+static void free_tile(DP_Tile *tile)
+{
+    if (tile->solid) {
+        DP_free_simd(tile);
+        return;
+    }
+
+    DP_TileMagazine *tm = get_tile_magazine();
+    int count = DP_atomic_get(&tm->count);
+    if (count == TILE_MAGAZINE_CAPACITY) {
+        DP_MUTEX_MUST_LOCK(tile_memory_pool_lock);
+        for (int i = 0; i < TILE_MAGAZINE_BATCH; ++i) {
+            DP_memory_pool_free_el(&tile_memory_pool, tm->tiles[--count]);
+        }
+        DP_atomic_set(&tm->count, count);
+        DP_MUTEX_MUST_UNLOCK(tile_memory_pool_lock);
+    }
+
+    tm->tiles[count++] = tile;
+    DP_atomic_set(&tm->count, count);
+}
+
 
 DP_MemoryPoolStatistics DP_tile_memory_usage(void)
 {
@@ -121,11 +244,14 @@ DP_MemoryPoolStatistics DP_tile_memory_usage(void)
         DP_MUTEX_MUST_LOCK(tile_memory_pool_lock);
         DP_MemoryPoolStatistics mps =
             DP_memory_pool_statistics(&tile_memory_pool);
+        for (DP_TileMagazine *tm = tile_magazines; tm; tm = tm->next) {
+            mps.el_free += DP_int_to_size(DP_atomic_get(&tm->count));
+        }
         DP_MUTEX_MUST_UNLOCK(tile_memory_pool_lock);
         return mps;
     }
     else {
-        return (DP_MemoryPoolStatistics){sizeof(DP_TransientTile), 0, 0, 0};
+        return (DP_MemoryPoolStatistics){FULL_TILE_SIZE, 0, 0, 0};
     }
 }
 
@@ -137,11 +263,7 @@ DP_Tile *DP_tile_new(unsigned int context_id)
 
 DP_Tile *DP_tile_new_from_pixel15(unsigned int context_id, DP_Pixel15 pixel)
 {
-    DP_TransientTile *tt = alloc_tile(false, pixel.a == 0, context_id);
-    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
-        tt->pixels[i] = pixel;
-    }
-    return (DP_Tile *)tt;
+    return alloc_solid_tile(context_id, pixel);
 }
 
 DP_Tile *DP_tile_new_from_upixel15(unsigned int context_id, DP_UPixel15 pixel)
@@ -211,6 +333,36 @@ DP_Tile *DP_tile_new_from_compressed(DP_DrawContext *dc,
     }
 }
 
+static unsigned char *get_lossless_inflate_output_buffer(size_t out_size,
+                                                         void *user)
+{
+    if (out_size == DP_TILE_BYTES) {
+        struct DP_TileInflateArgs *args = user;
+        args->tt = alloc_tile(false, true, args->context_id);
+        return (unsigned char *)args->tt->pixels;
+    }
+    else {
+        DP_error_set("Lossless tile decompression needs size %zu, but got %zu",
+                     (size_t)DP_TILE_BYTES, out_size);
+        return NULL;
+    }
+}
+
+DP_Tile *DP_tile_new_from_compressed_lossless(unsigned int context_id,
+                                              const unsigned char *data,
+                                              size_t size)
+{
+    struct DP_TileInflateArgs args = {NULL, context_id, NULL};
+    if (DP_compress_inflate(data, size, get_lossless_inflate_output_buffer,
+                            &args)) {
+        return (DP_Tile *)args.tt;
+    }
+    else {
+        DP_tile_decref_nullable((DP_Tile *)args.tt);
+        return NULL;
+    }
+}
+
 DP_Tile *DP_tile_new_zebra(unsigned int context_id, DP_Pixel15 pixel1,
                            DP_Pixel15 pixel2)
 {
@@ -278,9 +430,7 @@ void DP_tile_decref(DP_Tile *tile)
     DP_ASSERT(tile);
     DP_ASSERT(DP_atomic_get(&tile->refcount) > 0);
     if (DP_atomic_dec(&tile->refcount)) {
-        DP_MUTEX_MUST_LOCK(tile_memory_pool_lock);
-        DP_memory_pool_free_el(&tile_memory_pool, tile);
-        DP_MUTEX_MUST_UNLOCK(tile_memory_pool_lock);
+        free_tile(tile);
     }
 }
 
@@ -313,11 +463,11 @@ unsigned int DP_tile_context_id(DP_Tile *tile)
     return tile->context_id;
 }
 
-const DP_Pixel15 *DP_tile_pixels(DP_Tile *tile)
+bool DP_tile_solid(DP_Tile *tile)
 {
     DP_ASSERT(tile);
     DP_ASSERT(DP_atomic_get(&tile->refcount) > 0);
-    return tile->pixels;
+    return tile->solid;
 }
 
 DP_Pixel15 DP_tile_pixel_at(DP_Tile *tile, int x, int y)
@@ -328,18 +478,26 @@ DP_Pixel15 DP_tile_pixel_at(DP_Tile *tile, int x, int y)
     DP_ASSERT(y >= 0);
     DP_ASSERT(x < DP_TILE_SIZE);
     DP_ASSERT(y < DP_TILE_SIZE);
-    return tile->pixels[y * DP_TILE_SIZE + x];
+    return tile->pixels[tile->solid ? 0 : y * DP_TILE_SIZE + x];
 }
 
 bool DP_tile_blank(DP_Tile *tile)
 {
-    static const DP_Pixel15 blank_pixels[DP_TILE_LENGTH] = {0};
-    return memcmp(tile->pixels, blank_pixels, DP_TILE_BYTES) == 0;
+    if (tile->solid) {
+        return DP_pixel15_equal(tile->pixels[0], DP_pixel15_zero());
+    }
+    else {
+        static const DP_Pixel15 blank_pixels[DP_TILE_LENGTH] = {0};
+        return memcmp(tile->pixels, blank_pixels, DP_TILE_BYTES) == 0;
+    }
 }
 
 bool DP_tile_opaque(DP_Tile *tile_or_null)
 {
-    if (tile_or_null) {
+    if (tile_or_null && tile_or_null->solid) {
+        return tile_or_null->pixels[0].a == DP_BIT15;
+    }
+    else if (tile_or_null) {
         DP_Pixel15 *pixels = tile_or_null->pixels;
         for (int i = 1; i < DP_TILE_LENGTH; ++i) {
             if (pixels[i].a < DP_BIT15) {
@@ -356,7 +514,10 @@ bool DP_tile_opaque(DP_Tile *tile_or_null)
 bool DP_tile_same_pixel(DP_Tile *tile_or_null, DP_Pixel15 *out_pixel)
 {
     DP_Pixel15 pixel;
-    if (tile_or_null) {
+    if (tile_or_null && tile_or_null->solid) {
+        pixel = tile_or_null->pixels[0];
+    }
+    else if (tile_or_null) {
         DP_Pixel15 *pixels = tile_or_null->pixels;
         pixel = pixels[0];
         for (int i = 1; i < DP_TILE_LENGTH; ++i) {
@@ -376,6 +537,47 @@ bool DP_tile_same_pixel(DP_Tile *tile_or_null, DP_Pixel15 *out_pixel)
     return true;
 }
 
+uint64_t DP_tile_content_hash(DP_Tile *tile)
+{
+    DP_ASSERT(tile);
+    DP_ASSERT(DP_atomic_get(&tile->refcount) > 0);
+    // FNV-1a over whole pixels, seeded with the solidity, since a solid tile
+    // never has the same content as a full one, see DP_tile_same_content.
+    bool solid = tile->solid;
+    uint64_t hash = 14695981039346656037u;
+    hash = (hash ^ (solid ? 1u : 0u)) * 1099511628211u;
+    int count = solid ? 1 : DP_TILE_LENGTH;
+    for (int i = 0; i < count; ++i) {
+        DP_Pixel15 pixel = tile->pixels[i];
+        uint64_t value = (uint64_t)pixel.b | ((uint64_t)pixel.g << 16)
+                       | ((uint64_t)pixel.r << 32) | ((uint64_t)pixel.a << 48);
+        hash = (hash ^ value) * 1099511628211u;
+    }
+    return hash;
+}
+
+bool DP_tile_same_content(DP_Tile *a, DP_Tile *b)
+{
+    DP_ASSERT(a);
+    DP_ASSERT(b);
+    DP_ASSERT(DP_atomic_get(&a->refcount) > 0);
+    DP_ASSERT(DP_atomic_get(&b->refcount) > 0);
+    if (a == b) {
+        return true;
+    }
+    else if (a->solid != b->solid) {
+        // DP_tile_compress encodes some solid tiles differently than a full
+        // tile of the same color, so they can't stand in for each other.
+        return false;
+    }
+    else if (a->solid) {
+        return DP_pixel15_equal(a->pixels[0], b->pixels[0]);
+    }
+    else {
+        return memcmp(a->pixels, b->pixels, DP_TILE_BYTES) == 0;
+    }
+}
+
 
 size_t DP_tile_compress(DP_Tile *tile, DP_Pixel8 *pixel_buffer,
                         unsigned char *(*get_output_buffer)(size_t, void *),
@@ -384,12 +586,67 @@ size_t DP_tile_compress(DP_Tile *tile, DP_Pixel8 *pixel_buffer,
     DP_ASSERT(tile);
     DP_ASSERT(DP_atomic_get(&tile->refcount) > 0);
     DP_ASSERT(pixel_buffer);
-    DP_pixels15_to_8(pixel_buffer, tile->pixels, DP_TILE_LENGTH);
+    if (tile->solid) {
+        // Fully opaque or transparent colors survive the trip through a
+        // 4-byte color unchanged, so they can skip compression altogether.
+        DP_Pixel8 pixel = DP_pixel15_to_8(tile->pixels[0]);
+        if (pixel.a == 255 || pixel.color == 0) {
+            unsigned char *buffer = get_output_buffer(4, user);
+            if (!buffer) {
+                return 0;
+            }
+            DP_write_bigendian_uint32(pixel.color, buffer);
+            return 4;
+        }
+        else {
+            for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+                pixel_buffer[i] = pixel;
+            }
+        }
+    }
+    else {
+        DP_pixels15_to_8(pixel_buffer, tile->pixels, DP_TILE_LENGTH);
+    }
     return DP_compress_deflate((const unsigned char *)pixel_buffer,
                                DP_TILE_COMPRESSED_BYTES, get_output_buffer,
                                user);
 }
 
+size_t DP_tile_compress_lossless(
+    DP_Tile *tile, unsigned char *(*get_output_buffer)(size_t, void *),
+    void *user)
+{
+    DP_ASSERT(tile);
+    DP_ASSERT(DP_atomic_get(&tile->refcount) > 0);
+    DP_ASSERT(!tile->solid);
+    // This is for holding onto tiles in memory, so speed matters more than
+    // size and the pixels don't need to be converted to any other format.
+    return DP_compress_deflate_level((const unsigned char *)tile->pixels,
+                                     DP_TILE_BYTES, 1, get_output_buffer, user);
+}
+
+
+static void fill_pixels8(DP_Pixel8 *dst, DP_Pixel8 pixel, int width, int height,
+                         int stride)
+{
+    for (int y = 0; y < height; ++y) {
+        DP_Pixel8 *row = dst + y * stride;
+        for (int x = 0; x < width; ++x) {
+            row[x] = pixel;
+        }
+    }
+}
+
+static void fill_upixels8(DP_UPixel8 *dst, DP_UPixel8 pixel, int width,
+                          int height, int stride)
+{
+    for (int y = 0; y < height; ++y) {
+        DP_UPixel8 *row = dst + y * stride;
+        for (int x = 0; x < width; ++x) {
+            row[x] = pixel;
+        }
+    }
+}
 
 void DP_tile_copy_to_image(DP_Tile *tile_or_null, DP_Image *img, int x, int y)
 {
@@ -400,7 +657,12 @@ void DP_tile_copy_to_image(DP_Tile *tile_or_null, DP_Image *img, int x, int y)
     DP_Pixel8 *dst = DP_image_pixels(img) + y * img_width + x;
     size_t bytes = DP_int_to_size(width) * sizeof(*dst);
 
-    if (tile_or_null) {
+    if (tile_or_null && tile_or_null->solid) {
+        DP_ASSERT(DP_atomic_get(&tile_or_null->refcount) > 0);
+        fill_pixels8(dst, DP_pixel15_to_8(tile_or_null->pixels[0]), width,
+                     height, img_width);
+    }
+    else if (tile_or_null) {
         DP_ASSERT(DP_atomic_get(&tile_or_null->refcount) > 0);
         DP_Pixel15 *src = tile_or_null->pixels;
         for (int i = 0; i < height; ++i) {
@@ -424,7 +686,12 @@ void DP_tile_copy_to_pixels8(DP_Tile *tile_or_null, DP_Pixel8 *pixels, int x,
     DP_Pixel8 *dst = pixels + y * pixels_width + x;
     size_t bytes = DP_int_to_size(width) * sizeof(*dst);
 
-    if (tile_or_null) {
+    if (tile_or_null && tile_or_null->solid) {
+        DP_ASSERT(DP_atomic_get(&tile_or_null->refcount) > 0);
+        fill_pixels8(dst, DP_pixel15_to_8(tile_or_null->pixels[0]), width,
+                     height, pixels_width);
+    }
+    else if (tile_or_null) {
         DP_ASSERT(DP_atomic_get(&tile_or_null->refcount) > 0);
         DP_Pixel15 *src = tile_or_null->pixels;
         for (int i = 0; i < height; ++i) {
@@ -448,7 +715,13 @@ void DP_tile_copy_to_upixels8(DP_Tile *tile_or_null, DP_UPixel8 *pixels, int x,
     DP_UPixel8 *dst = pixels + y * pixels_width + x;
     size_t bytes = DP_int_to_size(width) * sizeof(*dst);
 
-    if (tile_or_null) {
+    if (tile_or_null && tile_or_null->solid) {
+        DP_ASSERT(DP_atomic_get(&tile_or_null->refcount) > 0);
+        DP_UPixel15 pixel = DP_pixel15_unpremultiply(tile_or_null->pixels[0]);
+        fill_upixels8(dst, DP_upixel15_to_8(pixel), width, height,
+                      pixels_width);
+    }
+    else if (tile_or_null) {
         DP_ASSERT(DP_atomic_get(&tile_or_null->refcount) > 0);
         DP_Pixel15 *src = tile_or_null->pixels;
         for (int i = 0; i < height; ++i) {
@@ -504,6 +777,40 @@ static void sample_tile(DP_Pixel15 *src, const uint16_t *mask, int w, int h,
     *in_out_alpha += (float)alpha;
 }
 
+static void sample_solid(DP_Pixel15 p, const uint16_t *mask, int w, int h,
+                         int mask_skip, bool opaque, float *in_out_weight,
+                         float *in_out_red, float *in_out_green,
+                         float *in_out_blue, float *in_out_alpha)
+{
+    uint_fast32_t weight = 0;
+    uint_fast32_t red = 0;
+    uint_fast32_t green = 0;
+    uint_fast32_t blue = 0;
+    uint_fast32_t alpha = 0;
+
+    if (!opaque || p.a > 512) {
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x, ++mask) {
+                uint_fast32_t m = *mask;
+                if (!opaque || m > 512) {
+                    weight += m;
+                    red += m * p.r / (uint_fast32_t)DP_BIT15;
+                    green += m * p.g / (uint_fast32_t)DP_BIT15;
+                    blue += m * p.b / (uint_fast32_t)DP_BIT15;
+                    alpha += m * p.a / (uint_fast32_t)DP_BIT15;
+                }
+            }
+            mask += mask_skip;
+        }
+    }
+
+    *in_out_weight += (float)weight;
+    *in_out_red += (float)red;
+    *in_out_green += (float)green;
+    *in_out_blue += (float)blue;
+    *in_out_alpha += (float)alpha;
+}
+
 static void sample_blank(const uint16_t *mask, int w, int h, int mask_skip,
                          float *in_out_weight)
 {
@@ -523,7 +830,12 @@ void DP_tile_sample(DP_Tile *tile_or_null, const uint16_t *mask, int x, int y,
                     float *in_out_green, float *in_out_blue,
                     float *in_out_alpha)
 {
-    if (tile_or_null) {
+    if (tile_or_null && tile_or_null->solid) {
+        sample_solid(tile_or_null->pixels[0], mask, width, height, skip, opaque,
+                     in_out_weight, in_out_red, in_out_green, in_out_blue,
+                     in_out_alpha);
+    }
+    else if (tile_or_null) {
         DP_Pixel15 *src = tile_or_null->pixels + y * DP_TILE_SIZE + x;
         sample_tile(src, mask, width, height, skip, DP_TILE_SIZE - width,
                     opaque, in_out_weight, in_out_red, in_out_green,
@@ -535,19 +847,32 @@ void DP_tile_sample(DP_Tile *tile_or_null, const uint16_t *mask, int x, int y,
 }
 
 
+static void copy_pixels(DP_Pixel15 *dst, DP_Tile *tile)
+{
+    if (tile->solid) {
+        DP_Pixel15 pixel = tile->pixels[0];
+        for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+            dst[i] = pixel;
+        }
+    }
+    else {
+        memcpy(dst, tile->pixels, DP_TILE_BYTES);
+    }
+}
+
 DP_TransientTile *DP_transient_tile_new(DP_Tile *tile, unsigned int context_id)
 {
     DP_ASSERT(tile);
     DP_ASSERT(DP_atomic_get(&tile->refcount) > 0);
     DP_TransientTile *tt = alloc_tile(true, tile->maybe_blank, context_id);
-    memcpy(tt->pixels, tile->pixels, DP_TILE_BYTES);
+    copy_pixels(tt->pixels, tile);
     return tt;
 }
 
 DP_TransientTile *DP_transient_tile_new_blank(unsigned int context_id)
 {
     DP_TransientTile *tt = alloc_tile(true, true, context_id);
-    memset(tt->pixels, 0, sizeof(tt->pixels));
+    memset(tt->pixels, 0, DP_TILE_BYTES);
 
     return tt;
 }
@@ -614,6 +939,20 @@ DP_Tile *DP_transient_tile_persist(DP_TransientTile *tt)
     return (DP_Tile *)tt;
 }
 
+DP_Tile *DP_transient_tile_persist_compact(DP_TransientTile *tt)
+{
+    DP_Tile *t = DP_transient_tile_persist(tt);
+    DP_Pixel15 pixel;
+    if (DP_tile_same_pixel(t, &pixel)) {
+        DP_Tile *solid_tile = alloc_solid_tile(t->context_id, pixel);
+        DP_tile_decref(t);
+        return solid_tile;
+    }
+    else {
+        return t;
+    }
+}
+
 
 unsigned int DP_transient_tile_context_id(DP_Tile *tt)
 {
@@ -705,7 +1044,7 @@ void DP_transient_tile_copy(DP_TransientTile *tt, DP_Tile *t)
     DP_ASSERT(tt->transient);
     DP_ASSERT(t);
     DP_ASSERT(DP_atomic_get(&t->refcount) > 0);
-    memcpy(tt->pixels, t->pixels, DP_TILE_BYTES);
+    copy_pixels(tt->pixels, t);
     tt->maybe_blank = t->maybe_blank;
 }
 
@@ -740,7 +1079,12 @@ void DP_transient_tile_merge(DP_TransientTile *DP_RESTRICT tt,
     if (DP_blend_mode_can_decrease_opacity(blend_mode)) {
         tt->maybe_blank = true;
     }
-    DP_blend_tile(tt->pixels, t->pixels, opacity, blend_mode);
+    if (t->solid) {
+        DP_blend_tile_solid(tt->pixels, t->pixels[0], opacity, blend_mode);
+    }
+    else {
+        DP_blend_tile(tt->pixels, t->pixels, opacity, blend_mode);
+    }
 }
 
 DP_TransientTile *
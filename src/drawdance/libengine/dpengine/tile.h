@@ -100,6 +100,11 @@ DP_Tile *DP_tile_new_from_compressed(DP_DrawContext *dc,
                                      const unsigned char *image,
                                      size_t image_size);
 
+// Counterpart to DP_tile_compress_lossless, gives back the exact same pixels.
+DP_Tile *DP_tile_new_from_compressed_lossless(unsigned int context_id,
+                                              const unsigned char *data,
+                                              size_t size);
+
 DP_Tile *DP_tile_new_zebra(unsigned int context_id, DP_Pixel15 pixel1,
                            DP_Pixel15 pixel2);
 
@@ -126,7 +131,8 @@ bool DP_tile_transient(DP_Tile *tile);
 
 unsigned int DP_tile_context_id(DP_Tile *tile);
 
-const DP_Pixel15 *DP_tile_pixels(DP_Tile *tile);
+// Solid tiles consist of a single color and only take up the memory for that.
+bool DP_tile_solid(DP_Tile *tile);
 
 DP_Pixel15 DP_tile_pixel_at(DP_Tile *tile, int x, int y);
 
@@ -136,11 +142,25 @@ bool DP_tile_opaque(DP_Tile *tile_or_null);
 
 bool DP_tile_same_pixel(DP_Tile *tile_or_null, DP_Pixel15 *out_pixel);
 
+// Hash of the pixel content. Collisions are possible, DP_tile_same_content
+// tells them apart.
+uint64_t DP_tile_content_hash(DP_Tile *tile);
+
+// Whether the tiles compress to the same data. A solid tile never has the same
+// content as a non-solid one, even if all of their pixels are equal.
+bool DP_tile_same_content(DP_Tile *a, DP_Tile *b);
+
 
 size_t DP_tile_compress(DP_Tile *tile, DP_Pixel8 *pixel_buffer,
                         unsigned char *(*get_output_buffer)(size_t, void *),
                         void *user);
 
+// Compresses the full 15 bit pixels, unlike DP_tile_compress, which converts
+// them to 8 bits. Solid tiles aren't supported, they're already tiny.
+size_t DP_tile_compress_lossless(
+    DP_Tile *tile, unsigned char *(*get_output_buffer)(size_t, void *),
+    void *user);
+
 
 void DP_tile_copy_to_image(DP_Tile *tile_or_null, DP_Image *img, int x, int y);
 
@@ -182,6 +202,10 @@ int DP_transient_tile_refcount(DP_TransientTile *tt);
 
 DP_Tile *DP_transient_tile_persist(DP_TransientTile *tt);
 
+// Like persist, but if all pixels in the tile are the same, the tile is
+// replaced with an equivalent solid one instead. Returns the resulting tile.
+DP_Tile *DP_transient_tile_persist_compact(DP_TransientTile *tt);
+
 
 unsigned int DP_transient_tile_context_id(DP_Tile *tt);
 
@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/layer_list.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dptest.h>
+#include "handle_common.h"
+#include "random_common.h"
+
+
+#define WIDTH         512
+#define HEIGHT        384
+#define LAYER_COUNT   3
+#define STROKE_COUNT  12
+#define STROKE_LENGTH 6
+#define DAB_COUNT     40
+#define UNDO_COUNT    8
+#define REDO_COUNT    4
+
+static void set_pixel_dabs(int count, DP_PixelDab *pds, void *user)
+{
+    for (int i = 0; i < count; ++i) {
+        DP_pixel_dab_init(pds, i, (int8_t)(next_random(user) % 17u),
+                          (int8_t)(next_random(user) % 17u),
+                          (uint8_t)(4u + next_random(user) % 40u),
+                          (uint8_t)(1u + next_random(user) % 255u));
+    }
+}
+
+static DP_Message *make_dabs(unsigned int *state)
+{
+    uint16_t layer_id = (uint16_t)(257u + next_random(state) % LAYER_COUNT);
+    int32_t x = (int32_t)(next_random(state) % WIDTH);
+    int32_t y = (int32_t)(next_random(state) % HEIGHT);
+    // Direct dabs, indirect ones would go into a sublayer.
+    uint32_t color = ((uint32_t)next_random(state)
+                      | ((uint32_t)next_random(state) << 16u))
+                   & 0xffffffu;
+    return DP_msg_draw_dabs_pixel_new(1, layer_id, x, y, color,
+                                      DP_BLEND_MODE_NORMAL, set_pixel_dabs,
+                                      DAB_COUNT, state);
+}
+
+
+static void handle(DP_CanvasHistory *chs[2], DP_DrawContext *dc,
+                   DP_Message *msg)
+{
+    for (int i = 0; i < 2; ++i) {
+        if (!DP_canvas_history_handle(chs[i], dc, msg)) {
+            DP_warn("Error handling message: %s", DP_error());
+        }
+    }
+    DP_message_decref(msg);
+}
+
+static int count_layer_differences(DP_CanvasState *a, DP_CanvasState *b)
+{
+    DP_LayerList *lla = DP_canvas_state_layers_noinc(a);
+    DP_LayerList *llb = DP_canvas_state_layers_noinc(b);
+    // Early save points are from before all the layers were created.
+    int count = DP_layer_list_count(lla);
+    if (count != DP_layer_list_count(llb)) {
+        return -1;
+    }
+    int differences = 0;
+    for (int i = 0; i < count; ++i) {
+        differences += count_differences(
+            DP_layer_list_entry_content_noinc(DP_layer_list_at_noinc(lla, i)),
+            DP_layer_list_entry_content_noinc(DP_layer_list_at_noinc(llb, i)));
+    }
+    return differences;
+}
+
+static int count_state_differences(DP_CanvasHistory *chs[2])
+{
+    DP_CanvasState *a = DP_canvas_history_get(chs[0]);
+    DP_CanvasState *b = DP_canvas_history_get(chs[1]);
+    int differences = count_layer_differences(a, b);
+    DP_canvas_state_decref(b);
+    DP_canvas_state_decref(a);
+    return differences;
+}
+
+// Compares the save points of both histories' snapshots, which must be the
+// same regardless of whether the history had them frozen or not.
+static void snapshot_save_points_eq_ok(TEST_PARAMS, DP_CanvasHistory *chs[2])
+{
+    DP_CanvasHistorySnapshot *a = DP_canvas_history_snapshot_new(chs[0]);
+    DP_CanvasHistorySnapshot *b = DP_canvas_history_snapshot_new(chs[1]);
+    int count = DP_canvas_history_snapshot_history_count(a);
+    INT_EQ_OK(DP_canvas_history_snapshot_history_count(b), count,
+              "snapshots have the same number of entries");
+    int save_points = 0;
+    int differences = 0;
+    for (int i = 0; i < count; ++i) {
+        DP_CanvasState *csa =
+            DP_canvas_history_snapshot_history_entry_at(a, i)->state;
+        DP_CanvasState *csb =
+            DP_canvas_history_snapshot_history_entry_at(b, i)->state;
+        if (csa && csb) {
+            ++save_points;
+            int d = count_layer_differences(csa, csb);
+            differences += d < 0 ? 1 : d;
+        }
+    }
+    OK(save_points > 1, "snapshots have save points");
+    INT_EQ_OK(differences, 0, "snapshot save points identical");
+    DP_canvas_history_snapshot_decref(b);
+    DP_canvas_history_snapshot_decref(a);
+}
+
+static void canvas_history_cold_undo_redo(TEST_PARAMS)
+{
+    // The first history keeps all of its save points around, the second one
+    // has a budget so small that everything that can be frozen will be.
+    DP_CanvasHistory *chs[2] = {
+        DP_canvas_history_new(NULL, NULL, false, NULL),
+        DP_canvas_history_new(NULL, NULL, false, NULL),
+    };
+    DP_canvas_history_cold_budget_set(chs[1], 1);
+    DP_DrawContext *dc = DP_draw_context_new();
+
+    handle(chs, dc, DP_msg_canvas_resize_new(1, 0, WIDTH, HEIGHT, 0));
+    for (int i = 0; i < LAYER_COUNT; ++i) {
+        handle(chs, dc,
+               DP_msg_layer_tree_create_new(1, (uint16_t)(257 + i), 0, 0, 0, 0,
+                                            "", 0));
+    }
+
+    unsigned int state = 1;
+    for (int i = 0; i < STROKE_COUNT; ++i) {
+        handle(chs, dc, DP_msg_undo_point_new(1));
+        for (int j = 0; j < STROKE_LENGTH; ++j) {
+            handle(chs, dc, make_dabs(&state));
+        }
+    }
+    handle(chs, dc, DP_msg_undo_point_new(1));
+
+    DP_CanvasHistoryColdStats stats = DP_canvas_history_cold_stats(chs[1]);
+    OK(stats.cold_points > 0, "save points were frozen");
+    OK(stats.cold_tiles > 0, "tiles were frozen");
+    OK(stats.cold_compressed_bytes < stats.cold_raw_bytes,
+       "frozen tiles are compressed");
+    INT_EQ_OK(DP_canvas_history_cold_stats(chs[0]).cold_points, 0,
+              "no save points frozen without a budget");
+    INT_EQ_OK(count_state_differences(chs), 0,
+              "states identical after drawing");
+    snapshot_save_points_eq_ok(TEST_ARGS, chs);
+
+    for (int i = 0; i < UNDO_COUNT; ++i) {
+        handle(chs, dc, DP_msg_undo_new(1, 0, false));
+        INT_EQ_OK(count_state_differences(chs), 0,
+                  "states identical after undo %d", i + 1);
+    }
+    for (int i = 0; i < REDO_COUNT; ++i) {
+        handle(chs, dc, DP_msg_undo_new(1, 0, true));
+        INT_EQ_OK(count_state_differences(chs), 0,
+                  "states identical after redo %d", i + 1);
+    }
+    OK(DP_canvas_history_cold_stats(chs[1]).thaws > 0,
+       "save points were thawed");
+
+    // Resetting drops all save points, cold ones included.
+    DP_canvas_history_cold_budget_set(chs[1], 0);
+    DP_canvas_history_reset(chs[1]);
+    INT_EQ_OK(DP_canvas_history_cold_stats(chs[1]).cold_points, 0,
+              "no frozen save points after reset");
+
+    DP_draw_context_free(dc);
+    DP_canvas_history_free(chs[1]);
+    DP_canvas_history_free(chs[0]);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(canvas_history_cold_undo_redo);
+}
+
+int main(int argc, char **argv)
+{
+    DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/frame_pipeline.h>
+#include <dpengine/image.h>
+#include <dpengine/view_mode.h>
+#include <dpmsg/message.h>
+#include <dptest.h>
+#include "handle_common.h"
+
+
+#define WIDTH       96
+#define HEIGHT      80
+#define FRAME_COUNT 6
+
+// Frames 0 and 1, 2 and 3 and 4 and 5 are the same, so every other frame in
+// here can reuse the previous image, including across the wraparound.
+static const int frame_indexes[] = {0, 1, 2, 3, 4, 5, 0, 1, 3, 2, 5, 0};
+static const bool frame_reused[] = {false, true,  false, true,
+                                    false, true,  false, true,
+                                    false, true,  false, false};
+
+static DP_CanvasState *make_animation(DP_DrawContext *dc)
+{
+    static const uint32_t fills[] = {0xffff0000u, 0xff00ff00u, 0xff0000ffu};
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    handle_history(ch, dc, DP_msg_canvas_resize_new(1, 0, WIDTH, HEIGHT, 0));
+    handle_history(ch, dc,
+                   DP_msg_set_metadata_int_new(
+                       1, DP_MSG_SET_METADATA_INT_FIELD_FRAME_COUNT,
+                       FRAME_COUNT));
+    handle_history(ch, dc, DP_msg_track_create_new(1, 257, 0, 0, "", 0));
+    for (int i = 0; i < 3; ++i) {
+        uint16_t layer_id = (uint16_t)(257 + i);
+        handle_history(ch, dc,
+                       DP_msg_layer_tree_create_new(1, layer_id, 0, 0,
+                                                    fills[i], 0, "", 0));
+        handle_history(ch, dc,
+                       DP_msg_key_frame_set_new(
+                           1, 257, (uint16_t)(i * 2), layer_id, 0,
+                           DP_MSG_KEY_FRAME_SET_SOURCE_LAYER));
+    }
+    DP_CanvasState *cs = DP_canvas_history_get(ch);
+    DP_canvas_history_free(ch);
+    return cs;
+}
+
+static bool same_image(DP_Image *a, DP_Image *b)
+{
+    if (!a || !b || DP_image_width(a) != DP_image_width(b)
+        || DP_image_height(a) != DP_image_height(b)) {
+        return false;
+    }
+    size_t size = sizeof(*DP_image_pixels(a))
+                * DP_int_to_size(DP_image_width(a))
+                * DP_int_to_size(DP_image_height(a));
+    return memcmp(DP_image_pixels(a), DP_image_pixels(b), size) == 0;
+}
+
+static DP_Image *flatten_frame(DP_CanvasState *cs, int frame_index)
+{
+    DP_ViewModeBuffer vmb;
+    DP_view_mode_buffer_init(&vmb);
+    DP_ViewModeFilter vmf =
+        DP_view_mode_filter_make_frame_render(&vmb, cs, frame_index);
+    DP_Image *img = DP_canvas_state_to_flat_image(
+        cs, DP_FLAT_IMAGE_RENDER_FLAGS, NULL, &vmf);
+    DP_view_mode_buffer_dispose(&vmb);
+    return img;
+}
+
+static void check_pipeline(TEST_PARAMS, DP_CanvasState *cs, int thread_count)
+{
+    int count = DP_size_to_int(DP_ARRAY_LENGTH(frame_indexes));
+    DP_FramePipeline *fp =
+        DP_frame_pipeline_new(cs, NULL, count, frame_indexes, thread_count);
+    for (int i = 0; i < count; ++i) {
+        bool reused;
+        DP_Image *img = DP_frame_pipeline_next(fp, &reused);
+        DP_Image *expected = flatten_frame(cs, frame_indexes[i]);
+        OK(same_image(img, expected), "%d thread(s) frame %d matches",
+           thread_count, i);
+        OK(reused == frame_reused[i], "%d thread(s) frame %d reused is %s",
+           thread_count, i, frame_reused[i] ? "true" : "false");
+        DP_image_free(expected);
+    }
+    NULL_OK(DP_frame_pipeline_next(fp, NULL),
+            "%d thread(s) pipeline runs out of frames", thread_count);
+    DP_frame_pipeline_free(fp);
+}
+
+
+static void frame_pipeline_order(TEST_PARAMS)
+{
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_CanvasState *cs = make_animation(dc);
+    INT_EQ_OK(DP_canvas_state_frame_count(cs), FRAME_COUNT, "frame count");
+    OK(!DP_canvas_state_same_frame(cs, 1, 2), "frames 1 and 2 differ");
+
+    for (int thread_count = 1; thread_count <= 4; ++thread_count) {
+        check_pipeline(TEST_ARGS, cs, thread_count);
+    }
+
+    DP_canvas_state_decref(cs);
+    DP_draw_context_free(dc);
+}
+
+static void frame_pipeline_early_free(TEST_PARAMS)
+{
+    // Freeing the pipeline with frames still being flattened must wait for
+    // them to finish instead of pulling the rug out from under them.
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_CanvasState *cs = make_animation(dc);
+    int count = DP_size_to_int(DP_ARRAY_LENGTH(frame_indexes));
+    DP_FramePipeline *fp =
+        DP_frame_pipeline_new(cs, NULL, count, frame_indexes, 4);
+    NOT_NULL_OK(DP_frame_pipeline_next(fp, NULL), "got first frame");
+    DP_frame_pipeline_free(fp);
+
+    fp = DP_frame_pipeline_new(cs, NULL, 0, NULL, 2);
+    NULL_OK(DP_frame_pipeline_next(fp, NULL), "empty pipeline has no frames");
+    DP_frame_pipeline_free(fp);
+
+    DP_canvas_state_decref(cs);
+    DP_draw_context_free(dc);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(frame_pipeline_order);
+    REGISTER_TEST(frame_pipeline_early_free);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
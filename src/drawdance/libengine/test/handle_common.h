@@ -24,6 +24,9 @@
 #include <dpengine/canvas_history.h>
 #include <dpengine/canvas_state.h>
 #include <dpengine/draw_context.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
 #include <dpmsg/message.h>
 #include <dptest.h>
 
@@ -64,6 +67,59 @@ DP_UNUSED static void register_handle_tests(REGISTER_PARAMS)
 }
 
 
+DP_UNUSED static void handle_history(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                                     DP_Message *msg)
+{
+    if (!DP_canvas_history_handle(ch, dc, msg)) {
+        DP_warn("Error handling message: %s", DP_error());
+    }
+    DP_message_decref(msg);
+}
+
+DP_UNUSED static DP_CanvasState *handle_state(DP_CanvasState *cs,
+                                              DP_DrawContext *dc,
+                                              DP_Message *msg)
+{
+    DP_CanvasState *next = DP_canvas_state_handle(cs, dc, NULL, msg);
+    DP_message_decref(msg);
+    DP_ASSERT(next);
+    DP_canvas_state_decref(cs);
+    return next;
+}
+
+// Number of pixels that differ between the two, plus tiles that are only
+// present in one of them.
+DP_UNUSED static int count_differences(DP_LayerContent *a, DP_LayerContent *b)
+{
+    int differences = 0;
+    int xtiles = DP_tile_count_round(DP_layer_content_width(a));
+    int ytiles = DP_tile_count_round(DP_layer_content_height(a));
+    for (int tile_y = 0; tile_y < ytiles; ++tile_y) {
+        for (int tile_x = 0; tile_x < xtiles; ++tile_x) {
+            DP_Tile *ta = DP_layer_content_tile_at_noinc(a, tile_x, tile_y);
+            DP_Tile *tb = DP_layer_content_tile_at_noinc(b, tile_x, tile_y);
+            if (!ta || !tb) {
+                if (ta != tb) {
+                    ++differences;
+                }
+                continue;
+            }
+            for (int y = 0; y < DP_TILE_SIZE; ++y) {
+                for (int x = 0; x < DP_TILE_SIZE; ++x) {
+                    DP_Pixel15 pa = DP_tile_pixel_at(ta, x, y);
+                    DP_Pixel15 pb = DP_tile_pixel_at(tb, x, y);
+                    if (pa.b != pb.b || pa.g != pb.g || pa.r != pb.r
+                        || pa.a != pb.a) {
+                        ++differences;
+                    }
+                }
+            }
+        }
+    }
+    return differences;
+}
+
+
 DP_UNUSED static void add_message(DP_Output *output, DP_CanvasHistory *ch,
                                   DP_DrawContext *dc, DP_Message *msg)
 {
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/threading.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/paint_engine.h>
+#include <dpmsg/acl.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dpmsg/msg_internal.h>
+#include <dptest.h>
+
+
+#define STROKE_COUNT     3
+#define FILLS_PER_STROKE 2
+
+static void on_renderer_tile(DP_UNUSED void *user, DP_UNUSED int x,
+                             DP_UNUSED int y, DP_UNUSED DP_Pixel8 *pixels)
+{
+}
+
+static void on_renderer_unlock(DP_UNUSED void *user)
+{
+}
+
+static void on_renderer_resize(DP_UNUSED void *user, DP_UNUSED int width,
+                               DP_UNUSED int height, DP_UNUSED int prev_width,
+                               DP_UNUSED int prev_height,
+                               DP_UNUSED int offset_x, DP_UNUSED int offset_y,
+                               DP_UNUSED int lod)
+{
+}
+
+static void on_playback(void *user, DP_UNUSED long long position)
+{
+    DP_Semaphore *sem = user;
+    DP_SEMAPHORE_MUST_POST(sem);
+}
+
+static void on_acls_changed(DP_UNUSED void *user,
+                            DP_UNUSED int acl_change_flags)
+{
+}
+
+static void on_laser_trail(DP_UNUSED void *user,
+                           DP_UNUSED unsigned int context_id,
+                           DP_UNUSED int persistence, DP_UNUSED uint32_t color)
+{
+}
+
+static void on_move_pointer(DP_UNUSED void *user,
+                            DP_UNUSED unsigned int context_id,
+                            DP_UNUSED int x, DP_UNUSED int y)
+{
+}
+
+
+static void paint_engine_stats(TEST_PARAMS)
+{
+    DP_Semaphore *sem = DP_semaphore_new(0);
+    DP_DrawContext *paint_dc = DP_draw_context_new();
+    DP_DrawContext *main_dc = DP_draw_context_new();
+    DP_DrawContext *preview_dc = DP_draw_context_new();
+    DP_AclState *acls = DP_acl_state_new_playback();
+    DP_PaintEngine *pe = DP_paint_engine_new_inc(
+        paint_dc, main_dc, preview_dc, acls, NULL, false, 0, 0,
+        on_renderer_tile, on_renderer_unlock, on_renderer_resize, NULL, NULL,
+        NULL, NULL, NULL, false, NULL, NULL, NULL, NULL, on_playback, NULL,
+        sem, NULL, NULL);
+
+    DP_Message *msgs[2 + STROKE_COUNT * (1 + FILLS_PER_STROKE) + 2];
+    int count = 0;
+    msgs[count++] = DP_msg_canvas_resize_new(1, 0, 100, 100, 0);
+    msgs[count++] =
+        DP_msg_layer_tree_create_new(1, 0x101, 0, 0, 0, 0, "layer", 5);
+    for (int i = 0; i < STROKE_COUNT; ++i) {
+        msgs[count++] = DP_msg_undo_point_new(1);
+        for (int j = 0; j < FILLS_PER_STROKE; ++j) {
+            msgs[count++] = DP_msg_fill_rect_new(
+                1, 0x101, DP_BLEND_MODE_NORMAL, DP_int_to_uint32(i * 10),
+                DP_int_to_uint32(j * 10), 10, 10, 0xff000000u);
+        }
+    }
+    // The history figures get updated on undo points.
+    msgs[count++] = DP_msg_undo_point_new(1);
+    // Processed after everything else, so it tells us when the engine is done.
+    msgs[count++] = DP_msg_internal_playback_new(0, 0);
+
+    // The history holds on to every message except the internal one, plus the
+    // undo point it starts out with.
+    DP_Message *initial_undo_point = DP_msg_undo_point_new(0);
+    size_t retained_bytes = DP_message_length(initial_undo_point);
+    DP_message_decref(initial_undo_point);
+    for (int i = 0; i < count - 1; ++i) {
+        retained_bytes += DP_message_length(msgs[i]);
+    }
+
+    DP_PaintEngineStats before = DP_paint_engine_stats(pe);
+    INT_EQ_OK(before.history.entries, 1, "history starts with one entry");
+    INT_EQ_OK(before.history.save_points, 1,
+              "history starts with one save point");
+
+    int pushed = DP_paint_engine_handle_inc(pe, false, true, count, msgs,
+                                            on_acls_changed, on_laser_trail,
+                                            on_move_pointer, NULL);
+    INT_EQ_OK(pushed, count, "all messages pushed");
+    for (int i = 0; i < count; ++i) {
+        DP_message_decref(msgs[i]);
+    }
+    DP_SEMAPHORE_MUST_WAIT(sem);
+
+    DP_PaintEngineStats stats = DP_paint_engine_stats(pe);
+    UINT_EQ_OK(stats.messages_handled - before.messages_handled,
+               (unsigned int)count, "messages handled");
+    UINT_EQ_OK(stats.messages_by_context[1] - before.messages_by_context[1],
+               (unsigned int)count - 1, "messages handled for context 1");
+    UINT_EQ_OK(stats.messages_by_context[2] - before.messages_by_context[2], 0u,
+               "no messages handled for context 2");
+    INT_EQ_OK(stats.local_queue_depth, 0, "local queue drained");
+    INT_EQ_OK(stats.remote_queue_depth, 0, "remote queue drained");
+    INT_EQ_OK(stats.history.entries, count, "history entries");
+    INT_EQ_OK(stats.history.save_points, STROKE_COUNT + 2,
+              "save point per undo point plus the initial one");
+    OK(stats.history.retained_bytes == retained_bytes,
+       "retained message bytes %zu == %zu", stats.history.retained_bytes,
+       retained_bytes);
+
+    DP_paint_engine_free_join(pe);
+    DP_acl_state_free(acls);
+    DP_draw_context_free(preview_dc);
+    DP_draw_context_free(main_dc);
+    DP_draw_context_free(paint_dc);
+    DP_semaphore_free(sem);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(paint_engine_stats);
+}
+
+int main(int argc, char **argv)
+{
+    DP_test_main(argc, argv, register_tests, NULL);
+}
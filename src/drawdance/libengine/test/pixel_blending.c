@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: MIT
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/cpu.h>
+#include <dpengine/pixels.h>
+#include <dpmsg/blend_mode.h>
+#include <dptest.h>
+
+
+// Blending uses vector instructions for some blend modes if available. These
+// tests run the same inputs through every level of CPU support up to what is
+// actually available and check that the results are bit-identical to the
+// plain scalar versions. If the CPU support is fixed at compile-time, this
+// just compares the implementation against itself.
+
+extern DP_CpuSupport DP_cpu_support_value;
+
+static const int separable_blend_modes[] = {
+    DP_BLEND_MODE_MULTIPLY,    DP_BLEND_MODE_DIVIDE,
+    DP_BLEND_MODE_BURN,        DP_BLEND_MODE_DODGE,
+    DP_BLEND_MODE_DARKEN,      DP_BLEND_MODE_LIGHTEN,
+    DP_BLEND_MODE_SUBTRACT,    DP_BLEND_MODE_ADD,
+    DP_BLEND_MODE_SCREEN,      DP_BLEND_MODE_OVERLAY,
+    DP_BLEND_MODE_HARD_LIGHT,  DP_BLEND_MODE_SOFT_LIGHT,
+    DP_BLEND_MODE_LINEAR_BURN, DP_BLEND_MODE_LINEAR_LIGHT,
+    DP_BLEND_MODE_LUMINOSITY_SHINE_SAI,
+};
+
+static const uint16_t opacities[] = {0, 1, 9999, 16384, 32767, DP_BIT15};
+
+#define MASK_WIDTH     61
+#define MASK_HEIGHT    13
+#define MASK_SKIP      3
+#define BASE_SKIP      5
+#define MASK_LENGTH    ((MASK_WIDTH + MASK_SKIP) * MASK_HEIGHT)
+#define MASK_DST_COUNT ((MASK_WIDTH + BASE_SKIP) * MASK_HEIGHT)
+
+static_assert(MASK_DST_COUNT <= DP_TILE_LENGTH, "mask fits into a tile");
+
+
+static uint16_t random_channel(int max)
+{
+    // Bias towards the edges of the range, that's where things break.
+    switch (rand() % 8) {
+    case 0:
+        return 0;
+    case 1:
+        return DP_int_to_uint16(max);
+    case 2:
+        return DP_int_to_uint16(max / 2);
+    default:
+        return DP_int_to_uint16(rand() % (max + 1));
+    }
+}
+
+static DP_Pixel15 random_pixel(void)
+{
+    uint16_t a = random_channel(DP_BIT15);
+    return (DP_Pixel15){
+        .b = random_channel(a),
+        .g = random_channel(a),
+        .r = random_channel(a),
+        .a = a,
+    };
+}
+
+static DP_UPixel15 random_upixel(void)
+{
+    return (DP_UPixel15){
+        .b = random_channel(DP_BIT15),
+        .g = random_channel(DP_BIT15),
+        .r = random_channel(DP_BIT15),
+        .a = DP_BIT15,
+    };
+}
+
+static void fill_random_pixels(DP_Pixel15 *pixels, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        pixels[i] = random_pixel();
+    }
+}
+
+static bool check_pixels_equal(TEST_PARAMS, const DP_Pixel15 *actual,
+                               const DP_Pixel15 *expected, int count,
+                               const char *what, int blend_mode,
+                               uint16_t opacity, int cpu_support)
+{
+    for (int i = 0; i < count; ++i) {
+        DP_Pixel15 a = actual[i];
+        DP_Pixel15 e = expected[i];
+        if (!DP_pixel15_equal(a, e)) {
+            return FAIL("%s %s opacity %d cpu support %d: pixel %d is "
+                        "{%d, %d, %d, %d}, expected {%d, %d, %d, %d}",
+                        what, DP_blend_mode_enum_name(blend_mode),
+                        (int)opacity, cpu_support, i, a.b, a.g, a.r, a.a, e.b,
+                        e.g, e.r, e.a);
+        }
+    }
+    return PASS("%s %s opacity %d cpu support %d", what,
+                DP_blend_mode_enum_name(blend_mode), (int)opacity,
+                cpu_support);
+}
+
+
+static void blend_tile_separable(TEST_PARAMS)
+{
+    DP_CpuSupport max_support = DP_cpu_support_value;
+    DP_Pixel15 *src = DP_malloc_simd(sizeof(*src) * DP_TILE_LENGTH);
+    DP_Pixel15 *dst = DP_malloc_simd(sizeof(*dst) * DP_TILE_LENGTH);
+    DP_Pixel15 *expected = DP_malloc_simd(sizeof(*dst) * DP_TILE_LENGTH);
+    DP_Pixel15 *actual = DP_malloc_simd(sizeof(*dst) * DP_TILE_LENGTH);
+    fill_random_pixels(src, DP_TILE_LENGTH);
+    fill_random_pixels(dst, DP_TILE_LENGTH);
+
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(separable_blend_modes); ++i) {
+        int blend_mode = separable_blend_modes[i];
+        for (size_t j = 0; j < DP_ARRAY_LENGTH(opacities); ++j) {
+            uint16_t opacity = opacities[j];
+
+            DP_cpu_support_value = DP_CPU_SUPPORT_DEFAULT;
+            memcpy(expected, dst, sizeof(*dst) * DP_TILE_LENGTH);
+            DP_blend_tile(expected, src, opacity, blend_mode);
+
+            for (int cpu_support = DP_CPU_SUPPORT_DEFAULT + 1;
+                 cpu_support <= (int)max_support; ++cpu_support) {
+                DP_cpu_support_value = (DP_CpuSupport)cpu_support;
+                memcpy(actual, dst, sizeof(*dst) * DP_TILE_LENGTH);
+                DP_blend_tile(actual, src, opacity, blend_mode);
+                check_pixels_equal(T, actual, expected, DP_TILE_LENGTH,
+                                   "blend_tile", blend_mode, opacity,
+                                   cpu_support);
+            }
+        }
+    }
+
+    DP_cpu_support_value = max_support;
+    DP_free_simd(actual);
+    DP_free_simd(expected);
+    DP_free_simd(dst);
+    DP_free_simd(src);
+}
+
+
+static void blend_mask_separable(TEST_PARAMS)
+{
+    DP_CpuSupport max_support = DP_cpu_support_value;
+    uint16_t *mask = DP_malloc(sizeof(*mask) * MASK_LENGTH);
+    DP_Pixel15 *dst = DP_malloc(sizeof(*dst) * MASK_DST_COUNT);
+    DP_Pixel15 *expected = DP_malloc(sizeof(*dst) * MASK_DST_COUNT);
+    DP_Pixel15 *actual = DP_malloc(sizeof(*dst) * MASK_DST_COUNT);
+    for (int i = 0; i < MASK_LENGTH; ++i) {
+        mask[i] = random_channel(DP_BIT15);
+    }
+    fill_random_pixels(dst, MASK_DST_COUNT);
+
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(separable_blend_modes); ++i) {
+        int blend_mode = separable_blend_modes[i];
+        DP_UPixel15 src = random_upixel();
+        for (size_t j = 0; j < DP_ARRAY_LENGTH(opacities); ++j) {
+            uint16_t opacity = opacities[j];
+
+            DP_cpu_support_value = DP_CPU_SUPPORT_DEFAULT;
+            memcpy(expected, dst, sizeof(*dst) * MASK_DST_COUNT);
+            DP_blend_mask(expected, src, blend_mode, mask, opacity, MASK_WIDTH,
+                          MASK_HEIGHT, MASK_SKIP, BASE_SKIP);
+
+            for (int cpu_support = DP_CPU_SUPPORT_DEFAULT + 1;
+                 cpu_support <= (int)max_support; ++cpu_support) {
+                DP_cpu_support_value = (DP_CpuSupport)cpu_support;
+                memcpy(actual, dst, sizeof(*dst) * MASK_DST_COUNT);
+                DP_blend_mask(actual, src, blend_mode, mask, opacity,
+                              MASK_WIDTH, MASK_HEIGHT, MASK_SKIP, BASE_SKIP);
+                check_pixels_equal(T, actual, expected, MASK_DST_COUNT,
+                                   "blend_mask", blend_mode, opacity,
+                                   cpu_support);
+            }
+        }
+    }
+
+    DP_cpu_support_value = max_support;
+    DP_free(actual);
+    DP_free(expected);
+    DP_free(dst);
+    DP_free(mask);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(blend_tile_separable);
+    REGISTER_TEST(blend_mask_separable);
+}
+
+int main(int argc, char **argv)
+{
+    DP_test_main(argc, argv, register_tests, NULL);
+}
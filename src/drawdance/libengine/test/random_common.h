@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DP_TEST_RANDOM_COMMON_H
+#define DP_TEST_RANDOM_COMMON_H
+
+// Small deterministic pseudo-random generator for tests and benchmarks, so
+// that runs are repeatable across platforms and C libraries.
+static inline unsigned int next_random(unsigned int *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16u) & 0x7fffu;
+}
+
+#endif
@@ -0,0 +1,394 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/threading.h>
+#include <dpengine/canvas_diff.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/local_state.h>
+#include <dpengine/pixels.h>
+#include <dpengine/renderer.h>
+#include <dpengine/tile.h>
+#include <dpengine/view_mode.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dptest.h>
+#include "handle_common.h"
+
+
+#define WIDTH  300
+#define HEIGHT 200
+
+typedef struct DP_RendererTest {
+    DP_Semaphore *sem;
+    DP_Pixel8 *pixels;
+    int width, height, lod;
+} DP_RendererTest;
+
+static void on_tile(void *user, int x, int y, DP_Pixel8 *pixels)
+{
+    DP_RendererTest *rt = user;
+    int left = x * DP_TILE_SIZE;
+    int top = y * DP_TILE_SIZE;
+    int right = DP_min_int(left + DP_TILE_SIZE, rt->width);
+    int bottom = DP_min_int(top + DP_TILE_SIZE, rt->height);
+    for (int py = top; py < bottom; ++py) {
+        for (int px = left; px < right; ++px) {
+            rt->pixels[py * rt->width + px] =
+                pixels[(py - top) * DP_TILE_SIZE + (px - left)];
+        }
+    }
+}
+
+static void on_unlock(void *user)
+{
+    DP_RendererTest *rt = user;
+    DP_SEMAPHORE_MUST_POST(rt->sem);
+}
+
+static void on_resize(void *user, int width, int height,
+                      DP_UNUSED int prev_width, DP_UNUSED int prev_height,
+                      DP_UNUSED int offset_x, DP_UNUSED int offset_y, int lod)
+{
+    DP_RendererTest *rt = user;
+    int lod_width = DP_renderer_lod_size(width, lod);
+    int lod_height = DP_renderer_lod_size(height, lod);
+    DP_free(rt->pixels);
+    rt->pixels = DP_malloc(sizeof(*rt->pixels) * DP_int_to_size(lod_width)
+                           * DP_int_to_size(lod_height));
+    rt->width = lod_width;
+    rt->height = lod_height;
+    rt->lod = lod;
+}
+
+
+static DP_CanvasState *fill_rect(DP_CanvasState *cs, DP_DrawContext *dc,
+                                 uint16_t layer_id, uint32_t x, uint32_t y,
+                                 uint32_t w, uint32_t h, uint32_t color)
+{
+    return handle_state(cs, dc,
+                        DP_msg_fill_rect_new(1, layer_id, DP_BLEND_MODE_NORMAL,
+                                             x, y, w, h, color));
+}
+
+static DP_CanvasState *set_blend_mode(DP_CanvasState *cs, DP_DrawContext *dc,
+                                      uint16_t layer_id, uint8_t opacity,
+                                      uint8_t blend_mode)
+{
+    return handle_state(cs, dc,
+                        DP_msg_layer_attributes_new(1, layer_id, 0, 0, opacity,
+                                                    blend_mode));
+}
+
+static void set_active_layer(DP_LocalState *ls, DP_DrawContext *dc,
+                             int layer_id)
+{
+    DP_Message *msg = DP_local_state_msg_active_layer_new(layer_id);
+    DP_local_state_handle(ls, dc, msg);
+    DP_message_decref(msg);
+}
+
+
+static bool pixels_match(DP_Pixel8 a, DP_Pixel8 b)
+{
+    // Merging the layers above the active one as a single tile may round
+    // differently than blending them one by one.
+    return abs(a.b - b.b) <= 1 && abs(a.g - b.g) <= 1 && abs(a.r - b.r) <= 1
+        && abs(a.a - b.a) <= 1;
+}
+
+// Flattens the whole canvas at full resolution, padded out to full tiles.
+static DP_Pixel15 *flatten_canvas(DP_CanvasState *cs, int xtiles, int ytiles)
+{
+    int stride = xtiles * DP_TILE_SIZE;
+    DP_Pixel15 *canvas = DP_malloc(sizeof(*canvas) * DP_int_to_size(stride)
+                                   * DP_int_to_size(ytiles * DP_TILE_SIZE));
+    DP_ViewModeFilter vmf = DP_view_mode_filter_make_default();
+    DP_TransientTile *tt = DP_transient_tile_new_blank(0);
+    for (int tile_y = 0; tile_y < ytiles; ++tile_y) {
+        for (int tile_x = 0; tile_x < xtiles; ++tile_x) {
+            DP_Tile *background_tile =
+                DP_canvas_state_background_tile_noinc(cs);
+            if (background_tile) {
+                DP_transient_tile_copy(tt, background_tile);
+            }
+            else {
+                DP_transient_tile_clear(tt);
+            }
+            DP_canvas_state_flatten_tile_to(cs, tile_y * xtiles + tile_x, tt,
+                                            true, &vmf);
+            DP_Pixel15 *src = DP_transient_tile_pixels(tt);
+            for (int y = 0; y < DP_TILE_SIZE; ++y) {
+                for (int x = 0; x < DP_TILE_SIZE; ++x) {
+                    canvas[(tile_y * DP_TILE_SIZE + y) * stride
+                           + tile_x * DP_TILE_SIZE + x] =
+                        src[y * DP_TILE_SIZE + x];
+                }
+            }
+        }
+    }
+    DP_transient_tile_decref(tt);
+    return canvas;
+}
+
+static DP_Pixel8 downsample_pixel(const DP_Pixel15 *canvas, int stride, int x,
+                                  int y, int lod)
+{
+    int n = 1 << lod;
+    uint32_t b = 0, g = 0, r = 0, a = 0;
+    for (int sy = 0; sy < n; ++sy) {
+        for (int sx = 0; sx < n; ++sx) {
+            DP_Pixel15 p = canvas[(y * n + sy) * stride + x * n + sx];
+            b += p.b;
+            g += p.g;
+            r += p.r;
+            a += p.a;
+        }
+    }
+    uint32_t count = (uint32_t)(n * n);
+    return DP_pixel15_to_8((DP_Pixel15){
+        .b = (uint16_t)((b + count / 2u) / count),
+        .g = (uint16_t)((g + count / 2u) / count),
+        .r = (uint16_t)((r + count / 2u) / count),
+        .a = (uint16_t)((a + count / 2u) / count),
+    });
+}
+
+static void render_and_compare_mode(TEST_PARAMS, DP_Renderer *renderer,
+                                    DP_RendererTest *rt, DP_CanvasState *prev,
+                                    DP_CanvasState *cs, DP_LocalState *ls,
+                                    DP_CanvasDiff *diff, int lod,
+                                    DP_RendererMode mode, const char *title)
+{
+    // Only render what changed, the rest must carry over from before.
+    DP_canvas_state_diff(cs, prev, diff);
+    DP_renderer_apply(renderer, cs, ls, diff, false, (DP_Pixel8){0},
+                      (DP_Pixel8){0}, DP_rect_make(0, 0, INT16_MAX, INT16_MAX),
+                      false, lod, mode);
+    DP_SEMAPHORE_MUST_WAIT(rt->sem);
+
+    int width = DP_canvas_state_width(cs);
+    int height = DP_canvas_state_height(cs);
+    int lod_width = DP_renderer_lod_size(width, lod);
+    int lod_height = DP_renderer_lod_size(height, lod);
+    INT_EQ_OK(rt->lod, lod, "%s: rendered level of detail", title);
+    INT_EQ_OK(rt->width, lod_width, "%s: rendered width", title);
+    INT_EQ_OK(rt->height, lod_height, "%s: rendered height", title);
+
+    int xtiles = DP_tile_count_round(width);
+    int ytiles = DP_tile_count_round(height);
+    DP_Pixel15 *canvas = flatten_canvas(cs, xtiles, ytiles);
+    int mismatches = 0;
+    for (int y = 0; y < lod_height; ++y) {
+        for (int x = 0; x < lod_width; ++x) {
+            DP_Pixel8 expected = downsample_pixel(
+                canvas, xtiles * DP_TILE_SIZE, x, y, lod);
+            if (!pixels_match(rt->pixels[y * lod_width + x], expected)) {
+                ++mismatches;
+            }
+        }
+    }
+    DP_free(canvas);
+    INT_EQ_OK(mismatches, 0, "%s: rendered pixels match flattened canvas",
+              title);
+}
+
+static void render_and_compare(TEST_PARAMS, DP_Renderer *renderer,
+                               DP_RendererTest *rt, DP_CanvasState *prev,
+                               DP_CanvasState *cs, DP_LocalState *ls,
+                               DP_CanvasDiff *diff, int lod, const char *title)
+{
+    render_and_compare_mode(T, renderer, rt, prev, cs, ls, diff, lod,
+                            DP_RENDERER_VIEW_BOUNDS_CHANGED, title);
+}
+
+static void renderer_cached_composites(TEST_PARAMS)
+{
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_RendererTest rt = {DP_semaphore_new(0), NULL, 0, 0, 0};
+    DP_Renderer *renderer =
+        DP_renderer_new(2, false, (DP_Pixel8){0}, (DP_Pixel8){0}, on_tile,
+                        on_unlock, on_resize, &rt);
+    DP_CanvasDiff *diff = DP_canvas_diff_new();
+
+    DP_CanvasState *cs = DP_canvas_state_new();
+    cs = handle_state(cs, dc, DP_msg_canvas_resize_new(1, 0, WIDTH, HEIGHT, 0));
+    for (uint16_t layer_id = 257; layer_id <= 262; ++layer_id) {
+        cs = handle_state(
+            cs, dc,
+            DP_msg_layer_tree_create_new(1, layer_id, 0, 0, 0, 0, "", 0));
+        uint32_t offset = (uint32_t)(layer_id - 257) * 30;
+        cs = fill_rect(cs, dc, layer_id, offset, offset / 2, 120, 90,
+                       0x80000000u | (offset * 0x010203u));
+    }
+    cs = set_blend_mode(cs, dc, 258, 255, DP_BLEND_MODE_MULTIPLY);
+
+    DP_LocalState *ls = DP_local_state_new(cs, NULL, NULL);
+    set_active_layer(ls, dc, 260);
+    render_and_compare(T, renderer, &rt, NULL, cs, ls, diff, 0, "initial");
+
+    DP_CanvasState *prev = DP_canvas_state_incref(cs);
+    cs = fill_rect(cs, dc, 260, 10, 10, 200, 150, 0xc0ff0000u);
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 0, "active layer");
+    DP_canvas_state_decref(prev);
+
+    prev = DP_canvas_state_incref(cs);
+    cs = fill_rect(cs, dc, 257, 100, 50, 150, 100, 0xff00ff00u);
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 0, "layer below");
+    DP_canvas_state_decref(prev);
+
+    prev = DP_canvas_state_incref(cs);
+    cs = fill_rect(cs, dc, 262, 0, 100, 250, 60, 0x400000ffu);
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 0, "layer above");
+    DP_canvas_state_decref(prev);
+
+    prev = DP_canvas_state_incref(cs);
+    cs = fill_rect(cs, dc, 260, 150, 20, 100, 100, 0xffffffffu);
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 0,
+                       "active layer again");
+    DP_canvas_state_decref(prev);
+
+    set_active_layer(ls, dc, 258);
+    render_and_compare(T, renderer, &rt, cs, cs, ls, diff, 0,
+                       "other active layer");
+
+    prev = DP_canvas_state_incref(cs);
+    cs = set_blend_mode(cs, dc, 261, 128, DP_BLEND_MODE_SCREEN);
+    cs = fill_rect(cs, dc, 258, 0, 0, 80, 80, 0xff123456u);
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 0,
+                       "blend mode above");
+    DP_canvas_state_decref(prev);
+
+    prev = DP_canvas_state_incref(cs);
+    cs = handle_state(cs, dc, DP_msg_canvas_resize_new(1, 10, 20, 30, 40));
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 0, "resized");
+    DP_canvas_state_decref(prev);
+
+    DP_local_state_free(ls);
+    DP_canvas_state_decref(cs);
+    DP_canvas_diff_free(diff);
+    DP_renderer_free(renderer);
+    DP_free(rt.pixels);
+    DP_semaphore_free(rt.sem);
+    DP_draw_context_free(dc);
+}
+
+
+static void renderer_lod(TEST_PARAMS)
+{
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_RendererTest rt = {DP_semaphore_new(0), NULL, 0, 0, 0};
+    DP_Renderer *renderer =
+        DP_renderer_new(3, false, (DP_Pixel8){0}, (DP_Pixel8){0}, on_tile,
+                        on_unlock, on_resize, &rt);
+    DP_CanvasDiff *diff = DP_canvas_diff_new();
+
+    // Deliberately not a multiple of the tile size at any level of detail.
+    DP_CanvasState *cs = DP_canvas_state_new();
+    cs = handle_state(cs, dc, DP_msg_canvas_resize_new(1, 0, 700, 523, 0));
+    for (uint16_t layer_id = 257; layer_id <= 260; ++layer_id) {
+        cs = handle_state(
+            cs, dc,
+            DP_msg_layer_tree_create_new(1, layer_id, 0, 0, 0, 0, "", 0));
+        uint32_t offset = (uint32_t)(layer_id - 257) * 97;
+        cs = fill_rect(cs, dc, layer_id, offset, offset / 2, 333, 251,
+                       0x90000000u | (offset * 0x030201u));
+    }
+    DP_LocalState *ls = DP_local_state_new(cs, NULL, NULL);
+    set_active_layer(ls, dc, 258);
+
+    static const char *titles[] = {"lod 0", "lod 1", "lod 2", "lod 3"};
+    render_and_compare(T, renderer, &rt, NULL, cs, ls, diff, 0, titles[0]);
+    for (int lod = 1; lod <= DP_RENDERER_LOD_MAX; ++lod) {
+        render_and_compare(T, renderer, &rt, cs, cs, ls, diff, lod,
+                           titles[lod]);
+    }
+
+    // Only the changed canvas tiles get re-rendered into the reduced tiles.
+    DP_CanvasState *prev = DP_canvas_state_incref(cs);
+    cs = fill_rect(cs, dc, 258, 130, 70, 90, 300, 0xffff8000u);
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 3,
+                       "lod 3 after change");
+    DP_canvas_state_decref(prev);
+
+    prev = DP_canvas_state_incref(cs);
+    cs = fill_rect(cs, dc, 260, 600, 450, 100, 73, 0x800000ffu);
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 1,
+                       "lod 1 with change");
+    DP_canvas_state_decref(prev);
+
+    prev = DP_canvas_state_incref(cs);
+    cs = handle_state(cs, dc, DP_msg_canvas_resize_new(1, 0, 77, 0, 13));
+    render_and_compare(T, renderer, &rt, prev, cs, ls, diff, 1,
+                       "lod 1 resized");
+    DP_canvas_state_decref(prev);
+
+    render_and_compare(T, renderer, &rt, cs, cs, ls, diff, 0,
+                       "back to lod 0");
+
+    DP_local_state_free(ls);
+    DP_canvas_state_decref(cs);
+    DP_canvas_diff_free(diff);
+    DP_renderer_free(renderer);
+    DP_free(rt.pixels);
+    DP_semaphore_free(rt.sem);
+    DP_draw_context_free(dc);
+}
+
+
+static void renderer_changes(TEST_PARAMS)
+{
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_RendererTest rt = {DP_semaphore_new(0), NULL, 0, 0, 0};
+    DP_Renderer *renderer =
+        DP_renderer_new(2, false, (DP_Pixel8){0}, (DP_Pixel8){0}, on_tile,
+                        on_unlock, on_resize, &rt);
+    DP_CanvasDiff *diff = DP_canvas_diff_new();
+
+    DP_CanvasState *cs = DP_canvas_state_new();
+    cs = handle_state(cs, dc, DP_msg_canvas_resize_new(1, 0, WIDTH, HEIGHT, 0));
+    cs = handle_state(cs, dc,
+                      DP_msg_layer_tree_create_new(1, 257, 0, 0, 0, 0, "", 0));
+    cs = fill_rect(cs, dc, 257, 20, 30, 150, 100, 0xff336699u);
+    DP_LocalState *ls = DP_local_state_new(cs, NULL, NULL);
+    render_and_compare_mode(T, renderer, &rt, NULL, cs, ls, diff, 0,
+                            DP_RENDERER_CHANGES, "initial");
+
+    // The unlock function must be called even if there's nothing to render,
+    // otherwise this would wait forever.
+    render_and_compare_mode(T, renderer, &rt, cs, cs, ls, diff, 0,
+                            DP_RENDERER_CHANGES, "unchanged");
+
+    DP_CanvasState *prev = DP_canvas_state_incref(cs);
+    cs = fill_rect(cs, dc, 257, 200, 100, 90, 90, 0x80ff0000u);
+    render_and_compare_mode(T, renderer, &rt, prev, cs, ls, diff, 0,
+                            DP_RENDERER_CHANGES, "changed");
+    DP_canvas_state_decref(prev);
+
+    prev = DP_canvas_state_incref(cs);
+    cs = handle_state(cs, dc, DP_msg_canvas_resize_new(1, 0, 64, 0, 0));
+    render_and_compare_mode(T, renderer, &rt, prev, cs, ls, diff, 0,
+                            DP_RENDERER_CHANGES, "resized");
+    DP_canvas_state_decref(prev);
+
+    DP_local_state_free(ls);
+    DP_canvas_state_decref(cs);
+    DP_canvas_diff_free(diff);
+    DP_renderer_free(renderer);
+    DP_free(rt.pixels);
+    DP_semaphore_free(rt.sem);
+    DP_draw_context_free(dc);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(renderer_cached_composites);
+    REGISTER_TEST(renderer_lod);
+    REGISTER_TEST(renderer_changes);
+}
+
+int main(int argc, char **argv)
+{
+    DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/vector.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/layer_routes.h>
+#include <dpengine/pixels.h>
+#include <dpengine/snapshots.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dptest.h>
+#include "handle_common.h"
+
+
+#define WIDTH  512
+#define HEIGHT 512
+#define COLOR  0xff336699u
+
+#define TILES_PER_LAYER ((WIDTH / DP_TILE_SIZE) * (HEIGHT / DP_TILE_SIZE))
+
+static unsigned char *get_tile_buffer(size_t size, void *user)
+{
+    unsigned char **buffer = user;
+    *buffer = DP_malloc(size);
+    return *buffer;
+}
+
+static void set_image(size_t size, unsigned char *out, void *image)
+{
+    memcpy(out, image, size);
+}
+
+// Has solid tiles on one layer and full tiles of the same color on another,
+// plus enough different tiles that compressing them gets spread over threads.
+static DP_CanvasState *make_canvas(DP_DrawContext *dc)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    handle_history(ch, dc, DP_msg_canvas_resize_new(1, 0, WIDTH, HEIGHT, 0));
+    handle_history(ch, dc,
+                   DP_msg_layer_tree_create_new(1, 0x101, 0, 0, COLOR, 0,
+                                                "solid", 5));
+
+    // Put tiles don't get compacted, unlike fills, so these stay full tiles.
+    handle_history(ch, dc,
+                   DP_msg_layer_tree_create_new(1, 0x102, 0, 0, 0, 0, "full",
+                                                4));
+    DP_Pixel8 *pixels = DP_malloc(sizeof(*pixels) * DP_TILE_LENGTH);
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        pixels[i].color = COLOR;
+    }
+    DP_Tile *full = DP_tile_new_from_pixels8(0, pixels);
+    unsigned char *image = NULL;
+    size_t image_size = DP_tile_compress(full, pixels, get_tile_buffer, &image);
+    handle_history(ch, dc,
+                   DP_msg_put_tile_new(1, 0x102, 0, 0, 0,
+                                       TILES_PER_LAYER / 4 - 1, set_image,
+                                       image_size, image));
+    DP_free(image);
+    DP_tile_decref(full);
+    DP_free(pixels);
+
+    handle_history(ch, dc,
+                   DP_msg_layer_tree_create_new(1, 0x103, 0, 0, 0, 0, "mixed",
+                                                5));
+    for (int y = 0; y < HEIGHT / DP_TILE_SIZE; ++y) {
+        for (int x = 0; x < WIDTH / DP_TILE_SIZE; ++x) {
+            uint32_t color = 0xff000000u | DP_int_to_uint32(y * 40 + x * 3);
+            handle_history(ch, dc,
+                           DP_msg_fill_rect_new(
+                               1, 0x103, DP_BLEND_MODE_NORMAL,
+                               DP_int_to_uint32(x * DP_TILE_SIZE + x),
+                               DP_int_to_uint32(y * DP_TILE_SIZE + y),
+                               DP_TILE_SIZE / 2, DP_TILE_SIZE / 2, color));
+        }
+    }
+    DP_CanvasState *cs = DP_canvas_history_get(ch);
+    DP_canvas_history_free(ch);
+    return cs;
+}
+
+static void push_message(void *user, DP_Message *msg)
+{
+    DP_VECTOR_PUSH_TYPE(user, DP_Message *, msg);
+}
+
+static DP_Message *message_at(DP_Vector *msgs, int i)
+{
+    return DP_VECTOR_AT_TYPE(msgs, DP_Message *, i);
+}
+
+static void dispose_messages(DP_Vector *msgs)
+{
+    int count = DP_size_to_int(msgs->used);
+    for (int i = 0; i < count; ++i) {
+        DP_message_decref(message_at(msgs, i));
+    }
+    DP_vector_dispose(msgs);
+}
+
+static unsigned char *get_buffer(void *user, size_t size)
+{
+    unsigned char **buffer = user;
+    *buffer = DP_malloc(size);
+    return *buffer;
+}
+
+static size_t serialize(DP_Message *msg, unsigned char **out_buffer)
+{
+    return DP_message_serialize(msg, true, get_buffer, out_buffer);
+}
+
+static bool same_message(DP_Message *a, DP_Message *b)
+{
+    unsigned char *buffer_a = NULL;
+    unsigned char *buffer_b = NULL;
+    size_t size_a = serialize(a, &buffer_a);
+    size_t size_b = serialize(b, &buffer_b);
+    bool same = size_a != 0 && size_a == size_b
+             && memcmp(buffer_a, buffer_b, size_a) == 0;
+    DP_free(buffer_a);
+    DP_free(buffer_b);
+    return same;
+}
+
+// Each put tile must have exactly what compressing its tile on its own gives,
+// so deduplicating tiles can't have replaced it with something else.
+static bool put_tile_matches_canvas(DP_CanvasState *cs, DP_Message *msg,
+                                    DP_Pixel8 *pixel_buffer)
+{
+    DP_MsgPutTile *mpt = DP_message_internal(msg);
+    DP_LayerRoutesEntry *lre = DP_layer_routes_search(
+        DP_canvas_state_layer_routes_noinc(cs), DP_msg_put_tile_layer(mpt));
+    if (!lre || DP_layer_routes_entry_is_group(lre)) {
+        return false;
+    }
+    DP_LayerContent *lc = DP_layer_routes_entry_content(lre, cs);
+    DP_Tile *t = DP_layer_content_tile_at_noinc(
+        lc, DP_msg_put_tile_col(mpt), DP_msg_put_tile_row(mpt));
+    if (!t) {
+        return false;
+    }
+
+    unsigned char *expected = NULL;
+    size_t expected_size =
+        DP_tile_compress(t, pixel_buffer, get_tile_buffer, &expected);
+    size_t actual_size;
+    const unsigned char *actual = DP_msg_put_tile_image(mpt, &actual_size);
+    bool matches = expected_size != 0 && expected_size == actual_size
+                && memcmp(expected, actual, actual_size) == 0;
+    DP_free(expected);
+    return matches;
+}
+
+static void reset_image_threads_match(TEST_PARAMS)
+{
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_CanvasState *cs = make_canvas(dc);
+
+    DP_Vector inline_msgs;
+    DP_VECTOR_INIT_TYPE(&inline_msgs, DP_Message *, 64);
+    DP_reset_image_build_with_threads(cs, 0, 1, push_message, &inline_msgs);
+    DP_Vector worker_msgs;
+    DP_VECTOR_INIT_TYPE(&worker_msgs, DP_Message *, 64);
+    DP_reset_image_build_with_threads(cs, 0, 4, push_message, &worker_msgs);
+
+    int inline_count = DP_size_to_int(inline_msgs.used);
+    int worker_count = DP_size_to_int(worker_msgs.used);
+    INT_EQ_OK(worker_count, inline_count,
+              "same number of messages with and without worker");
+    int count = DP_min_int(inline_count, worker_count);
+    int put_tile_count = 0;
+    int solid_put_tile_count = 0;
+    DP_Pixel8 *pixel_buffer =
+        DP_malloc(sizeof(*pixel_buffer) * DP_TILE_LENGTH);
+    for (int i = 0; i < count; ++i) {
+        DP_Message *msg = message_at(&inline_msgs, i);
+        OK(same_message(msg, message_at(&worker_msgs, i)),
+           "message %d is the same", i);
+        if (DP_message_type(msg) == DP_MSG_PUT_TILE) {
+            ++put_tile_count;
+            OK(put_tile_matches_canvas(cs, msg, pixel_buffer),
+               "put tile %d matches canvas", i);
+            size_t size;
+            DP_msg_put_tile_image(DP_message_internal(msg), &size);
+            if (size == 4) {
+                ++solid_put_tile_count;
+            }
+        }
+    }
+    DP_free(pixel_buffer);
+
+    INT_EQ_OK(put_tile_count, TILES_PER_LAYER * 2 + TILES_PER_LAYER / 4,
+              "put tile count");
+    INT_EQ_OK(solid_put_tile_count, TILES_PER_LAYER,
+              "solid layer tiles aren't replaced by full ones");
+
+    dispose_messages(&worker_msgs);
+    dispose_messages(&inline_msgs);
+    DP_canvas_state_decref(cs);
+    DP_draw_context_free(dc);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(reset_image_threads_match);
+}
+
+int main(int argc, char **argv)
+{
+    DP_test_main(argc, argv, register_tests, NULL);
+}
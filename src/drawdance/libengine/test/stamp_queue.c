@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/layer_list.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dptest.h>
+#include "handle_common.h"
+#include "random_common.h"
+
+
+#define WIDTH         500
+#define HEIGHT        400
+#define LAYER_COUNT   3
+#define MESSAGE_COUNT 600
+#define DAB_COUNT     40
+
+static int8_t random_offset(unsigned int *state)
+{
+    return (int8_t)((int)(next_random(state) % 49u) - 24);
+}
+
+static void set_classic_dabs(int count, DP_ClassicDab *cds, void *user)
+{
+    for (int i = 0; i < count; ++i) {
+        DP_classic_dab_init(cds, i, random_offset(user), random_offset(user),
+                            (uint16_t)(256 + next_random(user) % 20000u),
+                            (uint8_t)(next_random(user) % 256u),
+                            (uint8_t)(1u + next_random(user) % 255u));
+    }
+}
+
+static void set_pixel_dabs(int count, DP_PixelDab *pds, void *user)
+{
+    for (int i = 0; i < count; ++i) {
+        DP_pixel_dab_init(pds, i, random_offset(user), random_offset(user),
+                          (uint8_t)(1u + next_random(user) % 90u),
+                          (uint8_t)(1u + next_random(user) % 255u));
+    }
+}
+
+static void set_mypaint_dabs(int count, DP_MyPaintDab *mpds, void *user)
+{
+    for (int i = 0; i < count; ++i) {
+        DP_mypaint_dab_init(mpds, i, random_offset(user), random_offset(user),
+                            (uint16_t)(256 + next_random(user) % 20000u),
+                            (uint8_t)(next_random(user) % 256u),
+                            (uint8_t)(1u + next_random(user) % 255u),
+                            (uint8_t)(next_random(user) % 256u),
+                            (uint8_t)(next_random(user) % 256u));
+    }
+}
+
+static DP_Message *make_dabs(unsigned int *state)
+{
+    unsigned int context_id = 1u + next_random(state) % 3u;
+    uint16_t layer_id = (uint16_t)(257u + next_random(state) % LAYER_COUNT);
+    int32_t x = (int32_t)(next_random(state) % (WIDTH * 4u));
+    int32_t y = (int32_t)(next_random(state) % (HEIGHT * 4u));
+    uint32_t color = (uint32_t)next_random(state)
+                   | ((uint32_t)next_random(state) << 16u);
+    // Half of the classic and pixel dabs are indirect, the rest direct.
+    if (next_random(state) % 2u == 0) {
+        color &= 0xffffffu;
+    }
+    static const uint8_t blend_modes[] = {
+        DP_BLEND_MODE_NORMAL,   DP_BLEND_MODE_ERASE, DP_BLEND_MODE_MULTIPLY,
+        DP_BLEND_MODE_BEHIND,   DP_BLEND_MODE_SCREEN,
+    };
+    uint8_t blend_mode =
+        blend_modes[next_random(state) % DP_ARRAY_LENGTH(blend_modes)];
+
+    switch (next_random(state) % 4u) {
+    case 0:
+        return DP_msg_draw_dabs_classic_new(context_id, layer_id, x, y, color,
+                                            blend_mode, set_classic_dabs,
+                                            DAB_COUNT, state);
+    case 1:
+        return DP_msg_draw_dabs_pixel_new(context_id, layer_id, x / 4, y / 4,
+                                          color, blend_mode, set_pixel_dabs,
+                                          DAB_COUNT, state);
+    case 2:
+        return DP_msg_draw_dabs_pixel_square_new(
+            context_id, layer_id, x / 4, y / 4, color, blend_mode,
+            set_pixel_dabs, DAB_COUNT, state);
+    default:
+        return DP_msg_draw_dabs_mypaint_new(
+            context_id, layer_id, x, y, color | 0xff000000u,
+            (uint8_t)(next_random(state) % 2u * 128u),
+            (uint8_t)(next_random(state) % 2u * 64u),
+            (uint8_t)(next_random(state) % 2u * 200u), 0, set_mypaint_dabs,
+            DAB_COUNT, state);
+    }
+}
+
+
+static void stamp_queue_matches_serial(TEST_PARAMS)
+{
+    DP_DrawContext *serial_dc = DP_draw_context_new();
+    DP_DrawContext *parallel_dc = DP_draw_context_new();
+    DP_draw_context_stamp_threads_set(parallel_dc, 4);
+    NOT_NULL_OK(DP_draw_context_stamp_queue(parallel_dc),
+                "parallel draw context has a stamp queue");
+    OK(!DP_draw_context_stamp_queue(serial_dc),
+       "serial draw context has no stamp queue");
+
+    DP_CanvasState *cs = DP_canvas_state_new();
+    cs = handle_state(cs, serial_dc,
+                      DP_msg_canvas_resize_new(1, 0, WIDTH, HEIGHT, 0));
+    for (uint16_t i = 0; i < LAYER_COUNT; ++i) {
+        cs = handle_state(cs, serial_dc,
+                          DP_msg_layer_tree_create_new(1, (uint16_t)(257 + i),
+                                                       0, 0, 0, 0, "", 0));
+    }
+
+    unsigned int state = 1;
+    DP_Message **msgs = DP_malloc(sizeof(*msgs) * MESSAGE_COUNT);
+    for (int i = 0; i < MESSAGE_COUNT; ++i) {
+        msgs[i] = make_dabs(&state);
+    }
+
+    DP_CanvasState *serial_cs = DP_canvas_state_handle_multidab(
+        cs, serial_dc, NULL, MESSAGE_COUNT, msgs);
+    DP_CanvasState *parallel_cs = DP_canvas_state_handle_multidab(
+        cs, parallel_dc, NULL, MESSAGE_COUNT, msgs);
+    NOT_NULL_OK(serial_cs, "serial multidab succeeded");
+    NOT_NULL_OK(parallel_cs, "parallel multidab succeeded");
+
+    if (serial_cs && parallel_cs) {
+        DP_LayerList *serial_ll = DP_canvas_state_layers_noinc(serial_cs);
+        DP_LayerList *parallel_ll = DP_canvas_state_layers_noinc(parallel_cs);
+        for (int i = 0; i < LAYER_COUNT; ++i) {
+            DP_LayerContent *serial_lc = DP_layer_list_entry_content_noinc(
+                DP_layer_list_at_noinc(serial_ll, i));
+            DP_LayerContent *parallel_lc = DP_layer_list_entry_content_noinc(
+                DP_layer_list_at_noinc(parallel_ll, i));
+            INT_EQ_OK(count_differences(serial_lc, parallel_lc), 0,
+                      "layer %d is identical", i);
+        }
+
+        DP_TransientLayerContent *serial_flat = DP_canvas_state_to_flat_layer(
+            serial_cs, DP_FLAT_IMAGE_RENDER_FLAGS, NULL);
+        DP_TransientLayerContent *parallel_flat = DP_canvas_state_to_flat_layer(
+            parallel_cs, DP_FLAT_IMAGE_RENDER_FLAGS, NULL);
+        INT_EQ_OK(count_differences((DP_LayerContent *)serial_flat,
+                                    (DP_LayerContent *)parallel_flat),
+                  0, "flattened canvas including sublayers is identical");
+        DP_transient_layer_content_decref(parallel_flat);
+        DP_transient_layer_content_decref(serial_flat);
+    }
+
+    for (int i = 0; i < MESSAGE_COUNT; ++i) {
+        DP_message_decref(msgs[i]);
+    }
+    DP_free(msgs);
+    DP_canvas_state_decref_nullable(parallel_cs);
+    DP_canvas_state_decref_nullable(serial_cs);
+    DP_canvas_state_decref(cs);
+    DP_draw_context_free(parallel_dc);
+    DP_draw_context_free(serial_dc);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(stamp_queue_matches_serial);
+}
+
+int main(int argc, char **argv)
+{
+    DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,274 @@
+// SPDX-License-Identifier: MIT
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dptest.h>
+
+
+// Solid tiles only store a single pixel. These tests compare them against
+// regular tiles with all pixels set to the same value, they should behave the
+// same in every way except for the memory they take up.
+
+static const DP_Pixel15 solid_pixels[] = {
+    {0, 0, 0, 0},
+    {0, 0, 0, DP_BIT15},
+    {DP_BIT15, DP_BIT15, DP_BIT15, DP_BIT15},
+    {1234, 23456, 32767, DP_BIT15},
+    {1000, 2000, 3000, 16384},
+    {1, 0, 1, 1},
+};
+
+static const uint16_t opacities[] = {0, 1, 9999, 16384, DP_BIT15};
+
+
+static DP_Tile *new_full_tile(DP_Pixel15 pixel)
+{
+    DP_TransientTile *tt = DP_transient_tile_new_blank(0);
+    DP_Pixel15 *pixels = DP_transient_tile_pixels(tt);
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        pixels[i] = pixel;
+    }
+    return DP_transient_tile_persist(tt);
+}
+
+static DP_Tile *new_random_tile(void)
+{
+    DP_TransientTile *tt = DP_transient_tile_new_blank(0);
+    DP_Pixel15 *pixels = DP_transient_tile_pixels(tt);
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        uint16_t a = DP_int_to_uint16(rand() % (DP_BIT15 + 1));
+        pixels[i] = (DP_Pixel15){
+            DP_int_to_uint16(rand() % (a + 1)),
+            DP_int_to_uint16(rand() % (a + 1)),
+            DP_int_to_uint16(rand() % (a + 1)),
+            a,
+        };
+    }
+    return DP_transient_tile_persist(tt);
+}
+
+static bool tiles_equal(DP_Tile *a, DP_Tile *b)
+{
+    for (int y = 0; y < DP_TILE_SIZE; ++y) {
+        for (int x = 0; x < DP_TILE_SIZE; ++x) {
+            if (!DP_pixel15_equal(DP_tile_pixel_at(a, x, y),
+                                  DP_tile_pixel_at(b, x, y))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+static void solid_tile_properties(TEST_PARAMS)
+{
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(solid_pixels); ++i) {
+        DP_Pixel15 pixel = solid_pixels[i];
+        DP_Tile *solid = DP_tile_new_from_pixel15(0, pixel);
+        DP_Tile *full = new_full_tile(pixel);
+        OK(DP_tile_solid(solid), "pixel %zu tile is solid", i);
+        NOK(DP_tile_solid(full), "pixel %zu full tile is not solid", i);
+        OK(tiles_equal(solid, full), "pixel %zu tiles are equal", i);
+        OK(DP_tile_blank(solid) == DP_tile_blank(full),
+           "pixel %zu blank matches", i);
+        OK(DP_tile_opaque(solid) == DP_tile_opaque(full),
+           "pixel %zu opaque matches", i);
+        DP_Pixel15 same;
+        OK(DP_tile_same_pixel(solid, &same) && DP_pixel15_equal(same, pixel),
+           "pixel %zu same pixel", i);
+        DP_tile_decref(full);
+        DP_tile_decref(solid);
+    }
+}
+
+static void solid_tile_persist_compact(TEST_PARAMS)
+{
+    DP_Pixel15 pixel = {1000, 2000, 3000, 16384};
+    DP_Tile *full = new_full_tile(pixel);
+    DP_TransientTile *tt = DP_transient_tile_new(full, 0);
+    DP_tile_decref(full);
+    DP_Tile *t = DP_transient_tile_persist_compact(tt);
+    OK(DP_tile_solid(t), "uniform tile gets compacted");
+    OK(DP_pixel15_equal(DP_tile_pixel_at(t, 12, 34), pixel),
+       "compacted tile has the right color");
+    DP_tile_decref(t);
+
+    tt = DP_transient_tile_new_blank(0);
+    DP_transient_tile_pixel_at_set(tt, 63, 63, pixel);
+    t = DP_transient_tile_persist_compact(tt);
+    NOK(DP_tile_solid(t), "non-uniform tile does not get compacted");
+    DP_tile_decref(t);
+}
+
+static void solid_tile_merge(TEST_PARAMS)
+{
+    DP_Tile *base = new_random_tile();
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(solid_pixels); ++i) {
+        DP_Pixel15 pixel = solid_pixels[i];
+        DP_Tile *solid = DP_tile_new_from_pixel15(0, pixel);
+        DP_Tile *full = new_full_tile(pixel);
+        for (int blend_mode = 0; blend_mode < DP_BLEND_MODE_COUNT;
+             ++blend_mode) {
+            if (!DP_blend_mode_valid_for_layer(blend_mode)
+                && blend_mode != DP_BLEND_MODE_REPLACE) {
+                continue;
+            }
+            for (size_t j = 0; j < DP_ARRAY_LENGTH(opacities); ++j) {
+                DP_TransientTile *expected = DP_transient_tile_new(base, 0);
+                DP_TransientTile *actual = DP_transient_tile_new(base, 0);
+                DP_transient_tile_merge(expected, full, opacities[j],
+                                        blend_mode);
+                DP_transient_tile_merge(actual, solid, opacities[j],
+                                        blend_mode);
+                OK(tiles_equal((DP_Tile *)actual, (DP_Tile *)expected),
+                   "merge pixel %zu with %s opacity %d", i,
+                   DP_blend_mode_enum_name(blend_mode), (int)opacities[j]);
+                DP_transient_tile_decref(actual);
+                DP_transient_tile_decref(expected);
+            }
+        }
+        DP_tile_decref(full);
+        DP_tile_decref(solid);
+    }
+    DP_tile_decref(base);
+}
+
+static unsigned char *get_output_buffer(size_t size, void *user)
+{
+    void **buffer = user;
+    *buffer = DP_malloc(size);
+    return *buffer;
+}
+
+static void solid_tile_compress(TEST_PARAMS)
+{
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_Pixel8 *pixel_buffer = DP_malloc(sizeof(*pixel_buffer) * DP_TILE_LENGTH);
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(solid_pixels); ++i) {
+        DP_Pixel15 pixel = solid_pixels[i];
+        DP_Tile *solid = DP_tile_new_from_pixel15(0, pixel);
+        DP_Tile *full = new_full_tile(pixel);
+
+        void *solid_buffer, *full_buffer;
+        size_t solid_size =
+            DP_tile_compress(solid, pixel_buffer, get_output_buffer,
+                             &solid_buffer);
+        size_t full_size = DP_tile_compress(full, pixel_buffer,
+                                            get_output_buffer, &full_buffer);
+        OK(solid_size != 0, "pixel %zu solid tile compressed", i);
+        OK(full_size != 0, "pixel %zu full tile compressed", i);
+
+        DP_Tile *solid_result =
+            DP_tile_new_from_compressed(dc, 0, solid_buffer, solid_size);
+        DP_Tile *full_result =
+            DP_tile_new_from_compressed(dc, 0, full_buffer, full_size);
+        OK(solid_result && full_result
+               && tiles_equal(solid_result, full_result),
+           "pixel %zu decompresses the same", i);
+
+        DP_tile_decref_nullable(full_result);
+        DP_tile_decref_nullable(solid_result);
+        DP_free(full_buffer);
+        DP_free(solid_buffer);
+        DP_tile_decref(full);
+        DP_tile_decref(solid);
+    }
+    DP_free(pixel_buffer);
+    DP_draw_context_free(dc);
+}
+
+static void solid_tile_copy(TEST_PARAMS)
+{
+    int width = DP_TILE_SIZE + 7;
+    int height = DP_TILE_SIZE + 3;
+    size_t count = DP_int_to_size(width * height);
+    DP_Pixel8 *solid_pixels8 = DP_malloc_zeroed(sizeof(DP_Pixel8) * count);
+    DP_Pixel8 *full_pixels8 = DP_malloc_zeroed(sizeof(DP_Pixel8) * count);
+    DP_UPixel8 *solid_upixels8 = DP_malloc_zeroed(sizeof(DP_UPixel8) * count);
+    DP_UPixel8 *full_upixels8 = DP_malloc_zeroed(sizeof(DP_UPixel8) * count);
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(solid_pixels); ++i) {
+        DP_Pixel15 pixel = solid_pixels[i];
+        DP_Tile *solid = DP_tile_new_from_pixel15(0, pixel);
+        DP_Tile *full = new_full_tile(pixel);
+        DP_tile_copy_to_pixels8(solid, solid_pixels8, 7, 3, width, height);
+        DP_tile_copy_to_pixels8(full, full_pixels8, 7, 3, width, height);
+        DP_tile_copy_to_upixels8(solid, solid_upixels8, 7, 3, width, height);
+        DP_tile_copy_to_upixels8(full, full_upixels8, 7, 3, width, height);
+        OK(memcmp(solid_pixels8, full_pixels8, sizeof(DP_Pixel8) * count) == 0,
+           "pixel %zu copies to pixels8 the same", i);
+        OK(memcmp(solid_upixels8, full_upixels8, sizeof(DP_UPixel8) * count)
+               == 0,
+           "pixel %zu copies to upixels8 the same", i);
+        DP_tile_decref(full);
+        DP_tile_decref(solid);
+    }
+    DP_free(full_upixels8);
+    DP_free(solid_upixels8);
+    DP_free(full_pixels8);
+    DP_free(solid_pixels8);
+}
+
+static void solid_tile_content_hash(TEST_PARAMS)
+{
+    DP_Tile *random = new_random_tile();
+    DP_TransientTile *tt = DP_transient_tile_new(random, 0);
+    DP_Tile *copy = DP_transient_tile_persist(tt);
+    OK(DP_tile_same_content(random, copy), "random tile copy has same content");
+    OK(DP_tile_content_hash(random) == DP_tile_content_hash(copy),
+       "random tile copy has same hash");
+
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(solid_pixels); ++i) {
+        DP_Pixel15 pixel = solid_pixels[i];
+        DP_Tile *solid = DP_tile_new_from_pixel15(0, pixel);
+        DP_Tile *full = new_full_tile(pixel);
+        DP_Tile *full_copy = new_full_tile(pixel);
+        DP_Tile *solid_copy = DP_tile_new_from_pixel15(0, pixel);
+        // Solid tiles compress differently than full ones, so they must not
+        // be treated as the same content even if their pixels are equal.
+        NOK(DP_tile_same_content(solid, full), "pixel %zu solid not full", i);
+        NOK(DP_tile_same_content(full, solid), "pixel %zu full not solid", i);
+        OK(DP_tile_same_content(solid, solid_copy),
+           "pixel %zu solid same content", i);
+        OK(DP_tile_content_hash(solid) == DP_tile_content_hash(solid_copy),
+           "pixel %zu solid same hash", i);
+        OK(DP_tile_same_content(full, full_copy),
+           "pixel %zu full same content", i);
+        OK(DP_tile_content_hash(full) == DP_tile_content_hash(full_copy),
+           "pixel %zu full same hash", i);
+        NOK(DP_tile_same_content(solid, random),
+            "pixel %zu content differs from random tile", i);
+        for (size_t j = 0; j < i; ++j) {
+            DP_Tile *other = DP_tile_new_from_pixel15(0, solid_pixels[j]);
+            NOK(DP_tile_same_content(solid, other),
+                "pixel %zu content differs from pixel %zu", i, j);
+            DP_tile_decref(other);
+        }
+        DP_tile_decref(solid_copy);
+        DP_tile_decref(full_copy);
+        DP_tile_decref(full);
+        DP_tile_decref(solid);
+    }
+
+    DP_tile_decref(copy);
+    DP_tile_decref(random);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(solid_tile_properties);
+    REGISTER_TEST(solid_tile_persist_compact);
+    REGISTER_TEST(solid_tile_merge);
+    REGISTER_TEST(solid_tile_compress);
+    REGISTER_TEST(solid_tile_copy);
+    REGISTER_TEST(solid_tile_content_hash);
+}
+
+int main(int argc, char **argv)
+{
+    DP_test_main(argc, argv, register_tests, NULL);
+}
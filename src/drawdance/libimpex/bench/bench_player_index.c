@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/cpu.h>
+#include <dpcommon/file.h>
+#include <dpcommon/input.h>
+#include <dpcommon/perf.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/player.h>
+#include <dpimpex/player_index.h>
+#include <stdio.h>
+
+// Builds the index for each given recording serially and then with the given
+// number of threads, printing the times of both. The indexes are written next
+// to the recordings, like the player would, and compared to each other, since
+// the thread count must not change the result.
+
+
+struct SnapshotParams {
+    long long interval;
+    long long counter;
+};
+
+static bool should_snapshot(void *user)
+{
+    struct SnapshotParams *params = user;
+    return ++params->counter % params->interval == 0;
+}
+
+static bool build_index(const char *path, int thread_count, long long interval,
+                        unsigned long long *out_time)
+{
+    DP_Input *input = DP_file_input_new_from_path(path);
+    if (!input) {
+        return false;
+    }
+
+    DP_Player *player = DP_player_new(DP_PLAYER_TYPE_GUESS, path, input, NULL);
+    if (!player) {
+        return false;
+    }
+
+    DP_DrawContext *dc = DP_draw_context_new();
+    struct SnapshotParams params = {interval, 0};
+    unsigned long long start = DP_perf_time();
+    bool ok = DP_player_index_build_threads(player, dc, thread_count,
+                                            should_snapshot, NULL, &params);
+    *out_time = DP_perf_time() - start;
+    DP_draw_context_free(dc);
+    DP_player_free(player);
+    return ok;
+}
+
+static void *slurp_index(const char *path, size_t *out_length)
+{
+    DP_Input *input = DP_file_input_new_from_path(path);
+    if (!input) {
+        return NULL;
+    }
+
+    DP_Player *player = DP_player_new(DP_PLAYER_TYPE_GUESS, path, input, NULL);
+    if (!player) {
+        return NULL;
+    }
+
+    void *buffer = DP_file_slurp(DP_player_index_path(player), out_length);
+    DP_player_free(player);
+    return buffer;
+}
+
+static bool bench(const char *path, int thread_count, long long interval)
+{
+    unsigned long long serial_time;
+    if (!build_index(path, 1, interval, &serial_time)) {
+        DP_warn("Error building serial index for '%s': %s", path, DP_error());
+        return false;
+    }
+
+    size_t serial_length;
+    void *serial_buffer = slurp_index(path, &serial_length);
+    if (!serial_buffer) {
+        DP_warn("Error reading serial index for '%s': %s", path, DP_error());
+        return false;
+    }
+
+    unsigned long long threaded_time;
+    if (!build_index(path, thread_count, interval, &threaded_time)) {
+        DP_warn("Error building threaded index for '%s': %s", path,
+                DP_error());
+        DP_free(serial_buffer);
+        return false;
+    }
+
+    size_t threaded_length;
+    void *threaded_buffer = slurp_index(path, &threaded_length);
+    if (!threaded_buffer) {
+        DP_warn("Error reading threaded index for '%s': %s", path,
+                DP_error());
+        DP_free(serial_buffer);
+        return false;
+    }
+
+    bool identical =
+        serial_length == threaded_length
+        && memcmp(serial_buffer, threaded_buffer, serial_length) == 0;
+    DP_free(threaded_buffer);
+    DP_free(serial_buffer);
+
+    printf("%s\t%llu\t%llu\t%.2f\t%s\n", path, serial_time, threaded_time,
+           DP_ullong_to_double(serial_time)
+               / DP_ullong_to_double(threaded_time == 0 ? 1 : threaded_time),
+           identical ? "identical" : "DIFFERENT");
+    return identical;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s THREADS INTERVAL RECORDING...\n", argv[0]);
+        return 2;
+    }
+
+    int thread_count = atoi(argv[1]);
+    long long interval = atoll(argv[2]);
+    if (thread_count < 1 || interval < 1) {
+        fprintf(stderr, "THREADS and INTERVAL must be positive\n");
+        return 2;
+    }
+
+    DP_cpu_support_init();
+    printf("recording\tserial_ns\tthreaded_ns\tspeedup\tresult\n");
+    bool ok = true;
+    for (int i = 3; i < argc; ++i) {
+        if (!bench(argv[i], thread_count, interval)) {
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,524 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/cpu.h>
+#include <dpcommon/file.h>
+#include <dpcommon/input.h>
+#include <dpcommon/output.h>
+#include <dpcommon/perf.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/vector.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/paint_engine.h>
+#include <dpengine/player.h>
+#include <dpimpex/paint_engine_playback.h>
+#include <dpmsg/acl.h>
+#include <dpmsg/message.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Replays a recording through a full paint engine, canvas history, renderer
+// and all, as fast as it will go. Every step of messages is followed by a
+// render of the changed tiles, like a client would do every frame. Meanwhile,
+// the engine's perf instrumentation is captured and summed up, which gives the
+// time spent per message type and per phase. Optionally, the raw perf records
+// are also written to a file for closer inspection. Doesn't need a display.
+//
+// Batches of draw dabs messages handled in one go get their time split evenly
+// across their messages if they're all of the same type. Batches mixing types
+// can't be split like that, so they show up in a row of their own.
+
+
+#define LINE_MAX_LENGTH     1024
+#define CATEGORY_MAX_LENGTH 64
+#define TYPE_COUNT          256
+
+typedef struct ReplayCategory {
+    char name[CATEGORY_MAX_LENGTH];
+    long long count;
+    unsigned long long ns;
+} ReplayCategory;
+
+typedef struct ReplayType {
+    long long messages;
+    long long handled;
+    unsigned long long ns;
+} ReplayType;
+
+typedef struct ReplayStats {
+    DP_Vector categories;
+    ReplayType types[TYPE_COUNT];
+    ReplayType mixed_multidab;
+    DP_Output *log_or_null;
+} ReplayStats;
+
+typedef struct ReplayContext {
+    DP_Semaphore *playback_sem;
+    DP_Semaphore *render_sem;
+    DP_Vector messages;
+    ReplayStats *stats;
+} ReplayContext;
+
+
+static ReplayCategory *search_category(ReplayStats *stats, const char *name,
+                                       size_t length)
+{
+    size_t used = stats->categories.used;
+    for (size_t i = 0; i < used; ++i) {
+        ReplayCategory *rc =
+            DP_vector_at(&stats->categories, sizeof(*rc), i);
+        if (strncmp(rc->name, name, length) == 0 && rc->name[length] == '\0') {
+            return rc;
+        }
+    }
+
+    ReplayCategory *rc = DP_vector_push(&stats->categories, sizeof(*rc));
+    size_t name_length = DP_min_size(length, CATEGORY_MAX_LENGTH - 1);
+    memcpy(rc->name, name, name_length);
+    rc->name[name_length] = '\0';
+    rc->count = 0;
+    rc->ns = 0;
+    return rc;
+}
+
+static int detail_int(const char *detail, const char *key, int fallback)
+{
+    const char *s = strstr(detail, key);
+    return s ? atoi(s + strlen(key)) : fallback;
+}
+
+static void record_type(ReplayStats *stats, const char *detail,
+                        unsigned long long ns, bool multidab)
+{
+    int type = detail_int(detail, "type=", -1);
+    int count = multidab ? detail_int(detail, "count=", 0) : 1;
+    ReplayType *rt;
+    if (type >= 0 && type < TYPE_COUNT) {
+        rt = &stats->types[type];
+    }
+    else if (multidab) {
+        rt = &stats->mixed_multidab;
+    }
+    else {
+        return;
+    }
+    rt->handled += count;
+    rt->ns += ns;
+}
+
+// Perf records look like "<thread> <start> <end> <ns> <realm>:<category>
+// <details...>", see perf.c. The realm is dropped, since it's the same library
+// for all the interesting bits anyway.
+static void parse_perf_line(ReplayStats *stats, const char *line)
+{
+    unsigned long long ns;
+    int offset = 0;
+    if (line[0] == '#'
+        || sscanf(line, "%*s %*s %*s %llu %n", &ns, &offset) != 1
+        || offset == 0) {
+        return;
+    }
+
+    const char *realm = line + offset;
+    const char *category = strchr(realm, ':');
+    if (!category) {
+        return;
+    }
+    ++category;
+
+    size_t length = strcspn(category, " \n");
+    ReplayCategory *rc = search_category(stats, category, length);
+    ++rc->count;
+    rc->ns += ns;
+
+    // History handling is the outermost layer that sees each single message.
+    if (DP_str_equal(rc->name, "canvas_history:handle")) {
+        record_type(stats, category + length, ns, false);
+    }
+    else if (DP_str_equal(rc->name, "canvas_history:handle_multidab")) {
+        record_type(stats, category + length, ns, true);
+    }
+}
+
+static size_t stats_output_write(void *internal, const void *buffer,
+                                 size_t size)
+{
+    // The perf code writes each record in one go while holding its lock, so
+    // every call here gets exactly one line and never concurrently.
+    ReplayStats *stats = *(ReplayStats **)internal;
+    char line[LINE_MAX_LENGTH];
+    size_t length = DP_min_size(size, sizeof(line) - 1);
+    memcpy(line, buffer, length);
+    line[length] = '\0';
+    parse_perf_line(stats, line);
+
+    if (stats->log_or_null
+        && !DP_output_write(stats->log_or_null, buffer, size)) {
+        DP_warn("Error writing perf log: %s", DP_error());
+    }
+    return size;
+}
+
+static bool stats_output_dispose(void *internal, DP_UNUSED bool discard)
+{
+    ReplayStats *stats = *(ReplayStats **)internal;
+    DP_Output *log = stats->log_or_null;
+    stats->log_or_null = NULL;
+    return log ? DP_output_free(log) : true;
+}
+
+static const DP_OutputMethods stats_output_methods = {
+    stats_output_write, NULL, NULL, NULL, NULL, NULL, stats_output_dispose,
+};
+
+static const DP_OutputMethods *stats_output_init(void *internal, void *arg)
+{
+    *(ReplayStats **)internal = arg;
+    return &stats_output_methods;
+}
+
+
+static void on_renderer_tile(DP_UNUSED void *user, DP_UNUSED int x,
+                             DP_UNUSED int y, DP_UNUSED DP_Pixel8 *pixels)
+{
+    // Nothing, the tile has already been rendered at this point.
+}
+
+static void on_renderer_unlock(void *user)
+{
+    ReplayContext *c = user;
+    DP_SEMAPHORE_MUST_POST(c->render_sem);
+}
+
+static void on_renderer_resize(DP_UNUSED void *user, DP_UNUSED int width,
+                               DP_UNUSED int height, DP_UNUSED int prev_width,
+                               DP_UNUSED int prev_height,
+                               DP_UNUSED int offset_x, DP_UNUSED int offset_y,
+                               DP_UNUSED int lod)
+{
+    // Nothing, we don't keep the rendered image around.
+}
+
+static void on_playback(void *user, DP_UNUSED long long position)
+{
+    ReplayContext *c = user;
+    DP_SEMAPHORE_MUST_POST(c->playback_sem);
+}
+
+static void on_push_message(void *user, DP_Message *msg)
+{
+    ReplayContext *c = user;
+    DP_MessageType type = DP_message_type(msg);
+    if (type != DP_MSG_INTERNAL && (int)type < TYPE_COUNT) {
+        ++c->stats->types[type].messages;
+    }
+    DP_VECTOR_PUSH_TYPE(&c->messages, DP_Message *, msg);
+}
+
+static void on_acls_changed(DP_UNUSED void *user,
+                            DP_UNUSED int acl_change_flags)
+{
+}
+
+static void on_laser_trail(DP_UNUSED void *user,
+                           DP_UNUSED unsigned int context_id,
+                           DP_UNUSED int persistence, DP_UNUSED uint32_t color)
+{
+}
+
+static void on_move_pointer(DP_UNUSED void *user,
+                            DP_UNUSED unsigned int context_id,
+                            DP_UNUSED int x, DP_UNUSED int y)
+{
+}
+
+static void on_catchup(DP_UNUSED void *user, DP_UNUSED int progress)
+{
+}
+
+static void on_reset_lock_changed(DP_UNUSED void *user,
+                                  DP_UNUSED bool locked)
+{
+}
+
+static void on_recorder_state_changed(DP_UNUSED void *user,
+                                      DP_UNUSED bool started)
+{
+}
+
+static void on_layer_props_changed(DP_UNUSED void *user,
+                                   DP_UNUSED DP_LayerPropsList *lpl)
+{
+}
+
+static void on_annotations_changed(DP_UNUSED void *user,
+                                   DP_UNUSED DP_AnnotationList *al)
+{
+}
+
+static void on_document_metadata_changed(DP_UNUSED void *user,
+                                         DP_UNUSED DP_DocumentMetadata *dm)
+{
+}
+
+static void on_timeline_changed(DP_UNUSED void *user,
+                                DP_UNUSED DP_Timeline *tl)
+{
+}
+
+static void on_selections_changed(DP_UNUSED void *user,
+                                  DP_UNUSED DP_SelectionSet *ss_or_null)
+{
+}
+
+static void on_cursor_moved(DP_UNUSED void *user, DP_UNUSED unsigned int flags,
+                            DP_UNUSED unsigned int context_id,
+                            DP_UNUSED int layer_id, DP_UNUSED int x,
+                            DP_UNUSED int y)
+{
+}
+
+static void on_default_layer_set(DP_UNUSED void *user,
+                                 DP_UNUSED int layer_id)
+{
+}
+
+static void on_undo_depth_limit_set(DP_UNUSED void *user,
+                                    DP_UNUSED int undo_depth_limit)
+{
+}
+
+static void on_censored_layer_revealed(DP_UNUSED void *user,
+                                       DP_UNUSED int layer_id)
+{
+}
+
+
+static void handle_messages(DP_PaintEngine *pe, ReplayContext *c)
+{
+    int count = DP_size_to_int(c->messages.used);
+    DP_Message **msgs = c->messages.elements;
+    DP_paint_engine_handle_inc(pe, false, true, count, msgs, on_acls_changed,
+                               on_laser_trail, on_move_pointer, c);
+    for (int i = 0; i < count; ++i) {
+        DP_message_decref(msgs[i]);
+    }
+    c->messages.used = 0;
+}
+
+static void render_changes(DP_PaintEngine *pe, ReplayContext *c,
+                           unsigned long long *in_out_render_ns)
+{
+    unsigned long long start = DP_perf_time();
+    DP_paint_engine_tick(
+        pe, (DP_Rect){0, 0, UINT16_MAX, UINT16_MAX}, false, on_catchup,
+        on_reset_lock_changed, on_recorder_state_changed,
+        on_layer_props_changed, on_annotations_changed,
+        on_document_metadata_changed, on_timeline_changed,
+        on_selections_changed, on_cursor_moved, on_default_layer_set,
+        on_undo_depth_limit_set, on_censored_layer_revealed, c);
+    DP_paint_engine_render_changes(pe);
+    DP_SEMAPHORE_MUST_WAIT(c->render_sem);
+    *in_out_render_ns += DP_perf_time() - start;
+}
+
+static bool replay(const char *path, long long steps, ReplayStats *stats,
+                   long long *out_messages, unsigned long long *out_ns,
+                   unsigned long long *out_render_ns)
+{
+    DP_Input *input = DP_file_input_new_from_path(path);
+    if (!input) {
+        return false;
+    }
+
+    DP_Player *player = DP_player_new(DP_PLAYER_TYPE_GUESS, path, input, NULL);
+    if (!player) {
+        return false;
+    }
+
+    ReplayContext c = {DP_semaphore_new(0), DP_semaphore_new(0),
+                       DP_VECTOR_NULL, stats};
+    DP_VECTOR_INIT_TYPE(&c.messages, DP_Message *, 1024);
+    DP_DrawContext *paint_dc = DP_draw_context_new();
+    DP_DrawContext *main_dc = DP_draw_context_new();
+    DP_DrawContext *preview_dc = DP_draw_context_new();
+    DP_AclState *acls = DP_acl_state_new_playback();
+    DP_PaintEngine *pe = DP_paint_engine_new_inc(
+        paint_dc, main_dc, preview_dc, acls, NULL, true, 0xff646464u,
+        0xff878787u, on_renderer_tile, on_renderer_unlock, on_renderer_resize,
+        &c, NULL, NULL, NULL, NULL, false, NULL, NULL, NULL, player,
+        on_playback, NULL, &c, NULL, NULL);
+
+    bool ok = DP_paint_engine_playback_begin(pe) == DP_PLAYER_SUCCESS;
+    long long messages_before = 0;
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        messages_before += stats->types[i].messages;
+    }
+
+    unsigned long long render_ns = 0;
+    unsigned long long start = DP_perf_time();
+    while (ok) {
+        DP_PlayerResult result =
+            DP_paint_engine_playback_step(pe, steps, on_push_message, &c);
+        handle_messages(pe, &c);
+        DP_SEMAPHORE_MUST_WAIT(c.playback_sem);
+        render_changes(pe, &c, &render_ns);
+        if (result == DP_PLAYER_RECORDING_END) {
+            break;
+        }
+        else if (result != DP_PLAYER_SUCCESS) {
+            ok = false;
+        }
+    }
+    *out_ns = DP_perf_time() - start;
+    *out_render_ns = render_ns;
+
+    long long messages_after = 0;
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        messages_after += stats->types[i].messages;
+    }
+    *out_messages = messages_after - messages_before;
+
+    DP_paint_engine_free_join(pe);
+    DP_acl_state_free(acls);
+    DP_draw_context_free(preview_dc);
+    DP_draw_context_free(main_dc);
+    DP_draw_context_free(paint_dc);
+    DP_vector_dispose(&c.messages);
+    DP_semaphore_free(c.render_sem);
+    DP_semaphore_free(c.playback_sem);
+    return ok;
+}
+
+
+static unsigned long long category_ns(ReplayStats *stats, const char *name)
+{
+    size_t used = stats->categories.used;
+    for (size_t i = 0; i < used; ++i) {
+        ReplayCategory *rc =
+            DP_vector_at(&stats->categories, sizeof(*rc), i);
+        if (DP_str_equal(rc->name, name)) {
+            return rc->ns;
+        }
+    }
+    return 0;
+}
+
+static double ns_to_ms(unsigned long long ns)
+{
+    return DP_ullong_to_double(ns) / 1000000.0;
+}
+
+static void print_phase(const char *phase, unsigned long long ns)
+{
+    printf("%s\t%.3f\n", phase, ns_to_ms(ns));
+}
+
+static void print_type(const char *name, ReplayType *rt)
+{
+    printf("%s\t%lld\t%lld\t%.3f\t%.3f\n", name, rt->messages, rt->handled,
+           ns_to_ms(rt->ns),
+           rt->handled == 0 ? 0.0
+                            : DP_ullong_to_double(rt->ns)
+                                  / DP_llong_to_double(rt->handled) / 1000.0);
+}
+
+static void print_stats(ReplayStats *stats, unsigned long long render_wait_ns)
+{
+    // Canvas history handling includes painting on the canvas state, so take
+    // that out to get the overhead of the history itself.
+    unsigned long long paint_ns =
+        category_ns(stats, "canvas_state:handle")
+        + category_ns(stats, "canvas_state:handle_multidab");
+    unsigned long long history_ns =
+        category_ns(stats, "canvas_history:handle")
+        + category_ns(stats, "canvas_history:handle_multidab");
+    printf("\nphase\tms\n");
+    print_phase("history", history_ns > paint_ns ? history_ns - paint_ns : 0);
+    print_phase("paint", paint_ns);
+    print_phase("preview",
+                category_ns(stats, "paint_engine:tick:changes:preview"));
+    print_phase("tick", category_ns(stats, "paint_engine:tick"));
+    print_phase("render_apply", category_ns(stats, "renderer:apply"));
+    print_phase("render_tiles", category_ns(stats, "renderer:tile"));
+    print_phase("render_wait", render_wait_ns);
+
+    printf("\ntype\tmessages\thandled\tms\tus_per_message\n");
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        ReplayType *rt = &stats->types[i];
+        if (rt->messages != 0 || rt->handled != 0) {
+            print_type(
+                DP_message_type_enum_name_unprefixed((DP_MessageType)i), rt);
+        }
+    }
+    // Their messages are counted under their own types, but handled and the
+    // time taken can only be given for the batch as a whole.
+    if (stats->mixed_multidab.handled != 0) {
+        print_type("(mixed multidab)", &stats->mixed_multidab);
+    }
+
+    printf("\ncategory\tcount\tms\n");
+    size_t used = stats->categories.used;
+    for (size_t i = 0; i < used; ++i) {
+        ReplayCategory *rc =
+            DP_vector_at(&stats->categories, sizeof(*rc), i);
+        printf("%s\t%lld\t%.3f\n", rc->name, rc->count, ns_to_ms(rc->ns));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "Usage: %s STEPS RECORDING [PERF_LOG]\n", argv[0]);
+        return 2;
+    }
+
+    long long steps = atoll(argv[1]);
+    if (steps < 1) {
+        fprintf(stderr, "STEPS must be positive\n");
+        return 2;
+    }
+
+    const char *path = argv[2];
+    ReplayStats stats;
+    DP_VECTOR_INIT_TYPE(&stats.categories, ReplayCategory, 64);
+    memset(stats.types, 0, sizeof(stats.types));
+    stats.mixed_multidab = (ReplayType){0, 0, 0};
+    stats.log_or_null = NULL;
+    if (argc > 3) {
+        stats.log_or_null = DP_file_output_new_from_path(argv[3]);
+        if (!stats.log_or_null) {
+            DP_warn("Error opening perf log: %s", DP_error());
+            DP_vector_dispose(&stats.categories);
+            return 1;
+        }
+    }
+
+    DP_cpu_support_init();
+    if (!DP_perf_open(DP_output_new(stats_output_init, &stats,
+                                    sizeof(ReplayStats *)))) {
+        DP_warn("Error opening perf output: %s", DP_error());
+    }
+
+    long long messages = 0;
+    unsigned long long ns = 0, render_wait_ns = 0;
+    bool ok = replay(path, steps, &stats, &messages, &ns, &render_wait_ns);
+    if (!ok) {
+        DP_warn("Error replaying '%s': %s", path, DP_error());
+    }
+
+    if (DP_perf_is_open() && !DP_perf_close()) {
+        DP_warn("Error closing perf output: %s", DP_error());
+    }
+
+    printf("recording\tmessages\tms\tmessages_per_sec\n");
+    printf("%s\t%lld\t%.3f\t%.1f\n", path, messages, ns_to_ms(ns),
+           ns == 0 ? 0.0
+                   : DP_llong_to_double(messages) * 1000000000.0
+                         / DP_ullong_to_double(ns));
+    print_stats(&stats, render_wait_ns);
+
+    DP_vector_dispose(&stats.categories);
+    return ok ? 0 : 1;
+}
@@ -97,7 +97,7 @@ bool DP_image_write_png(DP_Image *img, DP_Output *output)
     DP_ASSERT(img);
     DP_ASSERT(output);
     return DP_image_png_write(output, DP_image_width(img), DP_image_height(img),
-                              DP_image_pixels(img));
+                              DP_image_pixels(img), -1);
 }
 
 bool DP_image_write_jpeg(DP_Image *img, DP_Output *output)
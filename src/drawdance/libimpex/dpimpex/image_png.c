@@ -152,6 +152,7 @@ DP_Image *DP_image_png_read(DP_Input *input)
 
 
 static bool write_png_with(DP_Output *output, int width, int height,
+                           int compression_level,
                            DP_UPixel8 (*get_pixel)(void *, size_t), void *user)
 {
     png_structp png_ptr =
@@ -196,6 +197,9 @@ static bool write_png_with(DP_Output *output, int width, int height,
     }
 
     png_set_write_fn(png_ptr, output, write_png, flush_png);
+    if (compression_level >= 0) {
+        png_set_compression_level(png_ptr, DP_min_int(compression_level, 9));
+    }
 
     png_set_IHDR(png_ptr, info_ptr, DP_int_to_uint32(width),
                  DP_int_to_uint32(height), 8, PNG_COLOR_TYPE_RGBA,
@@ -219,10 +223,10 @@ static DP_UPixel8 get_premultiplied_pixel(void *user, size_t pixel_index)
 }
 
 bool DP_image_png_write(DP_Output *output, int width, int height,
-                        DP_Pixel8 *pixels)
+                        DP_Pixel8 *pixels, int compression_level)
 {
-    return write_png_with(output, width, height, get_premultiplied_pixel,
-                          pixels);
+    return write_png_with(output, width, height, compression_level,
+                          get_premultiplied_pixel, pixels);
 }
 
 static DP_UPixel8 get_unpremultiplied_pixel(void *user, size_t pixel_index)
@@ -232,8 +236,9 @@ static DP_UPixel8 get_unpremultiplied_pixel(void *user, size_t pixel_index)
 }
 
 bool DP_image_png_write_unpremultiplied(DP_Output *output, int width,
-                                        int height, DP_UPixel8 *pixels)
+                                        int height, DP_UPixel8 *pixels,
+                                        int compression_level)
 {
-    return write_png_with(output, width, height, get_unpremultiplied_pixel,
-                          pixels);
+    return write_png_with(output, width, height, compression_level,
+                          get_unpremultiplied_pixel, pixels);
 }
@@ -12,11 +12,13 @@ typedef union DP_UPixel8 DP_UPixel8;
 
 DP_Image *DP_image_png_read(DP_Input *input);
 
+// The compression level goes from 0 (none) to 9 (best), -1 uses the default.
 bool DP_image_png_write(DP_Output *output, int width, int height,
-                        DP_Pixel8 *pixels);
+                        DP_Pixel8 *pixels, int compression_level);
 
-bool DP_image_png_write_unpremultiplied(DP_Output *output, int width, int height,
-                         DP_UPixel8 *pixels);
+bool DP_image_png_write_unpremultiplied(DP_Output *output, int width,
+                                        int height, DP_UPixel8 *pixels,
+                                        int compression_level);
 
 
 #endif
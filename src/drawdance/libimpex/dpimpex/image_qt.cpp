@@ -183,19 +183,34 @@ static bool write_image(DP_Output *output, int width, int height, uchar *pixels,
     return ok ? DP_output_flush(output) : false;
 }
 
+// Qt maps a PNG quality q to a compression level of (100 - q) * 9 / 91.
+static int png_compression_level_to_quality(int compression_level)
+{
+    if (compression_level < 0) {
+        return -1;
+    }
+    else {
+        int level = DP_min_int(compression_level, 9);
+        return 100 - (level * 91 + 8) / 9;
+    }
+}
+
 extern "C" bool DP_image_png_write(DP_Output *output, int width, int height,
-                                   DP_Pixel8 *pixels)
+                                   DP_Pixel8 *pixels, int compression_level)
 {
+    int quality = png_compression_level_to_quality(compression_level);
     return write_image(output, width, height, reinterpret_cast<uchar *>(pixels),
-                       "PNG", -1, QImage::Format_ARGB32_Premultiplied);
+                       "PNG", quality, QImage::Format_ARGB32_Premultiplied);
 }
 
 extern "C" bool DP_image_png_write_unpremultiplied(DP_Output *output, int width,
                                                    int height,
-                                                   DP_UPixel8 *pixels)
+                                                   DP_UPixel8 *pixels,
+                                                   int compression_level)
 {
+    int quality = png_compression_level_to_quality(compression_level);
     return write_image(output, width, height, reinterpret_cast<uchar *>(pixels),
-                       "PNG", -1, QImage::Format_ARGB32);
+                       "PNG", quality, QImage::Format_ARGB32);
 }
 
 bool DP_image_jpeg_write(DP_Output *output, int width, int height,
@@ -7,7 +7,9 @@
 #include <dpcommon/input.h>
 #include <dpcommon/output.h>
 #include <dpcommon/perf.h>
+#include <dpcommon/threading.h>
 #include <dpcommon/vector.h>
+#include <dpcommon/worker.h>
 #include <dpengine/annotation.h>
 #include <dpengine/annotation_list.h>
 #include <dpengine/canvas_history.h>
@@ -41,6 +43,7 @@
 #define INDEX_VERSION_LENGTH  2
 #define INDEX_HEADER_LENGTH   (INDEX_MAGIC_LENGTH + INDEX_VERSION_LENGTH + 12)
 #define INITAL_ENTRY_CAPACITY 64
+#define INITIAL_JOB_CAPACITY  256
 
 static_assert(INDEX_MAGIC_LENGTH < sizeof(DP_OutputBinaryEntry),
               "index header fits into output binary entry");
@@ -91,6 +94,46 @@ typedef struct DP_BuildIndexMaps {
     } timeline;
 } DP_BuildIndexMaps;
 
+// Building an index is pipelined: when the replay hits a snapshot, the history
+// for it is serialized right away and the canvas state is held onto. The tiles
+// that need writing get deflated and the thumbnail rendered on a pool of
+// worker threads while the replay continues. When the next snapshot comes
+// around (or the recording ends), the pending one is written out in the same
+// order as it would have been serially, so the index doesn't change.
+typedef struct DP_BuildIndexCompressedTile {
+    DP_Tile *t;
+    unsigned char *data; // Includes the size prefix, NULL on error.
+    size_t size;
+    char *error;
+    UT_hash_handle hh;
+} DP_BuildIndexCompressedTile;
+
+typedef struct DP_BuildIndexThumbnail {
+    DP_CanvasState *cs;
+    void *buffer;
+    size_t size;
+    char *warning; // Thumbnail is skipped, but indexing continues.
+    char *error;   // Indexing fails.
+} DP_BuildIndexThumbnail;
+
+typedef struct DP_BuildIndexPending {
+    bool active;
+    long long message_index;
+    size_t message_offset;
+    DP_CanvasState *cs;
+    int message_count;
+    void *history_buffer;
+    size_t history_size;
+    DP_BuildIndexCompressedTile *tiles;
+    DP_BuildIndexThumbnail thumbnail;
+    int job_count;
+} DP_BuildIndexPending;
+
+struct DP_BuildIndexJob {
+    struct DP_BuildIndexContext *c;
+    DP_BuildIndexCompressedTile *tile; // NULL for the thumbnail.
+};
+
 typedef struct DP_BuildIndexEntryContext {
     DP_Output *output;
     DP_AclState *acls;
@@ -112,6 +155,7 @@ typedef struct DP_BuildIndexEntryContext {
         unsigned char *buffer;
         size_t size;
     } annotation;
+    DP_BuildIndexCompressedTile *tiles;
 } DP_BuildIndexEntryContext;
 
 typedef struct DP_BuildIndexContext {
@@ -124,6 +168,13 @@ typedef struct DP_BuildIndexContext {
     long long message_count;
     DP_Vector entries;
     DP_BuildIndexMaps last;
+    DP_BuildIndexPending pending;
+    struct {
+        DP_Worker *worker; // NULL when building serially.
+        DP_Semaphore *done_sem;
+        int thread_count;
+        DP_DrawContext **dcs;
+    } pool;
     DP_PlayerIndexShouldSnapshotFn should_snapshot_fn;
     DP_PlayerIndexProgressFn progress_fn;
     void *user;
@@ -262,13 +313,42 @@ static unsigned char *get_compression_buffer(size_t size, void *user)
     return pool + sizeof(uint16_t);
 }
 
-static size_t write_index_tile(DP_BuildIndexEntryContext *e, DP_Tile *t)
+static size_t compress_index_tile(DP_DrawContext *dc, DP_Tile *t)
 {
-    size_t size = DP_tile_compress(t, DP_draw_context_tile8_buffer(e->dc),
-                                   get_compression_buffer, e->dc);
-    if (size == 0) {
+    size_t size = DP_tile_compress(t, DP_draw_context_tile8_buffer(dc),
+                                   get_compression_buffer, dc);
+    if (size != 0) {
+        unsigned char *buffer = DP_draw_context_pool(dc);
+        DP_write_littleendian_uint16(DP_size_to_uint16(size), buffer);
+        return size + sizeof(uint16_t);
+    }
+    else {
         return 0;
     }
+}
+
+static size_t write_index_tile(DP_BuildIndexEntryContext *e, DP_Tile *t)
+{
+    const unsigned char *data;
+    size_t size;
+    DP_BuildIndexCompressedTile *compressed;
+    HASH_FIND_PTR(e->tiles, &t, compressed);
+    if (compressed) {
+        if (!compressed->data) {
+            DP_error_set("%s", compressed->error);
+            return 0;
+        }
+        data = compressed->data;
+        size = compressed->size;
+    }
+    else {
+        // Not collected up front, shouldn't happen. Compress it right here.
+        size = compress_index_tile(e->dc, t);
+        if (size == 0) {
+            return 0;
+        }
+        data = DP_draw_context_pool(e->dc);
+    }
 
     bool error;
     size_t offset = DP_output_tell(e->output, &error);
@@ -276,9 +356,7 @@ static size_t write_index_tile(DP_BuildIndexEntryContext *e, DP_Tile *t)
         return 0;
     }
 
-    unsigned char *buffer = DP_draw_context_pool(e->dc);
-    DP_write_littleendian_uint16(DP_size_to_uint16(size), buffer);
-    if (!DP_output_write(e->output, buffer, size + sizeof(uint16_t))) {
+    if (!DP_output_write(e->output, data, size)) {
         return 0;
     }
 
@@ -790,9 +868,27 @@ static bool write_index_canvas_state(DP_BuildIndexEntryContext *e)
     return true;
 }
 
-static bool write_index_snapshot(DP_BuildIndexEntryContext *e)
+static bool write_index_pending_history(DP_BuildIndexEntryContext *e,
+                                        DP_BuildIndexPending *p)
+{
+    bool error;
+    size_t offset = DP_output_tell(e->output, &error);
+    if (error) {
+        return false;
+    }
+
+    if (!DP_output_write(e->output, p->history_buffer, p->history_size)) {
+        return false;
+    }
+
+    e->offset.history = offset;
+    return true;
+}
+
+static bool write_index_snapshot(DP_BuildIndexEntryContext *e,
+                                 DP_BuildIndexPending *p)
 {
-    bool ok = write_index_history(e) && write_index_layers(e)
+    bool ok = write_index_pending_history(e, p) && write_index_layers(e)
            && write_index_annotations(e) && write_index_background_tile(e)
            && write_index_timeline(e) && write_index_metadata(e)
            && write_index_canvas_state(e);
@@ -800,24 +896,19 @@ static bool write_index_snapshot(DP_BuildIndexEntryContext *e)
     return ok;
 }
 
-static bool write_index_thumbnail(DP_BuildIndexEntryContext *e)
+static void render_index_thumbnail(DP_BuildIndexThumbnail *thumbnail,
+                                   DP_DrawContext *dc)
 {
-    DP_Output *output = e->output;
-    bool error;
-    size_t thumbnail_offset = DP_output_tell(output, &error);
-    if (error) {
-        return false;
-    }
-
     DP_Image *img = DP_canvas_state_to_flat_image(
-        e->cs, DP_FLAT_IMAGE_RENDER_FLAGS, NULL, NULL);
+        thumbnail->cs, DP_FLAT_IMAGE_RENDER_FLAGS, NULL, NULL);
     if (!img) {
-        DP_warn("Error creating index thumbnail: %s", DP_error());
-        return true; // Keep going without a thumbnail.
+        thumbnail->warning =
+            DP_format("Error creating index thumbnail: %s", DP_error());
+        return;
     }
 
     DP_Image *thumb;
-    if (DP_image_thumbnail(img, e->dc, 256, 256, &thumb)) {
+    if (DP_image_thumbnail(img, dc, 256, 256, &thumb)) {
         if (thumb) {
             DP_image_free(img);
         }
@@ -827,35 +918,53 @@ static bool write_index_thumbnail(DP_BuildIndexEntryContext *e)
     }
     else {
         DP_image_free(img);
-        DP_warn("Error scaling index thumbnail: %s", DP_error());
-        return true; // Keep going without a thumbnail.
-    }
-
-    if (!DP_OUTPUT_WRITE_LITTLEENDIAN(output, DP_OUTPUT_UINT32(0))) {
-        return false;
+        thumbnail->warning =
+            DP_format("Error scaling index thumbnail: %s", DP_error());
+        return;
     }
 
+    void **buffer_ptr;
+    size_t *size_ptr;
+    DP_Output *output = DP_mem_output_new(64, false, &buffer_ptr, &size_ptr);
     bool write_ok = DP_image_write_png(thumb, output);
     DP_image_free(thumb);
-    if (!write_ok) {
-        return false;
+    void *buffer = *buffer_ptr;
+    size_t size = *size_ptr;
+    DP_output_free(output);
+
+    if (write_ok) {
+        thumbnail->buffer = buffer;
+        thumbnail->size = size;
+    }
+    else {
+        DP_free(buffer);
+        thumbnail->error = DP_strdup(DP_error());
     }
+}
 
-    size_t end_offset = DP_output_tell(output, &error);
+static bool write_index_thumbnail(DP_BuildIndexEntryContext *e,
+                                  DP_BuildIndexThumbnail *thumbnail)
+{
+    DP_Output *output = e->output;
+    bool error;
+    size_t thumbnail_offset = DP_output_tell(output, &error);
     if (error) {
         return false;
     }
 
-    if (!DP_output_seek(output, thumbnail_offset)) {
+    if (thumbnail->error) {
+        DP_error_set("%s", thumbnail->error);
         return false;
     }
-
-    size_t size = end_offset - thumbnail_offset - 4;
-    if (!DP_OUTPUT_WRITE_LITTLEENDIAN(output, DP_OUTPUT_UINT32(size))) {
-        return false;
+    else if (thumbnail->warning) {
+        DP_warn("%s", thumbnail->warning);
+        return true; // Keep going without a thumbnail.
     }
 
-    if (!DP_output_seek(output, end_offset)) {
+    bool ok = DP_OUTPUT_WRITE_LITTLEENDIAN(
+                  output, DP_OUTPUT_UINT32(thumbnail->size))
+           && DP_output_write(output, thumbnail->buffer, thumbnail->size);
+    if (!ok) {
         return false;
     }
 
@@ -896,36 +1005,260 @@ static void dispose_index_maps(DP_BuildIndexMaps *maps)
     DP_timeline_decref_nullable(maps->timeline.tl);
 }
 
-static bool make_index_entry(DP_BuildIndexContext *c, long long message_index,
-                             size_t message_offset)
+
+static void collect_index_tile(DP_BuildIndexContext *c, DP_Tile *t)
+{
+    if (t && !search_tile(c->last.tiles, t)) {
+        DP_BuildIndexCompressedTile *compressed;
+        HASH_FIND_PTR(c->pending.tiles, &t, compressed);
+        if (!compressed) {
+            compressed = DP_malloc(sizeof(*compressed));
+            compressed->t = t;
+            compressed->data = NULL;
+            compressed->size = 0;
+            compressed->error = NULL;
+            HASH_ADD_PTR(c->pending.tiles, t, compressed);
+        }
+    }
+}
+
+static bool is_existing_layer(DP_BuildIndexContext *c,
+                              DP_BuildIndexLayerKey *key)
 {
-    DP_BuildIndexEntryContext e = {c->output,
-                                   c->acls,
-                                   c->local_state,
-                                   c->ch,
-                                   NULL,
-                                   c->dc,
-                                   {NULL, NULL, NULL, {NULL, 0}, {NULL, 0}},
-                                   &c->last,
-                                   0,
-                                   {0, 0, 0, 0, 0},
-                                   {NULL, 0}};
-    bool ok = write_index_snapshot(&e) && write_index_thumbnail(&e);
+    DP_BuildIndexLayerMap *entry;
+    HASH_FIND(hh, c->last.layers, key, sizeof(*key), entry);
+    return entry != NULL;
+}
+
+static void collect_index_layer_list(DP_BuildIndexContext *c, DP_LayerList *ll,
+                                     DP_LayerPropsList *lpl);
+
+// Mirrors what write_index_layer_content and write_index_layer_group will end
+// up writing, skipping layers that get reused from the last snapshot.
+static void collect_index_layer_content(DP_BuildIndexContext *c,
+                                        DP_LayerContent *lc, DP_LayerProps *lp,
+                                        bool sublayer)
+{
+    if (!sublayer) {
+        DP_BuildIndexLayerKey key;
+        memset(&key, 0, sizeof(key));
+        key.lc = lc;
+        key.lp = lp;
+        if (is_existing_layer(c, &key)) {
+            return;
+        }
+    }
+
+    DP_LayerPropsList *sub_lpl = DP_layer_content_sub_props_noinc(lc);
+    DP_LayerList *sub_ll = DP_layer_content_sub_contents_noinc(lc);
+    int sub_count = DP_layer_props_list_count(sub_lpl);
+    for (int i = 0; i < sub_count; ++i) {
+        DP_LayerProps *sub_lp = DP_layer_props_list_at_noinc(sub_lpl, i);
+        if (is_relevant_sublayer(sub_lp)) {
+            collect_index_layer_content(
+                c, DP_layer_list_content_at_noinc(sub_ll, i), sub_lp, true);
+        }
+    }
+
+    DP_TileCounts tile_counts = DP_tile_counts_round(
+        DP_layer_content_width(lc), DP_layer_content_height(lc));
+    for (int y = 0; y < tile_counts.y; ++y) {
+        for (int x = 0; x < tile_counts.x; ++x) {
+            collect_index_tile(c, DP_layer_content_tile_at_noinc(lc, x, y));
+        }
+    }
+}
+
+static void collect_index_layer_list(DP_BuildIndexContext *c, DP_LayerList *ll,
+                                     DP_LayerPropsList *lpl)
+{
+    int count = DP_layer_list_count(ll);
+    for (int i = 0; i < count; ++i) {
+        DP_LayerListEntry *lle = DP_layer_list_at_noinc(ll, i);
+        DP_LayerProps *lp = DP_layer_props_list_at_noinc(lpl, i);
+        DP_LayerPropsList *child_lpl = DP_layer_props_children_noinc(lp);
+        if (child_lpl) {
+            DP_LayerGroup *lg = DP_layer_list_entry_group_noinc(lle);
+            DP_BuildIndexLayerKey key;
+            memset(&key, 0, sizeof(key));
+            key.lg = lg;
+            key.lp = lp;
+            if (!is_existing_layer(c, &key)) {
+                collect_index_layer_list(c, DP_layer_group_children_noinc(lg),
+                                         child_lpl);
+            }
+        }
+        else {
+            collect_index_layer_content(
+                c, DP_layer_list_entry_content_noinc(lle), lp, false);
+        }
+    }
+}
+
+static void run_index_job(DP_BuildIndexContext *c,
+                          DP_BuildIndexCompressedTile *compressed,
+                          DP_DrawContext *dc)
+{
+    if (compressed) {
+        size_t size = compress_index_tile(dc, compressed->t);
+        if (size != 0) {
+            compressed->data = DP_malloc(size);
+            memcpy(compressed->data, DP_draw_context_pool(dc), size);
+            compressed->size = size;
+        }
+        else {
+            // Errors are thread-local, so the message has to be carried over.
+            compressed->error = DP_strdup(DP_error());
+        }
+    }
+    else {
+        render_index_thumbnail(&c->pending.thumbnail, dc);
+    }
+}
+
+static void run_index_worker_job(void *element, int thread_index)
+{
+    struct DP_BuildIndexJob *job = element;
+    DP_BuildIndexContext *c = job->c;
+    run_index_job(c, job->tile, c->pool.dcs[thread_index]);
+    DP_SEMAPHORE_MUST_POST(c->pool.done_sem);
+}
+
+static void push_index_job(DP_BuildIndexContext *c,
+                           DP_BuildIndexCompressedTile *compressed)
+{
+    DP_Worker *worker = c->pool.worker;
+    if (worker) {
+        DP_worker_push(worker, &(struct DP_BuildIndexJob){c, compressed});
+        ++c->pending.job_count;
+    }
+    else {
+        run_index_job(c, compressed, c->dc);
+    }
+}
+
+static void wait_index_jobs(DP_BuildIndexContext *c)
+{
+    int job_count = c->pending.job_count;
+    if (job_count != 0) {
+        DP_SEMAPHORE_MUST_WAIT_N(c->pool.done_sem, job_count);
+        c->pending.job_count = 0;
+    }
+}
+
+static void dispose_pending_entry(DP_BuildIndexContext *c)
+{
+    wait_index_jobs(c);
+    DP_BuildIndexPending *p = &c->pending;
+    DP_BuildIndexCompressedTile *compressed, *tmp;
+    HASH_ITER(hh, p->tiles, compressed, tmp) {
+        HASH_DEL(p->tiles, compressed);
+        DP_free(compressed->error);
+        DP_free(compressed->data);
+        DP_free(compressed);
+    }
+    DP_free(p->thumbnail.error);
+    DP_free(p->thumbnail.warning);
+    DP_free(p->thumbnail.buffer);
+    DP_free(p->history_buffer);
+    DP_canvas_state_decref_nullable(p->cs);
+    *p = (DP_BuildIndexPending){0};
+}
+
+static DP_BuildIndexEntryContext make_entry_context(DP_BuildIndexContext *c,
+                                                    DP_Output *output)
+{
+    return (DP_BuildIndexEntryContext){
+        output,
+        c->acls,
+        c->local_state,
+        c->ch,
+        NULL,
+        c->dc,
+        {NULL, NULL, NULL, {NULL, 0}, {NULL, 0}},
+        &c->last,
+        0,
+        {0, 0, 0, 0, 0},
+        {NULL, 0},
+        c->pending.tiles,
+    };
+}
+
+static bool start_index_entry(DP_BuildIndexContext *c, long long message_index,
+                              size_t message_offset)
+{
+    // The history has to be serialized right now, since the replay is going
+    // to keep changing it. It's buffered and written out with the rest later.
+    void **buffer_ptr;
+    size_t *size_ptr;
+    DP_Output *output = DP_mem_output_new(1024, false, &buffer_ptr, &size_ptr);
+    DP_BuildIndexEntryContext e = make_entry_context(c, output);
+    bool ok = write_index_history(&e);
+    void *buffer = *buffer_ptr;
+    size_t size = *size_ptr;
+    DP_output_free(output);
     if (!ok) {
-        dispose_index_maps(&e.current);
+        DP_free(buffer);
         return false;
     }
 
-    DP_PlayerIndexEntry entry = {message_index, message_offset,
-                                 e.offset.snapshot, e.offset.thumbnail};
-    DP_VECTOR_PUSH_TYPE(&c->entries, DP_PlayerIndexEntry, entry);
+    DP_BuildIndexPending *p = &c->pending;
+    p->active = true;
+    p->message_index = message_index;
+    p->message_offset = message_offset;
+    p->cs = DP_canvas_state_incref(e.cs);
+    p->message_count = e.message_count;
+    p->history_buffer = buffer;
+    p->history_size = size;
+    p->thumbnail.cs = p->cs;
 
-    dispose_index_maps(&c->last);
-    c->last = e.current;
+    collect_index_layer_list(c, DP_canvas_state_layers_noinc(p->cs),
+                             DP_canvas_state_layer_props_noinc(p->cs));
+    collect_index_tile(c, DP_canvas_state_background_tile_noinc(p->cs));
 
+    DP_BuildIndexCompressedTile *compressed, *tmp;
+    HASH_ITER(hh, p->tiles, compressed, tmp) {
+        push_index_job(c, compressed);
+    }
+    push_index_job(c, NULL);
     return true;
 }
 
+static bool finish_index_entry(DP_BuildIndexContext *c)
+{
+    DP_BuildIndexPending *p = &c->pending;
+    if (!p->active) {
+        return true;
+    }
+
+    wait_index_jobs(c);
+    DP_BuildIndexEntryContext e = make_entry_context(c, c->output);
+    e.cs = p->cs;
+    e.message_count = p->message_count;
+    bool ok =
+        write_index_snapshot(&e, p) && write_index_thumbnail(&e, &p->thumbnail);
+    if (ok) {
+        DP_PlayerIndexEntry entry = {p->message_index, p->message_offset,
+                                     e.offset.snapshot, e.offset.thumbnail};
+        DP_VECTOR_PUSH_TYPE(&c->entries, DP_PlayerIndexEntry, entry);
+        dispose_index_maps(&c->last);
+        c->last = e.current;
+    }
+    else {
+        dispose_index_maps(&e.current);
+    }
+
+    dispose_pending_entry(c);
+    return ok;
+}
+
+static bool make_index_entry(DP_BuildIndexContext *c, long long message_index,
+                             size_t message_offset)
+{
+    return finish_index_entry(c)
+        && start_index_entry(c, message_index, message_offset);
+}
+
 static bool write_index_messages(DP_BuildIndexContext *c)
 {
     DP_Player *player = c->player;
@@ -991,11 +1324,11 @@ static bool write_index_messages(DP_BuildIndexContext *c)
 
     long long message_index = c->message_count - 1;
     if (message_index >= 0 && message_index != last_written_message_index) {
-        return make_index_entry(c, message_index, DP_player_tell(player));
-    }
-    else {
-        return true;
+        if (!make_index_entry(c, message_index, DP_player_tell(player))) {
+            return false;
+        }
     }
+    return finish_index_entry(c);
 }
 
 static bool write_index_entry(DP_BuildIndexContext *c,
@@ -1040,9 +1373,69 @@ static bool write_index(DP_BuildIndexContext *c)
         && write_index_finish(c) && DP_output_flush(c->output);
 }
 
+static void start_index_pool(DP_BuildIndexContext *c, int thread_count)
+{
+    // The replay runs on the calling thread, the rest do compression.
+    int worker_count = thread_count - 1;
+    if (worker_count <= 0) {
+        return;
+    }
+
+    DP_Semaphore *done_sem = DP_semaphore_new(0);
+    if (!done_sem) {
+        DP_warn("Index: can't create semaphore, building serially: %s",
+                DP_error());
+        return;
+    }
+
+    DP_Worker *worker =
+        DP_worker_new(INITIAL_JOB_CAPACITY, sizeof(struct DP_BuildIndexJob),
+                      worker_count, run_index_worker_job);
+    if (!worker) {
+        DP_warn("Index: can't start workers, building serially: %s",
+                DP_error());
+        DP_semaphore_free(done_sem);
+        return;
+    }
+
+    int worker_thread_count = DP_worker_thread_count(worker);
+    DP_DrawContext **dcs =
+        DP_malloc(sizeof(*dcs) * DP_int_to_size(worker_thread_count));
+    for (int i = 0; i < worker_thread_count; ++i) {
+        dcs[i] = DP_draw_context_new();
+    }
+
+    c->pool.worker = worker;
+    c->pool.done_sem = done_sem;
+    c->pool.thread_count = worker_thread_count;
+    c->pool.dcs = dcs;
+}
+
+static void stop_index_pool(DP_BuildIndexContext *c)
+{
+    if (c->pool.worker) {
+        DP_worker_free_join(c->pool.worker);
+        for (int i = 0; i < c->pool.thread_count; ++i) {
+            DP_draw_context_free(c->pool.dcs[i]);
+        }
+        DP_free(c->pool.dcs);
+        DP_semaphore_free(c->pool.done_sem);
+    }
+}
+
 bool DP_player_index_build(DP_Player *player, DP_DrawContext *dc,
                            DP_PlayerIndexShouldSnapshotFn should_snapshot_fn,
                            DP_PlayerIndexProgressFn progress_fn, void *user)
+{
+    return DP_player_index_build_threads(player, dc, DP_worker_cpu_count(128),
+                                         should_snapshot_fn, progress_fn,
+                                         user);
+}
+
+bool DP_player_index_build_threads(
+    DP_Player *player, DP_DrawContext *dc, int thread_count,
+    DP_PlayerIndexShouldSnapshotFn should_snapshot_fn,
+    DP_PlayerIndexProgressFn progress_fn, void *user)
 {
     DP_ASSERT(player);
     DP_ASSERT(dc);
@@ -1081,7 +1474,8 @@ bool DP_player_index_build(DP_Player *player, DP_DrawContext *dc,
         return false;
     }
 
-    DP_PERF_BEGIN_DETAIL(fn, "index_build", "path=%s", path);
+    DP_PERF_BEGIN_DETAIL(fn, "index_build", "path=%s,threads=%d", path,
+                         thread_count);
     DP_AclState *acls = DP_acl_state_new_playback();
     DP_LocalState *ls = DP_local_state_new(NULL, NULL, NULL);
     DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
@@ -1094,11 +1488,16 @@ bool DP_player_index_build(DP_Player *player, DP_DrawContext *dc,
                               0,
                               DP_VECTOR_NULL,
                               {NULL, NULL, NULL, {NULL, 0}, {NULL, 0}},
+                              {0},
+                              {NULL, NULL, 0, NULL},
                               should_snapshot_fn,
                               progress_fn,
                               user};
     DP_VECTOR_INIT_TYPE(&c.entries, DP_PlayerIndexEntry, INITAL_ENTRY_CAPACITY);
+    start_index_pool(&c, thread_count);
     bool ok = write_index(&c);
+    dispose_pending_entry(&c);
+    stop_index_pool(&c);
     dispose_index_maps(&c.last);
     DP_vector_dispose(&c.entries);
     DP_canvas_history_free(ch);
@@ -21,6 +21,15 @@ bool DP_player_index_build(DP_Player *player, DP_DrawContext *dc,
                            DP_PlayerIndexShouldSnapshotFn should_snapshot_fn,
                            DP_PlayerIndexProgressFn progress_fn, void *user);
 
+// Like above, but with an explicit number of threads. The replay always runs
+// on the calling thread, any further threads compress tiles and render
+// thumbnails in the background. A count of 1 or less builds serially. The
+// resulting index is the same regardless of the thread count.
+bool DP_player_index_build_threads(
+    DP_Player *player, DP_DrawContext *dc, int thread_count,
+    DP_PlayerIndexShouldSnapshotFn should_snapshot_fn,
+    DP_PlayerIndexProgressFn progress_fn, void *user);
+
 
 bool DP_player_index_load(DP_Player *player);
 
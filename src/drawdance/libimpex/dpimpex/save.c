@@ -12,12 +12,14 @@
 #include <dpcommon/output.h>
 #include <dpcommon/perf.h>
 #include <dpcommon/threading.h>
+#include <dpcommon/vector.h>
 #include <dpcommon/worker.h>
 #include <dpengine/annotation.h>
 #include <dpengine/annotation_list.h>
 #include <dpengine/canvas_state.h>
 #include <dpengine/document_metadata.h>
 #include <dpengine/draw_context.h>
+#include <dpengine/frame_pipeline.h>
 #include <dpengine/image.h>
 #include <dpengine/key_frame.h>
 #include <dpengine/layer_content.h>
@@ -191,22 +193,60 @@ static bool ora_store_mimetype(DP_ZipWriter *zw)
                                   false, false);
 }
 
-static bool ora_store_png(DP_SaveOraContext *c, const char *name,
-                          bool (*write_png)(void *, DP_Output *), void *user)
+// Layers, the background and the merged image are compressed into PNGs on a
+// pool of worker threads, since that's where saving spends most of its time.
+// The results are written to the archive in a fixed order as they finish, so
+// the output doesn't depend on which thread finished first. Only a few jobs
+// per thread are in flight at a time, so the encoded images don't all pile up
+// in memory at once on canvases with lots of layers.
+#define ORA_JOB_PNG_MAX         2
+#define ORA_JOBS_PER_THREAD_MAX 2
+
+typedef enum DP_SaveOraJobType {
+    DP_SAVE_ORA_JOB_LAYER,
+    DP_SAVE_ORA_JOB_BACKGROUND,
+    DP_SAVE_ORA_JOB_MERGED,
+} DP_SaveOraJobType;
+
+typedef struct DP_SaveOraPng {
+    char *name;
+    void *buffer;
+    size_t size;
+} DP_SaveOraPng;
+
+typedef struct DP_SaveOraJob {
+    DP_SaveOraJobType type;
+    DP_CanvasState *cs;
+    DP_DrawContext *dc;
+    DP_LayerContent *lc;
+    DP_SaveOraLayer *sol;
+    int compression_level;
+    int png_count;
+    DP_SaveOraPng pngs[ORA_JOB_PNG_MAX];
+    char *error;
+    DP_Semaphore *done_sem;
+} DP_SaveOraJob;
+
+static bool ora_encode_png(DP_SaveOraJob *job, char *name,
+                           bool (*write_png)(void *, DP_Output *, int),
+                           void *user)
 {
+    DP_ASSERT(job->png_count < ORA_JOB_PNG_MAX);
     void **buffer_ptr;
     size_t *size_ptr;
     DP_Output *output = DP_mem_output_new(64, false, &buffer_ptr, &size_ptr);
-    bool ok = write_png(user, output);
+    bool ok = write_png(user, output, job->compression_level);
     void *buffer = *buffer_ptr;
     size_t size = *size_ptr;
     DP_output_free(output);
 
     if (ok) {
-        return DP_zip_writer_add_file(c->zw, name, buffer, size, false, true);
+        job->pngs[job->png_count++] = (DP_SaveOraPng){name, buffer, size};
+        return true;
     }
     else {
         DP_free(buffer);
+        DP_free(name);
         return false;
     }
 }
@@ -217,51 +257,152 @@ struct DP_OraWriteUpixelsParams {
     int height;
 };
 
-static bool ora_write_png_upixels(void *user, DP_Output *output)
+static bool ora_write_png_upixels(void *user, DP_Output *output,
+                                  int compression_level)
 {
     struct DP_OraWriteUpixelsParams *params = user;
     return DP_image_png_write_unpremultiplied(output, params->width,
-                                              params->height, params->pixels);
+                                              params->height, params->pixels,
+                                              compression_level);
 }
 
-static bool ora_store_png_upixels(DP_SaveOraContext *c, DP_UPixel8 *pixels,
-                                  int width, int height, const char *name)
+static bool ora_encode_png_upixels(DP_SaveOraJob *job, DP_UPixel8 *pixels,
+                                   int width, int height, char *name)
 {
     static DP_UPixel8 null_pixels[] = {{0}};
     struct DP_OraWriteUpixelsParams params =
         pixels ? (struct DP_OraWriteUpixelsParams){pixels, width, height}
                : (struct DP_OraWriteUpixelsParams){null_pixels, 1, 1};
-    return ora_store_png(c, name, ora_write_png_upixels, &params);
+    return ora_encode_png(job, name, ora_write_png_upixels, &params);
 }
 
-static bool ora_write_png_image(void *user, DP_Output *output)
+static bool ora_write_png_image(void *user, DP_Output *output,
+                                int compression_level)
 {
     DP_Image *img = user;
-    return DP_image_write_png(img, output);
+    return DP_image_png_write(output, DP_image_width(img), DP_image_height(img),
+                              DP_image_pixels(img), compression_level);
 }
 
-static bool ora_store_png_image(DP_SaveOraContext *c, DP_Image *img,
-                                const char *name)
+static bool ora_encode_png_image(DP_SaveOraJob *job, DP_Image *img,
+                                 char *name)
 {
-    return img ? ora_store_png(c, name, ora_write_png_image, img)
-               : ora_store_png_upixels(c, NULL, 0, 0, name);
+    return img ? ora_encode_png(job, name, ora_write_png_image, img)
+               : ora_encode_png_upixels(job, NULL, 0, 0, name);
 }
 
-static bool ora_store_layer(DP_SaveOraContext *c, DP_LayerContent *lc,
-                            DP_SaveOraLayer *sol)
+static bool ora_encode_layer(DP_SaveOraJob *job)
 {
+    DP_SaveOraLayer *sol = job->sol;
     int width, height;
     DP_UPixel8 *pixels = DP_layer_content_to_upixels8_cropped(
-        lc, false, &sol->offset_x, &sol->offset_y, &width, &height);
-    const char *name =
-        save_ora_context_format(c, "data/layer-%04x.png", sol->layer_id);
-    bool ok = ora_store_png_upixels(c, pixels, width, height, name);
+        job->lc, false, &sol->offset_x, &sol->offset_y, &width, &height);
+    bool ok =
+        ora_encode_png_upixels(job, pixels, width, height,
+                               DP_format("data/layer-%04x.png", sol->layer_id));
+    DP_free(pixels);
+    return ok;
+}
+
+static bool ora_encode_background(DP_SaveOraJob *job)
+{
+    DP_CanvasState *cs = job->cs;
+    DP_Tile *t = DP_canvas_state_background_tile_noinc(cs);
+    DP_UPixel8 *tile_pixels = DP_malloc(sizeof(*tile_pixels) * DP_TILE_LENGTH);
+    DP_tile_copy_to_upixels8(t, tile_pixels, 0, 0, DP_TILE_SIZE, DP_TILE_SIZE);
+    if (!ora_encode_png_upixels(job, tile_pixels, DP_TILE_SIZE, DP_TILE_SIZE,
+                                DP_strdup("data/background-tile.png"))) {
+        DP_free(tile_pixels);
+        return false;
+    }
+
+    int width = DP_max_int(1, DP_canvas_state_width(cs));
+    int height = DP_max_int(1, DP_canvas_state_height(cs));
+    DP_UPixel8 *pixels = DP_malloc(sizeof(*pixels) * DP_int_to_size(width)
+                                   * DP_int_to_size(height));
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int tx = x % DP_TILE_SIZE;
+            int ty = y % DP_TILE_SIZE;
+            pixels[y * width + x] = tile_pixels[ty * DP_TILE_SIZE + tx];
+        }
+    }
+    DP_free(tile_pixels);
+
+    bool ok = ora_encode_png_upixels(job, pixels, width, height,
+                                     DP_strdup("data/background.png"));
     DP_free(pixels);
     return ok;
 }
 
-static bool ora_store_layers(DP_SaveOraContext *c, int *next_index,
-                             DP_LayerList *ll, DP_LayerPropsList *lpl)
+static bool ora_encode_merged(DP_SaveOraJob *job)
+{
+    DP_Image *img = DP_canvas_state_to_flat_image(
+        job->cs, DP_FLAT_IMAGE_RENDER_FLAGS, NULL, NULL);
+    if (!img) {
+        return false;
+    }
+
+    if (!ora_encode_png_image(job, img, DP_strdup("mergedimage.png"))) {
+        DP_image_free(img);
+        return false;
+    }
+
+    DP_Image *thumb;
+    if (!DP_image_thumbnail(img, job->dc, 256, 256, &thumb)) {
+        DP_image_free(img);
+        return false;
+    }
+
+    bool ok = ora_encode_png_image(job, thumb ? thumb : img,
+                                   DP_strdup("Thumbnails/thumbnail.png"));
+    DP_image_free(thumb);
+    DP_image_free(img);
+    return ok;
+}
+
+static void ora_encode_job(void *element, DP_UNUSED int thread_index)
+{
+    DP_SaveOraJob *job = *(DP_SaveOraJob **)element;
+    bool ok;
+    switch (job->type) {
+    case DP_SAVE_ORA_JOB_LAYER:
+        ok = ora_encode_layer(job);
+        break;
+    case DP_SAVE_ORA_JOB_BACKGROUND:
+        ok = ora_encode_background(job);
+        break;
+    case DP_SAVE_ORA_JOB_MERGED:
+        ok = ora_encode_merged(job);
+        break;
+    default:
+        DP_UNREACHABLE();
+    }
+    // Errors are thread-local, so the message has to be carried over.
+    if (!ok) {
+        job->error = DP_strdup(DP_error());
+    }
+    if (job->done_sem) {
+        DP_SEMAPHORE_MUST_POST(job->done_sem);
+    }
+}
+
+static void ora_push_job(DP_Vector *jobs, DP_SaveOraJobType type,
+                         DP_CanvasState *cs, DP_DrawContext *dc,
+                         DP_LayerContent *lc, DP_SaveOraLayer *sol,
+                         int compression_level)
+{
+    DP_SaveOraJob job = {
+        type, cs, dc, lc, sol, compression_level, 0, {{NULL, NULL, 0}}, NULL,
+        NULL,
+    };
+    DP_VECTOR_PUSH_TYPE(jobs, DP_SaveOraJob, job);
+}
+
+static void ora_collect_layers(DP_SaveOraContext *c, DP_Vector *jobs,
+                               int *next_index, DP_LayerList *ll,
+                               DP_LayerPropsList *lpl, int compression_level)
 {
     int count = DP_layer_list_count(ll);
     DP_ASSERT(DP_layer_props_list_count(lpl) == count);
@@ -275,80 +416,128 @@ static bool ora_store_layers(DP_SaveOraContext *c, int *next_index,
             DP_LayerGroup *lg = DP_layer_list_entry_group_noinc(lle);
             DP_LayerList *child_ll = DP_layer_group_children_noinc(lg);
             DP_LayerPropsList *child_lpl = DP_layer_props_children_noinc(lp);
-            if (!ora_store_layers(c, next_index, child_ll, child_lpl)) {
-                return false;
-            }
+            ora_collect_layers(c, jobs, next_index, child_ll, child_lpl,
+                               compression_level);
         }
         else {
             DP_LayerContent *lc = DP_layer_list_entry_content_noinc(lle);
-            if (!ora_store_layer(c, lc, sol)) {
-                return false;
-            }
+            ora_push_job(jobs, DP_SAVE_ORA_JOB_LAYER, NULL, NULL, lc, sol,
+                         compression_level);
         }
     }
-    return true;
 }
 
-static bool ora_store_background(DP_SaveOraContext *c, DP_CanvasState *cs)
+static void ora_start_job(DP_Worker *worker, DP_SaveOraJob *job)
 {
-    DP_Tile *t = DP_canvas_state_background_tile_noinc(cs);
-    if (t && !DP_tile_blank(t)) {
-        DP_UPixel8 *tile_pixels =
-            DP_malloc(sizeof(*tile_pixels) * DP_TILE_LENGTH);
-        DP_pixels15_to_8_unpremultiply(tile_pixels, DP_tile_pixels(t),
-                                       DP_TILE_LENGTH);
-        if (!ora_store_png_upixels(c, tile_pixels, DP_TILE_SIZE, DP_TILE_SIZE,
-                                   "data/background-tile.png")) {
-            DP_free(tile_pixels);
-            return false;
-        }
+    job->done_sem = worker ? DP_semaphore_new(0) : NULL;
+    if (job->done_sem) {
+        DP_worker_push(worker, &job);
+    }
+    else {
+        ora_encode_job(&job, 0);
+    }
+}
 
-        int width = DP_max_int(1, DP_canvas_state_width(cs));
-        int height = DP_max_int(1, DP_canvas_state_height(cs));
-        DP_UPixel8 *pixels = DP_malloc(sizeof(*pixels) * DP_int_to_size(width)
-                                       * DP_int_to_size(height));
+static void ora_wait_job(DP_SaveOraJob *job)
+{
+    if (job->done_sem) {
+        DP_SEMAPHORE_MUST_WAIT(job->done_sem);
+    }
+}
 
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                int tx = x % DP_TILE_SIZE;
-                int ty = y % DP_TILE_SIZE;
-                pixels[y * width + x] = tile_pixels[ty * DP_TILE_SIZE + tx];
-            }
-        }
-        DP_free(tile_pixels);
+static bool ora_store_job(DP_SaveOraContext *c, DP_SaveOraJob *job)
+{
+    if (job->error) {
+        DP_error_set("%s", job->error);
+        return false;
+    }
 
-        bool ok = ora_store_png_upixels(c, pixels, width, height,
-                                        "data/background.png");
-        DP_free(pixels);
-        return ok;
+    int count = job->png_count;
+    for (int i = 0; i < count; ++i) {
+        DP_SaveOraPng *png = &job->pngs[i];
+        // The zip writer takes the buffer, even if it fails.
+        void *buffer = png->buffer;
+        png->buffer = NULL;
+        if (!DP_zip_writer_add_file(c->zw, png->name, buffer, png->size, false,
+                                    true)) {
+            return false;
+        }
     }
     return true;
 }
 
-static bool ora_store_merged(DP_SaveOraContext *c, DP_CanvasState *cs,
-                             DP_DrawContext *dc)
+static void ora_dispose_job(DP_SaveOraJob *job)
 {
-    DP_Image *img = DP_canvas_state_to_flat_image(
-        cs, DP_FLAT_IMAGE_RENDER_FLAGS, NULL, NULL);
-    if (!img) {
-        return false;
+    for (int i = 0; i < job->png_count; ++i) {
+        DP_free(job->pngs[i].buffer);
+        DP_free(job->pngs[i].name);
     }
+    DP_free(job->error);
+}
 
-    if (!ora_store_png_image(c, img, "mergedimage.png")) {
-        DP_image_free(img);
-        return false;
+static bool ora_store_content(DP_SaveOraContext *c, DP_CanvasState *cs,
+                              DP_DrawContext *dc, int compression_level)
+{
+    // Collect everything up front, since the layer index must be complete
+    // before any of the worker threads start poking at it.
+    DP_Vector jobs;
+    DP_VECTOR_INIT_TYPE(&jobs, DP_SaveOraJob, 64);
+    int next_index = 0;
+    ora_collect_layers(c, &jobs, &next_index, DP_canvas_state_layers_noinc(cs),
+                       DP_canvas_state_layer_props_noinc(cs),
+                       compression_level);
+
+    DP_Tile *t = DP_canvas_state_background_tile_noinc(cs);
+    if (t && !DP_tile_blank(t)) {
+        ora_push_job(&jobs, DP_SAVE_ORA_JOB_BACKGROUND, cs, NULL, NULL, NULL,
+                     compression_level);
     }
 
-    DP_Image *thumb;
-    if (!DP_image_thumbnail(img, dc, 256, 256, &thumb)) {
-        DP_image_free(img);
-        return false;
+    // The draw context is only used for the thumbnail, so the merged image job
+    // is the only one touching it and the caller leaves it alone meanwhile.
+    ora_push_job(&jobs, DP_SAVE_ORA_JOB_MERGED, cs, dc, NULL, NULL,
+                 compression_level);
+
+    int job_count = DP_size_to_int(jobs.used);
+    int thread_count = DP_min_int(job_count, DP_worker_cpu_count(128));
+    int window = thread_count * ORA_JOBS_PER_THREAD_MAX;
+    DP_Worker *worker =
+        DP_worker_new(DP_int_to_size(window), sizeof(DP_SaveOraJob *),
+                      thread_count, ora_encode_job);
+    if (!worker) {
+        DP_warn("Save ORA: can't start workers, encoding serially: %s",
+                DP_error());
+        window = 1;
+    }
+
+    // Keep the workers busy with the next jobs while the current one gets
+    // written. After an error, nothing new is started, but the jobs that are
+    // already running still have to be waited for.
+    DP_SaveOraJob *elements = jobs.elements;
+    int started = 0;
+    bool ok = true;
+    for (int i = 0; i < job_count; ++i) {
+        while (ok && started < job_count && started - i < window) {
+            ora_start_job(worker, &elements[started++]);
+        }
+        if (i < started) {
+            ora_wait_job(&elements[i]);
+            if (ok) {
+                ok = ora_store_job(c, &elements[i]);
+            }
+        }
+        ora_dispose_job(&elements[i]);
     }
 
-    bool ok =
-        ora_store_png_image(c, thumb ? thumb : img, "Thumbnails/thumbnail.png");
-    DP_free(thumb);
-    DP_free(img);
+    // The semaphores must outlive the worker threads, since a thread may still
+    // be on its way out of posting one when the wait for it returns.
+    if (worker) {
+        DP_worker_free_join(worker);
+    }
+    for (int i = 0; i < started; ++i) {
+        DP_semaphore_free(elements[i].done_sem);
+    }
+    DP_vector_dispose(&jobs);
     return ok;
 }
 
@@ -664,7 +853,7 @@ static bool ora_store_xml(DP_SaveOraContext *c, DP_CanvasState *cs)
 }
 
 static DP_SaveResult save_ora(DP_CanvasState *cs, const char *path,
-                              DP_DrawContext *dc)
+                              DP_DrawContext *dc, int compression_level)
 {
     DP_ZipWriter *zw = DP_zip_writer_new(path);
     if (!zw) {
@@ -681,12 +870,8 @@ static DP_SaveResult save_ora(DP_CanvasState *cs, const char *path,
     }
 
     DP_SaveOraContext c = {zw, NULL, {0, NULL}};
-    int next_index = 0;
-    bool content_ok =
-        ora_store_layers(&c, &next_index, DP_canvas_state_layers_noinc(cs),
-                         DP_canvas_state_layer_props_noinc(cs))
-        && ora_store_background(&c, cs) && ora_store_merged(&c, cs, dc)
-        && ora_store_xml(&c, cs);
+    bool content_ok = ora_store_content(&c, cs, dc, compression_level)
+                   && ora_store_xml(&c, cs);
     save_ora_context_dispose(&c);
     if (!content_ok) {
         DP_warn("Save '%s': %s", path, DP_error());
@@ -703,9 +888,12 @@ static DP_SaveResult save_ora(DP_CanvasState *cs, const char *path,
 }
 
 
-static DP_SaveResult save_png(DP_Image *img, DP_Output *output)
+static DP_SaveResult save_png(DP_Image *img, DP_Output *output,
+                              int compression_level)
 {
-    bool ok = DP_image_write_png(img, output);
+    bool ok = DP_image_png_write(output, DP_image_width(img),
+                                 DP_image_height(img), DP_image_pixels(img),
+                                 compression_level);
     if (ok) {
         return DP_SAVE_RESULT_SUCCESS;
     }
@@ -715,7 +903,8 @@ static DP_SaveResult save_png(DP_Image *img, DP_Output *output)
     }
 }
 
-static DP_SaveResult save_jpeg(DP_Image *img, DP_Output *output)
+static DP_SaveResult save_jpeg(DP_Image *img, DP_Output *output,
+                               DP_UNUSED int compression_level)
 {
     bool ok = DP_image_write_jpeg(img, output);
     if (ok) {
@@ -727,7 +916,8 @@ static DP_SaveResult save_jpeg(DP_Image *img, DP_Output *output)
     }
 }
 
-static DP_SaveResult save_webp(DP_Image *img, DP_Output *output)
+static DP_SaveResult save_webp(DP_Image *img, DP_Output *output,
+                               DP_UNUSED int compression_level)
 {
     bool ok = DP_image_write_webp(img, output);
     if (ok) {
@@ -783,7 +973,8 @@ static void bake_annotations(DP_AnnotationList *al, DP_DrawContext *dc,
 
 static DP_SaveResult save_flat_image(
     DP_CanvasState *cs, DP_DrawContext *dc, DP_Rect *crop, const char *path,
-    DP_SaveResult (*save_fn)(DP_Image *, DP_Output *), DP_ViewModeFilter vmf,
+    DP_SaveResult (*save_fn)(DP_Image *, DP_Output *, int),
+    int compression_level, DP_ViewModeFilter vmf,
     DP_SaveBakeAnnotationFn bake_annotation, void *user)
 {
     DP_Image *img = DP_canvas_state_to_flat_image(
@@ -805,7 +996,7 @@ static DP_SaveResult save_flat_image(
         return DP_SAVE_RESULT_OPEN_ERROR;
     }
 
-    DP_SaveResult result = save_fn(img, output);
+    DP_SaveResult result = save_fn(img, output, compression_level);
     DP_output_free(output);
     DP_image_free(img);
     return result;
@@ -814,21 +1005,24 @@ static DP_SaveResult save_flat_image(
 
 static DP_SaveResult save(DP_CanvasState *cs, DP_DrawContext *dc,
                           DP_SaveImageType type, const char *path,
+                          int compression_level,
                           DP_SaveBakeAnnotationFn bake_annotation, void *user)
 {
     switch (type) {
     case DP_SAVE_IMAGE_ORA:
-        return save_ora(cs, path, dc);
+        return save_ora(cs, path, dc, compression_level);
     case DP_SAVE_IMAGE_PNG:
-        return save_flat_image(cs, dc, NULL, path, save_png,
+        return save_flat_image(cs, dc, NULL, path, save_png, compression_level,
                                DP_view_mode_filter_make_default(),
                                bake_annotation, user);
     case DP_SAVE_IMAGE_JPEG:
         return save_flat_image(cs, dc, NULL, path, save_jpeg,
+                               compression_level,
                                DP_view_mode_filter_make_default(),
                                bake_annotation, user);
     case DP_SAVE_IMAGE_WEBP:
         return save_flat_image(cs, dc, NULL, path, save_webp,
+                               compression_level,
                                DP_view_mode_filter_make_default(),
                                bake_annotation, user);
     case DP_SAVE_IMAGE_PSD:
@@ -842,10 +1036,22 @@ static DP_SaveResult save(DP_CanvasState *cs, DP_DrawContext *dc,
 DP_SaveResult DP_save(DP_CanvasState *cs, DP_DrawContext *dc,
                       DP_SaveImageType type, const char *path,
                       DP_SaveBakeAnnotationFn bake_annotation, void *user)
+{
+    return DP_save_with_compression_level(cs, dc, type, path,
+                                          DP_SAVE_COMPRESSION_LEVEL_DEFAULT,
+                                          bake_annotation, user);
+}
+
+DP_SaveResult DP_save_with_compression_level(
+    DP_CanvasState *cs, DP_DrawContext *dc, DP_SaveImageType type,
+    const char *path, int compression_level,
+    DP_SaveBakeAnnotationFn bake_annotation, void *user)
 {
     if (cs && path) {
-        DP_PERF_BEGIN_DETAIL(fn, "image", "path=%s", path);
-        DP_SaveResult result = save(cs, dc, type, path, bake_annotation, user);
+        DP_PERF_BEGIN_DETAIL(fn, "image", "path=%s,level=%d", path,
+                             compression_level);
+        DP_SaveResult result = save(cs, dc, type, path, compression_level,
+                                    bake_annotation, user);
         DP_PERF_END(fn);
         return result;
     }
@@ -1363,42 +1569,82 @@ save_animation_gif(DP_CanvasState *cs, DP_DrawContext *dc, const char *path,
         return DP_SAVE_RESULT_CANCEL;
     }
 
-    DP_ViewModeBuffer vmb;
-    DP_view_mode_buffer_init(&vmb);
-    double centiseconds_per_frame = get_gif_centiseconds_per_frame(framerate);
-    double delay_frac = 0.0;
+    // Runs of identical frames become a single GIF frame with a longer delay.
+    size_t capacity = DP_int_to_size(DP_max_int(frame_count, 1));
+    int *frame_indexes = DP_malloc(sizeof(*frame_indexes) * capacity);
+    int *frame_instances = DP_malloc(sizeof(*frame_instances) * capacity);
+    int entry_count = 0;
     for (int i = start; i <= end_inclusive; ++i) {
         int instances = 1;
         while (i < end_inclusive && DP_canvas_state_same_frame(cs, i, i + 1)) {
             ++i;
             ++instances;
         }
+        frame_indexes[entry_count] = i;
+        frame_instances[entry_count] = instances;
+        ++entry_count;
+    }
+
+    // Flattening runs ahead on worker threads while this thread scales and
+    // quantizes the frames that are already done.
+    DP_FramePipeline *fp =
+        DP_frame_pipeline_new(cs, crop, entry_count, frame_indexes, 0);
+    DP_SaveResult result = DP_SAVE_RESULT_SUCCESS;
+    double centiseconds_per_frame = get_gif_centiseconds_per_frame(framerate);
+    double delay_frac = 0.0;
+    int frames_done = 0;
+    for (int i = 0; i < entry_count; ++i) {
+        int frame_index = frame_indexes[i];
+        DP_Image *flat = DP_frame_pipeline_next(fp, NULL);
+        if (!flat) {
+            DP_warn("Flatten frame %d: %s", frame_index, DP_error());
+            result = DP_SAVE_RESULT_FLATTEN_ERROR;
+            break;
+        }
+
+        DP_Image *scaled;
+        if (DP_image_width(flat) == width && DP_image_height(flat) == height) {
+            scaled = NULL;
+        }
+        else {
+            scaled = DP_image_scale(flat, dc, width, height, interpolation);
+            if (!scaled) {
+                DP_warn("Scale frame %d: %s", frame_index, DP_error());
+                result = DP_SAVE_RESULT_FLATTEN_ERROR;
+                break;
+            }
+        }
 
-        DP_Image *img = generate_frame_image(cs, dc, crop, width, height,
-                                             interpolation, &vmb, i, NULL);
-        double delay = centiseconds_per_frame * DP_int_to_double(instances);
+        double delay =
+            centiseconds_per_frame * DP_int_to_double(frame_instances[i]);
         double delay_floored = floor(delay + delay_frac);
         delay_frac = delay - delay_floored;
-        bool frame_ok = jo_gifx_frame(write_gif, output, gif,
-                                      (uint32_t *)DP_image_pixels(img),
-                                      DP_double_to_uint16(delay_floored));
-        DP_image_free(img);
+        bool frame_ok = jo_gifx_frame(
+            write_gif, output, gif,
+            (uint32_t *)DP_image_pixels(scaled ? scaled : flat),
+            DP_double_to_uint16(delay_floored));
+        DP_image_free(scaled);
         if (!frame_ok) {
-            jo_gifx_abort(gif);
-            DP_output_free(output);
-            DP_view_mode_buffer_dispose(&vmb);
-            return DP_SAVE_RESULT_WRITE_ERROR;
+            result = DP_SAVE_RESULT_WRITE_ERROR;
+            break;
         }
 
-        if (!report_gif_progress(progress_fn, user, i - start + 1,
+        frames_done += frame_instances[i];
+        if (!report_gif_progress(progress_fn, user, frames_done,
                                  frame_count)) {
-            jo_gifx_abort(gif);
-            DP_output_free(output);
-            DP_view_mode_buffer_dispose(&vmb);
-            return DP_SAVE_RESULT_CANCEL;
+            result = DP_SAVE_RESULT_CANCEL;
+            break;
         }
     }
-    DP_view_mode_buffer_dispose(&vmb);
+    DP_frame_pipeline_free(fp);
+    DP_free(frame_instances);
+    DP_free(frame_indexes);
+
+    if (result != DP_SAVE_RESULT_SUCCESS) {
+        jo_gifx_abort(gif);
+        DP_output_free(output);
+        return result;
+    }
 
     if (!jo_gifx_end(write_gif, output, gif) || !DP_output_flush(output)) {
         DP_output_free(output);
@@ -28,6 +28,17 @@ DP_SaveResult DP_save(DP_CanvasState *cs, DP_DrawContext *dc,
                       DP_SaveImageType type, const char *path,
                       DP_SaveBakeAnnotationFn bake_annotation, void *user);
 
+// PNG compression level for layers in OpenRaster files and flat PNG images,
+// from 0 (none) to 9 (smallest). The fast level trades file size for speed,
+// which is useful for autosaves. Other formats ignore this.
+#define DP_SAVE_COMPRESSION_LEVEL_DEFAULT (-1)
+#define DP_SAVE_COMPRESSION_LEVEL_FAST    1
+
+DP_SaveResult DP_save_with_compression_level(
+    DP_CanvasState *cs, DP_DrawContext *dc, DP_SaveImageType type,
+    const char *path, int compression_level,
+    DP_SaveBakeAnnotationFn bake_annotation, void *user);
+
 
 typedef bool (*DP_SaveAnimationProgressFn)(void *user, double progress);
 
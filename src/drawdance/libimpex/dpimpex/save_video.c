@@ -6,8 +6,8 @@
 #include <dpcommon/geom.h>
 #include <dpcommon/output.h>
 #include <dpengine/canvas_state.h>
+#include <dpengine/frame_pipeline.h>
 #include <dpengine/image.h>
-#include <dpengine/view_mode.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/opt.h>
@@ -273,6 +273,38 @@ static bool report_frame_progress(DP_SaveAnimationProgressFn progress_fn,
     return report_progress(progress_fn, user, part / total * 0.97);
 }
 
+// Collapses runs of identical frames into a single one shown for multiple
+// instances and repeats the whole thing for each loop. Returns the number of
+// entries written to the output arrays, which must fit all frames of all loops.
+static int collect_frames(DP_CanvasState *cs, int start, int end_inclusive,
+                          int loops, int *out_frame_indexes,
+                          int *out_instances)
+{
+    int count = 0;
+    for (int frame_index = start; frame_index <= end_inclusive;
+         ++frame_index) {
+        int instances = 1;
+        while (frame_index < end_inclusive
+               && DP_canvas_state_same_frame(cs, frame_index,
+                                             frame_index + 1)) {
+            ++frame_index;
+            ++instances;
+        }
+        out_frame_indexes[count] = frame_index - instances + 1;
+        out_instances[count] = instances;
+        ++count;
+    }
+
+    for (int i = 1; i < loops; ++i) {
+        size_t size = DP_int_to_size(count);
+        memcpy(out_frame_indexes + size * DP_int_to_size(i), out_frame_indexes,
+               sizeof(*out_frame_indexes) * size);
+        memcpy(out_instances + size * DP_int_to_size(i), out_instances,
+               sizeof(*out_instances) * size);
+    }
+    return count * loops;
+}
+
 static DP_SaveResult handle_frame(AVCodecContext *codec_context,
                                   AVFormatContext *format_context,
                                   AVFrame *frame, AVPacket *packet)
@@ -311,9 +343,9 @@ DP_SaveResult DP_save_animation_video(DP_SaveVideoParams params)
     AVFrame *frame = NULL;
     AVPacket *packet = NULL;
     struct SwsContext *sws_context = NULL;
-    DP_ViewModeBuffer vmb;
-    DP_view_mode_buffer_init(&vmb);
-    DP_Image *img = NULL;
+    int *frame_indexes = NULL;
+    int *frame_instances = NULL;
+    DP_FramePipeline *fp = NULL;
 
     DP_Rect crop;
     const char *format_name;
@@ -509,57 +541,63 @@ DP_SaveResult DP_save_animation_video(DP_SaveVideoParams params)
     int frames_done = 0;
     int64_t duration =
         get_format_frame_duration(params.format, codec_context, stream);
+
+    // Frames are flattened ahead of time on worker threads while the encoder
+    // works on the current one. Frames identical to the previous one, like
+    // when looping a single frame, aren't flattened or scaled again.
+    frame_indexes =
+        DP_malloc(sizeof(*frame_indexes) * DP_int_to_size(frames_to_do));
+    frame_instances =
+        DP_malloc(sizeof(*frame_instances) * DP_int_to_size(frames_to_do));
+    int frame_entries =
+        collect_frames(params.cs, start, end_inclusive, loops, frame_indexes,
+                       frame_instances);
+    fp = DP_frame_pipeline_new(params.cs, &crop, frame_entries, frame_indexes,
+                               0);
+
     int instances = 0;
     frame->pts = 0;
-    for (int loop_index = 0; loop_index < loops; ++loop_index) {
-        int frame_index = start;
-        while (frame_index <= end_inclusive) {
-            err = av_frame_make_writable(frame);
-            if (err != 0) {
-                DP_error_set("Error making frame writeable: %s",
-                             av_err2str(err));
-                result = DP_SAVE_RESULT_INTERNAL_ERROR;
-                goto cleanup;
-            }
-
-            instances = 1;
-            while (frame_index < end_inclusive
-                   && DP_canvas_state_same_frame(params.cs, frame_index,
-                                                 frame_index + 1)) {
-                ++frame_index;
-                ++instances;
-            }
-
-            DP_ViewModeFilter vmf = DP_view_mode_filter_make_frame_render(
-                &vmb, params.cs, frame_index - instances + 1);
-            if (!DP_canvas_state_into_flat_image(
-                    params.cs, DP_FLAT_IMAGE_RENDER_FLAGS, &crop, &vmf, &img)) {
-                result = DP_SAVE_RESULT_INTERNAL_ERROR;
-                goto cleanup;
-            }
+    for (int i = 0; i < frame_entries; ++i) {
+        err = av_frame_make_writable(frame);
+        if (err != 0) {
+            DP_error_set("Error making frame writeable: %s", av_err2str(err));
+            result = DP_SAVE_RESULT_INTERNAL_ERROR;
+            goto cleanup;
+        }
+
+        bool reused;
+        DP_Image *img = DP_frame_pipeline_next(fp, &reused);
+        if (!img) {
+            result = DP_SAVE_RESULT_INTERNAL_ERROR;
+            goto cleanup;
+        }
+
+        // Making the frame writeable keeps its contents, so a reused image is
+        // already scaled into it.
+        if (!reused) {
             const uint8_t *data = (const uint8_t *)DP_image_pixels(img);
             const int stride = input_width * 4;
             sws_scale(sws_context, &data, &stride, 0, input_height, frame->data,
                       frame->linesize);
+        }
 
-            result = handle_frame(codec_context, format_context, frame, packet);
-            if (result != DP_SAVE_RESULT_SUCCESS) {
-                goto cleanup;
-            }
+        result = handle_frame(codec_context, format_context, frame, packet);
+        if (result != DP_SAVE_RESULT_SUCCESS) {
+            goto cleanup;
+        }
 
-            frame->pts += duration * instances;
-            frames_done += instances;
-            ++frame_index;
-            if (!report_frame_progress(params.progress_fn, params.user,
-                                       frames_done, frames_to_do)) {
-                result = DP_SAVE_RESULT_CANCEL;
-                goto cleanup;
-            }
+        instances = frame_instances[i];
+        frame->pts += duration * instances;
+        frames_done += instances;
+        if (!report_frame_progress(params.progress_fn, params.user,
+                                   frames_done, frames_to_do)) {
+            result = DP_SAVE_RESULT_CANCEL;
+            goto cleanup;
         }
     }
 
-    DP_image_free(img);
-    img = NULL;
+    DP_frame_pipeline_free(fp);
+    fp = NULL;
 
     if (instances > 1) {
         frame->pts -= duration;
@@ -617,8 +655,9 @@ DP_SaveResult DP_save_animation_video(DP_SaveVideoParams params)
     }
 
 cleanup:
-    DP_image_free(img);
-    DP_view_mode_buffer_dispose(&vmb);
+    DP_frame_pipeline_free(fp);
+    DP_free(frame_instances);
+    DP_free(frame_indexes);
     sws_freeContext(sws_context);
     if (format_context && format_context->pb) {
         av_freep(&format_context->pb->buffer);
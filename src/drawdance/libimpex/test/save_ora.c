@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/binary.h>
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/file.h>
+#include <dpcommon/worker.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpimpex/save.h>
+#include <dpimpex/zip_archive.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dptest_impex.h>
+
+
+#define WIDTH       300
+#define HEIGHT      200
+#define GROUP_ID    0x101
+#define CHILD_COUNT 4
+#define LAYER_COUNT 9
+
+#define ZIP_EOCD_SIGNATURE 0x06054b50u
+#define ZIP_EOCD_SIZE      22
+#define ZIP_CDFH_SIGNATURE 0x02014b50u
+#define ZIP_CDFH_SIZE      46
+
+static void set_background(size_t size, unsigned char *out,
+                           DP_UNUSED void *user)
+{
+    // A single BGRA pixel makes for a solid background tile.
+    DP_ASSERT(size == 4);
+    out[0] = 0x99;
+    out[1] = 0x66;
+    out[2] = 0x33;
+    out[3] = 0xff;
+}
+
+static void handle_history(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                           DP_Message *msg)
+{
+    if (!DP_canvas_history_handle(ch, dc, msg)) {
+        DP_warn("Error handling message: %s", DP_error());
+    }
+    DP_message_decref(msg);
+}
+
+static uint16_t layer_id_at(int i)
+{
+    return DP_int_to_uint16(GROUP_ID + 1 + i);
+}
+
+// More layers than there are jobs in flight, so the workers have to be refilled
+// while earlier layers are being written.
+static DP_CanvasState *make_canvas(DP_DrawContext *dc)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    handle_history(ch, dc, DP_msg_canvas_resize_new(1, 0, WIDTH, HEIGHT, 0));
+    handle_history(ch, dc,
+                   DP_msg_canvas_background_new(1, set_background, 4, NULL));
+    handle_history(ch, dc,
+                   DP_msg_layer_tree_create_new(
+                       1, GROUP_ID, 0, 0, 0,
+                       DP_MSG_LAYER_TREE_CREATE_FLAGS_GROUP, "group", 5));
+    for (int i = 0; i < LAYER_COUNT; ++i) {
+        uint16_t layer_id = layer_id_at(i);
+        bool child = i < CHILD_COUNT;
+        uint8_t flags = child ? DP_MSG_LAYER_TREE_CREATE_FLAGS_INTO : 0;
+        uint16_t target = child ? GROUP_ID : 0;
+        handle_history(ch, dc,
+                       DP_msg_layer_tree_create_new(1, layer_id, 0, target, 0,
+                                                    flags, "layer", 5));
+        uint32_t offset = DP_int_to_uint32(i * 23);
+        handle_history(ch, dc,
+                       DP_msg_fill_rect_new(
+                           1, layer_id, DP_BLEND_MODE_NORMAL, offset,
+                           offset / 2, 120, 90,
+                           0xff000000u | (offset * 0x010203u)));
+    }
+    DP_CanvasState *cs = DP_canvas_history_get(ch);
+    DP_canvas_history_free(ch);
+    return cs;
+}
+
+static void save_ora(TEST_PARAMS, DP_CanvasState *cs, DP_DrawContext *dc,
+                     int thread_limit, const char *path)
+{
+    DP_worker_cpu_limit_set(thread_limit);
+    DP_SaveResult result = DP_save(cs, dc, DP_SAVE_IMAGE_ORA, path, NULL, NULL);
+    DP_worker_cpu_limit_set(0);
+    INT_EQ_OK(result, DP_SAVE_RESULT_SUCCESS, "save %s", path);
+}
+
+static void entry_eq_ok(TEST_PARAMS, DP_ZipReader *serial,
+                        DP_ZipReader *parallel, const char *name)
+{
+    DP_ZipReaderFile *a = DP_zip_reader_read_file(serial, name);
+    DP_ZipReaderFile *b = DP_zip_reader_read_file(parallel, name);
+    if (NOT_NULL_OK(a, "serial archive has %s", name)
+        && NOT_NULL_OK(b, "parallel archive has %s", name)) {
+        size_t size = DP_zip_reader_file_size(a);
+        bool same = size == DP_zip_reader_file_size(b)
+                 && memcmp(DP_zip_reader_file_content(a),
+                           DP_zip_reader_file_content(b), size)
+                        == 0;
+        OK(same, "%s is the same", name);
+    }
+    DP_zip_reader_file_free(b);
+    DP_zip_reader_file_free(a);
+}
+
+// Returns the archive's entry names in central directory order, one per line.
+static char *read_entry_names(TEST_PARAMS, const char *path)
+{
+    size_t length;
+    unsigned char *buffer = DP_file_slurp(path, &length);
+    if (!NOT_NULL_OK(buffer, "slurp %s", path)) {
+        return NULL;
+    }
+
+    // No archive comment is written, so the end record is at the very end.
+    unsigned char *eocd =
+        length < ZIP_EOCD_SIZE ? NULL : buffer + length - ZIP_EOCD_SIZE;
+    if (!OK(eocd && DP_read_littleendian_uint32(eocd) == ZIP_EOCD_SIGNATURE,
+            "%s has an end of central directory record", path)) {
+        DP_free(buffer);
+        return NULL;
+    }
+
+    size_t count = DP_read_littleendian_uint16(eocd + 10);
+    size_t offset = DP_read_littleendian_uint32(eocd + 16);
+    char *names = DP_malloc(length);
+    size_t used = 0;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned char *cdfh = buffer + offset;
+        if (!OK(offset + ZIP_CDFH_SIZE <= length
+                    && DP_read_littleendian_uint32(cdfh) == ZIP_CDFH_SIGNATURE,
+                "%s has central directory entry %zu", path, i)) {
+            break;
+        }
+        size_t name_length = DP_read_littleendian_uint16(cdfh + 28);
+        memcpy(names + used, cdfh + ZIP_CDFH_SIZE, name_length);
+        used += name_length;
+        names[used++] = '\n';
+        offset += ZIP_CDFH_SIZE + name_length
+                + DP_read_littleendian_uint16(cdfh + 30)
+                + DP_read_littleendian_uint16(cdfh + 32);
+    }
+    names[used] = '\0';
+
+    DP_free(buffer);
+    return names;
+}
+
+static void entry_order_eq_ok(TEST_PARAMS, const char *serial_path,
+                              const char *parallel_path)
+{
+    char *serial = read_entry_names(TEST_ARGS, serial_path);
+    char *parallel = read_entry_names(TEST_ARGS, parallel_path);
+    if (serial && parallel) {
+        STR_EQ_OK(parallel, serial, "entry order is the same");
+        // The ORA spec requires the mimetype to be the first entry.
+        OK(strncmp(serial, "mimetype\n", 9) == 0, "mimetype comes first");
+    }
+    DP_free(parallel);
+    DP_free(serial);
+}
+
+static void save_ora_parallel_matches_serial(TEST_PARAMS)
+{
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_CanvasState *cs = make_canvas(dc);
+    const char *serial_path = "test/tmp/save_ora_serial.ora";
+    const char *parallel_path = "test/tmp/save_ora_parallel.ora";
+    const char *parallel_again_path = "test/tmp/save_ora_parallel_again.ora";
+    save_ora(TEST_ARGS, cs, dc, 1, serial_path);
+    save_ora(TEST_ARGS, cs, dc, 4, parallel_path);
+    save_ora(TEST_ARGS, cs, dc, 4, parallel_again_path);
+
+    // Entries are written as jobs finish, which must not change their order.
+    entry_order_eq_ok(TEST_ARGS, serial_path, parallel_path);
+    entry_order_eq_ok(TEST_ARGS, parallel_path, parallel_again_path);
+
+    DP_ZipReader *serial = DP_zip_reader_new(serial_path);
+    DP_ZipReader *parallel = DP_zip_reader_new(parallel_path);
+    if (NOT_NULL_OK(serial, "read %s", serial_path)
+        && NOT_NULL_OK(parallel, "read %s", parallel_path)) {
+        entry_eq_ok(TEST_ARGS, serial, parallel, "mimetype");
+        entry_eq_ok(TEST_ARGS, serial, parallel, "stack.xml");
+        entry_eq_ok(TEST_ARGS, serial, parallel, "data/background-tile.png");
+        entry_eq_ok(TEST_ARGS, serial, parallel, "data/background.png");
+        entry_eq_ok(TEST_ARGS, serial, parallel, "mergedimage.png");
+        entry_eq_ok(TEST_ARGS, serial, parallel, "Thumbnails/thumbnail.png");
+        for (int i = 0; i < LAYER_COUNT; ++i) {
+            char *name = DP_format("data/layer-%04x.png", layer_id_at(i));
+            entry_eq_ok(TEST_ARGS, serial, parallel, name);
+            DP_free(name);
+        }
+    }
+    if (parallel) {
+        DP_zip_reader_free(parallel);
+    }
+    if (serial) {
+        DP_zip_reader_free(serial);
+    }
+
+    DP_canvas_state_decref(cs);
+    DP_draw_context_free(dc);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(save_ora_parallel_matches_serial);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -24,24 +24,265 @@
 #include <dpcommon/atomic.h>
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
+#include <dpcommon/memory_pool.h>
+#include <dpcommon/threading.h>
 
 #define FLAG_NONE            0x0
 #define FLAG_OPAQUE          0x1
 #define FLAG_COMPAT_INDIRECT 0x2
 
+#define ALLOC_HEAP  0x0
+#define ALLOC_ARENA 0xff
+
+// Messages up to SLAB_SIZE_MAX bytes come out of slabs with power of two size
+// classes, slab number n holding elements of SLAB_SIZE_MIN << (n - 1) bytes.
+// Larger messages are rare, those just get allocated on the heap.
+#define SLAB_COUNT       6
+#define SLAB_SIZE_MIN    64
+#define SLAB_SIZE_MAX    (SLAB_SIZE_MIN << (SLAB_COUNT - 1))
+#define SLAB_BUCKET_SIZE 65536
+
+// Same magazine scheme as with tiles: each thread keeps a few messages of each
+// size class around and only takes the slab lock to refill or drain in batches.
+#define MAGAZINE_CAPACITY 64
+#define MAGAZINE_BATCH    32
+
+#define ARENA_BLOCK_CAPACITY 65536
+#define ARENA_MESSAGE_MAX    4096
+
 typedef DP_Message *(*DP_MessageDeserializeFn)(unsigned int context_id,
                                                const unsigned char *buffer,
                                                size_t length);
 
+typedef struct DP_MessageArenaBlock {
+    DP_Atomic refcount;
+    size_t used;
+    alignas(DP_max_align_t) unsigned char data[];
+} DP_MessageArenaBlock;
+
+struct DP_MessageArena {
+    DP_MessageArenaBlock *block;
+};
+
 struct DP_Message {
     DP_Atomic refcount;
     uint8_t type;
     uint8_t flags;
+    uint8_t alloc; // ALLOC_HEAP, ALLOC_ARENA or a slab number.
     unsigned int context_id;
     const DP_MessageMethods *methods;
+    DP_MessageArenaBlock *block; // Only set for arena messages.
     alignas(DP_max_align_t) unsigned char internal[];
 };
 
+typedef struct DP_MessageMagazine {
+    int count;
+    void *messages[MAGAZINE_CAPACITY];
+} DP_MessageMagazine;
+
+typedef struct DP_MessageThreadCache {
+    DP_MessageArena *arena;
+    DP_MessageMagazine magazines[SLAB_COUNT];
+} DP_MessageThreadCache;
+
+static struct {
+    DP_MemoryPool pool;
+    DP_Mutex *lock;
+} message_slabs[SLAB_COUNT];
+
+static DP_ThreadLocal *message_thread_cache_key = NULL;
+
+static void free_message_thread_cache(void *value)
+{
+    DP_MessageThreadCache *mtc = value;
+    for (int i = 0; i < SLAB_COUNT; ++i) {
+        DP_MessageMagazine *mm = &mtc->magazines[i];
+        if (mm->count != 0) {
+            DP_MUTEX_MUST_LOCK(message_slabs[i].lock);
+            for (int j = 0; j < mm->count; ++j) {
+                DP_memory_pool_free_el(&message_slabs[i].pool,
+                                       mm->messages[j]);
+            }
+            DP_MUTEX_MUST_UNLOCK(message_slabs[i].lock);
+        }
+    }
+    DP_free(mtc);
+}
+
+static void init_message_slabs(void)
+{
+    DP_ATOMIC_DECLARE_STATIC_SPIN_LOCK(message_slabs_spinlock);
+    if (!message_thread_cache_key) {
+        DP_atomic_lock(&message_slabs_spinlock);
+        if (!message_thread_cache_key) {
+            for (int i = 0; i < SLAB_COUNT; ++i) {
+                size_t el_size = (size_t)SLAB_SIZE_MIN << i;
+                message_slabs[i].pool =
+                    DP_memory_pool_new(el_size, SLAB_BUCKET_SIZE / el_size);
+                message_slabs[i].lock = DP_mutex_new();
+            }
+            message_thread_cache_key =
+                DP_thread_local_new(free_message_thread_cache);
+        }
+        DP_atomic_unlock(&message_slabs_spinlock);
+    }
+}
+
+static DP_MessageThreadCache *get_message_thread_cache(void)
+{
+    init_message_slabs();
+    DP_MessageThreadCache *mtc = DP_thread_local_get(message_thread_cache_key);
+    if (!mtc) {
+        mtc = DP_malloc(sizeof(*mtc));
+        mtc->arena = NULL;
+        for (int i = 0; i < SLAB_COUNT; ++i) {
+            mtc->magazines[i].count = 0;
+        }
+        DP_thread_local_set(message_thread_cache_key, mtc);
+    }
+    return mtc;
+}
+
+static int slab_for_size(size_t size)
+{
+    if (size > SLAB_SIZE_MAX) {
+        return ALLOC_HEAP;
+    }
+    int slab = 1;
+    for (size_t slab_size = SLAB_SIZE_MIN; slab_size < size; slab_size <<= 1) {
+        ++slab;
+    }
+    return slab;
+}
+
+static void arena_block_decref(DP_MessageArenaBlock *block)
+{
+    if (DP_atomic_dec(&block->refcount)) {
+        DP_free(block);
+    }
+}
+
+static DP_Message *alloc_arena_message(DP_MessageArena *arena, size_t size)
+{
+    size_t align = alignof(DP_max_align_t);
+    size_t aligned_size = (size + align - 1) / align * align;
+    DP_MessageArenaBlock *block = arena->block;
+    if (!block || block->used + aligned_size > ARENA_BLOCK_CAPACITY) {
+        if (block) {
+            arena_block_decref(block);
+        }
+        block = DP_malloc(DP_FLEX_SIZEOF(DP_MessageArenaBlock, data,
+                                         ARENA_BLOCK_CAPACITY));
+        DP_atomic_set(&block->refcount, 1);
+        block->used = 0;
+        arena->block = block;
+    }
+
+    DP_Message *msg = (void *)(block->data + block->used);
+    block->used += aligned_size;
+    DP_atomic_inc(&block->refcount);
+    memset(msg, 0, size);
+    msg->alloc = ALLOC_ARENA;
+    msg->block = block;
+    return msg;
+}
+
+static DP_Message *alloc_slab_message(DP_MessageThreadCache *mtc, int slab,
+                                      size_t size)
+{
+    int i = slab - 1;
+    DP_MessageMagazine *mm = &mtc->magazines[i];
+    if (mm->count == 0) {
+        DP_MUTEX_MUST_LOCK(message_slabs[i].lock);
+        for (int j = 0; j < MAGAZINE_BATCH; ++j) {
+            mm->messages[j] = DP_memory_pool_alloc_el(&message_slabs[i].pool);
+        }
+        DP_MUTEX_MUST_UNLOCK(message_slabs[i].lock);
+        mm->count = MAGAZINE_BATCH;
+    }
+
+    DP_Message *msg = mm->messages[--mm->count];
+    memset(msg, 0, size);
+    msg->alloc = (uint8_t)slab;
+    return msg;
+}
+
+static DP_Message *alloc_message(size_t size)
+{
+    DP_MessageThreadCache *mtc = get_message_thread_cache();
+    DP_MessageArena *arena = mtc->arena;
+    if (arena && size <= ARENA_MESSAGE_MAX) {
+        return alloc_arena_message(arena, size);
+    }
+
+    int slab = slab_for_size(size);
+    if (slab == ALLOC_HEAP) {
+        DP_Message *msg = DP_malloc_zeroed(size);
+        msg->alloc = ALLOC_HEAP;
+        return msg;
+    }
+    else {
+        return alloc_slab_message(mtc, slab, size);
+    }
+}
+
+static void free_slab_message(int slab, DP_Message *msg)
+{
+    int i = slab - 1;
+    DP_MessageMagazine *mm = &get_message_thread_cache()->magazines[i];
+    if (mm->count == MAGAZINE_CAPACITY) {
+        DP_MUTEX_MUST_LOCK(message_slabs[i].lock);
+        for (int j = 0; j < MAGAZINE_BATCH; ++j) {
+            DP_memory_pool_free_el(&message_slabs[i].pool,
+                                   mm->messages[--mm->count]);
+        }
+        DP_MUTEX_MUST_UNLOCK(message_slabs[i].lock);
+    }
+    mm->messages[mm->count++] = msg;
+}
+
+static void free_message(DP_Message *msg)
+{
+    int alloc = msg->alloc;
+    if (alloc == ALLOC_HEAP) {
+        DP_free(msg);
+    }
+    else if (alloc == ALLOC_ARENA) {
+        arena_block_decref(msg->block);
+    }
+    else {
+        free_slab_message(alloc, msg);
+    }
+}
+
+
+DP_MessageArena *DP_message_arena_new(void)
+{
+    DP_MessageArena *arena = DP_malloc(sizeof(*arena));
+    arena->block = NULL;
+    return arena;
+}
+
+void DP_message_arena_free(DP_MessageArena *arena)
+{
+    if (arena) {
+        DP_ASSERT(get_message_thread_cache()->arena != arena);
+        if (arena->block) {
+            arena_block_decref(arena->block);
+        }
+        DP_free(arena);
+    }
+}
+
+DP_MessageArena *DP_message_arena_use(DP_MessageArena *arena_or_null)
+{
+    DP_MessageThreadCache *mtc = get_message_thread_cache();
+    DP_MessageArena *prev = mtc->arena;
+    mtc->arena = arena_or_null;
+    return prev;
+}
+
+
 DP_Message *DP_message_new(DP_MessageType type, unsigned int context_id,
                            const DP_MessageMethods *methods,
                            size_t internal_size)
@@ -56,7 +297,7 @@ DP_Message *DP_message_new(DP_MessageType type, unsigned int context_id,
     DP_ASSERT(methods->write_payload_text);
     DP_ASSERT(internal_size <= SIZE_MAX - sizeof(DP_Message));
     DP_Message *msg =
-        DP_malloc_zeroed(DP_FLEX_SIZEOF(DP_Message, internal, internal_size));
+        alloc_message(DP_FLEX_SIZEOF(DP_Message, internal, internal_size));
     DP_atomic_set(&msg->refcount, 1);
     msg->type = (uint8_t)type;
     msg->flags = FLAG_NONE;
@@ -115,7 +356,7 @@ DP_Message *DP_message_new_opaque(DP_MessageType type, unsigned int context_id,
     DP_ASSERT(type <= DP_MESSAGE_MAX);
     DP_ASSERT(context_id <= UINT8_MAX);
     DP_ASSERT(length <= SIZE_MAX - sizeof(DP_Message));
-    DP_Message *msg = DP_malloc_zeroed(DP_FLEX_SIZEOF(
+    DP_Message *msg = alloc_message(DP_FLEX_SIZEOF(
         DP_Message, internal, DP_FLEX_SIZEOF(DP_OpaqueMessage, body, length)));
     DP_atomic_set(&msg->refcount, 1);
     msg->type = (uint8_t)type;
@@ -148,7 +389,7 @@ void DP_message_decref(DP_Message *msg)
     DP_ASSERT(msg);
     DP_ASSERT(DP_atomic_get(&msg->refcount) > 0);
     if (DP_atomic_dec(&msg->refcount)) {
-        DP_free(msg);
+        free_message(msg);
     }
 }
 
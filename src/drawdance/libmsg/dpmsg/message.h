@@ -37,6 +37,14 @@ typedef struct DP_TextWriter DP_TextWriter;
 
 typedef struct DP_Message DP_Message;
 
+// Bulk allocator for messages. While an arena is in use on a thread, messages
+// created there are carved out of large blocks instead of being allocated one
+// by one. A block is freed all at once after every message in it is gone, so
+// messages may safely outlive the arena, but a single long-lived message keeps
+// its entire block alive. Meant for reading through a recording, where lots of
+// messages are created in a row and dropped again in roughly the same order.
+typedef struct DP_MessageArena DP_MessageArena;
+
 typedef unsigned char *(*DP_GetMessageBufferFn)(void *user, size_t length);
 
 
@@ -47,6 +55,17 @@ DP_Message *DP_message_new(DP_MessageType type, unsigned int context_id,
 DP_Message *DP_message_new_opaque(DP_MessageType type, unsigned int context_id,
                                   const unsigned char *body, size_t length);
 
+
+DP_MessageArena *DP_message_arena_new(void);
+
+// Must not be in use on any thread anymore.
+void DP_message_arena_free(DP_MessageArena *arena);
+
+// Sets the arena new messages on the calling thread are allocated from, NULL
+// goes back to regular allocation. Returns the previous arena for restoring.
+DP_MessageArena *DP_message_arena_use(DP_MessageArena *arena_or_null);
+
+
 DP_Message *DP_message_incref(DP_Message *msg);
 
 DP_Message *DP_message_incref_nullable(DP_Message *msg_or_null);
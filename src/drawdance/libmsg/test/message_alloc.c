@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/threading.h>
+#include <dpmsg/message.h>
+#include <dptest.h>
+
+
+#define MESSAGE_COUNT  500
+#define LENGTH_STEP    11
+#define THREAD_COUNT   4
+#define THREAD_ROUNDS  20
+#define SERIALIZE_SIZE (DP_MESSAGE_HEADER_LENGTH + MESSAGE_COUNT * LENGTH_STEP)
+
+static unsigned char body_byte(size_t length, size_t i)
+{
+    return (unsigned char)((length * 31u + i * 7u) & 0xffu);
+}
+
+static DP_Message *make_message(unsigned char *body, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        body[i] = body_byte(length, i);
+    }
+    return DP_message_new_opaque(DP_MSG_CHAT, 1, body, length);
+}
+
+static unsigned char *get_serialize_buffer(void *user, size_t length)
+{
+    return length <= SERIALIZE_SIZE ? user : NULL;
+}
+
+static bool message_intact(DP_Message *msg, size_t length)
+{
+    unsigned char buffer[SERIALIZE_SIZE];
+    size_t written =
+        DP_message_serialize(msg, true, get_serialize_buffer, buffer);
+    if (written != DP_MESSAGE_HEADER_LENGTH + length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (buffer[DP_MESSAGE_HEADER_LENGTH + i] != body_byte(length, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int count_intact(DP_Message **msgs)
+{
+    int intact = 0;
+    for (int i = 0; i < MESSAGE_COUNT; ++i) {
+        if (message_intact(msgs[i], (size_t)i * LENGTH_STEP)) {
+            ++intact;
+        }
+    }
+    return intact;
+}
+
+static void make_messages(DP_Message **msgs)
+{
+    unsigned char body[MESSAGE_COUNT * LENGTH_STEP];
+    for (int i = 0; i < MESSAGE_COUNT; ++i) {
+        msgs[i] = make_message(body, (size_t)i * LENGTH_STEP);
+    }
+}
+
+
+static void message_alloc_sizes(TEST_PARAMS)
+{
+    // Covers every slab size class and the heap fallback. Freeing every other
+    // message and then making them again forces the slabs to reuse memory.
+    DP_Message *msgs[MESSAGE_COUNT];
+    make_messages(msgs);
+    INT_EQ_OK(count_intact(msgs), MESSAGE_COUNT, "all messages intact");
+
+    unsigned char body[MESSAGE_COUNT * LENGTH_STEP];
+    for (int i = 0; i < MESSAGE_COUNT; i += 2) {
+        DP_message_decref(msgs[i]);
+    }
+    for (int i = 0; i < MESSAGE_COUNT; i += 2) {
+        msgs[i] = make_message(body, (size_t)i * LENGTH_STEP);
+    }
+    INT_EQ_OK(count_intact(msgs), MESSAGE_COUNT,
+              "all messages intact after reuse");
+
+    for (int i = 0; i < MESSAGE_COUNT; ++i) {
+        DP_message_decref(msgs[i]);
+    }
+}
+
+static void message_alloc_arena(TEST_PARAMS)
+{
+    DP_MessageArena *arena = DP_message_arena_new();
+    DP_MessageArena *prev = DP_message_arena_use(arena);
+    NULL_OK(prev, "no arena in use initially");
+
+    DP_Message *msgs[MESSAGE_COUNT];
+    make_messages(msgs);
+    INT_EQ_OK(count_intact(msgs), MESSAGE_COUNT, "arena messages intact");
+
+    // Drop the first half while the arena is still in use, which lets the
+    // earlier blocks go away, and the rest after it's gone already.
+    for (int i = 0; i < MESSAGE_COUNT / 2; ++i) {
+        DP_message_decref(msgs[i]);
+    }
+    PTR_EQ_OK(DP_message_arena_use(NULL), arena, "arena was in use");
+    DP_message_arena_free(arena);
+
+    int intact = 0;
+    for (int i = MESSAGE_COUNT / 2; i < MESSAGE_COUNT; ++i) {
+        if (message_intact(msgs[i], (size_t)i * LENGTH_STEP)) {
+            ++intact;
+        }
+        DP_message_decref(msgs[i]);
+    }
+    INT_EQ_OK(intact, MESSAGE_COUNT - MESSAGE_COUNT / 2,
+              "arena messages outlive the arena");
+}
+
+
+struct DP_MessageAllocThread {
+    DP_Message *msgs[MESSAGE_COUNT];
+    int intact;
+};
+
+static void run_alloc_thread(void *data)
+{
+    struct DP_MessageAllocThread *t = data;
+    t->intact = 0;
+    for (int round = 0; round < THREAD_ROUNDS; ++round) {
+        make_messages(t->msgs);
+        t->intact += count_intact(t->msgs);
+        if (round != THREAD_ROUNDS - 1) {
+            for (int i = 0; i < MESSAGE_COUNT; ++i) {
+                DP_message_decref(t->msgs[i]);
+            }
+        }
+    }
+}
+
+static void message_alloc_threads(TEST_PARAMS)
+{
+    // The messages from the last round get freed on the main thread, after
+    // the threads that allocated them are gone.
+    struct DP_MessageAllocThread ts[THREAD_COUNT];
+    DP_Thread *threads[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        threads[i] = DP_thread_new(run_alloc_thread, &ts[i]);
+    }
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        DP_thread_free_join(threads[i]);
+    }
+
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        INT_EQ_OK(ts[i].intact, MESSAGE_COUNT * THREAD_ROUNDS,
+                  "thread %d messages intact", i);
+        INT_EQ_OK(count_intact(ts[i].msgs), MESSAGE_COUNT,
+                  "thread %d messages intact after join", i);
+        for (int j = 0; j < MESSAGE_COUNT; ++j) {
+            DP_message_decref(ts[i].msgs[j]);
+        }
+    }
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(message_alloc_sizes);
+    REGISTER_TEST(message_alloc_arena);
+    REGISTER_TEST(message_alloc_threads);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
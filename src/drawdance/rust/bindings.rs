@@ -34,6 +34,7 @@ pub const DP_USER_CURSOR_FLAG_PEN_DOWN: u32 = 8;
 pub const DP_CANVAS_HISTORY_UNDO_DEPTH_MIN: u32 = 3;
 pub const DP_CANVAS_HISTORY_UNDO_DEPTH_MAX: u32 = 255;
 pub const DP_PREVIEW_BASE_SUBLAYER_ID: i32 = -100;
+pub const DP_RENDERER_LOD_MAX: u32 = 3;
 pub const DP_PREVIEW_TRANSFORM_COUNT: u32 = 16;
 pub const DP_PAINT_ENGINE_FILTER_MESSAGE_FLAG_NO_TIME: u32 = 1;
 pub const DP_ACL_ALL_LOCKED_BIT: u32 = 128;
@@ -1041,6 +1042,40 @@ extern "C" {
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct DP_Worker {
+    _unused: [u8; 0],
+}
+pub type DP_WorkerJobFn = ::std::option::Option<
+    unsafe extern "C" fn(
+        element: *mut ::std::os::raw::c_void,
+        thread_index: ::std::os::raw::c_int,
+    ),
+>;
+extern "C" {
+    pub fn DP_worker_cpu_count(max: ::std::os::raw::c_int) -> ::std::os::raw::c_int;
+}
+extern "C" {
+    pub fn DP_worker_cpu_limit_set(limit: ::std::os::raw::c_int);
+}
+extern "C" {
+    pub fn DP_worker_new(
+        initial_capacity: usize,
+        element_size: usize,
+        thread_count: ::std::os::raw::c_int,
+        job_fn: DP_WorkerJobFn,
+    ) -> *mut DP_Worker;
+}
+extern "C" {
+    pub fn DP_worker_free_join(worker: *mut DP_Worker);
+}
+extern "C" {
+    pub fn DP_worker_thread_count(worker: *mut DP_Worker) -> ::std::os::raw::c_int;
+}
+extern "C" {
+    pub fn DP_worker_push(worker: *mut DP_Worker, element: *mut ::std::os::raw::c_void);
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct DP_Annotation {
     _unused: [u8; 0],
 }
@@ -1522,6 +1557,14 @@ extern "C" {
         blend_mode: ::std::os::raw::c_int,
     );
 }
+extern "C" {
+    pub fn DP_blend_tile_solid(
+        dst: *mut DP_Pixel15,
+        src: DP_Pixel15,
+        opacity: u16,
+        blend_mode: ::std::os::raw::c_int,
+    );
+}
 extern "C" {
     pub fn DP_posterize_mask(
         dst: *mut DP_Pixel15,
@@ -1596,6 +1639,11 @@ pub struct DP_Message {
 }
 #[repr(C)]
 #[derive(Debug, Copy, Clone)]
+pub struct DP_MessageArena {
+    _unused: [u8; 0],
+}
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
 pub struct DP_Selection {
     _unused: [u8; 0],
 }
@@ -4836,6 +4884,103 @@ fn bindgen_test_layout_DP_ForkEntry() {
         )
     );
 }
+#[repr(C)]
+#[derive(Debug, Copy, Clone)]
+pub struct DP_CanvasHistoryColdStats {
+    pub warm_points: ::std::os::raw::c_int,
+    pub cold_points: ::std::os::raw::c_int,
+    pub cold_tiles: ::std::os::raw::c_int,
+    pub warm_bytes: usize,
+    pub cold_raw_bytes: usize,
+    pub cold_compressed_bytes: usize,
+    pub thaws: ::std::os::raw::c_uint,
+}
+#[test]
+fn bindgen_test_layout_DP_CanvasHistoryColdStats() {
+    const UNINIT: ::std::mem::MaybeUninit<DP_CanvasHistoryColdStats> =
+        ::std::mem::MaybeUninit::uninit();
+    let ptr = UNINIT.as_ptr();
+    assert_eq!(
+        ::std::mem::size_of::<DP_CanvasHistoryColdStats>(),
+        48usize,
+        concat!("Size of: ", stringify!(DP_CanvasHistoryColdStats))
+    );
+    assert_eq!(
+        ::std::mem::align_of::<DP_CanvasHistoryColdStats>(),
+        8usize,
+        concat!("Alignment of ", stringify!(DP_CanvasHistoryColdStats))
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).warm_points) as usize - ptr as usize },
+        0usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_CanvasHistoryColdStats),
+            "::",
+            stringify!(warm_points)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).cold_points) as usize - ptr as usize },
+        4usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_CanvasHistoryColdStats),
+            "::",
+            stringify!(cold_points)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).cold_tiles) as usize - ptr as usize },
+        8usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_CanvasHistoryColdStats),
+            "::",
+            stringify!(cold_tiles)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).warm_bytes) as usize - ptr as usize },
+        16usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_CanvasHistoryColdStats),
+            "::",
+            stringify!(warm_bytes)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).cold_raw_bytes) as usize - ptr as usize },
+        24usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_CanvasHistoryColdStats),
+            "::",
+            stringify!(cold_raw_bytes)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).cold_compressed_bytes) as usize - ptr as usize },
+        32usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_CanvasHistoryColdStats),
+            "::",
+            stringify!(cold_compressed_bytes)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).thaws) as usize - ptr as usize },
+        40usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_CanvasHistoryColdStats),
+            "::",
+            stringify!(thaws)
+        )
+    );
+}
 pub type DP_CanvasHistorySavePointFn = ::std::option::Option<
     unsafe extern "C" fn(
         user: *mut ::std::os::raw::c_void,
@@ -4899,6 +5044,15 @@ extern "C" {
 extern "C" {
     pub fn DP_canvas_history_want_dump_set(ch: *mut DP_CanvasHistory, want_dump: bool);
 }
+extern "C" {
+    pub fn DP_canvas_history_cold_budget(ch: *mut DP_CanvasHistory) -> usize;
+}
+extern "C" {
+    pub fn DP_canvas_history_cold_budget_set(ch: *mut DP_CanvasHistory, budget: usize);
+}
+extern "C" {
+    pub fn DP_canvas_history_cold_stats(ch: *mut DP_CanvasHistory) -> DP_CanvasHistoryColdStats;
+}
 extern "C" {
     pub fn DP_canvas_history_get(ch: *mut DP_CanvasHistory) -> *mut DP_CanvasState;
 }
@@ -6347,11 +6501,13 @@ pub type DP_RendererResizeFn = ::std::option::Option<
         prev_height: ::std::os::raw::c_int,
         offset_x: ::std::os::raw::c_int,
         offset_y: ::std::os::raw::c_int,
+        lod: ::std::os::raw::c_int,
     ),
 >;
 pub const DP_RENDERER_CONTINUOUS: DP_RendererMode = 0;
 pub const DP_RENDERER_VIEW_BOUNDS_CHANGED: DP_RendererMode = 1;
 pub const DP_RENDERER_EVERYTHING: DP_RendererMode = 2;
+pub const DP_RENDERER_CHANGES: DP_RendererMode = 3;
 pub type DP_RendererMode = ::std::os::raw::c_uint;
 extern "C" {
     pub fn DP_renderer_new(
@@ -6388,6 +6544,7 @@ extern "C" {
         checker_color2: DP_Pixel8,
         view_tile_bounds: DP_Rect,
         render_outside_view: bool,
+        lod: ::std::os::raw::c_int,
         mode: DP_RendererMode,
     );
 }
@@ -6631,6 +6788,15 @@ extern "C" {
         want_canvas_history_dump: bool,
     );
 }
+extern "C" {
+    pub fn DP_paint_engine_history_cold_budget(pe: *mut DP_PaintEngine) -> usize;
+}
+extern "C" {
+    pub fn DP_paint_engine_history_cold_budget_set(pe: *mut DP_PaintEngine, budget: usize);
+}
+extern "C" {
+    pub fn DP_paint_engine_history_cold_stats(pe: *mut DP_PaintEngine) -> DP_CanvasHistoryColdStats;
+}
 extern "C" {
     pub fn DP_paint_engine_local_state_reset_image_build(
         pe: *mut DP_PaintEngine,
@@ -6696,6 +6862,12 @@ extern "C" {
 extern "C" {
     pub fn DP_paint_engine_checker_color2_set(pe: *mut DP_PaintEngine, color2: u32);
 }
+extern "C" {
+    pub fn DP_paint_engine_render_lod(pe: *mut DP_PaintEngine) -> ::std::os::raw::c_int;
+}
+extern "C" {
+    pub fn DP_paint_engine_render_lod_set(pe: *mut DP_PaintEngine, lod: ::std::os::raw::c_int);
+}
 extern "C" {
     pub fn DP_paint_engine_local_background_tile_noinc(pe: *mut DP_PaintEngine) -> *mut DP_Tile;
 }
@@ -6766,6 +6938,9 @@ extern "C" {
 extern "C" {
     pub fn DP_paint_engine_render_everything(pe: *mut DP_PaintEngine);
 }
+extern "C" {
+    pub fn DP_paint_engine_render_changes(pe: *mut DP_PaintEngine);
+}
 extern "C" {
     pub fn DP_paint_engine_preview_cut(
         pe: *mut DP_PaintEngine,
@@ -7129,6 +7304,13 @@ extern "C" {
         image_size: usize,
     ) -> *mut DP_Tile;
 }
+extern "C" {
+    pub fn DP_tile_new_from_compressed_lossless(
+        context_id: ::std::os::raw::c_uint,
+        data: *const ::std::os::raw::c_uchar,
+        size: usize,
+    ) -> *mut DP_Tile;
+}
 extern "C" {
     pub fn DP_tile_new_zebra(
         context_id: ::std::os::raw::c_uint,
@@ -7173,7 +7355,7 @@ extern "C" {
     pub fn DP_tile_context_id(tile: *mut DP_Tile) -> ::std::os::raw::c_uint;
 }
 extern "C" {
-    pub fn DP_tile_pixels(tile: *mut DP_Tile) -> *const DP_Pixel15;
+    pub fn DP_tile_solid(tile: *mut DP_Tile) -> bool;
 }
 extern "C" {
     pub fn DP_tile_pixel_at(
@@ -7204,6 +7386,18 @@ extern "C" {
         user: *mut ::std::os::raw::c_void,
     ) -> usize;
 }
+extern "C" {
+    pub fn DP_tile_compress_lossless(
+        tile: *mut DP_Tile,
+        get_output_buffer: ::std::option::Option<
+            unsafe extern "C" fn(
+                arg1: usize,
+                arg2: *mut ::std::os::raw::c_void,
+            ) -> *mut ::std::os::raw::c_uchar,
+        >,
+        user: *mut ::std::os::raw::c_void,
+    ) -> usize;
+}
 extern "C" {
     pub fn DP_tile_copy_to_image(
         tile_or_null: *mut DP_Tile,
@@ -7292,6 +7486,9 @@ extern "C" {
 extern "C" {
     pub fn DP_transient_tile_persist(tt: *mut DP_TransientTile) -> *mut DP_Tile;
 }
+extern "C" {
+    pub fn DP_transient_tile_persist_compact(tt: *mut DP_TransientTile) -> *mut DP_Tile;
+}
 extern "C" {
     pub fn DP_transient_tile_context_id(tt: *mut DP_Tile) -> ::std::os::raw::c_uint;
 }
@@ -7734,6 +7931,16 @@ extern "C" {
         user: *mut ::std::os::raw::c_void,
     ) -> bool;
 }
+extern "C" {
+    pub fn DP_player_index_build_threads(
+        player: *mut DP_Player,
+        dc: *mut DP_DrawContext,
+        thread_count: ::std::os::raw::c_int,
+        should_snapshot_fn: DP_PlayerIndexShouldSnapshotFn,
+        progress_fn: DP_PlayerIndexProgressFn,
+        user: *mut ::std::os::raw::c_void,
+    ) -> bool;
+}
 extern "C" {
     pub fn DP_player_index_load(player: *mut DP_Player) -> bool;
 }
@@ -11666,6 +11873,15 @@ extern "C" {
         length: usize,
     ) -> *mut DP_Message;
 }
+extern "C" {
+    pub fn DP_message_arena_new() -> *mut DP_MessageArena;
+}
+extern "C" {
+    pub fn DP_message_arena_free(arena: *mut DP_MessageArena);
+}
+extern "C" {
+    pub fn DP_message_arena_use(arena_or_null: *mut DP_MessageArena) -> *mut DP_MessageArena;
+}
 extern "C" {
     pub fn DP_message_incref(msg: *mut DP_Message) -> *mut DP_Message;
 }
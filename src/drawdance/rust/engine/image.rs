@@ -18,6 +18,10 @@ pub struct Image {
     image: *mut DP_Image,
 }
 
+// The image is just a block of pixels owned by this struct, nothing else holds
+// onto it, so it's fine to hand it off to another thread.
+unsafe impl Send for Image {}
+
 impl Image {
     pub fn new(width: usize, height: usize) -> Result<Self> {
         if width > 0 && height > 0 {
@@ -6,7 +6,8 @@ use crate::{
     DP_canvas_state_decref, DP_message_type, DP_paint_engine_free_join, DP_paint_engine_handle_inc,
     DP_paint_engine_new_inc, DP_paint_engine_playback_begin, DP_paint_engine_playback_play,
     DP_paint_engine_playback_skip_by, DP_paint_engine_playback_step,
-    DP_paint_engine_render_everything, DP_paint_engine_reveal_censored_set, DP_paint_engine_tick,
+    DP_paint_engine_render_changes, DP_paint_engine_render_everything,
+    DP_paint_engine_reveal_censored_set, DP_paint_engine_tick,
     DP_paint_engine_view_canvas_state_inc, DP_save, DP_MSG_INTERVAL, DP_MSG_UNDO,
     DP_PAINT_ENGINE_FILTER_MESSAGE_FLAG_NO_TIME, DP_PLAYER_RECORDING_END, DP_PLAYER_SUCCESS,
     DP_SAVE_IMAGE_ORA, DP_SAVE_RESULT_SUCCESS, DP_TILE_SIZE,
@@ -103,6 +104,10 @@ impl PaintEngine {
         self.render_height
     }
 
+    pub fn render_pixels(&self) -> &[u32] {
+        &self.render_image
+    }
+
     pub fn set_reveal_censored(&self, reveal_censored: bool) {
         unsafe { DP_paint_engine_reveal_censored_set(self.paint_engine, reveal_censored) }
     }
@@ -146,6 +151,7 @@ impl PaintEngine {
         _prev_height: c_int,
         _offset_x: c_int,
         _offset_y: c_int,
+        _lod: c_int,
     ) {
         let pe = unsafe { user.cast::<Self>().as_mut().unwrap_unchecked() };
         let w = width as usize;
@@ -293,6 +299,20 @@ impl PaintEngine {
     extern "C" fn on_move_pointer(_user: *mut c_void, _context_id: c_uint, _x: c_int, _y: c_int) {}
 
     pub fn render(&mut self) {
+        self.tick();
+        unsafe { DP_paint_engine_render_everything(self.paint_engine) };
+        self.render_barrier.wait();
+    }
+
+    // Only renders the tiles that changed since the last render, everything
+    // else in the rendered image is carried over from before.
+    pub fn render_changes(&mut self) {
+        self.tick();
+        unsafe { DP_paint_engine_render_changes(self.paint_engine) };
+        self.render_barrier.wait();
+    }
+
+    fn tick(&mut self) {
         let user: *mut Self = self;
         let tile_bounds = DP_Rect {
             x1: 0,
@@ -319,9 +339,7 @@ impl PaintEngine {
                 Some(Self::on_censored_layer_revealed),
                 user.cast(),
             );
-            DP_paint_engine_render_everything(self.paint_engine);
         }
-        self.render_barrier.wait();
     }
 
     extern "C" fn on_catchup(_user: *mut c_void, _progress: c_int) {}
@@ -87,6 +87,8 @@ CanvasModel::CanvasModel(
 		&LayerListModel::setLayersVisibleInFrame);
 
 	settings.bindEngineFrameRate(m_paintengine, &PaintEngine::setFps);
+	settings.bindEngineHistoryColdBudget(
+		m_paintengine, &PaintEngine::setHistoryColdBudgetMiB);
 	settings.bindEngineSnapshotCount(
 		m_paintengine, &PaintEngine::setSnapshotMaxCount);
 	settings.bindEngineSnapshotInterval(this, [this](int minDelaySec) {
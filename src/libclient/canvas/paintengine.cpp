@@ -109,6 +109,12 @@ void PaintEngine::setWantCanvasHistoryDump(bool wantCanvasHistoryDump)
 	m_paintEngine.setWantCanvasHistoryDump(wantCanvasHistoryDump);
 }
 
+void PaintEngine::setHistoryColdBudgetMiB(int historyColdBudgetMiB)
+{
+	m_paintEngine.setHistoryColdBudget(
+		size_t(qMax(0, historyColdBudgetMiB)) * size_t(1024 * 1024));
+}
+
 void PaintEngine::start()
 {
 	if(m_timerId != 0) {
@@ -713,11 +719,20 @@ void PaintEngine::withPixmap(
 
 QImage PaintEngine::renderPixmap()
 {
+	// The result should be at full resolution even if the view is currently
+	// zoomed out, the level of detail is restored on the next render.
+	int renderLod = m_paintEngine.renderLod();
+	if(renderLod != 0) {
+		m_paintEngine.setRenderLod(0);
+	}
 	DP_paint_engine_render_everything(m_paintEngine.get());
 	DP_SEMAPHORE_MUST_WAIT(m_viewSem);
 	DP_mutex_lock(m_cacheMutex);
 	QImage img = m_useTileCache ? m_tileCache.toImage() : m_cache.toImage();
 	DP_mutex_unlock(m_cacheMutex);
+	if(renderLod != 0) {
+		m_paintEngine.setRenderLod(renderLod);
+	}
 	return img;
 }
 
@@ -749,6 +764,13 @@ void PaintEngine::setCanvasViewTileArea(const QRect &canvasViewTileArea)
 	}
 }
 
+void PaintEngine::setRenderLod(int lod)
+{
+	if(m_useTileCache) {
+		m_paintEngine.setRenderLod(lod);
+	}
+}
+
 void PaintEngine::setRenderOutsideView(bool renderOutsideView)
 {
 	m_renderOutsideView = renderOutsideView;
@@ -974,8 +996,11 @@ void PaintEngine::onRenderUnlock(void *user)
 
 void PaintEngine::onRenderResizePixmap(
 	void *user, int width, int height, int prevWidth, int prevHeight,
-	int offsetX, int offsetY)
+	int offsetX, int offsetY, int lod)
 {
+	// The pixmap is always rendered at full resolution.
+	Q_ASSERT(lod == 0);
+	Q_UNUSED(lod);
 	PaintEngine *pe = static_cast<PaintEngine *>(user);
 	QSize size(width, height);
 	DP_mutex_lock(pe->m_cacheMutex);
@@ -998,14 +1023,14 @@ void PaintEngine::onRenderResizePixmap(
 
 void PaintEngine::onRenderResizeTileCache(
 	void *user, int width, int height, int prevWidth, int prevHeight,
-	int offsetX, int offsetY)
+	int offsetX, int offsetY, int lod)
 {
 	Q_UNUSED(prevWidth);
 	Q_UNUSED(prevHeight);
 	PaintEngine *pe = static_cast<PaintEngine *>(user);
 	QSize size(width, height);
 	DP_mutex_lock(pe->m_cacheMutex);
-	pe->m_tileCache.resize(width, height, offsetX, offsetY);
+	pe->m_tileCache.resize(width, height, offsetX, offsetY, lod);
 	if(!pe->m_tileCacheDirtyCheckOnTick) {
 		emit pe->tileCacheDirtyCheckNeeded();
 	}
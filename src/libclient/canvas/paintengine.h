@@ -53,6 +53,7 @@ public:
 	void setSnapshotMaxCount(int snapshotMaxCount);
 	void setSnapshotMinDelayMs(long long snapshotMinDelayMs);
 	void setWantCanvasHistoryDump(bool wantCanvasHistoryDump);
+	void setHistoryColdBudgetMiB(int historyColdBudgetMiB);
 
 	/// Reset the paint engine to its default state
 	void reset(
@@ -76,6 +77,11 @@ public:
 
 	void setRenderOutsideView(bool renderOutsideView);
 
+	// Renders zoomed out views at a reduced level of detail, see
+	// DP_renderer_apply. Only possible with the tile cache, takes effect the
+	// next time the view area is set or the canvas changes.
+	void setRenderLod(int lod);
+
 	//! Get the number of frames in an animated canvas
 	int frameCount() const;
 
@@ -197,6 +203,10 @@ public:
 		return m_paintEngine.sampleCanvasState();
 	}
 
+	//! Live performance counters of the paint engine and its renderer. Cheap
+	//! enough to poll on a timer, the counters wrap around, so diff them.
+	DP_PaintEngineStats stats() const { return m_paintEngine.stats(); }
+
 	const drawdance::SnapshotQueue &snapshotQueue() const
 	{
 		return m_snapshotQueue;
@@ -331,11 +341,11 @@ private:
 
 	static void onRenderResizePixmap(
 		void *user, int width, int height, int prevWidth, int prevHeight,
-		int offsetX, int offsetY);
+		int offsetX, int offsetY, int lod);
 
 	static void onRenderResizeTileCache(
 		void *user, int width, int height, int prevWidth, int prevHeight,
-		int offsetX, int offsetY);
+		int offsetX, int offsetY, int lod);
 
 	void start();
 
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 extern "C" {
+#include <dpengine/renderer.h>
 #include <dpengine/tile.h>
 #include <dpengine/tile_iterator.h>
 }
@@ -16,7 +17,9 @@ class TileCache::BaseImpl {
 public:
 	virtual ~BaseImpl() {}
 
-	QSize size() const { return QSize(m_width, m_height); }
+	QSize size() const { return QSize(m_canvasWidth, m_canvasHeight); }
+	int lod() const { return m_lod; }
+	QSize lodSize() const { return QSize(m_width, m_height); }
 
 	void clear()
 	{
@@ -25,6 +28,9 @@ public:
 		m_needsDirtyCheck = false;
 		m_needsNavigatorDirtyCheck = false;
 		m_resized = true;
+		m_canvasWidth = 0;
+		m_canvasHeight = 0;
+		m_lod = 0;
 		m_width = 0;
 		m_height = 0;
 		m_lastWidth = 0;
@@ -38,8 +44,14 @@ public:
 		clearImpl();
 	}
 
-	void resize(int width, int height, int offsetX, int offsetY)
+	void resize(
+		int canvasWidth, int canvasHeight, int offsetX, int offsetY, int lod)
 	{
+		m_canvasWidth = canvasWidth;
+		m_canvasHeight = canvasHeight;
+		m_lod = lod;
+		int width = DP_renderer_lod_size(canvasWidth, lod);
+		int height = DP_renderer_lod_size(canvasHeight, lod);
 		DP_TileCounts tc = DP_tile_counts_round(width, height);
 		int tileTotal = tc.x * tc.y;
 		m_dirtyTiles.fill(true, tileTotal);
@@ -63,8 +75,8 @@ public:
 	bool getResizeReset(Resize &outResize)
 	{
 		if(m_resized) {
-			outResize.width = m_width;
-			outResize.height = m_height;
+			outResize.width = m_canvasWidth;
+			outResize.height = m_canvasHeight;
 			outResize.offsetX = m_offsetX;
 			outResize.offsetY = m_offsetY;
 			m_resized = false;
@@ -140,6 +152,9 @@ protected:
 	bool m_needsDirtyCheck = false;
 	bool m_needsNavigatorDirtyCheck = false;
 	bool m_resized = false;
+	int m_canvasWidth = 0;
+	int m_canvasHeight = 0;
+	int m_lod = 0;
 	int m_width = 0;
 	int m_height = 0;
 	int m_lastWidth = 0;
@@ -421,16 +436,49 @@ QSize TileCache::size() const
 	return d->size();
 }
 
+int TileCache::lod() const
+{
+	return d->lod();
+}
+
+QSize TileCache::lodSize() const
+{
+	return d->lodSize();
+}
+
+QRect TileCache::lodTileArea(const QRect &canvasTileArea) const
+{
+	int lod = d->lod();
+	if(lod == 0 || canvasTileArea.isEmpty()) {
+		return canvasTileArea;
+	} else {
+		return QRect(
+			QPoint(canvasTileArea.left() >> lod, canvasTileArea.top() >> lod),
+			QPoint(
+				canvasTileArea.right() >> lod, canvasTileArea.bottom() >> lod));
+	}
+}
+
+QRect TileCache::lodToCanvasRect(const QRect &rect) const
+{
+	int scale = 1 << d->lod();
+	return QRect(
+		rect.x() * scale, rect.y() * scale, rect.width() * scale,
+		rect.height() * scale);
+}
+
 void TileCache::clear()
 {
 	d->clear();
 }
 
-void TileCache::resize(int width, int height, int offsetX, int offsetY)
+void TileCache::resize(int width, int height, int offsetX, int offsetY, int lod)
 {
 	Q_ASSERT(width >= 0);
 	Q_ASSERT(height >= 0);
-	d->resize(width, height, offsetX, offsetY);
+	Q_ASSERT(lod >= 0);
+	Q_ASSERT(lod <= DP_RENDERER_LOD_MAX);
+	d->resize(width, height, offsetX, offsetY, lod);
 }
 
 TileCache::RenderResult
@@ -441,12 +489,35 @@ TileCache::render(int tileX, int tileY, const DP_Pixel8 *src)
 
 QImage TileCache::toImage() const
 {
-	return d->toImage();
+	QImage img = d->toImage();
+	if(d->lod() == 0) {
+		return img;
+	} else {
+		return img.scaled(
+			d->size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	}
 }
 
 QImage TileCache::toSubImage(const QRect &rect)
 {
-	return d->toSubImage(rect);
+	int lod = d->lod();
+	if(lod == 0) {
+		return d->toSubImage(rect);
+	} else {
+		// Only the downsampled pixels are available, so pick from those.
+		QRect r = rect.intersected(QRect(QPoint(0, 0), d->size()));
+		if(r.isEmpty()) {
+			return QImage();
+		} else {
+			QImage img = d->toSubImage(QRect(
+				QPoint(r.left() >> lod, r.top() >> lod),
+				QPoint(r.right() >> lod, r.bottom() >> lod)));
+			return img.isNull() ? img
+								: img.scaled(
+									  r.size(), Qt::IgnoreAspectRatio,
+									  Qt::FastTransformation);
+		}
+	}
 }
 
 bool TileCache::getResizeReset(Resize &outResize)
@@ -25,6 +25,11 @@ namespace canvas {
 // glTexSubImage2D. Tiles at the right and bottom edge may have smaller
 // dimensions, but they still allocate a full tile of space to avoid
 // complicating the indexing. For the software canvas, it's a QPixmap.
+//
+// When zoomed out, the canvas may be rendered at a reduced level of detail,
+// see DP_renderer_apply. The held image is then smaller than the canvas, tile
+// coordinates and pixel rectangles passed to render and eachDirtyTileReset are
+// in terms of that smaller image. Everything else is in canvas coordinates.
 class TileCache final {
 	// In the OpenGL canvas, pixels is a pointer to an array of DP_Pixel8 to be
 	// placed into the texture. In the software canvas, it's a null pointer and
@@ -54,9 +59,13 @@ public:
 	TileCache &operator=(TileCache &&) = delete;
 
 	QSize size() const;
+	int lod() const;
+	QSize lodSize() const;
+	QRect lodTileArea(const QRect &canvasTileArea) const;
+	QRect lodToCanvasRect(const QRect &rect) const;
 
 	void clear();
-	void resize(int width, int height, int offsetX, int offsetY);
+	void resize(int width, int height, int offsetX, int offsetY, int lod);
 
 	RenderResult render(int tileX, int tileY, const DP_Pixel8 *src);
 
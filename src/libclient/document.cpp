@@ -2,6 +2,7 @@
 extern "C" {
 #include <dpengine/snapshots.h>
 #include <dpimpex/load.h>
+#include <dpimpex/save.h>
 #include <dpmsg/reset_stream.h>
 }
 #include "libclient/canvas/canvasmodel.h"
@@ -851,7 +852,7 @@ void Document::autosaveNow()
 
 	saveCanvasState(
 		m_canvas->paintEngine()->viewCanvasState(), true, currentPath(),
-		currentType());
+		currentType(), true);
 }
 
 void Document::saveCanvasAs(
@@ -875,13 +876,17 @@ void Document::saveCanvasStateAs(
 
 void Document::saveCanvasState(
 	const drawdance::CanvasState &canvasState, bool isCurrentState,
-	const QString &path, DP_SaveImageType type)
+	const QString &path, DP_SaveImageType type, bool autosave)
 {
 	Q_ASSERT(!m_saveInProgress);
 	m_saveInProgress = true;
 
 	CanvasSaverRunnable *saver =
 		new CanvasSaverRunnable(canvasState, type, path);
+	// Autosaves happen in the middle of drawing, so they should be quick.
+	if(autosave && m_settings.autoSaveFastCompression()) {
+		saver->setCompressionLevel(DP_SAVE_COMPRESSION_LEVEL_FAST);
+	}
 	if(isCurrentState) {
 		unmarkDirty();
 	}
@@ -329,7 +329,7 @@ private slots:
 private:
 	void saveCanvasState(
 		const drawdance::CanvasState &canvasState, bool isCurrentState,
-		const QString &path, DP_SaveImageType type);
+		const QString &path, DP_SaveImageType type, bool autosave = false);
 	QImage selectionToImage();
 	void setCurrentPath(const QString &path, DP_SaveImageType type);
 	void setSessionPersistent(bool p);
@@ -66,6 +66,8 @@ net::MessageList PaintEngine::reset(
 		DP_paint_engine_want_canvas_history_dump(m_data);
 	QColor checkerColor1(DP_paint_engine_checker_color1(m_data));
 	QColor checkerColor2(DP_paint_engine_checker_color2(m_data));
+	int renderLod = DP_paint_engine_render_lod(m_data);
+	size_t historyColdBudget = DP_paint_engine_history_cold_budget(m_data);
 	DP_paint_engine_free_join(m_data);
 	acls.reset(localUserId);
 	m_data = DP_paint_engine_new_inc(
@@ -77,6 +79,8 @@ net::MessageList PaintEngine::reset(
 		getDumpDir().toUtf8().constData(), &PaintEngine::getTimeMs, nullptr,
 		player, playbackFn, dumpPlaybackFn, playbackUser, streamResetStartFn,
 		streamResetUser);
+	DP_paint_engine_render_lod_set(m_data, renderLod);
+	DP_paint_engine_history_cold_budget_set(m_data, historyColdBudget);
 	return localResetImage;
 }
 
@@ -96,6 +100,26 @@ void PaintEngine::setWantCanvasHistoryDump(bool wantCanvasHistoryDump)
 	DP_paint_engine_want_canvas_history_dump_set(m_data, wantCanvasHistoryDump);
 }
 
+size_t PaintEngine::historyColdBudget() const
+{
+	return DP_paint_engine_history_cold_budget(m_data);
+}
+
+void PaintEngine::setHistoryColdBudget(size_t historyColdBudget)
+{
+	DP_paint_engine_history_cold_budget_set(m_data, historyColdBudget);
+}
+
+DP_CanvasHistoryColdStats PaintEngine::historyColdStats() const
+{
+	return DP_paint_engine_history_cold_stats(m_data);
+}
+
+DP_PaintEngineStats PaintEngine::stats() const
+{
+	return DP_paint_engine_stats(m_data);
+}
+
 QSet<int> PaintEngine::getLayersVisibleInFrame()
 {
 	QSet<int> layersVisibleInFrame;
@@ -154,6 +178,16 @@ bool PaintEngine::checkersVisible() const
 	return DP_paint_engine_checkers_visible(m_data);
 }
 
+int PaintEngine::renderLod() const
+{
+	return DP_paint_engine_render_lod(m_data);
+}
+
+void PaintEngine::setRenderLod(int lod)
+{
+	DP_paint_engine_render_lod_set(m_data, lod);
+}
+
 Tile PaintEngine::localBackgroundTile() const
 {
 	return Tile::inc(DP_paint_engine_local_background_tile_noinc(m_data));
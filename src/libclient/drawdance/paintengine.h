@@ -70,6 +70,12 @@ public:
 
 	void setWantCanvasHistoryDump(bool wantCanvasHistoryDump);
 
+	size_t historyColdBudget() const;
+	void setHistoryColdBudget(size_t historyColdBudget);
+	DP_CanvasHistoryColdStats historyColdStats() const;
+
+	DP_PaintEngineStats stats() const;
+
 	QSet<int> getLayersVisibleInFrame();
 
 	int activeLayerId() const;
@@ -88,6 +94,9 @@ public:
 	void setCheckerColor2(const QColor &color2);
 	bool checkersVisible() const;
 
+	int renderLod() const;
+	void setRenderLod(int lod);
+
 	Tile localBackgroundTile() const;
 
 	static RecordStartResult makeRecorderParameters(
@@ -23,6 +23,7 @@ CanvasSaverRunnable::CanvasSaverRunnable(
 	, m_type(type)
 	, m_path(path)
 	, m_tempDir(tempDir)
+	, m_compressionLevel(DP_SAVE_COMPRESSION_LEVEL_DEFAULT)
 {
 }
 
@@ -48,8 +49,9 @@ void CanvasSaverRunnable::run()
 
 	const char *path = pathBytes.constData();
 	drawdance::DrawContext dc = drawdance::DrawContextPool::acquire();
-	DP_SaveResult result = DP_save(
-		m_canvasState.get(), dc.get(), m_type, path, bakeAnnotation, this);
+	DP_SaveResult result = DP_save_with_compression_level(
+		m_canvasState.get(), dc.get(), m_type, path, m_compressionLevel,
+		bakeAnnotation, this);
 
 #ifdef Q_OS_ANDROID
 	QFile tempFile(tempPath);
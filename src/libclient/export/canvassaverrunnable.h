@@ -25,6 +25,14 @@ public:
 
 	~CanvasSaverRunnable() override;
 
+	/**
+	 * @brief Set the PNG compression level, from 0 to 9 or -1 for the default
+	 */
+	void setCompressionLevel(int compressionLevel)
+	{
+		m_compressionLevel = compressionLevel;
+	}
+
 	void run() override;
 
 	static QString saveResultToErrorString(DP_SaveResult result);
@@ -48,6 +56,7 @@ private:
 	DP_SaveImageType m_type;
 	QString m_path;
 	QTemporaryDir *m_tempDir;
+	int m_compressionLevel;
 };
 
 #endif
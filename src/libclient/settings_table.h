@@ -11,6 +11,7 @@
 #   endif
 #endif
 
+SETTING(autoSaveFastCompression     , AutoSaveFastCompression     , "settings/autosavefastcompression"      , true)
 SETTING(autoSaveIntervalMinutes     , AutoSaveIntervalMinutes     , "settings/autosaveminutes"              , 5)
 SETTING(checkerColor1               , CheckerColor1               , "settings/checkercolor1"                , CHECKER_COLOR1_DEFAULT)
 SETTING(checkerColor2               , CheckerColor2               , "settings/checkercolor2"                , CHECKER_COLOR2_DEFAULT)
@@ -24,6 +25,7 @@ SETTING(parentalControlsLevel       , ParentalControlsLevel       , "pc/level"
 SETTING(parentalControlsLocked      , ParentalControlsLocked      , "pc/locked"                             , QByteArray())
 SETTING(parentalControlsTags        , ParentalControlsTags        , "pc/tagwords"                           , parentalcontrols::defaultWordList())
 SETTING(engineFrameRate             , EngineFrameRate             , "settings/paintengine/fps"              , 60)
+SETTING(engineHistoryColdBudget     , EngineHistoryColdBudget     , "settings/paintengine/historycoldbudget", 0)
 SETTING(engineSnapshotCount         , EngineSnapshotCount         , "settings/paintengine/snapshotcount"    , SNAPSHOT_COUNT_DEFAULT)
 SETTING(engineSnapshotInterval      , EngineSnapshotInterval      , "settings/paintengine/snapshotinterval" , 10)
 SETTING(engineUndoDepth             , EngineUndoDepth             , "settings/paintengine/undodepthlimit"   , DP_UNDO_DEPTH_DEFAULT)
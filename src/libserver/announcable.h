@@ -3,6 +3,8 @@
 #ifndef ANNOUNCABLE_H
 #define ANNOUNCABLE_H
 
+#include <QMetaType>
+
 class QString;
 
 namespace sessionlisting {
@@ -34,4 +36,6 @@ public:
 
 }
 
+Q_DECLARE_METATYPE(const sessionlisting::Announcable *)
+
 #endif // ANNOUNCABLE_H
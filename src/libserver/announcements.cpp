@@ -6,6 +6,8 @@
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
 
+#include <QMutexLocker>
+#include <QThread>
 #include <QTimerEvent>
 
 namespace sessionlisting {
@@ -22,32 +24,49 @@ void Announcements::announceSession(Announcable *session, const QUrl &listServer
 {
 	Q_ASSERT(session);
 
+	if(thread() != QThread::currentThread()) {
+		QMetaObject::invokeMethod(this, [this, session, listServer]() {
+			announceSession(session, listServer);
+		}, Qt::QueuedConnection);
+		return;
+	}
+
 	if(!listServer.isValid() || !m_config->isAllowedAnnouncementUrl(listServer)) {
 		server::Log()
 			.about(server::Log::Level::Warn, server::Log::Topic::PubList)
 			.message("Announcement API URL not allowed: " + listServer.toString())
 			.to(m_config->logger());
-		session->sendListserverMessage(
-			QStringLiteral("Listing on %1 is not allowed on this server")
-				.arg(listServer.host()));
+		withSession(session, [&]() {
+			session->sendListserverMessage(
+				QStringLiteral("Listing on %1 is not allowed on this server")
+					.arg(listServer.host()));
+		});
 		return;
 	}
 
-	auto description = session->getSessionAnnouncement();
+	bool found = false;
+	Session description;
+	withSession(session, [&]() {
+		description = session->getSessionAnnouncement();
+		found = true;
+	});
 
-	// Don't announce twice at the same server
-	if(findListing(listServer, session))
+	// Don't announce sessions that have ended or twice at the same server
+	if(!found || findListing(listServer, session))
 		return;
 
 	// Make announcement
-	m_announcements << Listing {
-		listServer,
-		session,
-		Announcement {},
-		QElapsedTimer(),
-		false,
-		{},
-	};
+	{
+		QMutexLocker locker(&m_mutex);
+		m_announcements << Listing {
+			listServer,
+			session,
+			Announcement {},
+			QElapsedTimer(),
+			false,
+			{},
+		};
+	}
 
 	server::Log()
 		.about(server::Log::Level::Info, server::Log::Topic::PubList)
@@ -72,11 +91,13 @@ void Announcements::announceSession(Announcable *session, const QUrl &listServer
 				.message(listServer.toString() + ": announcement failed: " + error)
 				.to(m_config->logger());
 
-			unlistSession(listing->session, listing->listServer, false);
+			unlistSession(session, listServer, false);
 
-			listing->session->sendListserverMessage(
-				QStringLiteral("Listing on %1 failed: %2")
-					.arg(listServer.host(), error));
+			withSession(session, [&]() {
+				session->sendListserverMessage(
+					QStringLiteral("Listing on %1 failed: %2")
+						.arg(listServer.host(), error));
+			});
 			return;
 		}
 
@@ -94,13 +115,18 @@ void Announcements::announceSession(Announcable *session, const QUrl &listServer
 				QStringLiteral("This session is now listed at %1: %2")
 					.arg(listServer.host(), message);
 		}
-		listing->session->sendListserverMessage(successMessage);
+		{
+			QMutexLocker locker(&m_mutex);
+			listing->announcement = result.value<sessionlisting::Announcement>();
+			Q_ASSERT(listing->announcement.apiUrl == listing->listServer);
+			listing->finishedListing = true;
+			listing->description = description;
+			listing->refreshTimer.start();
+		}
 
-		listing->announcement = result.value<sessionlisting::Announcement>();
-		Q_ASSERT(listing->announcement.apiUrl == listing->listServer);
-		listing->finishedListing = true;
-		listing->description = description;
-		listing->refreshTimer.start();
+		withSession(session, [&]() {
+			session->sendListserverMessage(successMessage);
+		});
 
 		emit announcementsChanged(listing->session);
 
@@ -113,6 +139,14 @@ void Announcements::announceSession(Announcable *session, const QUrl &listServer
 
 void Announcements::unlistSession(Announcable *session, const QUrl &listServer, bool delist)
 {
+	if(thread() != QThread::currentThread()) {
+		QMetaObject::invokeMethod(this, [this, session, listServer, delist]() {
+			unlistSession(session, listServer, delist);
+		}, Qt::QueuedConnection);
+		return;
+	}
+
+	QMutexLocker locker(&m_mutex);
 	QMutableVectorIterator<Listing> i(m_announcements);
 	QSet<Announcable*> changes;
 
@@ -139,6 +173,7 @@ void Announcements::unlistSession(Announcable *session, const QUrl &listServer,
 			i.remove();
 		}
 	}
+	locker.unlock();
 
 	for(const auto *changedSession : changes)
 		emit announcementsChanged(changedSession);
@@ -177,10 +212,17 @@ void Announcements::refreshListings()
 
 	// Gather a list of announcements that need refreshing
 	for(Listing &listing : m_announcements) {
-		bool shouldRefresh = listing.finishedListing && (
-			listing.refreshTimer.hasExpired(listing.announcement.refreshInterval * 60 * 1000) ||
-			listing.session->hasUrgentAnnouncementChange(listing.description) ||
-			refreshServer == listing.listServer);
+		bool shouldRefresh = false;
+		if(listing.finishedListing) {
+			shouldRefresh =
+				listing.refreshTimer.hasExpired(listing.announcement.refreshInterval * 60 * 1000) ||
+				refreshServer == listing.listServer;
+			if(!shouldRefresh) {
+				withSession(listing.session, [&]() {
+					shouldRefresh = listing.session->hasUrgentAnnouncementChange(listing.description);
+				});
+			}
+		}
 
 		if(shouldRefresh) {
 			Q_ASSERT(listing.announcement.apiUrl == listing.listServer);
@@ -199,7 +241,10 @@ void Announcements::refreshListings()
 				continue;
 			}
 
-			Session description = listing.session->getSessionAnnouncement();
+			Session description;
+			withSession(listing.session, [&]() {
+				description = listing.session->getSessionAnnouncement();
+			});
 
 			updates << QPair<Announcement, Session> {
 				listing.announcement,
@@ -289,6 +334,7 @@ void Announcements::refreshListings()
 
 QVector<Announcement> Announcements::getAnnouncements(const Announcable *session) const
 {
+	QMutexLocker locker(&m_mutex);
 	QVector<Announcement> list;
 	for(const auto &listing : m_announcements) {
 		if(listing.finishedListing && listing.session == session)
@@ -297,4 +343,13 @@ QVector<Announcement> Announcements::getAnnouncements(const Announcable *session
 	return list;
 }
 
+void Announcements::withSession(Announcable *session, const std::function<void()> &fn)
+{
+	if(m_sessionRunner) {
+		m_sessionRunner(session, fn);
+	} else {
+		fn();
+	}
+}
+
 }
@@ -8,6 +8,8 @@
 #include <QObject>
 #include <QVector>
 #include <QElapsedTimer>
+#include <QMutex>
+#include <functional>
 
 namespace server {
 	class ServerConfig;
@@ -19,13 +21,29 @@ class Announcable;
 
 /**
  * @brief All session announcements made from this server
+ *
+ * Sessions may be running in different threads than this object. Announcing
+ * and unlisting is forwarded to this object's thread and getting the list of
+ * announcements is guarded by a mutex, so those can be called from anywhere.
+ * Calls back into sessions go through the session runner.
  */
 class Announcements final : public QObject
 {
 	Q_OBJECT
 public:
+	using SessionRunner = std::function<void(Announcable *, const std::function<void()> &)>;
+
 	explicit Announcements(server::ServerConfig *config, QObject *parent = nullptr);
 
+	/**
+	 * @brief Set the function used to call into sessions
+	 *
+	 * The runner must call the given function in the session's thread and
+	 * wait for it to finish, or not call it at all if the session is gone.
+	 * By default, the function is called directly.
+	 */
+	void setSessionRunner(const SessionRunner &runner) { m_sessionRunner = runner; }
+
 	/**
 	 * @brief announceSession
 	 * @param session
@@ -77,7 +95,13 @@ private:
 
 	void refreshListings();
 
+	void withSession(Announcable *session, const std::function<void()> &fn);
+
+	// Only modified in this object's thread, which therefore only needs to
+	// lock the mutex when writing.
 	QVector<Listing> m_announcements;
+	mutable QMutex m_mutex;
+	SessionRunner m_sessionRunner;
 	server::ServerConfig *m_config;
 
 	int m_timerId;
@@ -251,6 +251,11 @@ QJsonObject Client::description(bool includeSession) const
 	u["muted"] = isMuted();
 	u["mod"] = isModerator();
 	u["tls"] = isSecure();
+	const net::MessageQueue::WriteStats &writeStats =
+		d->msgqueue->writeStats();
+	u["writes"] = writeStats.writes;
+	u["messagesPerWrite"] = writeStats.messagesPerWrite();
+	u["bytesPerWrite"] = writeStats.bytesPerWrite();
 	if(includeSession && d->session) {
 		u["session"] = d->session->id();
 	}
@@ -644,6 +649,11 @@ void Client::setKeepAliveTimeout(int timeout)
 	d->msgqueue->setKeepAliveTimeout(timeout);
 }
 
+void Client::setWriteBatchSize(int writeBatchSize)
+{
+	d->msgqueue->setWriteBatchSize(writeBatchSize);
+}
+
 qint64 Client::lastActive() const
 {
 	return d->lastActive;
@@ -666,6 +676,13 @@ void Client::sendDirectMessage(const net::Message &msg)
 	}
 }
 
+void Client::sendDirectMessage(const net::EncodedMessage &msg)
+{
+	if(!isAwaitingReset() || msg.message().isControl()) {
+		d->msgqueue->sendEncoded(msg);
+	}
+}
+
 void Client::sendDirectMessages(const net::MessageList &msgs)
 {
 	if(isAwaitingReset()) {
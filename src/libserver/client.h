@@ -2,6 +2,7 @@
 #ifndef DP_SERVER_CLIENT_H
 #define DP_SERVER_CLIENT_H
 #include "libserver/jsonapi.h"
+#include "libshared/net/encodedmessage.h"
 #include "libshared/net/message.h"
 #include <QAbstractSocket>
 #include <QObject>
@@ -171,6 +172,7 @@ public:
 	 */
 	void setConnectionTimeout(int timeout);
 	void setKeepAliveTimeout(int timeout);
+	void setWriteBatchSize(int writeBatchSize);
 
 	/**
 	 * Get the timestamp of this client's last activity (i.e. non-keepalive
@@ -214,6 +216,7 @@ public:
 	 * @param msg
 	 */
 	void sendDirectMessage(const net::Message &msg);
+	void sendDirectMessage(const net::EncodedMessage &msg);
 	void sendDirectMessages(const net::MessageList &msgs);
 
 	/**
@@ -23,6 +23,22 @@ namespace server {
 // A block is closed when its size goes above this limit
 static const qint64 MAX_BLOCK_SIZE = 0xffff * 10;
 
+// Byte offset of the message with the given index in a buffer of framed
+// messages, or -1 if the buffer doesn't have that many whole messages.
+static int framedMessageOffset(const QByteArray &data, long long index)
+{
+	int pos = 0;
+	for(long long i = 0; i < index; ++i) {
+		int len = net::framedMessageLength(
+			data.constData() + pos, data.size() - pos);
+		if(len == 0) {
+			return -1;
+		}
+		pos += len;
+	}
+	return pos;
+}
+
 FiledHistory::FiledHistory(
 	const QDir &dir, QFile *journal, const QString &id, const QString &alias,
 	const protocol::ProtocolVersion &version, const QString &founder,
@@ -728,6 +744,69 @@ FiledHistory::getBatch(long long after) const
 		b.messages.mid(idxOffset), b.startIndex + b.count - 1LL);
 }
 
+bool FiledHistory::getFramedBatch(
+	long long after, QByteArray &outData, int &outCount,
+	long long &outLastIndex) const
+{
+	if(!m_recording || !m_recording->isOpen()) {
+		return false;
+	}
+
+	// The last block is still being written to. Its messages are the ones
+	// that were just broadcast, so those go through the message cache.
+	Block &b = m_blockCache.findBlock(after);
+	if(&b == &m_blockCache.lastBlock()) {
+		return false;
+	}
+
+	long long idxOffset = qMax(0LL, after - b.startIndex + 1LL);
+	if(idxOffset >= b.count) {
+		return false;
+	}
+
+	if(b.framed.isEmpty()) {
+		// Map the block instead of seeking around in the file the writer is
+		// using. The bytes are copied out once and then shared by every
+		// client catching up through this block, since their upload queues
+		// may hold onto them for longer than the mapping lives.
+		qint64 size = b.endOffset - b.startOffset;
+		if(!m_recording->flush()) {
+			qWarning(
+				"Error flushing recording %s: %s",
+				qUtf8Printable(m_recording->fileName()),
+				qUtf8Printable(m_recording->errorString()));
+			return false;
+		}
+
+		uchar *data = m_recording->map(b.startOffset, size);
+		if(!data) {
+			qWarning(
+				"Error mapping recording %s: %s",
+				qUtf8Printable(m_recording->fileName()),
+				qUtf8Printable(m_recording->errorString()));
+			return false;
+		}
+		QByteArray framed(
+			reinterpret_cast<const char *>(data), compat::sizetype(size));
+		m_recording->unmap(data);
+
+		if(framedMessageOffset(framed, b.count) != framed.size()) {
+			qWarning(
+				"Recording %s has unexpected messages at %lld",
+				qUtf8Printable(m_recording->fileName()),
+				static_cast<long long>(b.startOffset));
+			return false;
+		}
+		b.framed = framed;
+	}
+
+	int pos = framedMessageOffset(b.framed, idxOffset);
+	outData = pos == 0 ? b.framed : b.framed.mid(pos);
+	outCount = int(b.count - idxOffset);
+	outLastIndex = b.startIndex + b.count - 1LL;
+	return true;
+}
+
 void FiledHistory::historyAdd(const net::Message &msg)
 {
 	size_t len = DP_binary_writer_write_message(m_writer, msg.get());
@@ -1078,11 +1157,12 @@ void FiledHistory::BlockCache::cleanup(long long before)
 	for(Block &b : m_blocks) {
 		if(b.startIndex + b.count >= before) {
 			break;
-		} else if(!b.messages.isEmpty()) {
+		} else if(!b.messages.isEmpty() || !b.framed.isEmpty()) {
 			qDebug(
 				"Releasing history block cache from %lld to %lld", b.startIndex,
 				b.startIndex + b.count - 1LL);
 			b.messages = net::MessageList();
+			b.framed = QByteArray();
 		}
 	}
 }
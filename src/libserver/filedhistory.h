@@ -85,6 +85,9 @@ public:
 	void cleanupBatches(long long before) override;
 	std::tuple<net::MessageList, long long>
 	getBatch(long long after) const override;
+	bool getFramedBatch(
+		long long after, QByteArray &outData, int &outCount,
+		long long &outLastIndex) const override;
 
 	void addAnnouncement(const QString &) override;
 	void removeAnnouncement(const QString &url) override;
@@ -125,6 +128,7 @@ private:
 		long long count;
 		qint64 endOffset;
 		net::MessageList messages;
+		QByteArray framed;
 
 		Block(qint64 offset, long long index)
 			: startOffset(offset)
@@ -2,6 +2,7 @@
 
 #include "libserver/inmemoryconfig.h"
 #include "libserver/serverlog.h"
+#include <QMutexLocker>
 
 namespace server {
 
@@ -17,6 +18,7 @@ InMemoryConfig::~InMemoryConfig()
 
 QString InMemoryConfig::getConfigValue(const ConfigKey key, bool &found) const
 {
+	QMutexLocker locker(&m_mutex);
 	if(m_config.count(key.index)==0) {
 		found = false;
 		return QString();
@@ -28,6 +30,7 @@ QString InMemoryConfig::getConfigValue(const ConfigKey key, bool &found) const
 
 void InMemoryConfig::setConfigValue(ConfigKey key, const QString &value)
 {
+	QMutexLocker locker(&m_mutex);
 	m_config[key.index] = value;
 }
 
@@ -4,6 +4,7 @@
 #define INMEMORYCONFIG_H
 
 #include "libserver/serverconfig.h"
+#include <QMutex>
 
 namespace server {
 
@@ -23,6 +24,7 @@ protected:
 	void setConfigValue(const ConfigKey key, const QString &value) override;
 
 private:
+	mutable QMutex m_mutex;
 	QHash<int, QString> m_config;
 	ServerLog *m_logger;
 };
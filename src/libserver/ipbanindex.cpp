@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "libserver/ipbanindex.h"
+#include <QHostAddress>
+#include <QtAlgorithms>
+
+namespace server {
+
+IpBanIndex::IpBanIndex()
+{
+	clear();
+}
+
+void IpBanIndex::clear()
+{
+	m_nodes.clear();
+	m_freeNodes.clear();
+	m_prefixes.clear();
+	// The root node is the empty prefix and is always present.
+	makeNode(Key{0, 0}, 0);
+}
+
+void IpBanIndex::insertSubnet(int value, const QHostAddress &ip, int subnet)
+{
+	if(subnet < 0) {
+		return;
+	}
+
+	int length;
+	switch(ip.protocol()) {
+	case QAbstractSocket::IPv4Protocol:
+		length = BITS - 32 + (subnet == 0 || subnet > 32 ? 32 : subnet);
+		break;
+	case QAbstractSocket::IPv6Protocol:
+		length = subnet == 0 || subnet > BITS ? BITS : subnet;
+		break;
+	default:
+		return;
+	}
+	insertPrefix(value, maskKey(toKey(ip), length), length);
+}
+
+void IpBanIndex::insertRange(
+	int value, const QHostAddress &from, const QHostAddress &to)
+{
+	if(from.isNull() || to.isNull()) {
+		return;
+	}
+
+	Key start = toKey(from);
+	Key end = toKey(to);
+	if(keyLess(end, start)) {
+		return;
+	}
+
+	while(true) {
+		// Largest block aligned at the start that doesn't overshoot the end.
+		int length;
+		if(start.lo != 0) {
+			length = BITS - int(qCountTrailingZeroBits(start.lo));
+		} else if(start.hi != 0) {
+			length = 64 - int(qCountTrailingZeroBits(start.hi));
+		} else {
+			length = 0;
+		}
+		Key last = fillKey(start, length);
+		while(keyLess(end, last)) {
+			++length;
+			last = fillKey(start, length);
+		}
+
+		insertPrefix(value, start, length);
+		if(keyEqual(last, end)) {
+			break;
+		}
+
+		start = last;
+		if(++start.lo == 0) {
+			++start.hi;
+		}
+	}
+}
+
+void IpBanIndex::remove(int value)
+{
+	const QVector<Prefix> prefixes = m_prefixes.take(value);
+	for(const Prefix &prefix : prefixes) {
+		removePrefix(value, prefix);
+	}
+}
+
+QVector<int> IpBanIndex::lookup(const QHostAddress &addr) const
+{
+	QVector<int> values;
+	if(!addr.isNull() && !m_prefixes.isEmpty()) {
+		Key key = toKey(addr);
+		int index = 0;
+		while(index != -1) {
+			const Node &node = m_nodes[index];
+			if(commonLength(key, node.key, node.length) < node.length) {
+				break;
+			}
+			values.append(node.values);
+			if(node.length == BITS) {
+				break;
+			}
+			index = node.children[bitAt(key, node.length)];
+		}
+	}
+	return values;
+}
+
+IpBanIndex::Key IpBanIndex::toKey(const QHostAddress &addr)
+{
+	// IPv4 addresses come out as IPv4-mapped IPv6 addresses.
+	Q_IPV6ADDR ip6 = addr.toIPv6Address();
+	Key key = {0, 0};
+	for(int i = 0; i < 8; ++i) {
+		key.hi = (key.hi << 8) | quint64(ip6.c[i]);
+		key.lo = (key.lo << 8) | quint64(ip6.c[i + 8]);
+	}
+	return key;
+}
+
+int IpBanIndex::bitAt(const Key &key, int index)
+{
+	Q_ASSERT(index >= 0 && index < BITS);
+	return index < 64 ? int((key.hi >> (63 - index)) & 1)
+					  : int((key.lo >> (127 - index)) & 1);
+}
+
+int IpBanIndex::commonLength(const Key &a, const Key &b, int maxLength)
+{
+	quint64 hi = a.hi ^ b.hi;
+	int length;
+	if(hi != 0) {
+		length = int(qCountLeadingZeroBits(hi));
+	} else {
+		quint64 lo = a.lo ^ b.lo;
+		length = lo == 0 ? BITS : 64 + int(qCountLeadingZeroBits(lo));
+	}
+	return qMin(length, maxLength);
+}
+
+IpBanIndex::Key IpBanIndex::maskKey(const Key &key, int length)
+{
+	if(length <= 0) {
+		return {0, 0};
+	} else if(length < 64) {
+		return {key.hi & ~(~quint64(0) >> length), 0};
+	} else if(length == 64) {
+		return {key.hi, 0};
+	} else if(length < BITS) {
+		return {key.hi, key.lo & ~(~quint64(0) >> (length - 64))};
+	} else {
+		return key;
+	}
+}
+
+IpBanIndex::Key IpBanIndex::fillKey(const Key &key, int length)
+{
+	if(length <= 0) {
+		return {~quint64(0), ~quint64(0)};
+	} else if(length < 64) {
+		return {key.hi | (~quint64(0) >> length), ~quint64(0)};
+	} else if(length == 64) {
+		return {key.hi, ~quint64(0)};
+	} else if(length < BITS) {
+		return {key.hi, key.lo | (~quint64(0) >> (length - 64))};
+	} else {
+		return key;
+	}
+}
+
+bool IpBanIndex::keyLess(const Key &a, const Key &b)
+{
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+bool IpBanIndex::keyEqual(const Key &a, const Key &b)
+{
+	return a.hi == b.hi && a.lo == b.lo;
+}
+
+void IpBanIndex::insertPrefix(int value, const Key &key, int length)
+{
+	int index = 0;
+	while(true) {
+		if(m_nodes[index].length == length) {
+			QVector<int> &values = m_nodes[index].values;
+			if(!values.contains(value)) {
+				values.append(value);
+				m_prefixes[value].append({key, length});
+			}
+			return;
+		}
+
+		int bit = bitAt(key, m_nodes[index].length);
+		int child = m_nodes[index].children[bit];
+		if(child == -1) {
+			int leaf = makeNode(key, length);
+			m_nodes[leaf].values.append(value);
+			m_nodes[index].children[bit] = leaf;
+			break;
+		}
+
+		const Node &childNode = m_nodes[child];
+		int childLength = childNode.length;
+		int common =
+			commonLength(key, childNode.key, qMin(length, childLength));
+		if(common == childLength) {
+			index = child;
+			continue;
+		}
+
+		Key childKey = childNode.key;
+		if(common == length) {
+			// The new prefix sits between this node and the child.
+			int middle = makeNode(key, length);
+			m_nodes[middle].values.append(value);
+			m_nodes[middle].children[bitAt(childKey, length)] = child;
+			m_nodes[index].children[bit] = middle;
+		} else {
+			// The new prefix and the child diverge, add a branch node.
+			int branch = makeNode(maskKey(key, common), common);
+			int leaf = makeNode(key, length);
+			m_nodes[leaf].values.append(value);
+			m_nodes[branch].children[bitAt(childKey, common)] = child;
+			m_nodes[branch].children[bitAt(key, common)] = leaf;
+			m_nodes[index].children[bit] = branch;
+		}
+		break;
+	}
+	m_prefixes[value].append({key, length});
+}
+
+void IpBanIndex::removePrefix(int value, const Prefix &prefix)
+{
+	QVector<int> path;
+	int index = 0;
+	while(m_nodes[index].length < prefix.length) {
+		path.append(index);
+		index = m_nodes[index].children[bitAt(
+			prefix.key, m_nodes[index].length)];
+		if(index == -1 ||
+		   commonLength(prefix.key, m_nodes[index].key, prefix.length) <
+			   m_nodes[index].length) {
+			return;
+		}
+	}
+
+	if(m_nodes[index].length != prefix.length) {
+		return;
+	}
+	m_nodes[index].values.removeAll(value);
+
+	// Splice out nodes that no longer carry any values and don't branch,
+	// keeping the trie compressed. The root node always stays.
+	while(index != 0 && m_nodes[index].values.isEmpty()) {
+		const int *children = m_nodes[index].children;
+		if(children[0] != -1 && children[1] != -1) {
+			break;
+		}
+		int replacement = children[0] == -1 ? children[1] : children[0];
+		int parent = path.takeLast();
+		int *parentChildren = m_nodes[parent].children;
+		parentChildren[parentChildren[0] == index ? 0 : 1] = replacement;
+		freeNode(index);
+		if(replacement != -1) {
+			break;
+		}
+		index = parent;
+	}
+}
+
+int IpBanIndex::makeNode(const Key &key, int length)
+{
+	Node node = {key, length, {-1, -1}, {}};
+	if(m_freeNodes.isEmpty()) {
+		m_nodes.append(node);
+		return m_nodes.size() - 1;
+	} else {
+		int index = m_freeNodes.takeLast();
+		m_nodes[index] = node;
+		return index;
+	}
+}
+
+void IpBanIndex::freeNode(int index)
+{
+	m_nodes[index].values.clear();
+	m_freeNodes.append(index);
+}
+
+}
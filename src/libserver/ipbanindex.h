@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DP_SERVER_IPBANINDEX_H
+#define DP_SERVER_IPBANINDEX_H
+#include <QHash>
+#include <QVector>
+
+class QHostAddress;
+
+namespace server {
+
+/**
+ * @brief Index of banned address prefixes
+ *
+ * A compressed binary radix trie over 128 bit addresses. IPv4 addresses are
+ * stored as IPv4-mapped IPv6 addresses, the same way that
+ * ServerConfig::matchesBannedAddress and ServerConfig::isAddressInRange
+ * compare them, so a single trie covers both protocols.
+ *
+ * Each entry is identified by an integer value, like a database row id or an
+ * index into a ban list, and may cover any number of prefixes. Looking up an
+ * address walks at most one node per address bit, regardless of how many
+ * entries there are.
+ */
+class IpBanIndex final {
+public:
+	IpBanIndex();
+
+	bool isEmpty() const { return m_prefixes.isEmpty(); }
+	int count() const { return m_prefixes.size(); }
+	bool contains(int value) const { return m_prefixes.contains(value); }
+
+	void clear();
+
+	/**
+	 * @brief Add a subnet to the entry with the given value
+	 *
+	 * Same semantics as ServerConfig::matchesBannedAddress: a subnet of 0 is
+	 * a single address and IPv4 subnets are relative to the IPv4 part.
+	 */
+	void insertSubnet(int value, const QHostAddress &ip, int subnet);
+
+	/**
+	 * @brief Add an inclusive address range to the entry with the given value
+	 *
+	 * Same semantics as ServerConfig::isAddressInRange. The range is split
+	 * into the smallest set of prefixes that covers it exactly.
+	 */
+	void insertRange(
+		int value, const QHostAddress &from, const QHostAddress &to);
+
+	//! Remove all prefixes of the entry with the given value
+	void remove(int value);
+
+	/**
+	 * @brief Find all entries with a prefix that contains the given address
+	 *
+	 * The result is in no particular order and may contain the same value
+	 * more than once if its prefixes overlap.
+	 */
+	QVector<int> lookup(const QHostAddress &addr) const;
+
+private:
+	struct Key {
+		quint64 hi;
+		quint64 lo;
+	};
+
+	struct Prefix {
+		Key key;
+		int length;
+	};
+
+	struct Node {
+		Key key;
+		int length;
+		int children[2];
+		QVector<int> values;
+	};
+
+	static constexpr int BITS = 128;
+
+	static Key toKey(const QHostAddress &addr);
+	static int bitAt(const Key &key, int index);
+	static int commonLength(const Key &a, const Key &b, int maxLength);
+	static Key maskKey(const Key &key, int length);
+	static Key fillKey(const Key &key, int length);
+	static bool keyLess(const Key &a, const Key &b);
+	static bool keyEqual(const Key &a, const Key &b);
+
+	void insertPrefix(int value, const Key &key, int length);
+	void removePrefix(int value, const Prefix &prefix);
+	int makeNode(const Key &key, int length);
+	void freeNode(int index);
+
+	QVector<Node> m_nodes;
+	QVector<int> m_freeNodes;
+	QHash<int, QVector<Prefix>> m_prefixes;
+};
+
+}
+
+#endif
@@ -10,17 +10,42 @@
 #include "libshared/net/servercmd.h"
 #include "libshared/util/authtoken.h"
 #include "libshared/util/networkaccess.h"
+#include "libshared/util/passwordhash.h"
 #include "libshared/util/validators.h"
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QRegularExpression>
 #include <QStringList>
+#include <QThread>
 #include <utility>
 
 namespace server {
 
 Sessions::~Sessions() {}
 
+void Sessions::runOnSession(
+	Session *session, const std::function<void(Session *)> &fn)
+{
+	fn(session);
+}
+
+void Sessions::joinSession(Session *session, Client *client, bool host)
+{
+	session->joinUser(client, host);
+}
+
+void Sessions::checkPassword(
+	const QHostAddress &address, const QString &password,
+	const QByteArray &hash, QObject *context,
+	const std::function<void(PasswordCheckResult)> &callback)
+{
+	Q_UNUSED(address);
+	Q_UNUSED(context);
+	callback(
+		passwordhash::check(password, hash) ? PasswordCheckResult::Ok
+											: PasswordCheckResult::Bad);
+}
+
 class LoginHandler::ClientInfoLogGuard {
 public:
 	ClientInfoLogGuard(LoginHandler *loginHandler, const QJsonObject &info)
@@ -29,7 +54,12 @@ public:
 	{
 	}
 
-	~ClientInfoLogGuard() { m_loginHandler->logClientInfo(m_info); }
+	~ClientInfoLogGuard()
+	{
+		if(m_loginHandler) {
+			m_loginHandler->logClientInfo(m_info);
+		}
+	}
 
 private:
 	LoginHandler *m_loginHandler;
@@ -189,6 +219,16 @@ void LoginHandler::handleLoginMessage(const net::Message &msg)
 	if(m_state == State::Ignore) {
 		// Either the client is supposed to get disconnected or we're
 		// intentionally leaving them hanging because they're banned.
+	} else if(m_state == State::WaitForPasswordCheck) {
+		// The client is supposed to wait for the reply to its ident or join.
+		m_client->log(
+			Log()
+				.about(Log::Level::Error, Log::Topic::RuleBreak)
+				.message(
+					"Invalid login command (while checking password): " +
+					cmd.cmd));
+		m_client->disconnectClient(
+			Client::DisconnectionReason::Error, "invalid message", cmd.cmd);
 	} else if(m_state == State::WaitForSecure) {
 		// Secure mode: wait for STARTTLS before doing anything
 		if(cmd.cmd == "startTls") {
@@ -292,7 +332,15 @@ void LoginHandler::handleLookupMessage(const net::ServerCommand &cmd)
 		} else {
 			Session *session =
 				m_sessions->getSessionById(sessionIdOrAlias, false);
-			if(!session) {
+			QString id;
+			QJsonObject description;
+			if(session) {
+				m_sessions->runOnSession(session, [&](Session *s) {
+					id = s->id();
+					description = s->getDescription();
+				});
+			}
+			if(id.isEmpty()) {
 				sendError(
 					"lookupFailed",
 					QStringLiteral(
@@ -300,9 +348,9 @@ void LoginHandler::handleLookupMessage(const net::ServerCommand &cmd)
 						"invite link has changed"));
 				return;
 			}
-			m_lookup = session->id();
+			m_lookup = id;
 			msg = net::ServerReply::makeResultJoinLookup(
-				QStringLiteral("Join lookup OK!"), session->getDescription());
+				QStringLiteral("Join lookup OK!"), description);
 		}
 
 	} else {
@@ -341,8 +389,7 @@ void LoginHandler::handleIdentMessage(const net::ServerCommand &cmd)
 		return;
 	}
 
-	const RegisteredUser userAccount =
-		m_config->getUserAccount(username, password);
+	const RegisteredUser userAccount = m_config->lookupUserAccount(username);
 	if(userAccount.status != RegisteredUser::NotFound) {
 		if(cmd.kwargs.contains("extauth")) {
 			// This should never happen. If it does, it means there's a bug in
@@ -356,6 +403,30 @@ void LoginHandler::handleIdentMessage(const net::ServerCommand &cmd)
 		}
 	}
 
+	if(userAccount.status == RegisteredUser::Ok) {
+		checkPassword(
+			password, userAccount.passwordHash,
+			[this, cmd, username, password, intent, userAccount](bool ok) {
+				if(ok) {
+					finishIdent(cmd, username, password, intent, userAccount);
+				} else {
+					finishIdent(
+						cmd, username, password, intent,
+						RegisteredUser{
+							RegisteredUser::BadPass, username, QStringList(),
+							QString(), QByteArray()});
+				}
+			});
+	} else {
+		finishIdent(cmd, username, password, intent, userAccount);
+	}
+}
+
+void LoginHandler::finishIdent(
+	const net::ServerCommand &cmd, const QString &username,
+	const QString &password, IdentIntent intent,
+	const RegisteredUser &userAccount)
+{
 	if(cmd.kwargs.contains("avatar") &&
 	   m_config->getConfigBool(config::AllowCustomAvatars)) {
 		// TODO validate
@@ -887,17 +958,25 @@ void LoginHandler::handleHostMessage(const net::ServerCommand &cmd)
 	checkClientCapabilities(cmd);
 
 	m_complete = true;
-	session->joinUser(m_client, true);
+	m_sessions->joinSession(session, m_client, true);
 
 	deleteLater();
 }
 
 void LoginHandler::handleJoinMessage(const net::ServerCommand &cmd)
+{
+	handleJoin(cmd, nullptr);
+}
+
+void LoginHandler::handleJoin(
+	const net::ServerCommand &cmd, const QByteArray *verifiedPasswordHash)
 {
 	Q_ASSERT(!m_client->username().isEmpty());
 
-	// Logs client info on destruction.
-	ClientInfoLogGuard clientInfoLogGuard(this, extractClientInfo(cmd));
+	// Logs client info on destruction. If this is the continuation after the
+	// session password was checked, it was already logged the first time.
+	ClientInfoLogGuard clientInfoLogGuard(
+		verifiedPasswordHash ? nullptr : this, extractClientInfo(cmd));
 
 	if(cmd.args.size() != 1) {
 		sendError("syntax", "Expected session ID");
@@ -918,83 +997,146 @@ void LoginHandler::handleJoinMessage(const net::ServerCommand &cmd)
 		return;
 	}
 
-	if(!m_lookup.isEmpty() && session->id() != m_lookup) {
+	// The session may be running in a different thread, so everything that
+	// needs to look at it happens over there. Replies are sent from here.
+	QString realSessionId;
+	bool allowWeb = false;
+	protocol::ProtocolVersion protocolVersion;
+	m_sessions->runOnSession(session, [&](Session *s) {
+		realSessionId = s->id();
+		allowWeb = s->history()->hasFlag(SessionHistory::AllowWeb);
+		protocolVersion = s->history()->protocolVersion();
+	});
+
+	if(realSessionId.isEmpty()) {
+		sendError("notFound", "Session not found!");
+		return;
+	}
+
+	if(!m_lookup.isEmpty() && realSessionId != m_lookup) {
 		sendError(
 			QStringLiteral("lookupMismatch"),
 			QStringLiteral("Cannot look up one session and then join another"));
 		return;
 	}
 
-	if(m_client->isWebSocket() &&
-	   !session->history()->hasFlag(SessionHistory::AllowWeb)) {
+	if(m_client->isWebSocket() && !allowWeb) {
 		sendError(
 			QStringLiteral("noWebJoin"),
 			QStringLiteral("This session does not allow joining from the web"));
 		return;
 	}
 
-	if(!verifySystemId(cmd, session->history()->protocolVersion())) {
+	if(!verifySystemId(cmd, protocolVersion)) {
 		return;
 	}
 
-	if(!m_client->isModerator()) {
-		// Non-moderators have to obey access restrictions
-		int banId = session->history()->banlist().isBanned(
-			m_client->username(), m_client->peerAddress(), m_client->authId(),
-			m_client->sid());
-		if(banId != 0) {
-			session->log(
-				Log()
-					.about(Log::Level::Info, Log::Topic::Ban)
-					.user(
-						m_client->id(), m_client->peerAddress(),
-						m_client->username())
-					.message(
-						QStringLiteral("Join prevented by ban %1").arg(banId)));
-			sendError(
-				"banned", QStringLiteral(
-							  "You have been banned from this session (ban %1)")
-							  .arg(banId));
-			return;
-		}
-		if(session->isClosed()) {
-			sendError("closed", "This session is closed");
-			return;
-		}
-		if(session->history()->hasFlag(SessionHistory::AuthOnly) &&
-		   !m_client->isAuthenticated()) {
-			sendError("authOnly", "This session does not allow guest logins");
-			return;
+	bool found = false;
+	int banId = 0;
+	bool closed = false;
+	bool authOnly = false;
+	bool needPasswordCheck = false;
+	QByteArray passwordHash;
+	int existingClientId = 0;
+	bool existingClientAuthMatches = false;
+	QString password = cmd.kwargs.value("password").toString();
+	m_sessions->runOnSession(session, [&](Session *s) {
+		found = true;
+		if(!m_client->isModerator()) {
+			// Non-moderators have to obey access restrictions
+			banId = s->history()->banlist().isBanned(
+				m_client->username(), m_client->peerAddress(),
+				m_client->authId(), m_client->sid());
+			if(banId != 0) {
+				s->log(Log()
+						   .about(Log::Level::Info, Log::Topic::Ban)
+						   .user(
+							   m_client->id(), m_client->peerAddress(),
+							   m_client->username())
+						   .message(QStringLiteral("Join prevented by ban %1")
+										.arg(banId)));
+				return;
+			}
+			closed = s->isClosed();
+			authOnly = s->history()->hasFlag(SessionHistory::AuthOnly) &&
+					   !m_client->isAuthenticated();
+			if(closed || authOnly) {
+				return;
+			}
+			// Checking the password is slow, so that happens outside of
+			// the session and then this is run again with the result.
+			passwordHash = s->history()->passwordHash();
+			bool passwordOk =
+				(passwordHash.isEmpty() && password.isEmpty()) ||
+				(verifiedPasswordHash &&
+				 *verifiedPasswordHash == passwordHash);
+			if(!passwordOk) {
+				needPasswordCheck = true;
+				return;
+			}
 		}
 
-		if(!session->history()->checkPassword(
-			   cmd.kwargs.value("password").toString())) {
-			++m_sessionPasswordAttempts;
-			m_client->log(
-				Log()
-					.about(Log::Level::Warn, Log::Topic::RuleBreak)
-					.message(
-						QStringLiteral(
-							"Incorrect password for session %1 (attempt %2/%3)")
-							.arg(session->id())
-							.arg(m_sessionPasswordAttempts)
-							.arg(MAX_PASSWORD_ATTEMPTS)));
-			sendError(
-				"badPassword", "Incorrect password",
-				m_sessionPasswordAttempts >= MAX_PASSWORD_ATTEMPTS);
-			return;
+		Client *existingClient = s->getClientByUsername(m_client->username());
+		if(existingClient) {
+			existingClientId = existingClient->id();
+			existingClientAuthMatches =
+				m_client->isAuthenticated() &&
+				existingClient->isAuthenticated() &&
+				m_client->authId() == existingClient->authId();
 		}
+	});
+
+	if(!found) {
+		sendError("notFound", "Session not found!");
+		return;
 	}
 
-	Client *existingClient = session->getClientByUsername(m_client->username());
-	if(existingClient) {
-		bool shouldReplace = m_client->isAuthenticated() &&
-							 existingClient->isAuthenticated() &&
-							 m_client->authId() == existingClient->authId();
-		if(!shouldReplace) {
-			sendError("nameInuse", "This username is already in use");
-			return;
-		}
+	if(banId != 0) {
+		sendError(
+			"banned",
+			QStringLiteral("You have been banned from this session (ban %1)")
+				.arg(banId));
+		return;
+	}
+
+	if(closed) {
+		sendError("closed", "This session is closed");
+		return;
+	}
+
+	if(authOnly) {
+		sendError("authOnly", "This session does not allow guest logins");
+		return;
+	}
+
+	if(needPasswordCheck) {
+		checkPassword(
+			password, passwordHash,
+			[this, cmd, realSessionId, passwordHash](bool ok) {
+				if(ok) {
+					handleJoin(cmd, &passwordHash);
+					return;
+				}
+				++m_sessionPasswordAttempts;
+				m_client->log(
+					Log()
+						.about(Log::Level::Warn, Log::Topic::RuleBreak)
+						.message(
+							QStringLiteral("Incorrect password for session %1 "
+										   "(attempt %2/%3)")
+								.arg(realSessionId)
+								.arg(m_sessionPasswordAttempts)
+								.arg(MAX_PASSWORD_ATTEMPTS)));
+				sendError(
+					"badPassword", "Incorrect password",
+					m_sessionPasswordAttempts >= MAX_PASSWORD_ATTEMPTS);
+			});
+		return;
+	}
+
+	if(existingClientId != 0 && !existingClientAuthMatches) {
+		sendError("nameInuse", "This username is already in use");
+		return;
 	}
 
 	if(m_client->triggerBan(false)) {
@@ -1002,23 +1144,36 @@ void LoginHandler::handleJoinMessage(const net::ServerCommand &cmd)
 		return;
 	}
 
-	if(existingClient) {
-		m_client->setId(existingClient->id());
-	} else {
-		session->assignId(m_client);
+	found = false;
+	QString aliasOrId;
+	QJsonArray flags;
+	m_sessions->runOnSession(session, [&](Session *s) {
+		found = true;
+		aliasOrId = s->aliasOrId();
+		if(existingClientId != 0) {
+			m_client->setId(existingClientId);
+		} else {
+			s->assignId(m_client);
+		}
+		flags = sessionFlags(s);
+	});
+
+	if(!found) {
+		sendError("notFound", "Session not found!");
+		return;
 	}
 
 	send(net::ServerReply::makeResultJoinHost(
 		QStringLiteral("Joining a session!"), QStringLiteral("join"),
-		{{QStringLiteral("id"), session->aliasOrId()},
+		{{QStringLiteral("id"), aliasOrId},
 		 {QStringLiteral("user"), m_client->id()},
-		 {QStringLiteral("flags"), sessionFlags(session)},
+		 {QStringLiteral("flags"), flags},
 		 {QStringLiteral("authId"), m_client->authId()}}));
 
 	checkClientCapabilities(cmd);
 
 	m_complete = true;
-	session->joinUser(m_client, false);
+	m_sessions->joinSession(session, m_client, false);
 
 	deleteLater();
 }
@@ -1063,6 +1218,23 @@ QJsonObject LoginHandler::extractClientInfo(const net::ServerCommand &cmd)
 
 void LoginHandler::logClientInfo(const QJsonObject &info)
 {
+	// If the client has been handed over to a session running in a different
+	// thread, the entry has to be logged over there after it has joined.
+	if(m_client->thread() != QThread::currentThread()) {
+		Client *client = m_client;
+		QMetaObject::invokeMethod(
+			client,
+			[client, info]() {
+				client->log(
+					Log()
+						.about(Log::Level::Info, Log::Topic::ClientInfo)
+						.message(QJsonDocument(info).toJson(
+							QJsonDocument::Compact)));
+			},
+			Qt::QueuedConnection);
+		return;
+	}
+
 	bool infoChanged = m_lastClientInfo.isEmpty() || info != m_lastClientInfo;
 	if(infoChanged) {
 		m_lastClientInfo = info;
@@ -1090,7 +1262,10 @@ void LoginHandler::handleAbuseReport(const net::ServerCommand &cmd)
 		Session *s =
 			m_sessions->getSessionById(cmd.kwargs["session"].toString(), false);
 		if(s) {
-			s->sendAbuseReport(m_client, 0, cmd.kwargs["reason"].toString());
+			QString reason = cmd.kwargs["reason"].toString();
+			m_sessions->runOnSession(s, [&](Session *session) {
+				session->sendAbuseReport(m_client, 0, reason);
+			});
 		}
 	}
 }
@@ -1188,6 +1363,48 @@ bool LoginHandler::checkIdentIntent(
 	}
 }
 
+void LoginHandler::checkPassword(
+	const QString &password, const QByteArray &hash,
+	const std::function<void(bool)> &fn)
+{
+	// Without a password or without a hash, there's nothing slow to check.
+	// The result is the same as what passwordhash::check would say.
+	if(password.isEmpty() || hash.isEmpty()) {
+		fn(password.isEmpty() && hash.isEmpty());
+		return;
+	}
+
+	State prevState = m_state;
+	m_state = State::WaitForPasswordCheck;
+	m_sessions->checkPassword(
+		m_client->peerAddress(), password, hash, this,
+		[this, prevState, fn](PasswordCheckResult result) {
+			if(m_state == State::WaitForPasswordCheck) {
+				m_state = prevState;
+			}
+			switch(result) {
+			case PasswordCheckResult::Ok:
+				fn(true);
+				break;
+			case PasswordCheckResult::Bad:
+				fn(false);
+				break;
+			case PasswordCheckResult::Busy:
+				m_client->log(
+					Log()
+						.about(Log::Level::Warn, Log::Topic::RuleBreak)
+						.message(QStringLiteral(
+							"Too many password checks in progress from this "
+							"address")));
+				sendError(
+					QStringLiteral("passwordCheckBusy"),
+					QStringLiteral("Too many login attempts in progress, try "
+								   "again later."));
+				break;
+			}
+		});
+}
+
 bool LoginHandler::verifySystemId(
 	const net::ServerCommand &cmd, const protocol::ProtocolVersion &protover)
 {
@@ -6,6 +6,7 @@
 #include <QJsonObject>
 #include <QObject>
 #include <QStringList>
+#include <functional>
 
 namespace protocol {
 class ProtocolVersion;
@@ -22,6 +23,7 @@ class Client;
 class Session;
 class Sessions;
 class ServerConfig;
+struct RegisteredUser;
 
 /**
  * @brief Perform the client login handshake
@@ -89,6 +91,7 @@ private:
 		WaitForLookup,
 		WaitForIdent,
 		WaitForLogin,
+		WaitForPasswordCheck,
 		Ignore,
 	};
 	enum class IdentIntent { Invalid, Unknown, Guest, Auth, ExtAuth };
@@ -101,6 +104,8 @@ private:
 	void handleIdentMessage(const net::ServerCommand &cmd);
 	void handleHostMessage(const net::ServerCommand &cmd);
 	void handleJoinMessage(const net::ServerCommand &cmd);
+	void handleJoin(
+		const net::ServerCommand &cmd, const QByteArray *verifiedPasswordHash);
 	void checkClientCapabilities(const net::ServerCommand &cmd);
 	QJsonObject extractClientInfo(const net::ServerCommand &cmd);
 	void logClientInfo(const QJsonObject &info);
@@ -125,6 +130,22 @@ private:
 	bool checkIdentIntent(
 		IdentIntent intent, IdentIntent actual, bool extAuthFallback = false);
 
+	void finishIdent(
+		const net::ServerCommand &cmd, const QString &username,
+		const QString &password, IdentIntent intent,
+		const RegisteredUser &userAccount);
+
+	/**
+	 * @brief Check a password against its hash in the background
+	 *
+	 * Login messages aren't processed while the check is running. The function
+	 * is called with the result, unless the check was refused because this
+	 * address has too many of them running, then the client gets an error.
+	 */
+	void checkPassword(
+		const QString &password, const QByteArray &hash,
+		const std::function<void(bool)> &fn);
+
 	bool verifySystemId(
 		const net::ServerCommand &cmd,
 		const protocol::ProtocolVersion &protver);
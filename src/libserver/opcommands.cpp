@@ -5,7 +5,6 @@
 #include "libserver/serverlog.h"
 #include "libserver/session.h"
 #include "libshared/net/servercmd.h"
-#include "libshared/util/passwordhash.h"
 #include <QJsonArray>
 #include <QList>
 #include <QRegularExpression>
@@ -190,13 +189,37 @@ opWord(Client *client, const QJsonArray &args, const QJsonObject &kwargs)
 	if(opwordHash.isEmpty())
 		return CmdResult::err("No opword set");
 
-	if(passwordhash::check(args.at(0).toString(), opwordHash)) {
-		client->session()->changeOpStatus(client->id(), true, "password");
-		return CmdResult::ok();
-
-	} else {
-		return CmdResult::err("Incorrect password");
-	}
+	// Checking the hash is slow, so it goes through the same background checker
+	// and per-address limit as passwords at login. The reply comes later.
+	client->session()->checkPassword(
+		client, args.at(0).toString(), opwordHash,
+		[client](PasswordCheckResult result) {
+			QString error;
+			switch(result) {
+			case PasswordCheckResult::Ok:
+				if(Session *session = client->session()) {
+					session->changeOpStatus(client->id(), true, "password");
+				}
+				return;
+			case PasswordCheckResult::Bad:
+				error = QStringLiteral("Incorrect password");
+				break;
+			case PasswordCheckResult::Busy:
+				client->log(
+					Log()
+						.about(Log::Level::Warn, Log::Topic::RuleBreak)
+						.message(QStringLiteral(
+							"Too many password checks in progress from this "
+							"address")));
+				error = QStringLiteral(
+					"Too many password checks in progress, try again later");
+				break;
+			}
+			client->sendDirectMessage(
+				net::ServerReply::makeCommandError(
+					QStringLiteral("gain-op"), error));
+		});
+	return CmdResult::ok();
 }
 
 static CmdResult
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libserver/passwordchecker.h"
+#include "libshared/util/passwordhash.h"
+#include <QMetaObject>
+#include <QRunnable>
+#include <QThread>
+
+namespace server {
+
+class PasswordChecker::Job final : public QRunnable {
+public:
+	Job(PasswordChecker *checker, quint64 id, const QString &password,
+		const QByteArray &hash)
+		: m_checker(checker)
+		, m_id(id)
+		, m_password(password)
+		, m_hash(hash)
+	{
+	}
+
+	void run() override
+	{
+		bool ok = passwordhash::check(m_password, m_hash);
+		// The checker waits for all jobs before it goes away, so it's still
+		// alive here. If it's being destroyed, the queued call is dropped.
+		PasswordChecker *checker = m_checker;
+		quint64 id = m_id;
+		QMetaObject::invokeMethod(
+			checker, [checker, id, ok]() { checker->finish(id, ok); },
+			Qt::QueuedConnection);
+	}
+
+private:
+	PasswordChecker *m_checker;
+	quint64 m_id;
+	QString m_password;
+	QByteArray m_hash;
+};
+
+PasswordChecker::PasswordChecker(
+	int maxThreads, int maxPerAddress, QObject *parent)
+	: QObject(parent)
+	, m_maxPerAddress(qMax(1, maxPerAddress))
+{
+	m_pool.setMaxThreadCount(
+		qBound(1, maxThreads, qMax(1, QThread::idealThreadCount())));
+}
+
+PasswordChecker::~PasswordChecker()
+{
+	m_pool.clear();
+	m_pool.waitForDone();
+}
+
+void PasswordChecker::check(
+	const QHostAddress &address, const QString &password,
+	const QByteArray &hash, QObject *context,
+	const std::function<void(PasswordCheckResult)> &callback)
+{
+	int &inFlight = m_inFlightByAddress[address];
+	if(inFlight >= m_maxPerAddress) {
+		callback(PasswordCheckResult::Busy);
+		return;
+	}
+	++inFlight;
+
+	quint64 id = ++m_lastId;
+	m_pending.insert(id, {address, context, callback});
+	m_pool.start(new Job(this, id, password, hash));
+}
+
+void PasswordChecker::finish(quint64 id, bool ok)
+{
+	Pending pending = m_pending.take(id);
+	QHash<QHostAddress, int>::iterator it =
+		m_inFlightByAddress.find(pending.address);
+	if(it != m_inFlightByAddress.end() && --it.value() <= 0) {
+		m_inFlightByAddress.erase(it);
+	}
+
+	if(pending.context && pending.callback) {
+		pending.callback(
+			ok ? PasswordCheckResult::Ok : PasswordCheckResult::Bad);
+	}
+}
+
+}
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DP_SRV_PASSWORDCHECKER_H
+#define DP_SRV_PASSWORDCHECKER_H
+
+#include "libserver/sessions.h"
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QThreadPool>
+#include <functional>
+
+namespace server {
+
+/**
+ * @brief Check passwords against their hashes on a pool of threads
+ *
+ * Password hashes are slow to verify on purpose, tens of milliseconds each,
+ * so doing it on the main thread stalls every other login and session running
+ * there. This runs the checks on a bounded pool instead and reports the result
+ * back on the thread the checker lives in.
+ *
+ * Each address may only have a limited number of checks in flight at once,
+ * further attempts are rejected with PasswordCheckResult::Busy, so that a
+ * single client can't occupy the pool by spamming login attempts.
+ */
+class PasswordChecker final : public QObject {
+	Q_OBJECT
+public:
+	static constexpr int DEFAULT_MAX_THREADS = 4;
+	static constexpr int DEFAULT_MAX_PER_ADDRESS = 2;
+
+	explicit PasswordChecker(
+		int maxThreads = DEFAULT_MAX_THREADS,
+		int maxPerAddress = DEFAULT_MAX_PER_ADDRESS, QObject *parent = nullptr);
+
+	~PasswordChecker() override;
+
+	/**
+	 * @brief Check a password in the background
+	 *
+	 * The callback is called on this object's thread, unless the context
+	 * object has been destroyed by then, in which case it's dropped. If the
+	 * address already has too many checks in flight, the callback is called
+	 * immediately with PasswordCheckResult::Busy.
+	 */
+	void check(
+		const QHostAddress &address, const QString &password,
+		const QByteArray &hash, QObject *context,
+		const std::function<void(PasswordCheckResult)> &callback);
+
+	int inFlight() const { return m_pending.size(); }
+
+private:
+	class Job;
+
+	struct Pending {
+		QHostAddress address;
+		QPointer<QObject> context;
+		std::function<void(PasswordCheckResult)> callback;
+	};
+
+	void finish(quint64 id, bool ok);
+
+	QThreadPool m_pool;
+	int m_maxPerAddress;
+	quint64 m_lastId = 0;
+	QHash<quint64, Pending> m_pending;
+	QHash<QHostAddress, int> m_inFlightByAddress;
+};
+
+}
+
+#endif
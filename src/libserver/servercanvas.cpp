@@ -0,0 +1,319 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpcommon/conversions.h>
+#include <dpcommon/cpu.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/snapshots.h>
+#include <dpmsg/acl.h>
+#include <dpmsg/message.h>
+}
+#include "libserver/servercanvas.h"
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+namespace server {
+
+// Most tasks a job handles before giving other canvases a turn.
+static constexpr int JOB_BATCH_SIZE = 1000;
+
+struct ServerCanvas::Worker {
+	DP_CanvasHistory *ch;
+	DP_DrawContext *dc;
+	DP_AclState *acls;
+	net::Message pinnedMessage;
+	int defaultLayerId;
+
+	Worker()
+		: ch(DP_canvas_history_new(nullptr, nullptr, false, nullptr))
+		, dc(DP_draw_context_new())
+		, acls(DP_acl_state_new())
+		, defaultLayerId(0)
+	{
+	}
+
+	~Worker()
+	{
+		DP_acl_state_free(acls);
+		DP_draw_context_free(dc);
+		DP_canvas_history_free(ch);
+	}
+
+	void reset()
+	{
+		DP_canvas_history_reset(ch);
+		DP_acl_state_reset(acls, 0);
+		pinnedMessage = net::Message();
+		defaultLayerId = 0;
+	}
+
+	void handle(const net::Message &msg)
+	{
+		// Drop what the clients' paint engines would drop.
+		DP_Message *m = msg.get();
+		if(DP_acl_state_handle(acls, m, false) & DP_ACL_STATE_FILTERED_BIT) {
+			return;
+		}
+
+		DP_MessageType type = msg.type();
+		switch(type) {
+		case DP_MSG_CHAT:
+			handleChat(msg);
+			break;
+		case DP_MSG_DEFAULT_LAYER:
+			defaultLayerId = DP_msg_default_layer_id(msg.toDefaultLayer());
+			break;
+		case DP_MSG_UNDO_DEPTH:
+			DP_canvas_history_undo_depth_limit_set(
+				ch, dc, DP_msg_undo_depth_depth(DP_msg_undo_depth_cast(m)));
+			break;
+		case DP_MSG_SOFT_RESET:
+			DP_canvas_history_soft_reset(
+				ch, dc, msg.contextId(), nullptr, nullptr);
+			break;
+		default:
+			if(msg.isInCommandRange() && !DP_canvas_history_handle(ch, dc, m)) {
+				qWarning("Server canvas: %s", DP_error());
+			}
+			break;
+		}
+	}
+
+	void handleChat(const net::Message &msg)
+	{
+		DP_MsgChat *mc = msg.toChat();
+		if(DP_msg_chat_oflags(mc) & DP_MSG_CHAT_OFLAGS_PIN) {
+			// Special value to remove a pinned message.
+			size_t len;
+			const char *text = DP_msg_chat_message(mc, &len);
+			bool unpin = len == 1 && text[0] == '-';
+			pinnedMessage = unpin ? net::Message() : msg;
+		}
+	}
+
+	// Same layout as a reset image generated by a client: the pinned message
+	// and undo depth, the canvas, then the default layer and permissions.
+	net::MessageList buildResetImage()
+	{
+		net::MessageList image;
+		if(!pinnedMessage.isNull()) {
+			image.append(pinnedMessage);
+		}
+		image.append(net::Message::noinc(DP_msg_undo_depth_new(
+			0, DP_int_to_uint8(DP_canvas_history_undo_depth_limit(ch)))));
+
+		DP_CanvasState *cs = DP_canvas_history_get(ch);
+		DP_reset_image_build(cs, 0, &pushResetImageMessage, &image);
+		DP_canvas_state_decref(cs);
+
+		if(defaultLayerId > 0) {
+			image.append(net::Message::noinc(DP_msg_default_layer_new(
+				0, DP_int_to_uint16(defaultLayerId))));
+		}
+
+		if(!DP_acl_state_reset_image_build(
+			   acls, 0, DP_ACL_STATE_RESET_IMAGE_SESSION_RESET_FLAGS,
+			   &pushAclMessage, &image)) {
+			qWarning("Server canvas ACL reset image: %s", DP_error());
+			return {};
+		}
+		return image;
+	}
+
+	static void pushResetImageMessage(void *user, DP_Message *msg)
+	{
+		static_cast<net::MessageList *>(user)->append(
+			net::Message::noinc(msg));
+	}
+
+	static bool pushAclMessage(void *user, DP_Message *msg)
+	{
+		pushResetImageMessage(user, msg);
+		return true;
+	}
+};
+
+class ServerCanvas::Job final : public QRunnable {
+public:
+	explicit Job(ServerCanvas *canvas)
+		: m_canvas(canvas)
+	{
+	}
+
+	void run() override { m_canvas->runJob(); }
+
+private:
+	ServerCanvas *m_canvas;
+};
+
+ServerCanvas::ServerCanvas(QObject *parent)
+	: QObject(parent)
+	, m_worker(new Worker)
+{
+	// The client does this at startup, the server only needs it for canvases.
+	static bool cpuSupportInitialized = [] {
+		DP_cpu_support_init();
+		return true;
+	}();
+	Q_UNUSED(cpuSupportInitialized);
+}
+
+ServerCanvas::~ServerCanvas()
+{
+	{
+		QMutexLocker locker(&m_mutex);
+		m_tasks.clear();
+		m_generation.ref();
+		while(m_running) {
+			m_idle.wait(&m_mutex);
+		}
+	}
+	delete m_worker;
+}
+
+void ServerCanvas::handleMessage(const net::Message &msg)
+{
+	pushTask({Task::Type::Message, msg, 0});
+}
+
+void ServerCanvas::handleMessages(const net::MessageList &msgs)
+{
+	QVector<Task> tasks;
+	tasks.reserve(msgs.size());
+	for(const net::Message &msg : msgs) {
+		tasks.append({Task::Type::Message, msg, 0});
+	}
+	pushTasks(tasks);
+}
+
+void ServerCanvas::reset()
+{
+	// Pending reset images would be of a canvas that doesn't exist anymore.
+	m_resetImageFns.clear();
+	QMutexLocker locker(&m_mutex);
+	m_tasks.clear();
+	m_generation.ref();
+	m_tasks.append({Task::Type::Reset, net::Message(), 0});
+	startJob();
+}
+
+void ServerCanvas::buildResetImage(const ResetImageFn &fn)
+{
+	unsigned int id = ++m_lastResetImageId;
+	m_resetImageFns.insert(id, fn);
+	pushTask({Task::Type::ResetImage, net::Message(), id});
+}
+
+int ServerCanvas::backlog()
+{
+	QMutexLocker locker(&m_mutex);
+	return m_tasks.size();
+}
+
+void ServerCanvas::notifyWhenDrained()
+{
+	QMutexLocker locker(&m_mutex);
+	m_notifyWhenDrained = true;
+	startJob();
+}
+
+void ServerCanvas::pushTask(const Task &task)
+{
+	QMutexLocker locker(&m_mutex);
+	m_tasks.append(task);
+	startJob();
+}
+
+void ServerCanvas::pushTasks(const QVector<Task> &tasks)
+{
+	if(!tasks.isEmpty()) {
+		QMutexLocker locker(&m_mutex);
+		m_tasks.append(tasks);
+		startJob();
+	}
+}
+
+void ServerCanvas::startJob()
+{
+	// Must be called with the mutex locked.
+	if(!m_running) {
+		m_running = true;
+		QThreadPool::globalInstance()->start(new Job(this));
+	}
+}
+
+void ServerCanvas::runJob()
+{
+	QVector<Task> tasks;
+	int generation;
+	{
+		QMutexLocker locker(&m_mutex);
+		if(m_tasks.size() <= JOB_BATCH_SIZE) {
+			tasks.swap(m_tasks);
+		} else {
+			tasks = m_tasks.mid(0, JOB_BATCH_SIZE);
+			m_tasks.remove(0, JOB_BATCH_SIZE);
+		}
+		generation = m_generation.loadAcquire();
+	}
+
+	for(const Task &task : tasks) {
+		if(m_generation.loadAcquire() != generation) {
+			break;
+		}
+		switch(task.type) {
+		case Task::Type::Message:
+			m_worker->handle(task.msg);
+			break;
+		case Task::Type::Reset:
+			m_worker->reset();
+			break;
+		case Task::Type::ResetImage: {
+			net::MessageList image = m_worker->buildResetImage();
+			unsigned int id = task.resetImageId;
+			QMetaObject::invokeMethod(
+				this,
+				[this, id, image]() {
+					finishResetImage(id, image);
+				},
+				Qt::QueuedConnection);
+			break;
+		}
+		}
+	}
+	tasks.clear();
+
+	QMutexLocker locker(&m_mutex);
+	if(m_notifyWhenDrained && m_tasks.size() <= MAX_BACKLOG / 2) {
+		m_notifyWhenDrained = false;
+		QMetaObject::invokeMethod(
+			this,
+			[this]() {
+				emit backlogDrained();
+			},
+			Qt::QueuedConnection);
+	}
+
+	// Go to the back of the queue if there's more to do, rather than hogging
+	// the thread while other canvases are waiting.
+	if(m_tasks.isEmpty()) {
+		m_running = false;
+		m_idle.wakeAll();
+	} else {
+		QThreadPool::globalInstance()->start(new Job(this));
+	}
+}
+
+void ServerCanvas::finishResetImage(
+	unsigned int id, const net::MessageList &image)
+{
+	ResetImageFn fn = m_resetImageFns.take(id);
+	if(fn) {
+		fn(image);
+	}
+}
+
+}
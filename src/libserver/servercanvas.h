@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DP_SERVER_SERVERCANVAS_H
+#define DP_SERVER_SERVERCANVAS_H
+#include "libshared/net/message.h"
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+#include <QWaitCondition>
+#include <functional>
+
+namespace server {
+
+/**
+ * @brief A headless canvas that follows a session's history
+ *
+ * The session hands every message it adds to its history to this canvas,
+ * which applies them to a drawdance canvas history in the background, in the
+ * same order. Like on a client, messages are filtered through an ACL state
+ * first, so the result matches what everyone else is seeing.
+ *
+ * This lets the server build a reset image on its own, rather than having to
+ * ask an operator's client for one. The image is of the canvas as of the last
+ * message handed in before the request, messages that come in later don't
+ * affect it.
+ *
+ * Work is done on the global thread pool, with at most one job per canvas
+ * running at a time. A job handles a bounded batch of tasks and then goes to
+ * the back of the pool's queue, so one busy canvas can't starve the others.
+ * Resetting or destroying the canvas drops the tasks that the running job
+ * hasn't gotten to yet.
+ *
+ * The owner is expected to keep the backlog of tasks below MAX_BACKLOG. When
+ * it gets there, it should stop handing in messages, ask to be notified when
+ * the backlog has drained and then continue from its history.
+ */
+class ServerCanvas final : public QObject {
+	Q_OBJECT
+public:
+	//! Receives the reset image, or an empty list if building it failed.
+	using ResetImageFn = std::function<void(const net::MessageList &)>;
+
+	//! Number of pending tasks at which the owner should hold off
+	static constexpr int MAX_BACKLOG = 10000;
+
+	explicit ServerCanvas(QObject *parent = nullptr);
+	~ServerCanvas() override;
+
+	//! Apply a message from the session history
+	void handleMessage(const net::Message &msg);
+
+	//! Apply all messages currently in the session history
+	void handleMessages(const net::MessageList &msgs);
+
+	//! Go back to a blank canvas, e.g. because the history got replaced
+	void reset();
+
+	/**
+	 * @brief Build a reset image of the canvas in the background
+	 *
+	 * The function is called on this object's thread once it's done. If this
+	 * object is destroyed or reset beforehand, the function isn't called.
+	 */
+	void buildResetImage(const ResetImageFn &fn);
+
+	//! Is a reset image currently being built?
+	bool isBuildingResetImage() const { return !m_resetImageFns.isEmpty(); }
+
+	//! Number of tasks that haven't been taken up by a job yet
+	int backlog();
+
+	//! Emit backlogDrained once the backlog is down to half of MAX_BACKLOG
+	void notifyWhenDrained();
+
+signals:
+	void backlogDrained();
+
+private:
+	class Job;
+	struct Worker;
+
+	struct Task {
+		enum class Type { Message, Reset, ResetImage };
+		Type type;
+		net::Message msg;
+		unsigned int resetImageId;
+	};
+
+	void pushTask(const Task &task);
+	void pushTasks(const QVector<Task> &tasks);
+	void startJob();
+	void runJob();
+	void finishResetImage(unsigned int id, const net::MessageList &image);
+
+	// Only touched by the running job, never concurrently.
+	Worker *m_worker;
+
+	QMutex m_mutex;
+	QWaitCondition m_idle;
+	QVector<Task> m_tasks;
+	bool m_running = false;
+	bool m_notifyWhenDrained = false;
+	// Bumped with the mutex locked whenever pending tasks get dropped, the
+	// running job checks it between tasks it has already taken out.
+	QAtomicInt m_generation;
+
+	unsigned int m_lastResetImageId = 0;
+	QHash<unsigned int, ResetImageFn> m_resetImageFns;
+};
+
+}
+
+#endif
@@ -1,9 +1,12 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "libserver/serverconfig.h"
+#include "libshared/util/passwordhash.h"
 
+#include <QMutexLocker>
 #include <QRegularExpression>
 #include <QJsonObject>
+#include <algorithm>
 
 namespace server {
 
@@ -110,8 +113,22 @@ void ServerConfig::setConfigBool(ConfigKey key, bool value)
 	setConfigString(key, value ? QStringLiteral("true") : QStringLiteral("false"));
 }
 
+void ServerConfig::setExternalBans(const QVector<ExtBan> &bans)
+{
+	QMutexLocker locker(&m_extBanMutex);
+	m_extBans = bans;
+	m_extBanIndex.clear();
+	int count = m_extBans.size();
+	for(int i = 0; i < count; ++i) {
+		for(const BanIpRange &range : m_extBans[i].ips) {
+			m_extBanIndex.insertRange(i, range.from, range.to);
+		}
+	}
+}
+
 bool ServerConfig::setExternalBanEnabled(int id, bool enabled)
 {
+	QMutexLocker locker(&m_extBanMutex);
 	if(enabled) {
 		m_disabledExtBanIds.remove(id);
 	} else {
@@ -122,6 +139,7 @@ bool ServerConfig::setExternalBanEnabled(int id, bool enabled)
 
 QJsonArray ServerConfig::getExternalBans() const
 {
+	QMutexLocker locker(&m_extBanMutex);
 	QJsonArray bans;
 	for(const ExtBan &ban : m_extBans) {
 		bans.append(QJsonObject{
@@ -139,6 +157,12 @@ QJsonArray ServerConfig::getExternalBans() const
 	return bans;
 }
 
+const QVector<ExtBan> ServerConfig::extBans() const
+{
+	QMutexLocker locker(&m_extBanMutex);
+	return m_extBans;
+}
+
 bool ServerConfig::isAllowedAnnouncementUrl(const QUrl &url) const
 {
 	Q_UNUSED(url);
@@ -147,8 +171,20 @@ bool ServerConfig::isAllowedAnnouncementUrl(const QUrl &url) const
 
 BanResult ServerConfig::isAddressBanned(const QHostAddress &addr) const
 {
+	// The index only narrows down the candidates, the first matching ban in
+	// list order still wins and gets its reaction from its own ranges.
+	QMutexLocker locker(&m_extBanMutex);
+	QVector<int> candidates = m_extBanIndex.lookup(addr);
+	if(candidates.isEmpty()) {
+		return BanResult::notBanned();
+	}
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(
+		std::unique(candidates.begin(), candidates.end()), candidates.end());
+
 	QDateTime now = QDateTime::currentDateTime();
-	for(const ExtBan &ban : m_extBans) {
+	for(int i : candidates) {
+		const ExtBan &ban = m_extBans[i];
 		BanReaction reaction = BanReaction::NotBanned;
 		bool banned = !m_disabledExtBanIds.contains(ban.id) &&
 					  ban.expires > now &&
@@ -164,6 +200,7 @@ BanResult ServerConfig::isAddressBanned(const QHostAddress &addr) const
 
 BanResult ServerConfig::isSystemBanned(const QString &sid) const
 {
+	QMutexLocker locker(&m_extBanMutex);
 	QDateTime now = QDateTime::currentDateTime();
 	for(const ExtBan &ban : m_extBans) {
 		BanReaction reaction = BanReaction::NotBanned;
@@ -180,6 +217,7 @@ BanResult ServerConfig::isSystemBanned(const QString &sid) const
 
 BanResult ServerConfig::isUserBanned(long long userId) const
 {
+	QMutexLocker locker(&m_extBanMutex);
 	QDateTime now = QDateTime::currentDateTime();
 	for(const ExtBan &ban : m_extBans) {
 		BanReaction reaction = BanReaction::NotBanned;
@@ -197,12 +235,28 @@ BanResult ServerConfig::isUserBanned(long long userId) const
 
 RegisteredUser ServerConfig::getUserAccount(const QString &username, const QString &password) const
 {
-	Q_UNUSED(password);
+	RegisteredUser user = lookupUserAccount(username);
+	if(user.status == RegisteredUser::Ok &&
+	   !passwordhash::check(password, user.passwordHash)) {
+		return RegisteredUser {
+			RegisteredUser::BadPass,
+			username,
+			QStringList(),
+			QString(),
+			QByteArray()
+		};
+	}
+	return user;
+}
+
+RegisteredUser ServerConfig::lookupUserAccount(const QString &username) const
+{
 	return RegisteredUser {
 		RegisteredUser::NotFound,
 		username,
 		QStringList(),
-		nullptr
+		QString(),
+		QByteArray()
 	};
 }
 
@@ -3,9 +3,12 @@
 #ifndef SERVERCONFIG_H
 #define SERVERCONFIG_H
 
+#include "libserver/ipbanindex.h"
+#include <QByteArray>
 #include <QObject>
 #include <QString>
 #include <QHash>
+#include <QMutex>
 #include <QUrl>
 #include <QDateTime>
 #include <QHostAddress>
@@ -101,7 +104,14 @@ namespace config {
 		// Maximum number of users per session.
 		SessionUserLimit(42, "sessionUserLimit", "254", ConfigKey::INT),
 		// Automatically allow/disallow web sessions based on passwordedness.
-		PasswordDependentWebSession(43, "passwordDependentWebSession", "false", ConfigKey::BOOL);
+		PasswordDependentWebSession(43, "passwordDependentWebSession", "false", ConfigKey::BOOL),
+		// Maximum amount of queued messages to pack into a single socket write.
+		WriteBatchSize(44, "writeBatchSize", "64kb", ConfigKey::SIZE),
+		// Keep a canvas for each session on the server and build autoreset
+		// images from it, instead of asking an operator's client to do it.
+		// The canvas is created along with the session, so changing this only
+		// affects sessions started afterwards.
+		ServerSideAutoreset(45, "serverSideAutoreset", "false", ConfigKey::BOOL);
 }
 
 //! Settings that are not adjustable after the server has started
@@ -131,6 +141,8 @@ struct RegisteredUser {
 	QString username;
 	QStringList flags;
 	QString userId;
+	// Only filled in by lookupUserAccount, for checking the password later.
+	QByteArray passwordHash;
 };
 
 enum class BanReaction {
@@ -223,7 +235,7 @@ public:
 	void setConfigInt(ConfigKey, int value);
 	void setConfigBool(ConfigKey, bool value);
 
-	void setExternalBans(const QVector<ExtBan> &bans) { m_extBans = bans; }
+	void setExternalBans(const QVector<ExtBan> &bans);
 	virtual bool setExternalBanEnabled(int id, bool enabled);
 	QJsonArray getExternalBans() const;
 
@@ -244,9 +256,19 @@ public:
 	/**
 	 * @brief See if there is a registered user with the given credentials
 	 *
-	 * The default implementation always returns NotFound
+	 * Looks up the account and checks the password on the calling thread,
+	 * which is slow. LoginHandler uses lookupUserAccount instead and checks
+	 * the password hash in the background.
 	 */
-	virtual RegisteredUser getUserAccount(const QString &username, const QString &password) const;
+	RegisteredUser getUserAccount(const QString &username, const QString &password) const;
+
+	/**
+	 * @brief Look up a registered user without checking their password
+	 *
+	 * Returns Ok for existing, unlocked accounts along with their password
+	 * hash, never BadPass. The default implementation always returns NotFound.
+	 */
+	virtual RegisteredUser lookupUserAccount(const QString &username) const;
 
 	virtual bool hasAnyUserAccounts() const;
 
@@ -278,7 +300,7 @@ signals:
 	void configValueChanged(const ConfigKey &key);
 
 protected:
-	const QVector<ExtBan> extBans() const { return m_extBans; }
+	const QVector<ExtBan> extBans() const;
 
 	/**
 	 * @brief Get the configuration value for the given key
@@ -335,7 +357,12 @@ private:
 	static QJsonArray banUsersToJson(const QVector<BanUser> &users);
 
 	InternalConfig m_internalCfg;
+	// Bans are replaced from the main thread, but checked from session
+	// threads too. This guards the ban list, its index and disabled ids.
+	mutable QMutex m_extBanMutex;
 	QVector<ExtBan> m_extBans;
+	// Address ranges of the external bans, values are indexes into m_extBans.
+	IpBanIndex m_extBanIndex;
 	QSet<int> m_disabledExtBanIds;
 };
 
@@ -343,11 +370,14 @@ private:
 namespace diagnostic_marker_private {
 	class [[maybe_unused]] AbstractServerConfigMarker : ServerConfig
 	{
-		inline RegisteredUser getUserAccount(const QString &, const QString &) const override { return RegisteredUser(); }
+		inline RegisteredUser lookupUserAccount(const QString &) const override { return RegisteredUser(); }
 		inline bool isAllowedAnnouncementUrl(const QUrl &) const override { return false; }
 	};
 }
 
 }
 
+// Config change notifications get queued to sessions in session threads
+Q_DECLARE_METATYPE(server::ConfigKey)
+
 #endif // SERVERCONFIG_H
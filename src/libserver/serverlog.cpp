@@ -4,6 +4,7 @@
 
 #include <QMetaEnum>
 #include <QJsonObject>
+#include <QMutexLocker>
 
 namespace server {
 
@@ -75,6 +76,7 @@ void ServerLog::logMessage(const Log &entry)
 
 void InMemoryLog::setHistoryLimit(int limit)
 {
+	QMutexLocker locker(&m_mutex);
 	m_limit = limit;
 	if(limit>0 && limit<m_history.size())
 		m_history.erase(m_history.begin() + limit, m_history.end());
@@ -82,6 +84,7 @@ void InMemoryLog::setHistoryLimit(int limit)
 
 void InMemoryLog::storeMessage(const Log &entry)
 {
+	QMutexLocker locker(&m_mutex);
 	m_history.prepend(entry);
 	if(m_limit>0 && m_history.size() >= m_limit)
 		m_history.pop_back();
@@ -89,6 +92,7 @@ void InMemoryLog::storeMessage(const Log &entry)
 
 QList<Log> InMemoryLog::getLogEntries(const QString &session, const QDateTime &after, Log::Level atleast, bool omitSensitive, int offset, int limit) const
 {
+	QMutexLocker locker(&m_mutex);
 	QList<Log> filtered;
 
 	for(const Log &l : m_history) {
@@ -5,6 +5,7 @@
 
 #include <QDateTime>
 #include <QHostAddress>
+#include <QMutex>
 
 #include "libshared/util/ulid.h"
 
@@ -202,6 +203,8 @@ void Log::to(ServerLog *logger)
 
 /**
  * @brief A simple ServerLog implementation that keeps the latest messages in memory
+ *
+ * Messages may be logged from any thread.
  */
 class InMemoryLog : public ServerLog
 {
@@ -215,6 +218,7 @@ protected:
 	void storeMessage(const Log &entry) override;
 
 private:
+	mutable QMutex m_mutex;
 	QList<Log> m_history;
 	int m_limit;
 };
@@ -83,6 +83,20 @@ Session::~Session()
 	emit sessionDestroyed(this);
 }
 
+void Session::checkPassword(
+	Client *client, const QString &password, const QByteArray &hash,
+	const std::function<void(PasswordCheckResult)> &callback)
+{
+	if(m_sessions) {
+		m_sessions->checkPassword(
+			client->peerAddress(), password, hash, client, callback);
+	} else {
+		callback(
+			passwordhash::check(password, hash) ? PasswordCheckResult::Ok
+												: PasswordCheckResult::Bad);
+	}
+}
+
 static net::Message makeLogMessage(const Log &log)
 {
 	return net::ServerReply::makeLog(
@@ -1205,8 +1219,9 @@ void Session::killSession(const QString &message, bool terminate)
 
 void Session::directToAll(const net::Message &msg)
 {
+	net::EncodedMessage encoded(msg);
 	for(Client *c : m_clients) {
-		c->sendDirectMessage(msg);
+		c->sendDirectMessage(encoded);
 	}
 }
 
@@ -4,6 +4,7 @@
 #include "libserver/announcable.h"
 #include "libserver/jsonapi.h"
 #include "libserver/sessionhistory.h"
+#include "libserver/sessions.h"
 #include "libshared/net/message.h"
 #include <QDateTime>
 #include <QElapsedTimer>
@@ -64,6 +65,23 @@ public:
 	//! Get the server configuration
 	const ServerConfig *config() const { return m_config; }
 
+	/**
+	 * @brief Set the server that checks passwords for this session
+	 *
+	 * Without one, passwords get checked directly in the session's thread.
+	 */
+	void setSessions(Sessions *sessions) { m_sessions = sessions; }
+
+	/**
+	 * @brief Check a password sent by a client of this session
+	 *
+	 * See Sessions::checkPassword. The callback is called in the session's
+	 * thread and dropped if the client is gone by then.
+	 */
+	void checkPassword(
+		Client *client, const QString &password, const QByteArray &hash,
+		const std::function<void(PasswordCheckResult)> &callback);
+
 	//! Get the unique ID of the session
 	QString id() const override final { return m_history->id(); }
 
@@ -494,6 +512,7 @@ private:
 	SessionHistory *m_history;
 	ServerConfig *m_config;
 	sessionlisting::Announcements *m_announcements;
+	Sessions *m_sessions = nullptr;
 
 	State m_state = State::Initialization;
 	int m_initUser = -1; // the user who is currently uploading init/reset data
@@ -77,6 +77,17 @@ void SessionHistory::joinUser(uint8_t id, const QString &name)
 	idQueue().setIdForName(id, name);
 }
 
+bool SessionHistory::getFramedBatch(
+	long long after, QByteArray &outData, int &outCount,
+	long long &outLastIndex) const
+{
+	Q_UNUSED(after);
+	Q_UNUSED(outData);
+	Q_UNUSED(outCount);
+	Q_UNUSED(outLastIndex);
+	return false;
+}
+
 void SessionHistory::historyLoaded(size_t size, int messageCount)
 {
 	Q_ASSERT(m_lastIndex == -1);
@@ -237,6 +248,25 @@ SessionHistory::addStreamResetMessage(uint8_t ctxId, const net::Message &msg)
 	return StreamResetAddResult::Ok;
 }
 
+StreamResetAddResult SessionHistory::addStreamResetImage(
+	uint8_t ctxId, const net::MessageList &msgs)
+{
+	if(m_resetStreamState != ResetStreamState::Streaming) {
+		return StreamResetAddResult::NotActive;
+	}
+
+	if(m_resetStreamCtxId != ctxId) {
+		return StreamResetAddResult::InvalidUser;
+	}
+
+	for(const net::Message &msg : msgs) {
+		if(!receiveResetStreamMessage(msg)) {
+			return m_resetStreamAddError;
+		}
+	}
+	return StreamResetAddResult::Ok;
+}
+
 StreamResetAbortResult SessionHistory::abortStreamedReset(int ctxId)
 {
 	if(m_resetStreamState == ResetStreamState::Streaming) {
@@ -262,8 +292,11 @@ SessionHistory::prepareStreamedReset(uint8_t ctxId, int expectedMessageCount)
 		return StreamResetPrepareResult::InvalidUser;
 	}
 
+	// There's no consumer if nothing compressed was streamed, e.g. because
+	// the reset image was added directly.
 	m_resetStreamAddError = StreamResetAddResult::ConsumerError;
-	bool freeOk = DP_reset_stream_consumer_free_finish(m_resetStreamConsumer);
+	bool freeOk = !m_resetStreamConsumer ||
+				  DP_reset_stream_consumer_free_finish(m_resetStreamConsumer);
 	m_resetStreamConsumer = nullptr;
 	if(!freeOk) {
 		switch(m_resetStreamAddError) {
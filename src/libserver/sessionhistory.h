@@ -232,6 +232,16 @@ public:
 	StreamResetAddResult
 	addStreamResetMessage(uint8_t ctxId, const net::Message &msg);
 
+	/**
+	 * @brief Add an already decoded reset image to a streaming history reset
+	 *
+	 * This is for reset images generated on the server itself, which don't
+	 * need to be compressed and decompressed again like a client's stream.
+	 * The same messages are allowed as in a streamed image.
+	 */
+	StreamResetAddResult
+	addStreamResetImage(uint8_t ctxId, const net::MessageList &msgs);
+
 	/**
 	 * @brief Cancel a streaming history reset in progress
 	 *
@@ -287,6 +297,21 @@ public:
 	virtual std::tuple<net::MessageList, long long>
 	getBatch(long long after) const = 0;
 
+	/**
+	 * @brief Get a batch of messages without decoding them
+	 *
+	 * Like getBatch, but the batch is returned as the messages' bytes in the
+	 * TCP framing, as stored on disk, along with the number of messages in
+	 * it. This lets catching up clients be fed straight from storage.
+	 *
+	 * Returns false if the batch can't be provided this way, in which case
+	 * getBatch should be used instead. The default implementation always
+	 * returns false.
+	 */
+	virtual bool getFramedBatch(
+		long long after, QByteArray &outData, int &outCount,
+		long long &outLastIndex) const;
+
 	/**
 	 * @brief Mark messages before the given index as unneeded (for now)
 	 *
@@ -3,9 +3,13 @@
 #ifndef SESSIONS_INTERFACE_H
 #define SESSIONS_INTERFACE_H
 
+#include <functional>
 #include <tuple>
 
+class QByteArray;
+class QHostAddress;
 class QJsonArray;
+class QObject;
 class QString;
 
 namespace protocol {
@@ -14,8 +18,11 @@ namespace protocol {
 
 namespace server {
 
+class Client;
 class Session;
 
+enum class PasswordCheckResult { Ok, Bad, Busy };
+
 /**
  * Interface for a class that can accept client logins
  */
@@ -51,9 +58,43 @@ public:
 	 * @param protocolVersion session protocol version
 	 * @param founder name of the user who created the session
 	 *
+	 * The new session can be used directly until its founder is handed over
+	 * to it with joinSession.
+	 *
 	 * @return session, error string pair: if session is null, error string contains the error code
 	 */
 	virtual std::tuple<Session*, QString> createSession(const QString &id, const QString &alias, const protocol::ProtocolVersion &protocolVersion, const QString &founder) = 0;
+
+	/**
+	 * Run a function in the session's thread and wait for it to finish
+	 *
+	 * If the session has ended in the meantime, the function isn't called.
+	 * The default implementation calls the function directly, which is what
+	 * all single-threaded servers want.
+	 */
+	virtual void runOnSession(Session *session, const std::function<void(Session*)> &fn);
+
+	/**
+	 * Hand over a logged in client to the session and join it
+	 *
+	 * After this, the client belongs to the session and must not be touched
+	 * by the caller anymore. The default implementation joins directly.
+	 */
+	virtual void joinSession(Session *session, Client *client, bool host);
+
+	/**
+	 * Check a password against a hash on behalf of a client at the address
+	 *
+	 * Verifying a hash is slow on purpose, so servers with many clients should
+	 * do it in the background, see PasswordChecker. The callback must be
+	 * called on the calling thread and not at all if the context object has
+	 * been destroyed by then. The default implementation checks directly and
+	 * calls back immediately, which is fine for single-user servers.
+	 */
+	virtual void checkPassword(
+		const QHostAddress &address, const QString &password,
+		const QByteArray &hash, QObject *context,
+		const std::function<void(PasswordCheckResult)> &callback);
 };
 
 }
@@ -1,9 +1,11 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "libserver/sessionserver.h"
+#include "libserver/sessionthreads.h"
 #include "libserver/thinsession.h"
 #include "libserver/thinserverclient.h"
 #include "libserver/loginhandler.h"
+#include "libserver/passwordchecker.h"
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
 #include "libserver/inmemoryhistory.h"
@@ -11,6 +13,8 @@
 #include "libserver/templateloader.h"
 #include "libserver/announcements.h"
 
+#include <QMutex>
+#include <QThread>
 #include <QTimer>
 #include <QJsonArray>
 #include <QJsonDocument>
@@ -21,9 +25,14 @@ SessionServer::SessionServer(ServerConfig *config, QObject *parent)
 	: QObject(parent),
 	m_config(config),
 	m_tpls(nullptr),
-	m_useFiledSessions(false)
+	m_useFiledSessions(false),
+	m_threads(nullptr),
+	m_sessionClientCount(0)
 {
 	m_announcements = new sessionlisting::Announcements(config, this);
+	m_passwordChecker = new PasswordChecker(
+		PasswordChecker::DEFAULT_MAX_THREADS,
+		PasswordChecker::DEFAULT_MAX_PER_ADDRESS, this);
 
 	QTimer *cleanupTimer = new QTimer(this);
 	connect(cleanupTimer, &QTimer::timeout, this, &SessionServer::cleanupSessions);
@@ -31,6 +40,29 @@ SessionServer::SessionServer(ServerConfig *config, QObject *parent)
 	cleanupTimer->start(cleanupTimer->interval());
 }
 
+SessionServer::~SessionServer()
+{
+	// Sessions left in the threads must go before the announcements do.
+	delete m_threads;
+}
+
+void SessionServer::setSessionThreads(int threadCount)
+{
+	Q_ASSERT(!m_threads);
+	Q_ASSERT(m_sessions.isEmpty());
+	if(threadCount == 0)
+		return;
+
+	m_threads = new SessionThreads(threadCount < 0 ? 0 : threadCount, this);
+	m_announcements->setSessionRunner([this](sessionlisting::Announcable *announcable, const std::function<void()> &fn) {
+		runOnSession(static_cast<Session*>(announcable), [&](Session*) { fn(); });
+	});
+
+	Log().about(Log::Level::Info, Log::Topic::Status)
+		.message(QStringLiteral("Running sessions on %1 threads").arg(m_threads->threadCount()))
+		.to(m_config->logger());
+}
+
 void SessionServer::setSessionDir(const QDir &dir)
 {
 	if(dir.isReadable()) {
@@ -58,6 +90,7 @@ void SessionServer::loadNewSessions()
 			Session *session = new ThinSession(fh, m_config, m_announcements, this);
 			initSession(session);
 			session->log(Log().about(Log::Level::Debug, Log::Topic::Status).message("Loaded from file."));
+			moveToSessionThread(m_sessions.last());
 		}
 	}
 }
@@ -67,10 +100,15 @@ QJsonArray SessionServer::sessionDescriptions() const
 	QJsonArray descs;
 	QStringList aliases;
 
-	for(const Session *s : m_sessions) {
-		descs.append(s->getDescription());
-		if(!s->idAlias().isEmpty())
-			aliases << s->idAlias();
+	for(const SessionEntry &entry : m_sessions) {
+		if(entry.snapshot) {
+			QMutexLocker locker(&entry.snapshot->mutex);
+			descs.append(entry.snapshot->description);
+		} else {
+			descs.append(entry.session->getDescription());
+		}
+		if(!entry.idAlias.isEmpty())
+			aliases << entry.idAlias;
 	}
 
 	if(templateLoader()) {
@@ -155,33 +193,199 @@ Session *SessionServer::createFromTemplate(const QString &idAlias)
 	session->log(Log()
 		.about(Log::Level::Info, Log::Topic::Status)
 		.message(QStringLiteral("Session instantiated from template %1").arg(idAlias)));
+	moveToSessionThread(m_sessions.last());
 
 	return session;
 }
 
 void SessionServer::initSession(Session *session)
 {
-	m_sessions.append(session);
+	m_sessions.append({session, session, nullptr, session->id(), session->idAlias(), nullptr});
+	session->setSessions(this);
 
+	// When the session runs in a session thread, these become queued
+	// connections. The session pointer is then only used for identification.
 	connect(session, &Session::sessionAttributeChanged, this, &SessionServer::onSessionAttributeChanged);
-	connect(session, &Session::sessionDestroyed, this, &SessionServer::removeSession, Qt::DirectConnection);
+	connect(session, &Session::sessionDestroyed, this, &SessionServer::removeSession);
 
 	emit sessionCreated(session);
 	emit sessionChanged(session->getDescription());
 }
 
+struct SessionServer::SessionSnapshot {
+	static constexpr int REFRESH_INTERVAL_MSECS = 2000;
+
+	QMutex mutex;
+	QJsonObject description;
+	QJsonArray users;
+
+	void publish(const Session *session)
+	{
+		QJsonObject newDescription = session->getDescription();
+		QJsonArray newUsers;
+		for(const Client *c : session->clients())
+			newUsers.append(c->description());
+
+		QMutexLocker locker(&mutex);
+		description = newDescription;
+		users = newUsers;
+	}
+};
+
+/**
+ * @brief Move a session over to the least busy session thread
+ *
+ * Does nothing if session threads aren't enabled. The session must not be
+ * used directly anymore after this, only via runOnSession.
+ */
+void SessionServer::moveToSessionThread(SessionEntry &entry)
+{
+	if(!m_threads || entry.threadContext)
+		return;
+
+	Session *session = entry.session;
+	QObject *context = m_threads->acquire();
+	session->setParent(nullptr);
+	session->moveToThread(context->thread());
+	entry.threadContext = context;
+
+	std::shared_ptr<SessionSnapshot> snapshot = std::make_shared<SessionSnapshot>();
+	entry.snapshot = snapshot;
+
+	// Let the thread context own it, so it gets cleaned up with the thread.
+	runBlocking(context, [session, context, snapshot]() {
+		session->setParent(context);
+
+		snapshot->publish(session);
+		connect(session, &Session::sessionAttributeChanged, session, [snapshot](Session *s) {
+			snapshot->publish(s);
+		});
+
+		// Sizes and activity change all the time without further notice
+		QTimer *refreshTimer = new QTimer(session);
+		refreshTimer->setTimerType(Qt::CoarseTimer);
+		connect(refreshTimer, &QTimer::timeout, session, [snapshot, session]() {
+			snapshot->publish(session);
+		});
+		refreshTimer->start(SessionSnapshot::REFRESH_INTERVAL_MSECS);
+	});
+}
+
+int SessionServer::findSessionIndex(const Session *session) const
+{
+	for(int i = 0; i < m_sessions.size(); ++i) {
+		if(m_sessions[i].session == session)
+			return i;
+	}
+	return -1;
+}
+
+void SessionServer::runOnSession(Session *session, const std::function<void(Session*)> &fn)
+{
+	int i = findSessionIndex(session);
+	if(i >= 0)
+		runOnSessionEntry(m_sessions[i], fn);
+}
+
+void SessionServer::runOnSessionEntry(const SessionEntry &entry, const std::function<void(Session*)> &fn) const
+{
+	if(entry.threadContext) {
+		QPointer<Session> alive = entry.alive;
+		runBlocking(entry.threadContext, [&]() {
+			if(alive)
+				fn(alive.data());
+		});
+	} else {
+		fn(entry.session);
+	}
+}
+
+void SessionServer::joinSession(Session *session, Client *client, bool host)
+{
+	int i = findSessionIndex(session);
+	if(!m_threads || i < 0) {
+		Sessions::joinSession(session, client, host);
+		return;
+	}
+
+	// Freshly hosted sessions are still in the main thread up to this point
+	SessionEntry &entry = m_sessions[i];
+	moveToSessionThread(entry);
+
+	// The client now belongs to the session's thread, we only count it
+	ThinServerClient *thinClient = static_cast<ThinServerClient*>(client);
+	m_clients.removeOne(thinClient);
+	++m_sessionClientCount;
+	disconnect(thinClient, &ThinServerClient::thinServerClientDestroyed, this, &SessionServer::removeClient);
+	connect(thinClient, &ThinServerClient::thinServerClientDestroyed, this, [this]() {
+		--m_sessionClientCount;
+		emit userCountChanged(totalUsers());
+	}, Qt::QueuedConnection);
+
+	QObject *context = entry.threadContext;
+	QPointer<Session> alive = entry.alive;
+	client->setParent(nullptr);
+	client->moveToThread(context->thread());
+	QMetaObject::invokeMethod(context, [alive, client, context, host]() {
+		client->setParent(context);
+		if(alive) {
+			alive->joinUser(client, host);
+		} else {
+			client->disconnectClient(
+				Client::DisconnectionReason::Error,
+				QStringLiteral("Session ended"),
+				QStringLiteral("SessionServer::joinSession"));
+		}
+	}, Qt::QueuedConnection);
+}
+
+void SessionServer::checkPassword(const QHostAddress &address, const QString &password, const QByteArray &hash, QObject *context, const std::function<void(PasswordCheckResult)> &callback)
+{
+	if(QThread::currentThread() == thread()) {
+		m_passwordChecker->check(address, password, hash, context, callback);
+		return;
+	}
+
+	// Called from a session thread. The checker only works in the main thread,
+	// so the result gets sent back through a relay living in the caller's
+	// thread, since only that thread may look at whether the context is still
+	// alive. The relay deletes itself once it has passed the result on.
+	QObject *relay = new QObject;
+	QPointer<QObject> alive = context;
+	std::function<void(PasswordCheckResult)> reply =
+		[relay, alive, callback](PasswordCheckResult result) {
+			QMetaObject::invokeMethod(relay, [relay, alive, callback, result]() {
+				relay->deleteLater();
+				if(alive)
+					callback(result);
+			}, Qt::QueuedConnection);
+		};
+
+	PasswordChecker *checker = m_passwordChecker;
+	QMetaObject::invokeMethod(checker, [=]() {
+		checker->check(address, password, hash, checker, reply);
+	}, Qt::QueuedConnection);
+}
+
 void SessionServer::removeSession(Session *session)
 {
-	m_sessions.removeOne(session);
+	int i = findSessionIndex(session);
+	if(i < 0)
+		return;
+
+	const SessionEntry entry = m_sessions.takeAt(i);
+	if(entry.threadContext)
+		m_threads->release(entry.threadContext);
+
 	m_announcements->unlistSession(session); // just to be safe
-	emit sessionEnded(session->id());
+	emit sessionEnded(entry.id);
 }
 
 Session *SessionServer::getSessionById(const QString &id, bool load)
 {
-	for(Session *s : m_sessions) {
-		if(s->id() == id || s->idAlias() == id)
-			return s;
+	for(const SessionEntry &entry : m_sessions) {
+		if(entry.id == id || entry.idAlias == id)
+			return entry.session;
 	}
 
 	if(load && templateLoader() && templateLoader()->exists(id)) {
@@ -201,14 +405,20 @@ void SessionServer::stopAll()
 			QStringLiteral("SessionServer::stopAll"));
 	}
 
-	for(Session *s : m_sessions)
-		s->killSession(QStringLiteral("Server shutting down"), false);
+	const QVector<SessionEntry> sessions = m_sessions;
+	for(const SessionEntry &entry : sessions) {
+		runOnSessionEntry(entry, [](Session *s) {
+			s->killSession(QStringLiteral("Server shutting down"), false);
+		});
+	}
 }
 
 void SessionServer::messageAll(const QString &message, bool alert)
 {
-	for(Session *s : m_sessions) {
-		s->messageAll(message, alert);
+	for(const SessionEntry &entry : m_sessions) {
+		runOnSessionEntry(entry, [&](Session *s) {
+			s->messageAll(message, alert);
+		});
 	}
 }
 
@@ -216,13 +426,14 @@ void SessionServer::addClient(ThinServerClient *client)
 {
 	client->setParent(this);
 	client->setConnectionTimeout(m_config->getConfigTime(config::ClientTimeout) * 1000);
+	client->setWriteBatchSize(m_config->getConfigSize(config::WriteBatchSize));
 
 	m_clients.append(client);
 	connect(
 		client, &ThinServerClient::thinServerClientDestroyed, this,
 		&SessionServer::removeClient, Qt::DirectConnection);
 
-	emit userCountChanged(m_clients.size());
+	emit userCountChanged(totalUsers());
 
 	auto *login = new LoginHandler(client, this, m_config);
 	connect(this, &SessionServer::sessionChanged, login, &LoginHandler::announceSession);
@@ -233,7 +444,7 @@ void SessionServer::addClient(ThinServerClient *client)
 void SessionServer::removeClient(ThinServerClient *client)
 {
 	m_clients.removeOne(client);
-	emit userCountChanged(m_clients.size());
+	emit userCountChanged(totalUsers());
 }
 
 /**
@@ -247,23 +458,33 @@ void SessionServer::onSessionAttributeChanged(Session *session)
 {
 	Q_ASSERT(session);
 
-	bool delSession = false;
+	bool changed = false;
+	QJsonObject description;
+
+	runOnSession(session, [&](Session *s) {
+		bool delSession = false;
 
-	if(session->userCount()==0 && session->state() != Session::State::Shutdown) {
-		session->log(Log().about(Log::Level::Info, Log::Topic::Status).message("Last user left."));
+		if(s->userCount()==0 && s->state() != Session::State::Shutdown) {
+			s->log(Log().about(Log::Level::Info, Log::Topic::Status).message("Last user left."));
 
-		// A non-persistent session is deleted when the last user leaves
-		// A persistent session can also be deleted if it doesn't contain a snapshot point.
-		if(!session->history()->hasFlag(SessionHistory::Persistent)) {
-			session->log(Log().about(Log::Level::Info, Log::Topic::Status).message("Closing non-persistent session."));
-			delSession = true;
+			// A non-persistent session is deleted when the last user leaves
+			// A persistent session can also be deleted if it doesn't contain a snapshot point.
+			if(!s->history()->hasFlag(SessionHistory::Persistent)) {
+				s->log(Log().about(Log::Level::Info, Log::Topic::Status).message("Closing non-persistent session."));
+				delSession = true;
+			}
 		}
-	}
 
-	if(delSession)
-		session->killSession(QStringLiteral("Session terminated due to being empty"));
-	else
-		emit sessionChanged(session->getDescription());
+		if(delSession) {
+			s->killSession(QStringLiteral("Session terminated due to being empty"));
+		} else {
+			changed = true;
+			description = s->getDescription();
+		}
+	});
+
+	if(changed)
+		emit sessionChanged(description);
 }
 
 void SessionServer::cleanupSessions()
@@ -272,15 +493,18 @@ void SessionServer::cleanupSessions()
 	bool allowIdleOverride = m_config->getConfigBool(config::AllowIdleOverride);
 
 	if(expirationTime>0) {
-		for(Session *s : m_sessions) {
-			bool isExpired =
-				s->lastEventTime() > expirationTime &&
-				(!allowIdleOverride ||
-				 !s->history()->hasFlag(SessionHistory::IdleOverride));
-			if(isExpired) {
-				s->log(Log().about(Log::Level::Info, Log::Topic::Status).message("Idle session expired."));
-				s->killSession(QStringLiteral("Session terminated due to being idle too long"));
-			}
+		const QVector<SessionEntry> sessions = m_sessions;
+		for(const SessionEntry &entry : sessions) {
+			runOnSessionEntry(entry, [&](Session *s) {
+				bool isExpired =
+					s->lastEventTime() > expirationTime &&
+					(!allowIdleOverride ||
+					 !s->history()->hasFlag(SessionHistory::IdleOverride));
+				if(isExpired) {
+					s->log(Log().about(Log::Level::Info, Log::Topic::Status).message("Idle session expired."));
+					s->killSession(QStringLiteral("Session terminated due to being idle too long"));
+				}
+			});
 		}
 	}
 }
@@ -292,11 +516,14 @@ JsonApiResult SessionServer::callSessionJsonApi(JsonApiMethod method, const QStr
 	std::tie(head, tail) = popApiPath(path);
 
 	if(!head.isEmpty()) {
+		JsonApiResult result = JsonApiNotFound();
 		Session *s = getSessionById(head, false);
-		if(s)
-			return s->callJsonApi(method, tail, request);
-		else
-			return JsonApiNotFound();
+		if(s) {
+			runOnSession(s, [&](Session *session) {
+				result = session->callJsonApi(method, tail, request);
+			});
+		}
+		return result;
 	}
 
 	if(method == JsonApiMethod::Get) {
@@ -329,15 +556,32 @@ JsonApiResult SessionServer::callUserJsonApi(JsonApiMethod method, const QString
 			for(const ThinServerClient *c : m_clients) {
 				userlist.append(c->description());
 			}
+			for(const SessionEntry &entry : m_sessions) {
+				if(entry.snapshot) {
+					QMutexLocker locker(&entry.snapshot->mutex);
+					for(const QJsonValue &u : entry.snapshot->users) {
+						userlist.append(u);
+					}
+				}
+			}
 			return {JsonApiResult::Ok, QJsonDocument(userlist)};
 		}
 		case 1: {
-			ThinServerClient *c = searchClientByPathUid(path[0]);
-			if(c) {
-				return {JsonApiResult::Ok, QJsonDocument(c->description())};
-			} else {
-				return JsonApiNotFound();
+			for(const ThinServerClient *c : m_clients) {
+				if(path[0] == c->uid())
+					return {JsonApiResult::Ok, QJsonDocument(c->description())};
 			}
+			for(const SessionEntry &entry : m_sessions) {
+				if(entry.snapshot) {
+					QMutexLocker locker(&entry.snapshot->mutex);
+					for(const QJsonValue &u : entry.snapshot->users) {
+						QJsonObject description = u.toObject();
+						if(path[0] == description[QStringLiteral("uid")].toString())
+							return {JsonApiResult::Ok, QJsonDocument(description)};
+					}
+				}
+			}
+			return JsonApiNotFound();
 		}
 		default:
 			return JsonApiNotFound();
@@ -345,11 +589,12 @@ JsonApiResult SessionServer::callUserJsonApi(JsonApiMethod method, const QString
 
 	} else if(method == JsonApiMethod::Delete) {
 		if(path.size() == 1) {
-			ThinServerClient *c = searchClientByPathUid(path[0]);
-			if(c) {
-				return c->jsonApiKick(
-					request[QStringLiteral("message")].toString());
-			}
+			JsonApiResult result = JsonApiNotFound();
+			QString message = request[QStringLiteral("message")].toString();
+			runOnClientByUid(path[0], [&](Client *c) {
+				result = c->jsonApiKick(message);
+			});
+			return result;
 		}
 		return JsonApiNotFound();
 
@@ -358,14 +603,35 @@ JsonApiResult SessionServer::callUserJsonApi(JsonApiMethod method, const QString
 	}
 }
 
-ThinServerClient *SessionServer::searchClientByPathUid(const QString &uid)
+bool SessionServer::runOnClientByUid(const QString &uid, const std::function<void(Client*)> &fn)
 {
 	for(ThinServerClient *c : m_clients) {
 		if(uid == c->uid()) {
-			return c;
+			fn(c);
+			return true;
 		}
 	}
-	return nullptr;
+
+	// Clients that were handed over to a session thread can only be
+	// reached through their session.
+	if(m_threads) {
+		bool found = false;
+		for(const SessionEntry &entry : m_sessions) {
+			runOnSessionEntry(entry, [&](Session *s) {
+				for(Client *c : s->clients()) {
+					if(uid == c->uid()) {
+						fn(c);
+						found = true;
+						return;
+					}
+				}
+			});
+			if(found)
+				return true;
+		}
+	}
+
+	return false;
 }
 
 }
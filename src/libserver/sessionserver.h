@@ -6,6 +6,9 @@
 
 #include <QObject>
 #include <QDir>
+#include <QPointer>
+#include <QVector>
+#include <memory>
 
 namespace sessionlisting {
 	class Announcements;
@@ -13,8 +16,11 @@ namespace sessionlisting {
 
 namespace server {
 
+class Client;
+class PasswordChecker;
 class Session;
 class SessionHistory;
+class SessionThreads;
 class ThinServerClient;
 class ServerConfig;
 class TemplateLoader;
@@ -27,6 +33,19 @@ class SessionServer final : public QObject, public Sessions {
 Q_OBJECT
 public:
 	SessionServer(ServerConfig *config, QObject *parent=nullptr);
+	~SessionServer() override;
+
+	/**
+	 * @brief Run sessions in a pool of threads
+	 *
+	 * Each session and the clients that have joined it get their own event
+	 * loop in one of the threads, logins and the admin API stay in the main
+	 * thread. This must be called before any sessions are created.
+	 *
+	 * @param threadCount number of threads, 0 to run everything in the main
+	 * thread (the default) or a negative value for one thread per core
+	 */
+	void setSessionThreads(int threadCount);
 
 	/**
 	 * @brief Enable file backed sessions
@@ -94,10 +113,16 @@ public:
 	 */
 	Session *getSessionById(const QString &id, bool load) override;
 
+	void runOnSession(Session *session, const std::function<void(Session*)> &fn) override;
+
+	void joinSession(Session *session, Client *client, bool host) override;
+
+	void checkPassword(const QHostAddress &address, const QString &password, const QByteArray &hash, QObject *context, const std::function<void(PasswordCheckResult)> &callback) override;
+
 	/**
 	 * @brief Get the total number of connected users
 	 */
-	int totalUsers() const { return m_clients.size(); }
+	int totalUsers() const { return m_clients.size() + m_sessionClientCount; }
 
 	/**
 	 * @brief Get the number of active sessions
@@ -170,9 +195,31 @@ private slots:
 
 private:
 	SessionHistory *initHistory(const QString &id, const QString alias, const protocol::ProtocolVersion &protocolVersion, const QString &founder);
+
+	/**
+	 * @brief What the listings show of a session running in a session thread
+	 *
+	 * The session publishes this from its own thread whenever its attributes
+	 * change and periodically in between, so that listing sessions and users
+	 * doesn't have to wait on every session thread in turn.
+	 */
+	struct SessionSnapshot;
+
+	struct SessionEntry {
+		Session *session;          // only valid while alive is not null
+		QPointer<Session> alive;   // may only be dereferenced in the session's thread
+		QObject *threadContext;    // null while running in the main thread
+		QString id;
+		QString idAlias;
+		std::shared_ptr<SessionSnapshot> snapshot; // null while running in the main thread
+	};
+
 	void initSession(Session *session);
+	void moveToSessionThread(SessionEntry &entry);
+	int findSessionIndex(const Session *session) const;
+	void runOnSessionEntry(const SessionEntry &entry, const std::function<void(Session*)> &fn) const;
 
-	ThinServerClient *searchClientByPathUid(const QString &uid);
+	bool runOnClientByUid(const QString &uid, const std::function<void(Client*)> &fn);
 
 	sessionlisting::Announcements *m_announcements;
 	ServerConfig *m_config;
@@ -180,8 +227,11 @@ private:
 	QDir m_sessiondir;
 	bool m_useFiledSessions;
 
-	QList<Session*> m_sessions;
-	QList<ThinServerClient*> m_clients;
+	SessionThreads *m_threads;
+	PasswordChecker *m_passwordChecker;
+	QVector<SessionEntry> m_sessions;
+	QList<ThinServerClient*> m_clients; // clients running in the main thread
+	int m_sessionClientCount;           // clients handed over to session threads
 };
 
 }
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libserver/sessionthreads.h"
+
+namespace server {
+
+SessionThreads::SessionThreads(int threadCount, QObject *parent)
+	: QObject(parent)
+{
+	if(threadCount <= 0) {
+		threadCount = qMax(1, QThread::idealThreadCount());
+	}
+
+	m_threads.reserve(threadCount);
+	for(int i = 0; i < threadCount; ++i) {
+		QThread *thread = new QThread;
+		thread->setObjectName(QStringLiteral("session%1").arg(i + 1));
+
+		// Any objects left behind in the thread are deleted along with the
+		// context once the thread's event loop exits.
+		QObject *context = new QObject;
+		context->moveToThread(thread);
+		connect(thread, &QThread::finished, context, &QObject::deleteLater);
+
+		thread->start();
+		m_threads.append({thread, context, 0});
+	}
+}
+
+SessionThreads::~SessionThreads()
+{
+	for(Thread &t : m_threads) {
+		t.thread->quit();
+	}
+	for(Thread &t : m_threads) {
+		t.thread->wait();
+		delete t.thread;
+	}
+}
+
+QObject *SessionThreads::acquire()
+{
+	Q_ASSERT(!m_threads.isEmpty());
+	Thread *best = &m_threads[0];
+	for(Thread &t : m_threads) {
+		if(t.sessions < best->sessions) {
+			best = &t;
+		}
+	}
+	++best->sessions;
+	return best->context;
+}
+
+void SessionThreads::release(QObject *context)
+{
+	for(Thread &t : m_threads) {
+		if(t.context == context) {
+			Q_ASSERT(t.sessions > 0);
+			--t.sessions;
+			return;
+		}
+	}
+	qWarning("SessionThreads::release: unknown thread context");
+}
+
+}
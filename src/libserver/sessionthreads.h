@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DP_SRV_SESSIONTHREADS_H
+#define DP_SRV_SESSIONTHREADS_H
+
+#include <QMetaObject>
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include <type_traits>
+
+namespace server {
+
+/**
+ * @brief Run a function in the thread of the given context object and wait
+ *
+ * If the context object lives in the calling thread, the function is simply
+ * called directly. Otherwise the calling thread blocks until the context
+ * object's thread has run it.
+ *
+ * To avoid deadlocks, the main thread may block on session threads, but
+ * session threads must never block on the main thread.
+ */
+template <typename Fn>
+auto runBlocking(QObject *context, Fn fn) -> decltype(fn())
+{
+	using Result = decltype(fn());
+	if(context->thread() == QThread::currentThread()) {
+		return fn();
+	} else if constexpr(std::is_void<Result>::value) {
+		QMetaObject::invokeMethod(context, fn, Qt::BlockingQueuedConnection);
+	} else {
+		Result result;
+		QMetaObject::invokeMethod(
+			context, [&result, &fn]() { result = fn(); },
+			Qt::BlockingQueuedConnection);
+		return result;
+	}
+}
+
+/**
+ * @brief A pool of threads for running sessions on
+ *
+ * Each thread runs its own event loop. A session, along with all the clients
+ * that have joined it, lives entirely in one thread, so sessions don't need
+ * any locking between themselves. Sessions are assigned to the thread with
+ * the fewest sessions on it.
+ *
+ * Every thread has a context object, which can be used to run code in that
+ * thread (see runBlocking) and which is the parent of the objects that have
+ * been handed over to it. They are deleted when the pool is destroyed.
+ */
+class SessionThreads final : public QObject {
+	Q_OBJECT
+public:
+	/**
+	 * @brief Start the given number of session threads
+	 *
+	 * A non-positive thread count uses one thread per core.
+	 */
+	explicit SessionThreads(int threadCount, QObject *parent = nullptr);
+	~SessionThreads() override;
+
+	int threadCount() const { return m_threads.size(); }
+
+	/**
+	 * @brief Pick the least busy thread for a new session
+	 * @return the context object of the thread
+	 */
+	QObject *acquire();
+
+	//! A session running in the given thread context has ended
+	void release(QObject *context);
+
+	//! Number of sessions running on the given thread
+	int sessionCount(int thread) const { return m_threads[thread].sessions; }
+
+private:
+	struct Thread {
+		QThread *thread;
+		QObject *context;
+		int sessions;
+	};
+
+	QVector<Thread> m_threads;
+};
+
+}
+
+#endif
@@ -331,6 +331,52 @@ private slots:
 		QCOMPARE(lastIdx, 5);
 	}
 
+	// Closed blocks can be read without decoding the messages
+	void testFramedBatch()
+	{
+		QString file = makeTestRecording();
+		std::unique_ptr<FiledHistory> fh{
+			FiledHistory::load(m_dir.absoluteFilePath(file))};
+
+		fh->closeBlock();
+		fh->addMessage(net::makeChatMessage(1, 0, 0, QByteArray("test0")));
+
+		QByteArray framed;
+		int count;
+		long long lastIdx;
+		QVERIFY(fh->getFramedBatch(-1, framed, count, lastIdx));
+		QCOMPARE(count, 3);
+		QCOMPARE(lastIdx, 2LL);
+
+		// The framed bytes are the same as the serialized messages
+		net::MessageList msgs;
+		int batchLast;
+		std::tie(msgs, batchLast) = fh->getBatch(-1);
+		QByteArray expected;
+		for(const net::Message &msg : msgs) {
+			QByteArray buffer;
+			QVERIFY(msg.serialize(buffer));
+			expected.append(buffer);
+		}
+		QCOMPARE(framed, expected);
+
+		// Starting from the middle of a block
+		QVERIFY(fh->getFramedBatch(0, framed, count, lastIdx));
+		QCOMPARE(count, 2);
+		QCOMPARE(lastIdx, 2LL);
+		net::Message msg = net::Message::deserialize(
+			reinterpret_cast<const unsigned char *>(framed.constData()),
+			net::framedMessageLength(framed.constData(), framed.size()),
+			false);
+		QCOMPARE(getChatMessage(msg), QString("test2"));
+
+		// The last block is still open, so it isn't available this way
+		QVERIFY(!fh->getFramedBatch(2, framed, count, lastIdx));
+		std::tie(msgs, batchLast) = fh->getBatch(2);
+		QCOMPARE(msgs.size(), 1);
+		QCOMPARE(batchLast, 3);
+	}
+
 	void testUserLeave()
 	{
 		auto id = Ulid::make().toString();
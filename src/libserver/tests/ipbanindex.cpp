@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libserver/ipbanindex.h"
+
+#include <QHostAddress>
+#include <QtTest/QtTest>
+#include <algorithm>
+
+using server::IpBanIndex;
+
+class TestIpBanIndex final : public QObject {
+	Q_OBJECT
+private slots:
+	void testSubnets()
+	{
+		IpBanIndex index;
+		QVERIFY(index.isEmpty());
+		index.insertSubnet(1, QHostAddress("192.168.1.1"), 0);
+		index.insertSubnet(2, QHostAddress("10.0.0.0"), 8);
+		index.insertSubnet(3, QHostAddress("2001:db8::"), 32);
+		index.insertSubnet(4, QHostAddress("10.1.0.0"), 16);
+		QCOMPARE(index.count(), 4);
+
+		QCOMPARE(lookup(index, "192.168.1.1"), QVector<int>({1}));
+		QCOMPARE(lookup(index, "192.168.1.2"), QVector<int>());
+		QCOMPARE(lookup(index, "10.0.0.2"), QVector<int>({2}));
+		QCOMPARE(lookup(index, "10.1.2.3"), QVector<int>({2, 4}));
+		QCOMPARE(lookup(index, "11.0.0.2"), QVector<int>());
+		QCOMPARE(lookup(index, "2001:db8:1::1"), QVector<int>({3}));
+		QCOMPARE(lookup(index, "2001:db9::1"), QVector<int>());
+		// IPv4-mapped addresses match IPv4 bans.
+		QCOMPARE(lookup(index, "::ffff:10.1.0.1"), QVector<int>({2, 4}));
+		QCOMPARE(lookup(index, QHostAddress()), QVector<int>());
+
+		index.remove(2);
+		QCOMPARE(lookup(index, "10.0.0.2"), QVector<int>());
+		QCOMPARE(lookup(index, "10.1.2.3"), QVector<int>({4}));
+		QCOMPARE(index.count(), 3);
+
+		index.clear();
+		QVERIFY(index.isEmpty());
+		QCOMPARE(lookup(index, "192.168.1.1"), QVector<int>());
+	}
+
+	void testRanges()
+	{
+		IpBanIndex index;
+		index.insertRange(
+			1, QHostAddress("10.0.0.5"), QHostAddress("10.0.1.200"));
+		index.insertRange(
+			2, QHostAddress("2001:db8::ff"), QHostAddress("2001:db8::1:0"));
+		// Backwards ranges don't match anything, like isAddressInRange.
+		index.insertRange(
+			3, QHostAddress("10.0.0.9"), QHostAddress("10.0.0.8"));
+
+		QCOMPARE(lookup(index, "10.0.0.4"), QVector<int>());
+		QCOMPARE(lookup(index, "10.0.0.5"), QVector<int>({1}));
+		QCOMPARE(lookup(index, "10.0.0.255"), QVector<int>({1}));
+		QCOMPARE(lookup(index, "10.0.1.200"), QVector<int>({1}));
+		QCOMPARE(lookup(index, "10.0.1.201"), QVector<int>());
+		QCOMPARE(lookup(index, "2001:db8::fe"), QVector<int>());
+		QCOMPARE(lookup(index, "2001:db8::ff"), QVector<int>({2}));
+		QCOMPARE(lookup(index, "2001:db8::abcd"), QVector<int>({2}));
+		QCOMPARE(lookup(index, "2001:db8::1:0"), QVector<int>({2}));
+		QCOMPARE(lookup(index, "2001:db8::1:1"), QVector<int>());
+
+		index.remove(1);
+		QCOMPARE(lookup(index, "10.0.0.5"), QVector<int>());
+		QCOMPARE(lookup(index, "2001:db8::abcd"), QVector<int>({2}));
+	}
+
+	void testMatchesLinearScan()
+	{
+		// Compare against the same checks the server used to run row by row.
+		IpBanIndex index;
+		QVector<QPair<QHostAddress, QHostAddress>> ranges;
+		quint32 seed = 1;
+		auto next = [&seed]() {
+			seed = seed * 1103515245u + 12345u;
+			return (seed >> 16) & 0x7fffu;
+		};
+		for(int i = 0; i < 200; ++i) {
+			quint32 from = 0x0a000000u | (next() << 4) | (next() & 0xfu);
+			quint32 to = from + next() % 5000u;
+			ranges.append({QHostAddress(from), QHostAddress(to)});
+			index.insertRange(i, ranges.last().first, ranges.last().second);
+		}
+		for(int i = 0; i < 200; i += 3) {
+			index.remove(i);
+		}
+
+		for(int i = 0; i < 5000; ++i) {
+			QHostAddress addr(0x0a000000u | (next() << 4) | (next() & 0xfu));
+			QVector<int> expected;
+			for(int j = 0; j < ranges.size(); ++j) {
+				quint32 a = addr.toIPv4Address();
+				if(j % 3 != 0 && a >= ranges[j].first.toIPv4Address() &&
+				   a <= ranges[j].second.toIPv4Address()) {
+					expected.append(j);
+				}
+			}
+			QCOMPARE(lookup(index, addr), expected);
+		}
+	}
+
+private:
+	static QVector<int> lookup(const IpBanIndex &index, const char *addr)
+	{
+		return lookup(index, QHostAddress(QString::fromUtf8(addr)));
+	}
+
+	static QVector<int>
+	lookup(const IpBanIndex &index, const QHostAddress &addr)
+	{
+		QVector<int> values = index.lookup(addr);
+		std::sort(values.begin(), values.end());
+		values.erase(std::unique(values.begin(), values.end()), values.end());
+		return values;
+	}
+};
+
+
+QTEST_MAIN(TestIpBanIndex)
+#include "ipbanindex.moc"
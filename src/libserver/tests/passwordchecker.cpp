@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libserver/passwordchecker.h"
+#include "libshared/util/passwordhash.h"
+
+#include <QHostAddress>
+#include <QtTest/QtTest>
+#include <memory>
+
+using server::PasswordCheckResult;
+using server::PasswordChecker;
+
+class TestPasswordChecker final : public QObject {
+	Q_OBJECT
+private slots:
+	void testCheck()
+	{
+		PasswordChecker checker(2, 8);
+		QHostAddress address(QStringLiteral("192.0.2.1"));
+		QByteArray hash = passwordhash::hash(
+			QStringLiteral("hunter2"), passwordhash::PLAINTEXT);
+
+		QVector<PasswordCheckResult> results;
+		QObject context;
+		checker.check(
+			address, QStringLiteral("hunter2"), hash, &context,
+			[&](PasswordCheckResult result) {
+				QCOMPARE(QThread::currentThread(), thread());
+				results.append(result);
+			});
+		checker.check(
+			address, QStringLiteral("hunter3"), hash, &context,
+			[&](PasswordCheckResult result) {
+				results.append(result);
+			});
+		QVERIFY(results.isEmpty());
+
+		QTRY_COMPARE(results.size(), 2);
+		QVERIFY(results.contains(PasswordCheckResult::Ok));
+		QVERIFY(results.contains(PasswordCheckResult::Bad));
+		QCOMPARE(checker.inFlight(), 0);
+	}
+
+	void testPerAddressLimit()
+	{
+		PasswordChecker checker(1, 1);
+		QHostAddress address(QStringLiteral("192.0.2.1"));
+		QHostAddress otherAddress(QStringLiteral("2001:db8::1"));
+		QByteArray hash = passwordhash::hash(
+			QStringLiteral("hunter2"), passwordhash::PLAINTEXT);
+
+		int ok = 0;
+		int busy = 0;
+		auto callback = [&](PasswordCheckResult result) {
+			if(result == PasswordCheckResult::Busy) {
+				++busy;
+			} else if(result == PasswordCheckResult::Ok) {
+				++ok;
+			}
+		};
+
+		QObject context;
+		checker.check(address, "hunter2", hash, &context, callback);
+		checker.check(address, "hunter2", hash, &context, callback);
+		checker.check(otherAddress, "hunter2", hash, &context, callback);
+		// The second attempt from the same address is refused immediately.
+		QCOMPARE(busy, 1);
+
+		QTRY_COMPARE(ok, 2);
+		checker.check(address, "hunter2", hash, &context, callback);
+		QTRY_COMPARE(ok, 3);
+		QCOMPARE(busy, 1);
+	}
+
+	void testContextDestroyed()
+	{
+		PasswordChecker checker;
+		QByteArray hash = passwordhash::hash(
+			QStringLiteral("hunter2"), passwordhash::PLAINTEXT);
+
+		bool called = false;
+		std::unique_ptr<QObject> context{new QObject};
+		checker.check(
+			QHostAddress(QStringLiteral("192.0.2.1")), "hunter2", hash,
+			context.get(), [&](PasswordCheckResult) {
+				called = true;
+			});
+		context.reset();
+
+		QTRY_COMPARE(checker.inFlight(), 0);
+		QVERIFY(!called);
+	}
+};
+
+QTEST_MAIN(TestPasswordChecker)
+#include "passwordchecker.moc"
@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpcommon/conversions.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+}
+#include "libserver/servercanvas.h"
+#include <QtTest/QtTest>
+
+using server::ServerCanvas;
+
+class TestServerCanvas final : public QObject {
+	Q_OBJECT
+private slots:
+	void testResetImage()
+	{
+		ServerCanvas canvas;
+		canvas.handleMessages(makeCanvas(1));
+
+		bool done = false;
+		net::MessageList image;
+		canvas.buildResetImage([&](const net::MessageList &result) {
+			done = true;
+			image = result;
+		});
+		QVERIFY(canvas.isBuildingResetImage());
+		// Messages after the request must not end up in the image.
+		canvas.handleMessage(net::Message::noinc(
+			DP_msg_undo_depth_new(1, DP_int_to_uint8(60))));
+		QTRY_VERIFY(done);
+		QVERIFY(!canvas.isBuildingResetImage());
+
+		QVERIFY(!image.isEmpty());
+		QCOMPARE(image.first().type(), DP_MSG_UNDO_DEPTH);
+		QCOMPARE(
+			int(DP_msg_undo_depth_depth(
+				DP_msg_undo_depth_cast(image.first().get()))),
+			45);
+		QCOMPARE(count(image, DP_MSG_CANVAS_RESIZE), 1);
+		QCOMPARE(count(image, DP_MSG_LAYER_TREE_CREATE), 1);
+		QVERIFY(count(image, DP_MSG_PUT_TILE) > 0);
+	}
+
+	void testFiltered()
+	{
+		// User 2 isn't an operator, so it can't resize the canvas.
+		ServerCanvas canvas;
+		net::MessageList msgs = makeCanvas(2);
+		msgs.removeFirst();
+		canvas.handleMessage(
+			net::makeSessionOwnerMessage(0, QVector<uint8_t>({1})));
+		canvas.handleMessages(msgs);
+		net::MessageList image = buildResetImage(canvas);
+		QCOMPARE(count(image, DP_MSG_CANVAS_RESIZE), 0);
+	}
+
+	void testReset()
+	{
+		ServerCanvas canvas;
+		canvas.handleMessages(makeCanvas(1));
+		bool called = false;
+		canvas.buildResetImage([&](const net::MessageList &) {
+			called = true;
+		});
+		canvas.reset();
+		QVERIFY(!canvas.isBuildingResetImage());
+
+		net::MessageList image = buildResetImage(canvas);
+		QVERIFY(!called);
+		QCOMPARE(count(image, DP_MSG_CANVAS_RESIZE), 0);
+		QCOMPARE(count(image, DP_MSG_LAYER_TREE_CREATE), 0);
+	}
+
+	void testResetDuringJob()
+	{
+		// Enough work that the job is still busy with it when resetting.
+		ServerCanvas canvas;
+		canvas.handleMessages(makeCanvas(1));
+		canvas.handleMessages(makeFills(1000));
+		canvas.reset();
+
+		net::MessageList image = buildResetImage(canvas);
+		QCOMPARE(count(image, DP_MSG_CANVAS_RESIZE), 0);
+		QCOMPARE(count(image, DP_MSG_LAYER_TREE_CREATE), 0);
+		QCOMPARE(count(image, DP_MSG_PUT_TILE), 0);
+	}
+
+	void testDestroyDuringJob()
+	{
+		net::MessageList msgs = makeCanvas(1) + makeFills(1000);
+		bool called = false;
+		{
+			ServerCanvas canvas;
+			canvas.handleMessages(msgs);
+			canvas.buildResetImage([&](const net::MessageList &) {
+				called = true;
+			});
+		}
+		QCoreApplication::processEvents();
+		QVERIFY(!called);
+	}
+
+	void testBacklogDrained()
+	{
+		ServerCanvas canvas;
+		canvas.handleMessages(makeCanvas(1));
+		canvas.handleMessages(makeFills(ServerCanvas::MAX_BACKLOG));
+		QSignalSpy spy(&canvas, &ServerCanvas::backlogDrained);
+		canvas.notifyWhenDrained();
+		QTRY_COMPARE(spy.count(), 1);
+		QVERIFY(canvas.backlog() <= ServerCanvas::MAX_BACKLOG / 2);
+
+		// Asking again while idle gets an answer too.
+		buildResetImage(canvas);
+		canvas.notifyWhenDrained();
+		QTRY_COMPARE(spy.count(), 2);
+	}
+
+	void testJobsTakeTurns()
+	{
+		// With a single thread, a canvas with a long backlog must let another
+		// canvas' job run in between instead of working all of it off first.
+		QThreadPool *pool = QThreadPool::globalInstance();
+		int maxThreadCount = pool->maxThreadCount();
+		pool->setMaxThreadCount(1);
+		{
+			ServerCanvas busy;
+			busy.handleMessages(makeCanvas(1));
+			busy.handleMessages(makeFills(ServerCanvas::MAX_BACKLOG * 2));
+			ServerCanvas idle;
+			idle.handleMessages(makeCanvas(1));
+			buildResetImage(idle);
+			QVERIFY(busy.backlog() > 0);
+		}
+		pool->setMaxThreadCount(maxThreadCount);
+	}
+
+private:
+	static net::MessageList makeFills(int count)
+	{
+		net::MessageList msgs;
+		msgs.reserve(count);
+		for(int i = 0; i < count; ++i) {
+			msgs.append(net::Message::noinc(DP_msg_fill_rect_new(
+				1, 0x101, DP_BLEND_MODE_NORMAL, 0, 0, 64, 64,
+				0xff000000u | uint32_t(i))));
+		}
+		return msgs;
+	}
+
+	static net::MessageList makeCanvas(uint8_t owner)
+	{
+		uint16_t layerId = uint16_t((owner << 8) | 1);
+		return {
+			net::makeSessionOwnerMessage(0, QVector<uint8_t>({owner})),
+			net::Message::noinc(DP_msg_canvas_resize_new(owner, 0, 64, 64, 0)),
+			net::Message::noinc(
+				DP_msg_undo_depth_new(owner, DP_int_to_uint8(45))),
+			net::Message::noinc(
+				DP_msg_layer_create_new(owner, layerId, 0, 0, 0, "x", 1)),
+			net::Message::noinc(DP_msg_fill_rect_new(
+				owner, layerId, DP_BLEND_MODE_NORMAL, 0, 0, 32, 32,
+				0xff0000ffu)),
+		};
+	}
+
+	static net::MessageList buildResetImage(ServerCanvas &canvas)
+	{
+		bool done = false;
+		net::MessageList image;
+		canvas.buildResetImage([&](const net::MessageList &result) {
+			done = true;
+			image = result;
+		});
+		[&] {
+			QTRY_VERIFY(done);
+		}();
+		return image;
+	}
+
+	static int count(const net::MessageList &msgs, DP_MessageType type)
+	{
+		int n = 0;
+		for(const net::Message &msg : msgs) {
+			if(msg.type() == type) {
+				++n;
+			}
+		}
+		return n;
+	}
+};
+
+QTEST_MAIN(TestServerCanvas)
+#include "servercanvas.moc"
@@ -0,0 +1,452 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libserver/filedhistory.h"
+#include "libserver/inmemoryconfig.h"
+#include "libserver/session.h"
+#include "libserver/sessionserver.h"
+#include "libserver/sessionthreads.h"
+#include "libserver/thinserverclient.h"
+#include "libshared/net/message.h"
+#include "libshared/net/tcpmessagequeue.h"
+#include "libshared/util/ulid.h"
+
+#include <QElapsedTimer>
+#include <QSet>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using server::SessionThreads;
+
+class TestSessionThreads final : public QObject {
+	Q_OBJECT
+private slots:
+	void testAssignment()
+	{
+		SessionThreads threads(3);
+		QCOMPARE(threads.threadCount(), 3);
+
+		QVector<QObject *> contexts;
+		for(int i = 0; i < 6; ++i) {
+			contexts.append(threads.acquire());
+		}
+		for(int i = 0; i < threads.threadCount(); ++i) {
+			QCOMPARE(threads.sessionCount(i), 2);
+		}
+
+		// A freed up slot is the first to get reused
+		threads.release(contexts[4]);
+		QCOMPARE(threads.acquire(), contexts[4]);
+	}
+
+	void testRunBlocking()
+	{
+		SessionThreads threads(1);
+		QObject *context = threads.acquire();
+
+		QThread *thread = server::runBlocking(context, [] {
+			return QThread::currentThread();
+		});
+		QCOMPARE(thread, context->thread());
+		QVERIFY(thread != QThread::currentThread());
+
+		// Calls in the same thread don't go through the event loop
+		QObject local;
+		QCOMPARE(
+			server::runBlocking(
+				&local,
+				[] {
+					return QThread::currentThread();
+				}),
+			QThread::currentThread());
+	}
+
+	void testThreadedSessions()
+	{
+		QTemporaryDir tempDir;
+		QVERIFY(tempDir.isValid());
+		QDir dir(tempDir.path());
+
+		QStringList ids;
+		for(int i = 0; i < 4; ++i) {
+			QString id = Ulid::make().toString();
+			std::unique_ptr<server::FiledHistory> fh{
+				server::FiledHistory::startNew(
+					dir, id, QString(), protocol::ProtocolVersion::current(),
+					QStringLiteral("founder"))};
+			QVERIFY(fh);
+			ids.append(id);
+		}
+
+		server::InMemoryConfig config;
+		config.logger()->setSilent(true);
+		server::SessionServer sessions(&config);
+		sessions.setSessionThreads(2);
+		sessions.setSessionDir(dir);
+		QCOMPARE(sessions.sessionCount(), 4);
+
+		QSet<QThread *> sessionThreads;
+		QStringList seenIds;
+		for(const QString &id : ids) {
+			server::Session *session = sessions.getSessionById(id, false);
+			QVERIFY(session);
+			sessions.runOnSession(session, [&](server::Session *s) {
+				sessionThreads.insert(QThread::currentThread());
+				seenIds.append(s->id());
+			});
+		}
+		QCOMPARE(seenIds, ids);
+		QCOMPARE(sessionThreads.size(), 2);
+		QVERIFY(!sessionThreads.contains(QThread::currentThread()));
+		QCOMPARE(sessions.sessionDescriptions().size(), 4);
+
+		QSignalSpy ended(&sessions, &server::SessionServer::sessionEnded);
+		sessions.stopAll();
+		QTRY_COMPARE(sessions.sessionCount(), 0);
+		QCOMPARE(ended.size(), 4);
+	}
+
+	// Several sessions, each with a few users connected over real sockets,
+	// all of them chatting at once. Every user must see exactly the messages
+	// of their own session, in the same order as everyone else in it, with
+	// each sender's messages in the order they were sent.
+	void testSessionTraffic_data()
+	{
+		QTest::addColumn<int>("threadCount");
+		QTest::addRow("1 thread") << 1;
+		QTest::addRow("2 threads") << 2;
+		QTest::addRow("4 threads") << 4;
+	}
+
+	void testSessionTraffic()
+	{
+		QFETCH(int, threadCount);
+		const int sessionCount = 4;
+		const int usersPerSession = 3;
+		const int messagesPerUser = 200;
+
+		QTemporaryDir tempDir;
+		QVERIFY(tempDir.isValid());
+		QDir dir(tempDir.path());
+		QStringList ids = makeSessionFiles(dir, sessionCount);
+		QCOMPARE(ids.size(), sessionCount);
+
+		server::InMemoryConfig config;
+		config.logger()->setSilent(true);
+		server::SessionServer sessions(&config);
+		sessions.setSessionThreads(threadCount);
+		sessions.setSessionDir(dir);
+		QCOMPARE(sessions.sessionCount(), sessionCount);
+
+		QTcpServer listener;
+		QVERIFY(listener.listen(QHostAddress::LocalHost));
+
+		QObject owner;
+		std::vector<std::unique_ptr<TrafficUser>> allUsers;
+		QVector<QVector<TrafficUser *>> users(sessionCount);
+		for(int i = 0; i < sessionCount; ++i) {
+			server::Session *session = sessions.getSessionById(ids[i], false);
+			QVERIFY(session);
+			for(int j = 0; j < usersPerSession; ++j) {
+				uint8_t id = uint8_t(j + 1);
+				allUsers.emplace_back(new TrafficUser(id, &owner));
+				TrafficUser *user = allUsers.back().get();
+				user->socket->connectToHost(
+					QHostAddress::LocalHost, listener.serverPort());
+				QVERIFY(user->socket->waitForConnected(5000));
+				QVERIFY(listener.waitForNewConnection(5000));
+				QTcpSocket *serverSocket = listener.nextPendingConnection();
+				QVERIFY(serverSocket);
+
+				server::ThinServerClient *client =
+					new server::ThinServerClient(serverSocket, config.logger());
+				client->setId(id);
+				client->setUsername(QStringLiteral("user%1").arg(id));
+				sessions.joinSession(session, client, false);
+				users[i].append(user);
+			}
+		}
+
+		// Messages sent before the join has gone through would be dropped.
+		for(const QVector<TrafficUser *> &sessionUsers : users) {
+			for(TrafficUser *user : sessionUsers) {
+				QTRY_VERIFY_WITH_TIMEOUT(user->joined, 10000);
+			}
+		}
+
+		// Joined users show up in the listing once their sessions have
+		// published them, without the listing waiting on the session threads.
+		QTRY_COMPARE(
+			sessions
+				.callUserJsonApi(
+					server::JsonApiMethod::Get, QStringList(), QJsonObject())
+				.body.array()
+				.size(),
+			sessionCount * usersPerSession);
+
+		QElapsedTimer timer;
+		timer.start();
+		for(int i = 0; i < sessionCount; ++i) {
+			for(TrafficUser *user : users[i]) {
+				for(int k = 0; k < messagesPerUser; ++k) {
+					user->mq->send(net::makeChatMessage(
+						user->id, 0, 0,
+						QStringLiteral("s%1:%2:%3").arg(i).arg(user->id).arg(k)));
+				}
+			}
+		}
+
+		const int expectedCount = usersPerSession * messagesPerUser;
+		for(const QVector<TrafficUser *> &sessionUsers : users) {
+			for(TrafficUser *user : sessionUsers) {
+				QTRY_VERIFY_WITH_TIMEOUT(
+					user->received.size() >= expectedCount, 60000);
+			}
+		}
+		qint64 elapsed = qMax(qint64(1), timer.elapsed());
+
+		for(int i = 0; i < sessionCount; ++i) {
+			const QStringList &first = users[i].first()->received;
+			QCOMPARE(first.size(), expectedCount);
+			QVector<int> nextBySender(usersPerSession + 1, 0);
+			QString prefix = QStringLiteral("s%1:").arg(i);
+			for(const QString &text : first) {
+				QVERIFY2(text.startsWith(prefix), qPrintable(text));
+				QStringList parts = text.split(QLatin1Char(':'));
+				QCOMPARE(parts.size(), 3);
+				int sender = parts[1].toInt();
+				QVERIFY(sender >= 1 && sender <= usersPerSession);
+				QCOMPARE(parts[2].toInt(), nextBySender[sender]++);
+			}
+			for(TrafficUser *user : users[i]) {
+				QCOMPARE(user->received, first);
+			}
+		}
+
+		qint64 delivered =
+			qint64(sessionCount) * usersPerSession * expectedCount;
+		qInfo(
+			"%d thread(s): %lld messages delivered in %lld ms",
+			threadCount, delivered, elapsed);
+
+		sessions.stopAll();
+		QTRY_COMPARE(sessions.sessionCount(), 0);
+	}
+
+	// Load test: a fixed number of sessions with users connected over real
+	// sockets, each user sending and receiving on a thread of its own so that
+	// the clients don't become the bottleneck. The total amount of work stays
+	// the same, so the throughput should go up with the number of session
+	// threads, as long as there are enough cores to go around.
+	void testThroughput_data()
+	{
+		QTest::addColumn<int>("threadCount");
+		int ideal = qMax(1, QThread::idealThreadCount());
+		for(int threadCount = 1; threadCount < ideal; threadCount *= 2) {
+			QTest::addRow("%d threads", threadCount) << threadCount;
+		}
+		QTest::addRow("%d threads", ideal) << ideal;
+	}
+
+	void testThroughput()
+	{
+		QFETCH(int, threadCount);
+		const int sessionCount = qMax(4, QThread::idealThreadCount());
+		const int usersPerSession = 3;
+		const int messagesPerUser = 200;
+
+		QTemporaryDir tempDir;
+		QVERIFY(tempDir.isValid());
+		QDir dir(tempDir.path());
+		QStringList ids = makeSessionFiles(dir, sessionCount);
+		QCOMPARE(ids.size(), sessionCount);
+
+		server::InMemoryConfig config;
+		config.logger()->setSilent(true);
+		server::SessionServer sessions(&config);
+		sessions.setSessionThreads(threadCount);
+		sessions.setSessionDir(dir);
+		QCOMPARE(sessions.sessionCount(), sessionCount);
+
+		QTcpServer listener;
+		QVERIFY(listener.listen(QHostAddress::LocalHost));
+
+		// The users must outlive their threads, which still refer to them
+		// until they've shut down.
+		std::vector<std::unique_ptr<ThreadedUser>> users;
+		SessionThreads userThreads(sessionCount * usersPerSession);
+		for(int i = 0; i < sessionCount; ++i) {
+			server::Session *session = sessions.getSessionById(ids[i], false);
+			QVERIFY(session);
+			for(int j = 0; j < usersPerSession; ++j) {
+				uint8_t id = uint8_t(j + 1);
+				users.emplace_back(
+					new ThreadedUser(id, userThreads.acquire()));
+				users.back()->connectTo(listener.serverPort());
+				QVERIFY(listener.waitForNewConnection(5000));
+				QTcpSocket *serverSocket = listener.nextPendingConnection();
+				QVERIFY(serverSocket);
+
+				server::ThinServerClient *client =
+					new server::ThinServerClient(serverSocket, config.logger());
+				client->setId(id);
+				client->setUsername(QStringLiteral("user%1").arg(id));
+				sessions.joinSession(session, client, false);
+			}
+		}
+
+		for(const std::unique_ptr<ThreadedUser> &user : users) {
+			QTRY_VERIFY_WITH_TIMEOUT(user->joined.load(), 10000);
+		}
+
+		QElapsedTimer timer;
+		timer.start();
+		for(const std::unique_ptr<ThreadedUser> &user : users) {
+			user->send(messagesPerUser);
+		}
+
+		const int expectedCount = usersPerSession * messagesPerUser;
+		for(const std::unique_ptr<ThreadedUser> &user : users) {
+			QTRY_VERIFY_WITH_TIMEOUT(
+				user->received.load() >= expectedCount, 60000);
+		}
+		qint64 elapsed = qMax(qint64(1), timer.elapsed());
+
+		for(const std::unique_ptr<ThreadedUser> &user : users) {
+			QCOMPARE(user->received.load(), expectedCount);
+		}
+
+		qint64 messages =
+			qint64(sessionCount) * usersPerSession * expectedCount;
+		qInfo(
+			"%d thread(s): %lld messages in %lld ms, %lld messages/s",
+			threadCount, messages, elapsed, messages * 1000 / elapsed);
+
+		sessions.stopAll();
+		QTRY_COMPARE(sessions.sessionCount(), 0);
+	}
+
+private:
+	// The client end of a connection to a session.
+	struct TrafficUser {
+		uint8_t id;
+		QTcpSocket *socket;
+		net::MessageQueue *mq;
+		bool joined = false;
+		QStringList received;
+
+		TrafficUser(uint8_t id_, QObject *parent)
+			: id(id_)
+			, socket(new QTcpSocket(parent))
+			, mq(new net::TcpMessageQueue(socket, true, parent))
+		{
+			QObject::connect(
+				mq, &net::MessageQueue::messageAvailable, parent,
+				[this]() { receive(); });
+		}
+
+		void receive()
+		{
+			while(mq->isPending()) {
+				net::Message msg = mq->shiftPending();
+				if(msg.type() == DP_MSG_JOIN && msg.contextId() == id) {
+					joined = true;
+				} else if(msg.type() == DP_MSG_CHAT) {
+					size_t len;
+					const char *text =
+						DP_msg_chat_message(msg.toChat(), &len);
+					QString s = QString::fromUtf8(text, int(len));
+					if(s.startsWith(QLatin1Char('s'))) {
+						received.append(s);
+					}
+				}
+			}
+		}
+	};
+
+	// The client end of a connection, running in the thread of the given
+	// context object. Other threads only look at the counters.
+	struct ThreadedUser {
+		uint8_t id;
+		QObject *context;
+		net::MessageQueue *mq = nullptr;
+		std::atomic<bool> joined{false};
+		std::atomic<int> received{0};
+
+		ThreadedUser(uint8_t id_, QObject *context_)
+			: id(id_)
+			, context(context_)
+		{
+		}
+
+		void connectTo(quint16 port)
+		{
+			server::runBlocking(context, [this, port]() {
+				QTcpSocket *socket = new QTcpSocket(context);
+				mq = new net::TcpMessageQueue(socket, true, context);
+				QObject::connect(
+					mq, &net::MessageQueue::messageAvailable, context,
+					[this]() { receive(); });
+				socket->connectToHost(QHostAddress::LocalHost, port);
+			});
+		}
+
+		void send(int count)
+		{
+			QMetaObject::invokeMethod(
+				context,
+				[this, count]() {
+					for(int k = 0; k < count; ++k) {
+						mq->send(net::makeChatMessage(
+							id, 0, 0, QStringLiteral("t%1").arg(k)));
+					}
+				},
+				Qt::QueuedConnection);
+		}
+
+		void receive()
+		{
+			while(mq->isPending()) {
+				net::Message msg = mq->shiftPending();
+				if(msg.type() == DP_MSG_JOIN && msg.contextId() == id) {
+					joined = true;
+				} else if(msg.type() == DP_MSG_CHAT) {
+					size_t len;
+					const char *text =
+						DP_msg_chat_message(msg.toChat(), &len);
+					if(len != 0 && text[0] == 't') {
+						++received;
+					}
+				}
+			}
+		}
+	};
+
+	// Session files with some history in them, so that they're loaded in
+	// the running state and don't wait for an initializing user.
+	static QStringList makeSessionFiles(const QDir &dir, int count)
+	{
+		QStringList ids;
+		for(int i = 0; i < count; ++i) {
+			QString id = Ulid::make().toString();
+			std::unique_ptr<server::FiledHistory> fh{
+				server::FiledHistory::startNew(
+					dir, id, QString(), protocol::ProtocolVersion::current(),
+					QStringLiteral("founder"))};
+			if(!fh) {
+				return QStringList();
+			}
+			fh->addMessage(
+				net::makeChatMessage(1, 0, 0, QStringLiteral("init")));
+			ids.append(id);
+		}
+		return ids;
+	}
+};
+
+QTEST_MAIN(TestSessionThreads)
+#include "sessionthreads.moc"
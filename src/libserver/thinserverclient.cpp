@@ -42,11 +42,23 @@ void ThinServerClient::sendNextHistoryBatch()
 		// history position of all clients, so don't touch it before this point!
 		s->resolvePendingStreamedReset();
 
-		net::MessageList batch;
+		// Stored history can be sent as-is, without decoding the messages.
+		QByteArray framed;
+		int framedCount;
 		long long batchLast;
-		std::tie(batch, batchLast) = s->history()->getBatch(m_historyPosition);
-		m_historyPosition = batchLast;
-		mq->sendMultiple(batch.size(), batch.constData());
+		if(s->history()->getFramedBatch(
+			   m_historyPosition, framed, framedCount, batchLast)) {
+			m_historyPosition = batchLast;
+			mq->sendFramed(framed, framedCount);
+		} else {
+			net::MessageList batch;
+			std::tie(batch, batchLast) =
+				s->history()->getBatch(m_historyPosition);
+			m_historyPosition = batchLast;
+			net::EncodedMessageList encoded =
+				s->encodeHistoryBatch(batch, batchLast);
+			mq->sendEncodedMultiple(encoded.size(), encoded.constData());
+		}
 
 		s->cleanupHistoryCache();
 	}
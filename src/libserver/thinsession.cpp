@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "libserver/thinsession.h"
+#include "libserver/servercanvas.h"
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
 #include "libserver/thinserverclient.h"
@@ -26,6 +27,14 @@ ThinSession::ThinSession(
 	connect(
 		m_autoResetTimer, &QTimer::timeout, this,
 		&ThinSession::triggerAutoReset);
+
+	if(config->getConfigBool(config::ServerSideAutoreset)) {
+		m_serverCanvas = new ServerCanvas(this);
+		connect(
+			m_serverCanvas, &ServerCanvas::backlogDrained, this,
+			&ThinSession::feedServerCanvas);
+		rebuildServerCanvas();
+	}
 }
 
 void ThinSession::addToHistory(const net::Message &msg)
@@ -43,6 +52,9 @@ void ThinSession::addToHistory(const net::Message &msg)
 		// like that, so it's not worth putting immense effort into handling it.
 		net::Message em = msg.asEmergencyMessage();
 		if(!em.isNull() && history()->addEmergencyMessage(em)) {
+			if(m_serverCanvas) {
+				handToServerCanvas(em);
+			}
 			addedToHistory(em);
 		} else if(msg.isServerMeta()) {
 			directToAll(msg);
@@ -74,6 +86,10 @@ void ThinSession::addToHistory(const net::Message &msg)
 		}
 	}
 
+	if(m_serverCanvas) {
+		handToServerCanvas(msg);
+	}
+
 	addedToHistory(msg);
 	checkAutoResetQuery();
 
@@ -83,6 +99,26 @@ void ThinSession::addToHistory(const net::Message &msg)
 	}
 }
 
+net::EncodedMessageList ThinSession::encodeHistoryBatch(
+	const net::MessageList &batch, long long batchLast)
+{
+	int count = batch.size();
+	long long batchFirst = batchLast - count + 1LL;
+	net::EncodedMessageList encoded;
+	encoded.reserve(count);
+	for(int i = 0; i < count; ++i) {
+		const net::Message &msg = batch[i];
+		net::EncodedMessage &em = m_encodedHistory[batchFirst + i];
+		// The history may have handed out a different message object for the
+		// same index, e.g. because it reloaded a block from disk.
+		if(em.isNull() || em.message().get() != msg.get()) {
+			em = net::EncodedMessage(msg);
+		}
+		encoded.append(em);
+	}
+	return encoded;
+}
+
 void ThinSession::cleanupHistoryCache()
 {
 	long long minIdx = history()->lastIndex();
@@ -92,6 +128,12 @@ void ThinSession::cleanupHistoryCache()
 			minIdx);
 	}
 	history()->cleanupBatches(minIdx);
+
+	QMap<long long, net::EncodedMessage>::iterator it =
+		m_encodedHistory.begin();
+	while(it != m_encodedHistory.end() && it.key() <= minIdx) {
+		it = m_encodedHistory.erase(it);
+	}
 }
 
 void ThinSession::readyToAutoReset(
@@ -469,6 +511,9 @@ void ThinSession::onSessionInitialized()
 void ThinSession::onSessionReset()
 {
 	clearAutoReset();
+	if(m_serverCanvas) {
+		rebuildServerCanvas();
+	}
 	directToAll(net::ServerReply::makeCatchup(
 		history()->lastIndex() - history()->firstIndex(), 0));
 	sendStatusUpdate();
@@ -632,6 +677,12 @@ void ThinSession::checkAutoResetQuery()
 						history()->autoResetThreshold()))
 					.arg(locale.formattedDataSize(autoResetThreshold))));
 
+	// With a canvas on the server, there's no need to ask any client.
+	if(m_serverCanvas) {
+		startServerSideAutoReset();
+		return;
+	}
+
 	// Legacy alert for Drawpile 2.0.x versions
 	directToAll(net::ServerReply::makeSizeLimitWarning(
 		int(history()->sizeInBytes()), int(autoResetThreshold)));
@@ -659,6 +710,149 @@ void ThinSession::checkAutoResetQuery()
 	m_autoResetTimer->start(AUTORESET_RESPONSE_DELAY_MSECS);
 }
 
+void ThinSession::startServerSideAutoReset()
+{
+	// The reset image must contain everything up to the soft reset, so the
+	// canvas has to have caught up with the history before starting.
+	feedServerCanvas();
+	if(m_serverCanvasIndex < history()->lastIndex()) {
+		log(Log()
+				.about(Log::Level::Info, Log::Topic::Status)
+				.message(QStringLiteral("Server-side autoreset delayed, "
+										"canvas is still catching up")));
+		clearAutoReset(AUTORESET_FAILURE_RETRY_MSECS);
+		return;
+	}
+
+	m_autoResetPayload = generateAutoResetPayload();
+	StreamResetStartResult result = history()->startStreamedReset(
+		0, m_autoResetPayload, serverSideStateMessages());
+
+	// The soft reset goes into the history even if opening the stream fails,
+	// the canvas has to follow along so that undos still line up. The reset
+	// stream start that comes after it has nothing to do with the canvas.
+	if(result != StreamResetStartResult::AlreadyActive &&
+	   result != StreamResetStartResult::OutOfSpace) {
+		m_serverCanvas->handleMessage(net::makeSoftResetMessage(0));
+		m_serverCanvasIndex = history()->lastIndex();
+	}
+
+	if(result != StreamResetStartResult::Ok) {
+		log(Log()
+				.about(Log::Level::Warn, Log::Topic::Status)
+				.message(QStringLiteral(
+							 "Server-side autoreset failed to start, error %1")
+							 .arg(int(result))));
+		clearAutoReset(AUTORESET_FAILURE_RETRY_MSECS);
+		return;
+	}
+
+	log(Log()
+			.about(Log::Level::Info, Log::Topic::Status)
+			.message(QStringLiteral("Started server-side autoreset")));
+	m_autoResetRequestStatus = AutoResetState::ServerSide;
+	QString payload = m_autoResetPayload;
+	m_serverCanvas->buildResetImage(
+		[this, payload](const net::MessageList &image) {
+			finishServerSideAutoReset(payload, image);
+		});
+}
+
+void ThinSession::finishServerSideAutoReset(
+	const QString &payload, const net::MessageList &image)
+{
+	// If the autoreset got cleared in the meantime, the stream is gone too.
+	if(m_autoResetRequestStatus != AutoResetState::ServerSide ||
+	   payload != m_autoResetPayload) {
+		return;
+	}
+
+	if(image.isEmpty()) {
+		log(Log()
+				.about(Log::Level::Warn, Log::Topic::Status)
+				.message(QStringLiteral(
+					"Server-side autoreset failed to build reset image")));
+		clearAutoReset(AUTORESET_FAILURE_RETRY_MSECS);
+		return;
+	}
+
+	StreamResetAddResult addResult = history()->addStreamResetImage(0, image);
+	if(addResult != StreamResetAddResult::Ok) {
+		log(Log()
+				.about(Log::Level::Warn, Log::Topic::Status)
+				.message(QStringLiteral("Server-side autoreset failed to add "
+										"reset image, error %1")
+							 .arg(int(addResult))));
+		clearAutoReset(AUTORESET_FAILURE_RETRY_MSECS);
+		return;
+	}
+
+	StreamResetPrepareResult prepareResult = history()->prepareStreamedReset(
+		0, history()->resetStreamMessageCount());
+	if(prepareResult != StreamResetPrepareResult::Ok) {
+		log(Log()
+				.about(Log::Level::Warn, Log::Topic::Status)
+				.message(QStringLiteral("Server-side autoreset failed to "
+										"prepare reset image, error %1")
+							 .arg(int(prepareResult))));
+		clearAutoReset(AUTORESET_FAILURE_RETRY_MSECS);
+		return;
+	}
+
+	log(Log()
+			.about(Log::Level::Info, Log::Topic::Status)
+			.message(QStringLiteral(
+						 "Prepared server-side autoreset with %1 messages")
+						 .arg(image.size())));
+	resolvePendingStreamedReset();
+}
+
+void ThinSession::rebuildServerCanvas()
+{
+	m_serverCanvas->reset();
+	m_serverCanvasIndex = history()->firstIndex() - 1LL;
+	feedServerCanvas();
+}
+
+void ThinSession::handToServerCanvas(const net::Message &msg)
+{
+	// The message was just added to the end of the history. If the canvas is
+	// caught up and keeping up, it gets it directly, otherwise it continues
+	// from the history once it has room again.
+	long long lastIndex = history()->lastIndex();
+	if(m_serverCanvasIndex == lastIndex - 1LL &&
+	   m_serverCanvas->backlog() < ServerCanvas::MAX_BACKLOG) {
+		m_serverCanvas->handleMessage(msg);
+		m_serverCanvasIndex = lastIndex;
+	} else {
+		feedServerCanvas();
+	}
+}
+
+void ThinSession::feedServerCanvas()
+{
+	SessionHistory *hist = history();
+	bool fed = false;
+	while(m_serverCanvasIndex < hist->lastIndex()) {
+		if(m_serverCanvas->backlog() >= ServerCanvas::MAX_BACKLOG) {
+			m_serverCanvas->notifyWhenDrained();
+			break;
+		}
+		net::MessageList batch;
+		long long batchLast;
+		std::tie(batch, batchLast) = hist->getBatch(m_serverCanvasIndex);
+		if(batch.isEmpty()) {
+			break;
+		}
+		m_serverCanvas->handleMessages(batch);
+		m_serverCanvasIndex = batchLast;
+		fed = true;
+	}
+	if(fed) {
+		cleanupHistoryCache();
+	}
+}
+
 QString ThinSession::generateAutoResetPayload()
 {
 	static uint32_t autoResetIndex;
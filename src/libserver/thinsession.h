@@ -2,12 +2,16 @@
 #ifndef DP_SERVER_THINSESSION_H
 #define DP_SERVER_THINSESSION_H
 #include "libserver/session.h"
+#include "libshared/net/encodedmessage.h"
 #include <QDeadlineTimer>
+#include <QMap>
 
 class QTimer;
 
 namespace server {
 
+class ServerCanvas;
+
 /**
  * The (thin) serverside session state.
  */
@@ -32,6 +36,16 @@ public:
 
 	void resolvePendingStreamedReset();
 
+	/**
+	 * @brief Get a batch of history messages in encoded form
+	 *
+	 * Encoded messages are cached until every client has caught up past them,
+	 * so all clients share the same serialized buffers instead of each one
+	 * encoding the history anew.
+	 */
+	net::EncodedMessageList
+	encodeHistoryBatch(const net::MessageList &batch, long long batchLast);
+
 	void cleanupHistoryCache();
 
 	bool supportsAutoReset() const override { return true; }
@@ -54,7 +68,13 @@ private:
 	// After an autoreset failed, wait 30 seconds before trying again.
 	static constexpr int AUTORESET_FAILURE_RETRY_MSECS = 30000;
 
-	enum class AutoResetState { NotSent, Queried, QueriedWaiting, Requested };
+	enum class AutoResetState {
+		NotSent,
+		Queried,
+		QueriedWaiting,
+		Requested,
+		ServerSide,
+	};
 
 	struct AutoResetCandidate {
 		int responseRank;
@@ -71,6 +91,12 @@ private:
 	void resetLastStatusUpdate() { m_lastStatusUpdate.setRemainingTime(10000); }
 
 	void checkAutoResetQuery();
+	void startServerSideAutoReset();
+	void finishServerSideAutoReset(
+		const QString &payload, const net::MessageList &image);
+	void rebuildServerCanvas();
+	void handToServerCanvas(const net::Message &msg);
+	void feedServerCanvas();
 	static QString generateAutoResetPayload();
 	void triggerAutoReset();
 	void invalidateAutoResetCandidate(int ctxId);
@@ -85,6 +111,12 @@ private:
 	QTimer *m_autoResetTimer;
 	QString m_autoResetPayload;
 	QVector<AutoResetCandidate> m_autoResetCandidates;
+	QMap<long long, net::EncodedMessage> m_encodedHistory;
+	// Only present if server-side autoresets are enabled.
+	ServerCanvas *m_serverCanvas = nullptr;
+	// History index of the last message handed to the server canvas. If it's
+	// behind the history, the canvas is catching up from there.
+	long long m_serverCanvasIndex = 0;
 };
 
 }
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "libshared/net/encodedmessage.h"
+#include <QtGlobal>
+
+namespace net {
+
+EncodedMessage::EncodedMessage() {}
+
+EncodedMessage::EncodedMessage(const Message &msg)
+	: d(new Data{msg, QByteArray(), QByteArray(), false, false})
+{
+}
+
+const Message &EncodedMessage::message() const
+{
+	Q_ASSERT(d);
+	return d->msg;
+}
+
+QByteArray EncodedMessage::serialized() const
+{
+	Q_ASSERT(d);
+	if(!d->haveSerialized) {
+		d->haveSerialized = true;
+		if(!d->msg.serialize(d->serialized)) {
+			qWarning("Error serializing message: %s", DP_error());
+			d->serialized.clear();
+		}
+	}
+	return d->serialized;
+}
+
+QByteArray EncodedMessage::serializedWs() const
+{
+	Q_ASSERT(d);
+	if(!d->haveSerializedWs) {
+		d->haveSerializedWs = true;
+		if(!d->msg.serializeWs(d->serializedWs)) {
+			qWarning("Error serializing message: %s", DP_error());
+			d->serializedWs.clear();
+		}
+	}
+	return d->serializedWs;
+}
+
+}
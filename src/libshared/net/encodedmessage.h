@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef LIBSHARED_NET_ENCODEDMESSAGE_H
+#define LIBSHARED_NET_ENCODEDMESSAGE_H
+#include "libshared/net/message.h"
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QVector>
+
+namespace net {
+
+using EncodedMessageList = QVector<class EncodedMessage>;
+
+/**
+ * A message together with its serialized forms.
+ *
+ * The TCP and WebSocket serializations are generated lazily the first time
+ * they are requested. Copies of an encoded message share them, so a message
+ * that's sent to many clients only gets encoded once per transport and all of
+ * their upload queues point into the same buffer.
+ *
+ * Not thread-safe, an encoded message and its copies must only be used from
+ * a single thread at a time.
+ */
+class EncodedMessage final {
+public:
+	EncodedMessage();
+	explicit EncodedMessage(const Message &msg);
+
+	bool isNull() const { return !d; }
+
+	const Message &message() const;
+
+	/**
+	 * @brief Get the message serialized for a TCP connection
+	 *
+	 * Returns an empty byte array if serialization failed.
+	 */
+	QByteArray serialized() const;
+
+	/**
+	 * @brief Get the message serialized for a WebSocket connection
+	 *
+	 * Returns an empty byte array if serialization failed.
+	 */
+	QByteArray serializedWs() const;
+
+private:
+	struct Data {
+		Message msg;
+		QByteArray serialized;
+		QByteArray serializedWs;
+		bool haveSerialized;
+		bool haveSerializedWs;
+	};
+
+	QSharedPointer<Data> d;
+};
+
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include <QByteArray>
 #include <QJsonDocument>
 #include <QString>
+#include <QtEndian>
 
 namespace net {
 
@@ -355,6 +356,17 @@ unsigned char *Message::getDeserializeBuffer(void *user, size_t size)
 }
 
 
+int framedMessageLength(const char *buf, int bufsize)
+{
+	if(bufsize >= DP_MESSAGE_HEADER_LENGTH) {
+		int length = DP_MESSAGE_HEADER_LENGTH + qFromBigEndian<quint16>(buf);
+		if(length <= bufsize) {
+			return length;
+		}
+	}
+	return 0;
+}
+
 Message makeChatMessage(
 	uint8_t contextId, uint8_t tflags, uint8_t oflags, const QString &message)
 {
@@ -101,6 +101,10 @@ private:
 	DP_Message *m_data;
 };
 
+// Length of the TCP-framed message at the start of the buffer, including its
+// header, or 0 if the buffer doesn't contain a whole message.
+int framedMessageLength(const char *buf, int bufsize);
+
 Message makeChatMessage(
 	uint8_t contextId, uint8_t tflags, uint8_t oflags, const QString &message);
 
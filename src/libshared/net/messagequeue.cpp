@@ -18,6 +18,7 @@ MessageQueue::MessageQueue(bool decodeOpaque, QObject *parent)
 	, m_smoothTimer(nullptr)
 	, m_smoothMessagesToDrain(INT_MAX)
 	, m_contextId(0)
+	, m_writeBatchSize(DEFAULT_WRITE_BATCH_SIZE)
 	, m_pingTimer(nullptr)
 	, m_idleTimeout(0)
 	, m_keepAliveTimeout(0)
@@ -63,6 +64,11 @@ void MessageQueue::setKeepAliveTimeout(qint64 timeout)
 	resetKeepAliveTimer();
 }
 
+void MessageQueue::setWriteBatchSize(int writeBatchSize)
+{
+	m_writeBatchSize = qMax(0, writeBatchSize);
+}
+
 void MessageQueue::setSmoothEnabled(bool enabled)
 {
 	m_smoothEnabled = enabled;
@@ -158,6 +164,58 @@ void MessageQueue::sendMultiple(int count, const net::Message *msgs)
 	}
 }
 
+void MessageQueue::sendEncoded(const net::EncodedMessage &msg)
+{
+	sendEncodedMultiple(1, &msg);
+}
+
+void MessageQueue::sendEncodedMultiple(
+	int count, const net::EncodedMessage *msgs)
+{
+	if(m_artificialLagMs == 0) {
+		if(!m_gracefullyDisconnecting) {
+			resetKeepAliveTimer();
+			enqueueEncodedMessages(count, msgs);
+		}
+	} else {
+		// Artificial lag is only for development, not worth sharing buffers.
+		net::MessageList plainMsgs;
+		plainMsgs.reserve(count);
+		for(int i = 0; i < count; ++i) {
+			plainMsgs.append(msgs[i].message());
+		}
+		sendMultiple(count, plainMsgs.constData());
+	}
+}
+
+void MessageQueue::sendFramed(const QByteArray &data, int count)
+{
+	if(m_artificialLagMs == 0) {
+		if(!m_gracefullyDisconnecting) {
+			resetKeepAliveTimer();
+			enqueueFramedMessages(data, count);
+		}
+	} else {
+		net::MessageList plainMsgs;
+		plainMsgs.reserve(count);
+		int pos = 0;
+		int len;
+		while((len = net::framedMessageLength(
+				   data.constData() + pos, data.size() - pos)) != 0) {
+			net::Message msg = net::Message::deserialize(
+				reinterpret_cast<const unsigned char *>(data.constData()) + pos,
+				len, m_decodeOpaque);
+			if(msg.isNull()) {
+				qWarning("Error deserializing message: %s", DP_error());
+			} else {
+				plainMsgs.append(msg);
+			}
+			pos += len;
+		}
+		sendMultiple(plainMsgs.size(), plainMsgs.constData());
+	}
+}
+
 void MessageQueue::receiveSmoothedMessages()
 {
 	int count = m_smoothBuffer.size();
@@ -281,6 +339,13 @@ void MessageQueue::resetKeepAliveTimer()
 	resetDeadlineTimer(m_keepAliveTimer, m_keepAliveTimeout);
 }
 
+void MessageQueue::recordWrite(int messageCount, qint64 bytes)
+{
+	++m_writeStats.writes;
+	m_writeStats.messages += messageCount;
+	m_writeStats.bytes += bytes;
+}
+
 void MessageQueue::handlePing(bool isPong)
 {
 	if(!m_gracefullyDisconnecting) {
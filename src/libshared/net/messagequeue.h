@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #ifndef LIBSHARED_NET_MESSAGEQUEUE_H
 #define LIBSHARED_NET_MESSAGEQUEUE_H
+#include "libshared/net/encodedmessage.h"
 #include "libshared/net/message.h"
 #include <QAbstractSocket>
 #include <QDeadlineTimer>
@@ -20,6 +21,23 @@ class MessageQueue : public QObject {
 public:
 	static constexpr int DEFAULT_SMOOTH_DRAIN_RATE = 20;
 	static constexpr int MAX_SMOOTH_DRAIN_RATE = 60;
+	static constexpr int DEFAULT_WRITE_BATCH_SIZE = 64 * 1024;
+
+	struct WriteStats {
+		long long writes = 0;
+		long long messages = 0;
+		long long bytes = 0;
+
+		double messagesPerWrite() const
+		{
+			return writes == 0 ? 0.0 : double(messages) / double(writes);
+		}
+
+		double bytesPerWrite() const
+		{
+			return writes == 0 ? 0.0 : double(bytes) / double(writes);
+		}
+	};
 
 	enum class GracefulDisconnect {
 		Error,	  // An error occurred
@@ -53,6 +71,24 @@ public:
 	 */
 	void sendMultiple(int count, const net::Message *msgs);
 
+	/**
+	 * Enqueue a single pre-encoded message for sending. Use this when sending
+	 * the same message to multiple queues, since its serialization is shared.
+	 */
+	void sendEncoded(const net::EncodedMessage &msg);
+
+	/**
+	 * Enqueue multiple pre-encoded messages for sending.
+	 */
+	void sendEncodedMultiple(int count, const net::EncodedMessage *msgs);
+
+	/**
+	 * Enqueue a run of messages that are already serialized with the TCP
+	 * framing, such as a stretch of a session recording, without decoding
+	 * them. The data must contain exactly the given number of messages.
+	 */
+	void sendFramed(const QByteArray &data, int count);
+
 	/**
 	 * @brief Gracefully disconnect
 	 *
@@ -101,6 +137,22 @@ public:
 
 	void setKeepAliveTimeout(qint64 timeout);
 
+	/**
+	 * @brief Set how many bytes of queued messages may go into a single write
+	 *
+	 * Packing many small messages into one write avoids making lots of tiny
+	 * writes during catchup. A single message is always written whole, even
+	 * if it's larger than this. Zero means every message is written on its
+	 * own. Only has an effect on TCP connections, WebSockets always send one
+	 * message per frame.
+	 */
+	void setWriteBatchSize(int writeBatchSize);
+
+	/**
+	 * @brief Get statistics about socket writes made by this queue
+	 */
+	const WriteStats &writeStats() const { return m_writeStats; }
+
 	void setSmoothEnabled(bool smoothingEnabled);
 	void setSmoothDrainRate(int smoothDrainRate);
 
@@ -176,6 +228,9 @@ protected:
 	static constexpr int MSG_TYPE_KEEP_ALIVE = 2;
 
 	virtual void enqueueMessages(int count, const net::Message *msgs) = 0;
+	virtual void
+	enqueueEncodedMessages(int count, const net::EncodedMessage *msgs) = 0;
+	virtual void enqueueFramedMessages(const QByteArray &data, int count) = 0;
 	virtual void enqueuePing(bool pong) = 0;
 
 	virtual QAbstractSocket::SocketState getSocketState() = 0;
@@ -185,6 +240,8 @@ protected:
 
 	void handlePing(bool isPong);
 
+	void recordWrite(int messageCount, qint64 bytes);
+
 	bool m_decodeOpaque;
 	net::MessageList m_inbox; // received (complete) messages
 	bool m_gracefullyDisconnecting;
@@ -197,6 +254,7 @@ protected:
 	net::MessageList m_smoothBuffer;
 	int m_smoothMessagesToDrain;
 	unsigned int m_contextId;
+	int m_writeBatchSize;
 
 private slots:
 	void checkIdleTimeout();
@@ -231,6 +289,8 @@ private:
 	QVector<long long> m_artificialLagTimes;
 	QVector<net::Message> m_artificialLagMessages;
 	QTimer *m_artificialLagTimer;
+
+	WriteStats m_writeStats;
 };
 
 }
@@ -1,6 +1,5 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "libshared/net/tcpmessagequeue.h"
-#include "libshared/util/qtcompat.h"
 #include <QDateTime>
 #include <QTcpSocket>
 #include <QTimer>
@@ -16,6 +15,7 @@ TcpMessageQueue::TcpMessageQueue(
 	m_recvbuffer = new char[MAX_BUF_LEN];
 	m_recvbytes = 0;
 	m_sentbytes = 0;
+	m_sendbufferMessages = 0;
 
 	connect(socket, &QTcpSocket::readyRead, this, &TcpMessageQueue::readData);
 	connect(
@@ -34,8 +34,8 @@ TcpMessageQueue::~TcpMessageQueue()
 int TcpMessageQueue::uploadQueueBytes() const
 {
 	int total = m_socket->bytesToWrite() + m_sendbuffer.length() - m_sentbytes;
-	for(const net::Message &msg : m_outbox) {
-		total += compat::castSize(msg.length());
+	for(const Outgoing &out : m_outbox) {
+		total += out.data.length();
 	}
 	total +=
 		m_pings.size() * (DP_MESSAGE_HEADER_LENGTH + DP_MSG_PING_STATIC_LENGTH);
@@ -50,13 +50,44 @@ bool TcpMessageQueue::isUploading() const
 void TcpMessageQueue::enqueueMessages(int count, const net::Message *msgs)
 {
 	for(int i = 0; i < count; ++i) {
-		m_outbox.enqueue(msgs[i]);
+		QByteArray buffer;
+		if(msgs[i].serialize(buffer)) {
+			m_outbox.enqueue({buffer, 1});
+		} else {
+			qWarning("Error serializing message: %s", DP_error());
+		}
 	}
 	if(m_sendbuffer.isEmpty()) {
 		writeData();
 	}
 }
 
+void TcpMessageQueue::enqueueEncodedMessages(
+	int count, const net::EncodedMessage *msgs)
+{
+	for(int i = 0; i < count; ++i) {
+		// Shares the buffer with every other queue sending this message.
+		QByteArray buffer = msgs[i].serialized();
+		if(!buffer.isEmpty()) {
+			m_outbox.enqueue({buffer, 1});
+		}
+	}
+	if(m_sendbuffer.isEmpty()) {
+		writeData();
+	}
+}
+
+void TcpMessageQueue::enqueueFramedMessages(const QByteArray &data, int count)
+{
+	// Already in wire format, so it goes out as-is.
+	if(!data.isEmpty()) {
+		m_outbox.enqueue({data, count});
+		if(m_sendbuffer.isEmpty()) {
+			writeData();
+		}
+	}
+}
+
 void TcpMessageQueue::enqueuePing(bool pong)
 {
 	m_pings.enqueue(pong);
@@ -260,8 +291,8 @@ void TcpMessageQueue::writeData()
 		if(m_sendbuffer.isEmpty() && messagesInOutbox()) {
 			// Upload buffer is empty, but there are messages in the outbox
 			Q_ASSERT(m_sentbytes == 0);
-			if(!dequeueFromOutbox().serialize(m_sendbuffer)) {
-				qWarning("Error serializing message: %s", DP_error());
+			fillSendBuffer();
+			if(m_sendbuffer.isEmpty()) {
 				sendMore = messagesInOutbox();
 				continue;
 			}
@@ -275,6 +306,7 @@ void TcpMessageQueue::writeData()
 				emit writeError();
 				return;
 			}
+			recordWrite(m_sentbytes == 0 ? m_sendbufferMessages : 0, sent);
 			m_sentbytes += sent;
 			sentBatch += sent;
 
@@ -284,23 +316,55 @@ void TcpMessageQueue::writeData()
 				// Complete envelope sent
 				m_sendbuffer.clear();
 				m_sentbytes = 0;
+				m_sendbufferMessages = 0;
 				sendMore = messagesInOutbox();
 			}
 		}
 	}
 }
 
+void TcpMessageQueue::fillSendBuffer()
+{
+	// The first message is taken as-is, so if nothing else fits, its buffer
+	// doesn't get copied and stays shared with other queues sending it.
+	Outgoing first = dequeueFromOutbox();
+	m_sendbuffer = first.data;
+	m_sendbufferMessages = first.messages;
+	while(messagesInOutbox() &&
+		  m_sendbuffer.length() + nextOutboxLength() <= m_writeBatchSize) {
+		Outgoing next = dequeueFromOutbox();
+		if(!next.data.isEmpty()) {
+			m_sendbuffer.append(next.data);
+			m_sendbufferMessages += next.messages;
+		}
+	}
+}
+
 bool TcpMessageQueue::messagesInOutbox() const
 {
 	return !m_outbox.isEmpty() || !m_pings.isEmpty();
 }
 
-net::Message TcpMessageQueue::dequeueFromOutbox()
+int TcpMessageQueue::nextOutboxLength() const
+{
+	if(m_pings.isEmpty()) {
+		return m_outbox.head().data.length();
+	} else {
+		return DP_MESSAGE_HEADER_LENGTH + DP_MSG_PING_STATIC_LENGTH;
+	}
+}
+
+TcpMessageQueue::Outgoing TcpMessageQueue::dequeueFromOutbox()
 {
 	if(m_pings.isEmpty()) {
 		return m_outbox.dequeue();
 	} else {
-		return net::makePingMessage(0, m_pings.dequeue());
+		QByteArray buffer;
+		if(!net::makePingMessage(0, m_pings.dequeue()).serialize(buffer)) {
+			qWarning("Error serializing ping: %s", DP_error());
+			return {QByteArray(), 0};
+		}
+		return {buffer, 1};
 	}
 }
 
@@ -21,6 +21,9 @@ public:
 
 protected:
 	void enqueueMessages(int count, const net::Message *msgs) override;
+	void enqueueEncodedMessages(
+		int count, const net::EncodedMessage *msgs) override;
+	void enqueueFramedMessages(const QByteArray &data, int count) override;
 	void enqueuePing(bool pong) override;
 
 	QAbstractSocket::SocketState getSocketState() override;
@@ -34,22 +37,30 @@ private slots:
 private:
 	static constexpr int MAX_BUF_LEN = 0xffff + DP_MESSAGE_HEADER_LENGTH;
 
+	struct Outgoing {
+		QByteArray data;
+		int messages;
+	};
+
 	void afterDisconnectSent() override;
 
 	int haveWholeMessageToRead();
 
 	void writeData();
+	void fillSendBuffer();
 
 	bool messagesInOutbox() const;
-	net::Message dequeueFromOutbox();
+	int nextOutboxLength() const;
+	Outgoing dequeueFromOutbox();
 
 	QTcpSocket *m_socket;
 	char *m_recvbuffer;		 // raw message reception buffer
 	QByteArray m_sendbuffer; // raw message upload buffer
 	int m_recvbytes;		 // number of bytes in reception buffer
 	int m_sentbytes;		 // number of bytes in upload buffer already sent
-	QQueue<net::Message> m_outbox; // messages to be sent
-	QQueue<bool> m_pings;		   // pings and pongs to be sent
+	int m_sendbufferMessages;	 // number of messages in upload buffer
+	QQueue<Outgoing> m_outbox;	 // serialized messages to be sent
+	QQueue<bool> m_pings;		 // pings and pongs to be sent
 };
 
 }
@@ -45,9 +45,7 @@ void WebSocketMessageQueue::enqueueMessages(int count, const net::Message *msgs)
 {
 	for(int i = 0; i < count; ++i) {
 		if(msgs[i].serializeWs(m_serializationBuffer)) {
-			qint64 sent = m_socket->sendBinaryMessage(m_serializationBuffer);
-			if(sent != qint64(m_serializationBuffer.size())) {
-				emit writeError();
+			if(!sendSerialized(m_serializationBuffer)) {
 				break;
 			}
 		} else {
@@ -56,6 +54,34 @@ void WebSocketMessageQueue::enqueueMessages(int count, const net::Message *msgs)
 	}
 }
 
+void WebSocketMessageQueue::enqueueEncodedMessages(
+	int count, const net::EncodedMessage *msgs)
+{
+	for(int i = 0; i < count; ++i) {
+		QByteArray buffer = msgs[i].serializedWs();
+		if(!buffer.isEmpty() && !sendSerialized(buffer)) {
+			break;
+		}
+	}
+}
+
+void WebSocketMessageQueue::enqueueFramedMessages(
+	const QByteArray &data, int count)
+{
+	Q_UNUSED(count);
+	// The WebSocket framing is the same as the TCP one minus the length
+	// prefix, since each message is its own WebSocket frame.
+	int pos = 0;
+	int len;
+	while((len = net::framedMessageLength(
+			   data.constData() + pos, data.size() - pos)) != 0) {
+		if(!sendSerialized(data.mid(pos + 2, len - 2))) {
+			break;
+		}
+		pos += len;
+	}
+}
+
 void WebSocketMessageQueue::enqueuePing(bool pong)
 {
 	net::Message msg = net::makePingMessage(0, pong);
@@ -198,4 +224,16 @@ void WebSocketMessageQueue::afterDisconnectSent()
 #endif
 }
 
+bool WebSocketMessageQueue::sendSerialized(const QByteArray &buffer)
+{
+	qint64 sent = m_socket->sendBinaryMessage(buffer);
+	if(sent == qint64(buffer.size())) {
+		recordWrite(1, sent);
+		return true;
+	} else {
+		emit writeError();
+		return false;
+	}
+}
+
 }
@@ -18,6 +18,9 @@ public:
 
 protected:
 	void enqueueMessages(int count, const net::Message *msgs) override;
+	void enqueueEncodedMessages(
+		int count, const net::EncodedMessage *msgs) override;
+	void enqueueFramedMessages(const QByteArray &data, int count) override;
 	void enqueuePing(bool pong) override;
 
 	QAbstractSocket::SocketState getSocketState() override;
@@ -31,6 +34,8 @@ private slots:
 private:
 	void afterDisconnectSent() override;
 
+	bool sendSerialized(const QByteArray &buffer);
+
 	QWebSocket *m_socket;
     QByteArray m_serializationBuffer;
 };
@@ -185,6 +185,115 @@ private slots:
 		loopUntil(allReceived);
 	}
 
+	void testSendEncoded()
+	{
+		auto mq1 = getMsgQueue();
+		auto mq2 = getMsgQueue();
+
+		net::Message msg =
+			net::makeChatMessage(0, 0, 0, QStringLiteral("Hello everyone!"));
+		net::EncodedMessage encoded(msg);
+
+		// Copies of an encoded message share the same serialized buffer.
+		net::EncodedMessage copy = encoded;
+		QVERIFY(
+			copy.serialized().constData() == encoded.serialized().constData());
+		QCOMPARE(copy.serialized().size(), int(msg.length()));
+
+		int countReceived = 0;
+		bool allReceived = false;
+		for(net::TcpMessageQueue *mq : {mq1.get(), mq2.get()}) {
+			connect(mq, &net::MessageQueue::messageAvailable, [&, mq, msg]() {
+				net::MessageList got;
+				mq->receive(got);
+				QVERIFY(got.size() == 1);
+				QVERIFY(got[0].equals(msg));
+				allReceived = ++countReceived == 2;
+			});
+		}
+
+		mq1->sendEncoded(encoded);
+		mq2->sendEncoded(copy);
+		QCOMPARE(mq1->uploadQueueBytes(), int(msg.length()));
+
+		loopUntil(allReceived);
+	}
+
+	void testSendFramed()
+	{
+		auto mq = getMsgQueue();
+
+		const int sendCount = 10;
+		net::MessageList msgs;
+		QByteArray framed;
+		for(int i = 0; i < sendCount; ++i) {
+			msgs.append(net::makeChatMessage(0, 0, 0, QByteArray::number(i)));
+			QByteArray buffer;
+			QVERIFY(msgs.last().serialize(buffer));
+			framed.append(buffer);
+		}
+
+		net::MessageList received;
+		bool allReceived = false;
+		connect(mq.get(), &net::MessageQueue::messageAvailable, [&]() {
+			net::MessageList got;
+			mq->receive(got);
+			received.append(got);
+			allReceived = received.size() == sendCount;
+		});
+
+		mq->sendFramed(framed, sendCount);
+		QCOMPARE(mq->uploadQueueBytes(), framed.size());
+		loopUntil(allReceived);
+
+		for(int i = 0; i < sendCount; ++i) {
+			QVERIFY(received[i].equals(msgs[i]));
+		}
+		QCOMPARE(mq->writeStats().messages, (long long)sendCount);
+	}
+
+	void testBatchedWrites_data()
+	{
+		QTest::addColumn<int>("writeBatchSize");
+		QTest::addColumn<int>("expectedWrites");
+		QTest::newRow("batched") << net::MessageQueue::DEFAULT_WRITE_BATCH_SIZE
+								 << 1;
+		QTest::newRow("unbatched") << 0 << 100;
+	}
+
+	void testBatchedWrites()
+	{
+		QFETCH(int, writeBatchSize);
+		QFETCH(int, expectedWrites);
+		auto mq = getMsgQueue();
+		mq->setWriteBatchSize(writeBatchSize);
+
+		const int sendCount = 100;
+		net::MessageList msgs;
+		int totalSendLen = 0;
+		for(int i = 0; i < sendCount; ++i) {
+			msgs.append(net::makeChatMessage(0, 0, 0, QByteArray::number(i)));
+			totalSendLen += int(msgs.last().length());
+		}
+
+		int countReceived = 0;
+		bool allReceived = false;
+		connect(mq.get(), &net::MessageQueue::messageAvailable, [&]() {
+			net::MessageList got;
+			mq->receive(got);
+			countReceived += got.size();
+			allReceived = countReceived == sendCount;
+		});
+
+		mq->sendMultiple(msgs.size(), msgs.constData());
+		loopUntil(allReceived);
+
+		const net::MessageQueue::WriteStats &stats = mq->writeStats();
+		QCOMPARE(stats.writes, (long long)expectedWrites);
+		QCOMPARE(stats.messages, (long long)sendCount);
+		QCOMPARE(stats.bytes, (long long)totalSendLen);
+	}
+
 	void testSendDisconnect()
 	{
 		auto s = getConnection();
@@ -8,8 +8,10 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QSqlDatabase>
+#include <QSqlDriver>
 #include <QSqlError>
 #include <QSqlQuery>
+#include <QThread>
 
 Q_LOGGING_CATEGORY(lcDpDatabase, "net.drawpile.database", QtWarningMsg)
 
@@ -123,6 +125,45 @@ QSqlDatabase sqlite(
 	}
 }
 
+QSqlDatabase forThread(const QSqlDatabase &db)
+{
+	QThread *thread = QThread::currentThread();
+	if(!db.isValid() || db.driver()->thread() == thread) {
+		return db;
+	}
+
+	QString connectionName = QStringLiteral("%1@%2").arg(
+		db.connectionName(), QString::number(quintptr(thread), 16));
+	if(QSqlDatabase::contains(connectionName)) {
+		return QSqlDatabase::database(connectionName);
+	}
+
+	QSqlDatabase threadDb =
+		QSqlDatabase::addDatabase(db.driverName(), connectionName);
+	threadDb.setDatabaseName(db.databaseName());
+	threadDb.setConnectOptions(db.connectOptions());
+	if(threadDb.open()) {
+		qCDebug(
+			lcDpDatabase, "Opened connection '%s' for thread %p",
+			qUtf8Printable(connectionName), static_cast<void *>(thread));
+	} else {
+		qCWarning(
+			lcDpDatabase, "Error opening connection '%s': %s",
+			qUtf8Printable(connectionName),
+			qUtf8Printable(threadDb.lastError().text()));
+	}
+
+	// The finished signal is emitted in the thread itself, which is where
+	// the connection has to be closed.
+	QObject::connect(
+		thread, &QThread::finished, thread,
+		[connectionName]() {
+			QSqlDatabase::removeDatabase(connectionName);
+		},
+		Qt::DirectConnection);
+	return threadDb;
+}
+
 bool prepare(QSqlQuery &query, const QString &sql)
 {
 	if(query.prepare(sql)) {
@@ -17,6 +17,11 @@ QSqlDatabase sqlite(
 	const QString &connectionName, const QString &humaneName,
 	const QString &fileName, const QString &sourceFileName = QString{});
 
+// Returns a connection to the same database that can be used from the calling
+// thread. If that's not the thread the given connection was made in, a new
+// one is opened and kept around until the calling thread finishes.
+QSqlDatabase forThread(const QSqlDatabase &db);
+
 bool prepare(QSqlQuery &query, const QString &sql);
 
 bool execPrepared(QSqlQuery &query, const QString &sql);
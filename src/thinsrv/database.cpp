@@ -6,6 +6,7 @@
 #include "libshared/util/database.h"
 #include "libshared/util/passwordhash.h"
 #include "libshared/util/validators.h"
+#include "libserver/ipbanindex.h"
 #include "libserver/serverlog.h"
 #include "libshared/util/qtcompat.h"
 
@@ -20,12 +21,18 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QTimer>
+#include <algorithm>
 
 namespace server {
 
 struct Database::Private {
 	QSqlDatabase db;
 	ServerLog *logger;
+	// In-memory mirror of the unexpired rows of the ipbans table, so that
+	// checking an incoming connection doesn't scan the whole table. Values
+	// are row ids, expiry strings are compared like SQLite's datetime().
+	IpBanIndex ipBans;
+	QHash<int, QString> ipBanExpires;
 };
 
 static bool initDatabase(QSqlDatabase db)
@@ -118,6 +125,20 @@ Database::~Database()
 	delete d;
 }
 
+QSqlDatabase Database::db() const
+{
+	// Sessions may be running in their own threads
+	return utils::db::forThread(d->db);
+}
+
+bool Database::isInMemory() const
+{
+	// An empty name gives a temporary database that is private to its
+	// connection too.
+	QString name = d->db.databaseName();
+	return name.isEmpty() || name == QStringLiteral(":memory:");
+}
+
 bool Database::openFile(const QString &path)
 {
 	d->db = QSqlDatabase::addDatabase("QSQLITE");
@@ -137,12 +158,18 @@ bool Database::openFile(const QString &path)
 		qWarning("Couldn't initialize database log!");
 		delete dblog;
 	} else {
+		// In-memory databases can't be opened from the writer thread.
+		if(!isInMemory()) {
+			dblog->startWriter();
+		}
 		delete d->logger;
 		d->logger = dblog;
 	}
 
 	qDebug("Opened configuration database: %s", qPrintable(path));
 
+	loadIpBans();
+
 	// Purge old log entries on startup
 	dailyTasks();
 
@@ -152,7 +179,7 @@ bool Database::openFile(const QString &path)
 void Database::loadExternalIpBans(ExtBans *extBans)
 {
 	extBans->loadFromCache();
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	if(utils::db::exec(q, QStringLiteral("SELECT id FROM disabledextbans"))) {
 		while(q.next()) {
 			ServerConfig::setExternalBanEnabled(q.value(0).toInt(), false);
@@ -162,7 +189,7 @@ void Database::loadExternalIpBans(ExtBans *extBans)
 
 bool Database::setExternalBanEnabled(int id, bool enabled)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	QString sql =
 		enabled ? QStringLiteral("DELETE FROM disabledextbans WHERE id = ?")
 				: QStringLiteral(
@@ -178,7 +205,7 @@ void Database::setConfigValue(ConfigKey key, const QString &value)
 
 void Database::setConfigValueByName(const QString &name, const QString &value)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.prepare("INSERT OR REPLACE INTO settings VALUES (?, ?)");
 	q.bindValue(0, name);
 	q.bindValue(1, value);
@@ -192,7 +219,7 @@ QString Database::getConfigValue(const ConfigKey key, bool &found) const
 
 QString Database::getConfigValueByName(const QString &name, bool &found) const
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.prepare("SELECT value FROM settings WHERE key=?");
 	q.bindValue(0, name);
 	q.exec();
@@ -216,7 +243,7 @@ bool Database::isAllowedAnnouncementUrl(const QUrl &url) const
 
 	const QString urlStr = url.toString();
 
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.exec("SELECT url FROM listingservers");
 	while(q.next()) {
 		const QString serverUrl = q.value(0).toString();
@@ -235,7 +262,7 @@ bool Database::isAllowedAnnouncementUrl(const QUrl &url) const
 QStringList Database::listServerWhitelist() const
 {
 	QStringList list;
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.exec("SELECT url FROM listingservers");
 	while(q.next()) {
 		list << q.value(0).toString();
@@ -245,7 +272,7 @@ QStringList Database::listServerWhitelist() const
 
 void Database::updateListServerWhitelist(const QStringList &whitelist)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.exec("BEGIN TRANSACTION");
 	q.exec("DELETE FROM listingservers");
 	if(!whitelist.isEmpty()) {
@@ -262,23 +289,22 @@ void Database::updateListServerWhitelist(const QStringList &whitelist)
 
 BanResult Database::isAddressBanned(const QHostAddress &addr) const
 {
-	QSqlQuery q(d->db);
-	bool ok = utils::db::exec(q, QStringLiteral(
-		"SELECT rowid, ip, subnet, expires FROM ipbans\n"
-		"WHERE expires > datetime('now')"));
-	if(ok) {
-		while(q.next()) {
-			QHostAddress ip(q.value(1).toString());
-			int subnet = q.value(2).toInt();
-			if(matchesBannedAddress(addr, ip, subnet)) {
+	QVector<int> ids = d->ipBans.lookup(addr);
+	if(!ids.isEmpty()) {
+		// Lowest row id first, matching the order of the table scan.
+		std::sort(ids.begin(), ids.end());
+		QString now = currentSqlDateTime();
+		for(int id : ids) {
+			QString expires = d->ipBanExpires.value(id);
+			if(expires > now) {
 				return {
 					BanReaction::NormalBan,
 					QString(),
-					parseDateTime(q.value(3).toString()),
+					parseDateTime(expires),
 					addr.toString(),
 					QStringLiteral("database"),
 					QStringLiteral("IP"),
-					q.value(0).toInt(),
+					id,
 					true};
 			}
 		}
@@ -288,7 +314,7 @@ BanResult Database::isAddressBanned(const QHostAddress &addr) const
 
 BanResult Database::isSystemBanned(const QString &sid) const
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	bool ok = utils::db::exec(
 		q,
 		QStringLiteral("SELECT id, reaction, expires, reason FROM systembans\n"
@@ -315,7 +341,7 @@ BanResult Database::isSystemBanned(const QString &sid) const
 
 BanResult Database::isUserBanned(long long userId) const
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	bool ok = utils::db::exec(
 		q,
 		QStringLiteral("SELECT id, reaction, expires, reason FROM userbans\n"
@@ -343,7 +369,7 @@ BanResult Database::isUserBanned(long long userId) const
 QJsonArray Database::getIpBanlist() const
 {
 	QJsonArray result;
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.exec("SELECT rowid, ip, subnet, expires, comment, added FROM ipbans");
 
 	while(q.next()) {
@@ -355,7 +381,7 @@ QJsonArray Database::getIpBanlist() const
 QJsonArray Database::getSystemBanlist() const
 {
 	QJsonArray result;
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	bool ok = utils::db::exec(
 		q, QStringLiteral("SELECT id, sid, expires, reaction, reason, comment, "
 						  "added FROM systembans ORDER BY id ASC"));
@@ -368,7 +394,7 @@ QJsonArray Database::getSystemBanlist() const
 QJsonArray Database::getUserBanlist() const
 {
 	QJsonArray result;
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	bool ok = utils::db::exec(
 		q, QStringLiteral("SELECT id, userid, expires, reaction, reason, "
 						  "comment, added FROM userbans ORDER BY id ASC"));
@@ -380,7 +406,7 @@ QJsonArray Database::getUserBanlist() const
 
 QJsonObject Database::addIpBan(const QHostAddress &ip, int subnet, const QDateTime &expiration, const QString &comment)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.prepare("SELECT rowid, ip, subnet, expires, comment, added FROM ipbans WHERE ip=? AND subnet=?");
 	q.bindValue(0, ip.toString());
 	q.bindValue(1, subnet);
@@ -400,8 +426,13 @@ QJsonObject Database::addIpBan(const QHostAddress &ip, int subnet, const QDateTi
 		q.bindValue(4, now);
 		q.exec();
 
+		int id = q.lastInsertId().toInt();
+		if(id > 0) {
+			addIpBanToIndex(id, ip, subnet, datestr);
+		}
+
 		QJsonObject b;
-		b["id"] = q.lastInsertId().toInt();
+		b["id"] = id;
 		b["ip"] = ip.toString();
 		b["subnet"] = subnet;
 		b["expires"] = datestr;
@@ -415,7 +446,7 @@ QJsonObject Database::addSystemBan(
 	const QString &sid, const QDateTime &expires, BanReaction reaction,
 	const QString &reason, const QString &comment)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	QString expiresString = formatDateTime(expires);
 	QString addedString = formatDateTime(QDateTime::currentDateTime());
 	QString reactionString = reactionToString(reaction);
@@ -445,7 +476,7 @@ QJsonObject Database::addUserBan(
 	long long userId, const QDateTime &expires, BanReaction reaction,
 	const QString &reason, const QString &comment)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	QString expiresString = formatDateTime(expires);
 	QString addedString = formatDateTime(QDateTime::currentDateTime());
 	QString reactionString = reactionToString(reaction);
@@ -473,16 +504,72 @@ QJsonObject Database::addUserBan(
 
 bool Database::deleteIpBan(int entryId)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.prepare("DELETE FROM ipbans WHERE rowid=?");
 	q.bindValue(0, entryId);
 	q.exec();
-	return q.numRowsAffected()>0;
+	if(q.numRowsAffected()>0) {
+		removeIpBanFromIndex(entryId);
+		return true;
+	}
+	return false;
+}
+
+void Database::loadIpBans()
+{
+	d->ipBans.clear();
+	d->ipBanExpires.clear();
+	QSqlQuery q(db());
+	bool ok = utils::db::exec(q, QStringLiteral(
+		"SELECT rowid, ip, subnet, expires FROM ipbans\n"
+		"WHERE expires > datetime('now')"));
+	while(ok && q.next()) {
+		addIpBanToIndex(
+			q.value(0).toInt(), QHostAddress(q.value(1).toString()),
+			q.value(2).toInt(), q.value(3).toString());
+	}
+}
+
+void Database::addIpBanToIndex(
+	int id, const QHostAddress &ip, int subnet, const QString &expires)
+{
+	d->ipBans.insertSubnet(id, ip, subnet);
+	if(d->ipBans.contains(id)) {
+		d->ipBanExpires.insert(id, expires);
+	}
+}
+
+void Database::removeIpBanFromIndex(int id)
+{
+	d->ipBans.remove(id);
+	d->ipBanExpires.remove(id);
+}
+
+void Database::purgeExpiredIpBansFromIndex()
+{
+	QString now = currentSqlDateTime();
+	QVector<int> expiredIds;
+	for(auto it = d->ipBanExpires.constBegin(),
+			 end = d->ipBanExpires.constEnd();
+		it != end; ++it) {
+		if(!(it.value() > now)) {
+			expiredIds.append(it.key());
+		}
+	}
+	for(int id : expiredIds) {
+		removeIpBanFromIndex(id);
+	}
+}
+
+QString Database::currentSqlDateTime()
+{
+	// SQLite's datetime('now') is in UTC.
+	return formatDateTime(QDateTime::currentDateTimeUtc());
 }
 
 bool Database::deleteSystemBan(int entryId)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	return utils::db::exec(
 			   q, QStringLiteral("DELETE FROM systembans WHERE id = ?"),
 			   {entryId}) &&
@@ -491,7 +578,7 @@ bool Database::deleteSystemBan(int entryId)
 
 bool Database::deleteUserBan(int entryId)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	return utils::db::exec(
 			   q, QStringLiteral("DELETE FROM userbans WHERE id = ?"),
 			   {entryId}) &&
@@ -541,9 +628,9 @@ ServerLog *Database::logger() const
 	return d->logger;
 }
 
-RegisteredUser Database::getUserAccount(const QString &username, const QString &password) const
+RegisteredUser Database::lookupUserAccount(const QString &username) const
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.prepare("SELECT rowid, password, locked, flags FROM users WHERE username=?");
 	q.bindValue(0, username);
 	q.exec();
@@ -558,16 +645,8 @@ RegisteredUser Database::getUserAccount(const QString &username, const QString &
 				RegisteredUser::Banned,
 				username,
 				QStringList(),
-				QString()
-			};
-		}
-
-		if(!passwordhash::check(password, passwordHash)) {
-			return RegisteredUser {
-				RegisteredUser::BadPass,
-				username,
-				QStringList(),
-				QString()
+				QString(),
+				QByteArray()
 			};
 		}
 
@@ -575,21 +654,23 @@ RegisteredUser Database::getUserAccount(const QString &username, const QString &
 			RegisteredUser::Ok,
 			username,
 			flags,
-			QString::number(rowid)
+			QString::number(rowid),
+			passwordHash
 		};
 	} else {
 		return RegisteredUser {
 			RegisteredUser::NotFound,
 			username,
 			QStringList(),
-			QString()
+			QString(),
+			QByteArray()
 		};
 	}
 }
 
 bool Database::hasAnyUserAccounts() const
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	return utils::db::exec(q, QStringLiteral("SELECT 1 FROM users LIMIT 1")) &&
 		   q.next();
 }
@@ -607,7 +688,7 @@ static QJsonObject userQueryToJson(const QSqlQuery &q)
 QJsonArray Database::getAccountList() const
 {
 	QJsonArray list;
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.exec("SELECT rowid, username, locked, flags FROM users");
 	while(q.next()) {
 		list << userQueryToJson(q);
@@ -620,7 +701,7 @@ QJsonObject Database::addAccount(const QString &username, const QString &passwor
 	if(!validateUsername(username))
 		return QJsonObject();
 
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.prepare("INSERT INTO users (username, password, locked, flags) VALUES (?, ?, ?, ?)");
 	q.bindValue(0, username);
 	q.bindValue(1, passwordhash::hash(password));
@@ -660,7 +741,7 @@ QJsonObject Database::updateAccount(int id, const QJsonObject &update)
 		params << update["flags"].toString();
 	}
 
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 
 	if(!updates.isEmpty()) {
 		QString sql = QString("UPDATE users SET %1 WHERE rowid=?").arg(updates.join(','));
@@ -683,7 +764,7 @@ QJsonObject Database::updateAccount(int id, const QJsonObject &update)
 
 bool Database::deleteAccount(int userId)
 {
-	QSqlQuery q(d->db);
+	QSqlQuery q(db());
 	q.prepare("DELETE FROM users WHERE rowid=?");
 	q.bindValue(0, userId);
 	q.exec();
@@ -692,6 +773,9 @@ bool Database::deleteAccount(int userId)
 
 void Database::dailyTasks()
 {
+	// Expired bans are skipped on lookup anyway, this just frees them.
+	purgeExpiredIpBansFromIndex();
+
 	// Purge old Database log entries
 	DbLog *dblog = dynamic_cast<DbLog*>(d->logger);
 	if(dblog) {
@@ -5,6 +5,7 @@
 
 #include "libserver/serverconfig.h"
 
+class QSqlDatabase;
 class QSqlQuery;
 
 namespace server {
@@ -25,6 +26,9 @@ public:
 
 	Q_INVOKABLE bool openFile(const QString &path);
 
+	//! Is this an in-memory database, which other threads can't connect to?
+	bool isInMemory() const;
+
 	void loadExternalIpBans(ExtBans *extBans);
 
 	bool setExternalBanEnabled(int id, bool enabled) override;
@@ -33,7 +37,7 @@ public:
 	BanResult isAddressBanned(const QHostAddress &addr) const override;
 	BanResult isSystemBanned(const QString &sid) const override;
 	BanResult isUserBanned(long long userId) const override;
-	RegisteredUser getUserAccount(const QString &username, const QString &password) const override;
+	RegisteredUser lookupUserAccount(const QString &username) const override;
 	bool hasAnyUserAccounts() const override;
 	ServerLog *logger() const override;
 
@@ -74,6 +78,15 @@ protected:
 	void setConfigValue(ConfigKey key, const QString &value) override;
 
 private:
+	QSqlDatabase db() const;
+
+	void loadIpBans();
+	void addIpBanToIndex(
+		int id, const QHostAddress &ip, int subnet, const QString &expires);
+	void removeIpBanFromIndex(int id);
+	void purgeExpiredIpBansFromIndex();
+	static QString currentSqlDateTime();
+
 	QString getConfigValueByName(const QString &name, bool &found) const;
 	void setConfigValueByName(const QString &name, const QString &value);
 
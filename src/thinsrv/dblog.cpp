@@ -1,21 +1,54 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "thinsrv/dblog.h"
+#include "libshared/util/database.h"
 
-#include <QSqlQuery>
+#include <QElapsedTimer>
 #include <QMetaEnum>
+#include <QMutexLocker>
 #include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
 
 namespace server {
 
+class DbLog::Writer final : public QThread {
+public:
+	explicit Writer(DbLog *log) : m_log(log) { }
+
+protected:
+	void run() override { m_log->runWriter(); }
+
+private:
+	DbLog *m_log;
+};
+
 DbLog::DbLog(const QSqlDatabase &db)
-	: m_db(db)
+	: m_db(db), m_writer(nullptr), m_dropped(0), m_stopping(false),
+	  m_flushIntervalMs(DEFAULT_FLUSH_INTERVAL_MS),
+	  m_batchSize(DEFAULT_BATCH_SIZE), m_maxQueueSize(DEFAULT_MAX_QUEUE_SIZE),
+	  m_droppedTotal(0)
 {
 }
 
+DbLog::~DbLog()
+{
+	if(m_writer) {
+		{
+			QMutexLocker locker(&m_queueMutex);
+			m_stopping = true;
+			m_queueCondition.wakeAll();
+		}
+		m_writer->wait();
+		delete m_writer;
+	}
+	// Anything that came in while the writer was shutting down.
+	flush();
+}
+
 bool DbLog::initDb()
 {
-	QSqlQuery q(m_db);
+	QSqlQuery q(utils::db::forThread(m_db));
 	return q.exec(
 		"CREATE TABLE IF NOT EXISTS serverlog ("
 			"timestamp, level, topic, user, session, message"
@@ -23,8 +56,30 @@ bool DbLog::initDb()
 	);
 }
 
+void DbLog::startWriter(int flushIntervalMs, int batchSize, int maxQueueSize)
+{
+	Q_ASSERT(!m_writer);
+	{
+		QMutexLocker locker(&m_queueMutex);
+		m_flushIntervalMs = qMax(1, flushIntervalMs);
+		m_batchSize = qMax(1, batchSize);
+		m_maxQueueSize = qMax(1, maxQueueSize);
+	}
+	m_writer = new Writer(this);
+	m_writer->start(QThread::LowPriority);
+}
+
+int DbLog::droppedCount() const
+{
+	QMutexLocker locker(&m_queueMutex);
+	return m_droppedTotal;
+}
+
 QList<Log> DbLog::getLogEntries(const QString &session, const QDateTime &after, Log::Level atleast, bool omitSensitive, int offset, int limit) const
 {
+	// Make sure the most recent entries are in there.
+	flush();
+
 	QString sql = "SELECT timestamp, session, user, level, topic, message FROM serverlog WHERE 1=1";
 	QVariantList params;
 	if(!session.isEmpty()) {
@@ -56,7 +111,7 @@ QList<Log> DbLog::getLogEntries(const QString &session, const QDateTime &after,
 		params << offset;
 	}
 
-	QSqlQuery q(m_db);
+	QSqlQuery q(utils::db::forThread(m_db));
 	q.prepare(sql);
 	for(int i=0;i<params.size();++i)
 		q.bindValue(i, params.at(i));
@@ -82,15 +137,107 @@ QList<Log> DbLog::getLogEntries(const QString &session, const QDateTime &after,
 
 void DbLog::storeMessage(const Log &entry)
 {
-	QSqlQuery q(m_db);
-	q.prepare("INSERT INTO serverlog (timestamp, level, topic, user, session, message) VALUES (?, ?, ?, ?, ?, ?)");
-	q.bindValue(0, entry.timestamp().toString(Qt::ISODate));
-	q.bindValue(1, int(entry.level()));
-	q.bindValue(2, QMetaEnum::fromType<Log::Topic>().valueToKey(int(entry.topic())));
-	q.bindValue(3, entry.user());
-	q.bindValue(4, entry.session());
-	q.bindValue(5, entry.message());
-	q.exec();
+	if(!m_writer) {
+		writeEntries({entry});
+		return;
+	}
+
+	QMutexLocker locker(&m_queueMutex);
+	if(m_queue.size() >= m_maxQueueSize) {
+		++m_dropped;
+		++m_droppedTotal;
+	} else {
+		m_queue.append(entry);
+		if(m_queue.size() == m_batchSize) {
+			m_queueCondition.wakeAll();
+		}
+	}
+}
+
+void DbLog::flush() const
+{
+	QMutexLocker writeLocker(&m_writeMutex);
+	QVector<Log> entries;
+	int dropped;
+	{
+		QMutexLocker queueLocker(&m_queueMutex);
+		entries.swap(m_queue);
+		dropped = m_dropped;
+		m_dropped = 0;
+	}
+
+	if(dropped > 0) {
+		entries.append(
+			Log()
+				.about(Log::Level::Warn, Log::Topic::Status)
+				.message(QStringLiteral("Log writer fell behind, dropped %1 "
+										"log entries")
+							 .arg(dropped)));
+	}
+
+	if(!entries.isEmpty()) {
+		writeEntries(entries);
+	}
+}
+
+bool DbLog::writeEntries(const QVector<Log> &entries) const
+{
+	QSqlDatabase db = utils::db::forThread(m_db);
+	QSqlQuery q(db);
+	bool ok = utils::db::tx(db, [&]() {
+		if(!utils::db::prepare(
+			   q, QStringLiteral(
+					  "INSERT INTO serverlog (timestamp, level, topic, user, "
+					  "session, message) VALUES (?, ?, ?, ?, ?, ?)"))) {
+			return false;
+		}
+		const QMetaEnum topics = QMetaEnum::fromType<Log::Topic>();
+		for(const Log &entry : entries) {
+			q.bindValue(0, entry.timestamp().toString(Qt::ISODate));
+			q.bindValue(1, int(entry.level()));
+			q.bindValue(2, topics.valueToKey(int(entry.topic())));
+			q.bindValue(3, entry.user());
+			q.bindValue(4, entry.session());
+			q.bindValue(5, entry.message());
+			if(!q.exec()) {
+				qWarning("Couldn't store log entry: %s", qPrintable(q.lastError().databaseText()));
+				return false;
+			}
+		}
+		return true;
+	});
+
+	if(!ok) {
+		qWarning("Lost %d log entries", int(entries.size()));
+	}
+	return ok;
+}
+
+void DbLog::runWriter()
+{
+	while(true) {
+		bool stopping;
+		{
+			QMutexLocker locker(&m_queueMutex);
+			QElapsedTimer timer;
+			timer.start();
+			while(!m_stopping && m_queue.size() < m_batchSize) {
+				qint64 remaining = m_flushIntervalMs - timer.elapsed();
+				if(remaining <= 0 ||
+				   !m_queueCondition.wait(
+					   &m_queueMutex, static_cast<unsigned long>(remaining))) {
+					break;
+				}
+			}
+			stopping = m_stopping;
+		}
+
+		flush();
+
+		if(stopping) {
+			break;
+		}
+	}
 }
 
 int DbLog::purgeLogs(int olderThanDays)
@@ -98,7 +245,9 @@ int DbLog::purgeLogs(int olderThanDays)
 	if(olderThanDays<=0)
 		return 0;
 
-	QSqlQuery q(m_db);
+	flush();
+
+	QSqlQuery q(utils::db::forThread(m_db));
 	q.prepare("DELETE FROM serverlog WHERE timestamp < DATE('now', ?)");
 	q.bindValue(0, QStringLiteral("-%1 days").arg(olderThanDays));
 	if(!q.exec())
@@ -5,17 +5,60 @@
 
 #include "libserver/serverlog.h"
 
+#include <QMutex>
 #include <QSqlDatabase>
+#include <QVector>
+#include <QWaitCondition>
+
+class QThread;
 
 namespace server {
 
+/**
+ * @brief Server log stored in the configuration database
+ *
+ * Messages may be logged from any thread. They're put in a queue and written
+ * to the database in batches, one transaction at a time, by a background
+ * writer thread. A batch is written when enough entries have piled up or when
+ * the flush interval runs out, whichever comes first.
+ *
+ * The queue is bounded: if the writer can't keep up, further entries are
+ * dropped and a warning with the number of lost entries is logged once the
+ * writer catches up again. Queries and purges flush the queue first, so they
+ * always see everything logged up to that point.
+ *
+ * Without a writer thread, every message is written right away. That's what
+ * in-memory databases need, since those can't be opened from another thread.
+ */
 class DbLog final : public ServerLog
 {
 public:
+	static constexpr int DEFAULT_FLUSH_INTERVAL_MS = 1000;
+	static constexpr int DEFAULT_BATCH_SIZE = 256;
+	static constexpr int DEFAULT_MAX_QUEUE_SIZE = 10000;
+
 	explicit DbLog(const QSqlDatabase &db);
+	~DbLog() override;
 
 	bool initDb();
 
+	/**
+	 * @brief Start writing log entries in the background
+	 *
+	 * Must be called after initDb and at most once. If the queue is smaller
+	 * than a batch, entries are only written when the flush interval runs out.
+	 */
+	void startWriter(
+		int flushIntervalMs = DEFAULT_FLUSH_INTERVAL_MS,
+		int batchSize = DEFAULT_BATCH_SIZE,
+		int maxQueueSize = DEFAULT_MAX_QUEUE_SIZE);
+
+	//! Write all queued log entries to the database now
+	void flush() const;
+
+	//! Total number of entries dropped because the queue was full
+	int droppedCount() const;
+
 	QList<Log> getLogEntries(const QString &session, const QDateTime &after, Log::Level atleast, bool omitSensitive, int offset, int limit) const override;
 
 	/**
@@ -29,7 +72,26 @@ protected:
 	void storeMessage(const Log &entry) override;
 
 private:
+	class Writer;
+
+	bool writeEntries(const QVector<Log> &entries) const;
+	void runWriter();
+
 	QSqlDatabase m_db;
+	Writer *m_writer;
+
+	mutable QMutex m_queueMutex;
+	QWaitCondition m_queueCondition;
+	mutable QVector<Log> m_queue;
+	mutable int m_dropped;
+	bool m_stopping;
+	int m_flushIntervalMs;
+	int m_batchSize;
+	int m_maxQueueSize;
+	int m_droppedTotal;
+
+	// Held while a batch is being written, to keep batches in order.
+	mutable QMutex m_writeMutex;
 };
 
 }
@@ -5,6 +5,7 @@
 #include "libshared/util/passwordhash.h"
 
 #include <QFileInfo>
+#include <QMutexLocker>
 
 namespace server {
 
@@ -198,6 +199,7 @@ void ConfigFile::reloadFile() const
 
 QString ConfigFile::getConfigValue(const ConfigKey key, bool &found) const
 {
+	QMutexLocker locker(&m_mutex);
 	if(isModified())
 		reloadFile();
 
@@ -212,6 +214,7 @@ QString ConfigFile::getConfigValue(const ConfigKey key, bool &found) const
 
 BanResult ConfigFile::isAddressBanned(const QHostAddress &addr) const
 {
+	QMutexLocker locker(&m_mutex);
 	if(isModified()) {
 		reloadFile();
 	}
@@ -232,6 +235,7 @@ BanResult ConfigFile::isAddressBanned(const QHostAddress &addr) const
 
 BanResult ConfigFile::isSystemBanned(const QString &sid) const
 {
+	QMutexLocker locker(&m_mutex);
 	if(isModified()) {
 		reloadFile();
 	}
@@ -245,6 +249,7 @@ BanResult ConfigFile::isSystemBanned(const QString &sid) const
 
 BanResult ConfigFile::isUserBanned(long long userId) const
 {
+	QMutexLocker locker(&m_mutex);
 	if(isModified()) {
 		reloadFile();
 	}
@@ -261,11 +266,13 @@ bool ConfigFile::isAllowedAnnouncementUrl(const QUrl &url) const
 	if(!getConfigBool(config::AnnounceWhiteList))
 		return true;
 
+	QMutexLocker locker(&m_mutex);
 	return m_announcewhitelist.contains(url);
 }
 
-RegisteredUser ConfigFile::getUserAccount(const QString &username, const QString &password) const
+RegisteredUser ConfigFile::lookupUserAccount(const QString &username) const
 {
+	QMutexLocker locker(&m_mutex);
 	if(m_users.contains(username)) {
 		const User &u = m_users[username];
 		if(u.password.startsWith("*")) {
@@ -273,22 +280,16 @@ RegisteredUser ConfigFile::getUserAccount(const QString &username, const QString
 				RegisteredUser::Banned,
 				username,
 				QStringList(),
-				username
-			};
-
-		} else if(!passwordhash::check(password, u.password)) {
-			return RegisteredUser {
-				RegisteredUser::BadPass,
 				username,
-				QStringList(),
-				username
+				QByteArray()
 			};
 		} else {
 			return RegisteredUser {
 				RegisteredUser::Ok,
 				username,
 				u.flags,
-				username
+				username,
+				u.password
 			};
 		}
 
@@ -297,13 +298,15 @@ RegisteredUser ConfigFile::getUserAccount(const QString &username, const QString
 			RegisteredUser::NotFound,
 			username,
 			QStringList(),
-			QString()
+			QString(),
+			QByteArray()
 		};
 	}
 }
 
 bool ConfigFile::hasAnyUserAccounts() const
 {
+	QMutexLocker locker(&m_mutex);
 	if(isModified()) {
 		reloadFile();
 	}
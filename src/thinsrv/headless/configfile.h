@@ -7,6 +7,7 @@
 
 #include <QDateTime>
 #include <QHostAddress>
+#include <QMutex>
 #include <QUrl>
 
 namespace server {
@@ -45,7 +46,7 @@ public:
 	BanResult isAddressBanned(const QHostAddress &addr) const override;
 	BanResult isSystemBanned(const QString &sid) const override;
 	BanResult isUserBanned(long long userId) const override;
-	RegisteredUser getUserAccount(const QString &username, const QString &password) const override;
+	RegisteredUser lookupUserAccount(const QString &username) const override;
 	bool hasAnyUserAccounts() const override;
 
 	ServerLog *logger() const override { return m_logger; }
@@ -65,6 +66,9 @@ private:
 		QStringList flags;
 	};
 
+	// Sessions may read settings from other threads
+	mutable QMutex m_mutex;
+
 	// Cached settings:
 	mutable QHash<QString, QString> m_config;
 	mutable QHash<QString, User> m_users;
@@ -235,6 +235,10 @@ bool start() {
 	QCommandLineOption templatesOption(QStringList() << "templates" << "t", "Session templates", "path");
 	parser.addOption(templatesOption);
 
+	// --session-threads <count>
+	QCommandLineOption sessionThreadsOption("session-threads", "Number of threads to run sessions on (0 runs everything on the main thread, -1 uses one thread per CPU core)", "count", "0");
+	parser.addOption(sessionThreadsOption);
+
 #ifdef HAVE_LIBSODIUM
 	QString sodiumOptionSuffix;
 #else
@@ -301,6 +305,7 @@ bool start() {
 
 	// Set server configuration file or database
 	ServerConfig *serverconfig;
+	bool inMemoryDatabase = false;
 	if(parser.isSet(dbFileOption)) {
 		if(parser.isSet(configFileOption)) {
 			qCritical("Configuration file and database are mutually exclusive options");
@@ -313,6 +318,7 @@ bool start() {
 			delete db;
 			return false;
 		}
+		inMemoryDatabase = db->isInMemory();
 		serverconfig = db;
 
 	} else if(parser.isSet(configFileOption)) {
@@ -453,6 +459,22 @@ bool start() {
 		}
 	}
 
+	{
+		bool ok;
+		int sessionThreads = parser.value(sessionThreadsOption).toInt(&ok);
+		if(!ok || sessionThreads < -1) {
+			qCritical("Invalid session thread count %s", qUtf8Printable(parser.value(sessionThreadsOption)));
+			return false;
+		}
+		// Session threads get their own database connections, which would
+		// each see a different, empty in-memory database.
+		if(sessionThreads != 0 && inMemoryDatabase) {
+			qCritical("Session threads can't be used with an in-memory database");
+			return false;
+		}
+		server->setSessionThreads(sessionThreads);
+	}
+
 	{
 		QString sessionDirPath = parser.value(sessionsOption);
 		if(!sessionDirPath.isEmpty()) {
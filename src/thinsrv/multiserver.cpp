@@ -83,6 +83,11 @@ void MultiServer::setRecordingPath(const QString &path)
 	m_recordingPath = path;
 }
 
+void MultiServer::setSessionThreads(int threadCount)
+{
+	m_sessions->setSessionThreads(threadCount);
+}
+
 void MultiServer::setSessionDirectory(const QDir &path)
 {
 	m_sessions->setSessionDir(path);
@@ -555,6 +560,8 @@ JsonApiResult MultiServer::serverJsonApi(JsonApiMethod method, const QStringList
 		config::PasswordDependentWebSession,
 #endif
 		config::SessionUserLimit,
+		config::WriteBatchSize,
+		config::ServerSideAutoreset,
 	};
 	const int settingCount = sizeof(settings) / sizeof(settings[0]);
 
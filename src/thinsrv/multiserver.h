@@ -43,6 +43,14 @@ public:
 	void setRecordingPath(const QString &path);
 	void setTemplateDirectory(const QDir &dir);
 
+	/**
+	 * @brief Run sessions in a pool of threads
+	 *
+	 * Must be called before the session directory is set.
+	 * @see SessionServer::setSessionThreads
+	 */
+	void setSessionThreads(int threadCount);
+
 	/**
 	 * @brief Get the port the server is running from
 	 * @return port number or zero if server is not running
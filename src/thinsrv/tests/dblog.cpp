@@ -3,6 +3,8 @@
 #include "thinsrv/database.h"
 #include "thinsrv/dblog.h"
 
+#include <QSqlDatabase>
+#include <QTemporaryDir>
 #include <QtTest/QtTest>
 
 using server::Database;
@@ -47,6 +49,78 @@ private slots:
 		QCOMPARE(logEntryCount(), 1);
 	}
 
+	void testBatchedWriter()
+	{
+		// Only one database can be open at a time.
+		m_db.reset();
+		logger = nullptr;
+
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+		Database db;
+		QVERIFY(db.openFile(dir.filePath("test.db")));
+		DbLog *batchLogger = dynamic_cast<DbLog*>(db.logger());
+		QVERIFY(batchLogger);
+		batchLogger->setSilent(true);
+
+		const QDateTime now = QDateTime::currentDateTimeUtc();
+		for(int i = 0; i < 1000; ++i) {
+			batchLogger->logMessage(Log(now, QString(), "test", Log::Level::Info, Log::Topic::Status, QString::number(i)));
+		}
+
+		// Queries see everything logged so far, in order, even if the writer
+		// hasn't gotten around to all of it yet.
+		const QList<Log> entries = batchLogger->getLogEntries(QString(), QDateTime(), Log::Level::Debug, false, 0, 0);
+		QCOMPARE(entries.size(), 1000);
+		QCOMPARE(entries.first().message(), QStringLiteral("999"));
+		QCOMPARE(entries.last().message(), QStringLiteral("0"));
+		QCOMPARE(batchLogger->droppedCount(), 0);
+	}
+
+	void testBatchedWriterOverflow()
+	{
+		m_db.reset();
+		logger = nullptr;
+
+		QTemporaryDir dir;
+		QVERIFY(dir.isValid());
+		const QString connectionName = QStringLiteral("testdblogoverflow");
+		{
+			QSqlDatabase db =
+				QSqlDatabase::addDatabase("QSQLITE", connectionName);
+			db.setDatabaseName(dir.filePath("overflow.db"));
+			QVERIFY(db.open());
+
+			// The writer won't wake up on its own during the test, so
+			// everything past the first five entries has to be dropped.
+			DbLog overflowLogger(db);
+			QVERIFY(overflowLogger.initDb());
+			overflowLogger.setSilent(true);
+			overflowLogger.startWriter(60 * 60 * 1000, 100, 5);
+
+			const QDateTime now = QDateTime::currentDateTimeUtc();
+			for(int i = 0; i < 12; ++i) {
+				overflowLogger.logMessage(Log(now, QString(), "test", Log::Level::Info, Log::Topic::Status, QString::number(i)));
+			}
+			QCOMPARE(overflowLogger.droppedCount(), 7);
+
+			// Querying flushes the queue, which also writes the warning about
+			// the dropped entries after the ones that were kept.
+			const QList<Log> entries = overflowLogger.getLogEntries(QString(), QDateTime(), Log::Level::Debug, false, 0, 0);
+			QCOMPARE(entries.size(), 6);
+			QCOMPARE(entries[0].level(), Log::Level::Warn);
+			QCOMPARE(entries[0].message(), QStringLiteral("Log writer fell behind, dropped 7 log entries"));
+			for(int i = 1; i < 6; ++i) {
+				QCOMPARE(entries[i].message(), QString::number(5 - i));
+			}
+
+			// The total sticks around, but the warning is only written once.
+			QCOMPARE(overflowLogger.droppedCount(), 7);
+			QCOMPARE(overflowLogger.getLogEntries(QString(), QDateTime(), Log::Level::Debug, false, 0, 0).size(), 6);
+		}
+		QSqlDatabase::removeDatabase(connectionName);
+	}
+
 private:
 	int logEntryCount()
 	{
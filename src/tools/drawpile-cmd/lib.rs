@@ -1,15 +1,23 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
-use anyhow::Result;
+use anyhow::{anyhow, Result};
 use drawdance::{
     dp_cmake_config_version,
-    engine::{PaintEngine, Player},
-    DP_PLAYER_TYPE_GUESS, DP_PROTOCOL_VERSION,
+    engine::{DrawContext, Image, PaintEngine, Player},
+    DP_worker_cpu_limit_set, DP_PLAYER_TYPE_GUESS, DP_PROTOCOL_VERSION,
 };
 use std::{
+    collections::HashMap,
     ffi::{c_int, CStr, OsStr},
     fs::metadata,
+    num::NonZeroUsize,
     path::Path,
     str::FromStr,
+    sync::{
+        atomic::{AtomicUsize, Ordering},
+        mpsc::{sync_channel, Receiver, SyncSender},
+        Arc, Mutex,
+    },
+    thread::{self, JoinHandle},
 };
 
 #[derive(Copy, Clone, Debug)]
@@ -124,6 +132,14 @@ pub extern "C" fn drawpile_cmd_main() -> c_int {
         /// transparent or black, depending on the output format. This option is
         /// not supported for the output ora format.
         optional -S,--fixedsize
+        /// Batch mode. Every input file is exported on its own, with the output
+        /// files named and numbered after it instead of continuing on from the
+        /// previous input. If -o/--out is given, it must be a directory.
+        optional -b,--batch
+        /// Number of input files to process at the same time in batch mode.
+        /// Defaults to the number of available CPU cores. The cores are split
+        /// between the jobs, so each one renders with fewer threads.
+        optional -j,--jobs jobs: usize
         /// Input recording file(s).
         repeated input: String
     };
@@ -169,27 +185,150 @@ pub extern "C" fn drawpile_cmd_main() -> c_int {
         return 2;
     }
 
-    let mut format = flags.format.unwrap_or_default();
-    let pre_out_pattern = if let Some(out) = flags.out {
-        if metadata(&out).map(|m| m.is_dir()).unwrap_or(false) {
+    let format = flags.format.unwrap_or_default();
+    let jobs = if let Some(jobs) = flags.jobs {
+        if !flags.batch {
+            eprintln!("-j/--jobs requires -b/--batch");
+            return 2;
+        } else if jobs < 1 {
+            eprintln!("-j/--jobs must be >= 1");
+            return 2;
+        }
+        jobs
+    } else {
+        available_threads()
+    };
+
+    if flags.batch {
+        if let Some(out) = &flags.out {
+            if !metadata(out).map(|m| m.is_dir()).unwrap_or(false) {
+                eprintln!("-o/--out must be a directory in batch mode");
+                return 2;
+            }
+        }
+    }
+
+    // In batch mode, every input gets its own output pattern, otherwise they
+    // all go by the first one.
+    let pattern_inputs = if flags.batch {
+        &input_paths[..]
+    } else {
+        &input_paths[..1]
+    };
+    let mut out_patterns = Vec::with_capacity(pattern_inputs.len());
+    let mut out_format = format;
+    for input_path in pattern_inputs {
+        match make_out_pattern(&flags.out, input_path, format) {
+            Ok((f, pattern)) => {
+                out_format = f;
+                out_patterns.push(pattern);
+            }
+            Err(e) => {
+                eprintln!("{}", e);
+                return 2;
+            }
+        }
+    }
+
+    // Inputs with the same name in different directories would end up writing
+    // to the same files, with whichever finishes last winning.
+    if flags.batch {
+        let mut pattern_owners = HashMap::with_capacity(out_patterns.len());
+        for (pattern, input_path) in out_patterns.iter().zip(&input_paths) {
+            if let Some(other) = pattern_owners.insert(pattern, input_path) {
+                eprintln!(
+                    "Inputs '{}' and '{}' would both be written to '{}'",
+                    other, input_path, pattern
+                );
+                return 2;
+            }
+        }
+    }
+
+    if flags.maxsize.is_some() && out_format == OutputFormat::Ora {
+        eprintln!("The ora output format doesn't support -s/--max-size");
+        return 2;
+    }
+
+    let acl_override = !flags.acl;
+    // ORA files are written on the playback threads, they don't need encoders.
+    let encoder_threads = match out_format {
+        OutputFormat::Png | OutputFormat::Jpg | OutputFormat::Jpeg => available_threads(),
+        _ => 0,
+    };
+    let encoder = Encoder::new(encoder_threads, flags.maxsize, flags.fixedsize, out_format);
+
+    let result = if flags.batch {
+        // Every job has its own paint engine, which would otherwise start as
+        // many renderer and stamp threads as there are cores all by itself.
+        let running = jobs.min(input_paths.len());
+        let threads_per_job = (available_threads() / running).max(1);
+        let limit = c_int::try_from(threads_per_job).unwrap_or(c_int::MAX);
+        unsafe { DP_worker_cpu_limit_set(limit) };
+        dump_recordings_batch(
+            &input_paths,
+            &out_patterns,
+            jobs,
+            acl_override,
+            every,
+            steps,
+            out_format,
+            &encoder,
+        )
+    } else {
+        dump_recordings(
+            &input_paths,
+            acl_override,
+            every,
+            steps,
+            out_format,
+            &out_patterns[0],
+            &encoder,
+        )
+    };
+    let encoded = encoder.finish();
+
+    match result {
+        Ok(_) if encoded => 0,
+        Ok(_) => 1,
+        Err(e) => {
+            eprintln!("{}", e);
+            1
+        }
+    }
+}
+
+fn available_threads() -> usize {
+    thread::available_parallelism()
+        .map(NonZeroUsize::get)
+        .unwrap_or(1)
+}
+
+fn make_out_pattern(
+    out: &Option<String>,
+    input_path: &str,
+    mut format: OutputFormat,
+) -> Result<(OutputFormat, String), String> {
+    let pre_out_pattern = if let Some(out) = out {
+        if metadata(out).map(|m| m.is_dir()).unwrap_or(false) {
             format!(
                 "{}/{}-:idx:.{}",
                 out,
-                Path::new(&input_paths[0])
+                Path::new(input_path)
                     .file_stem()
                     .unwrap_or_default()
                     .to_string_lossy(),
                 format.suffix()
             )
         } else {
-            out
+            out.clone()
         }
     } else {
-        let first_path = Path::new(&input_paths[0]);
+        let input = Path::new(input_path);
         format!(
             "{}{}-:idx:.{}",
-            get_dir_prefix(first_path),
-            first_path.file_stem().unwrap_or_default().to_string_lossy(),
+            get_dir_prefix(input),
+            input.file_stem().unwrap_or_default().to_string_lossy(),
             format.suffix()
         )
     };
@@ -205,21 +344,20 @@ pub extern "C" fn drawpile_cmd_main() -> c_int {
                 "jpg" => OutputFormat::Jpg,
                 "jpeg" => OutputFormat::Jpeg,
                 _ => {
-                    eprintln!("Can't guess output format for extension '.{}'", ext);
-                    return 2;
+                    return Err(format!(
+                        "Can't guess output format for extension '.{}'",
+                        ext
+                    ));
                 }
             }
         } else {
-            eprintln!("Can't guess output format from '{}'", pre_out_pattern);
-            return 2;
+            return Err(format!(
+                "Can't guess output format from '{}'",
+                pre_out_pattern
+            ));
         }
     }
 
-    if flags.maxsize.is_some() && format == OutputFormat::Ora {
-        eprintln!("The ora output format doesn't support -s/--max-size");
-        return 2;
-    }
-
     let out_path = Path::new(&pre_out_pattern);
     let out_dir = get_dir_prefix(out_path);
     let out_stem = out_path.file_stem().unwrap_or_default().to_string_lossy();
@@ -229,25 +367,7 @@ pub extern "C" fn drawpile_cmd_main() -> c_int {
     } else {
         format!("{}{}-:idx:.{}", out_dir, out_stem, out_suffix)
     };
-
-    let acl_override = !flags.acl;
-
-    match dump_recordings(
-        &input_paths,
-        acl_override,
-        every,
-        steps,
-        flags.maxsize,
-        flags.fixedsize,
-        format,
-        &out_pattern,
-    ) {
-        Ok(_) => 0,
-        Err(e) => {
-            eprintln!("{}", e);
-            1
-        }
-    }
+    Ok((format, out_pattern))
 }
 
 fn get_dir_prefix(path: &Path) -> String {
@@ -259,16 +379,98 @@ fn get_dir_prefix(path: &Path) -> String {
     }
 }
 
+struct EncodeJob {
+    img: Image,
+    path: String,
+}
+
+// Scales and encodes flat images on a pool of threads, so that the player can
+// keep stepping in the meantime. The job queue is bounded, so submitting blocks
+// when the encoders fall behind instead of piling up images in memory.
+struct Encoder {
+    jobs: SyncSender<EncodeJob>,
+    threads: Vec<JoinHandle<bool>>,
+}
+
+impl Encoder {
+    fn new(
+        thread_count: usize,
+        max_size: Option<ImageSize>,
+        fixed_size: bool,
+        format: OutputFormat,
+    ) -> Self {
+        let (jobs, receiver) = sync_channel::<EncodeJob>(thread_count);
+        let receiver = Arc::new(Mutex::new(receiver));
+        let threads = (0..thread_count)
+            .map(|_| {
+                let receiver = Arc::clone(&receiver);
+                thread::spawn(move || run_encoder(&receiver, max_size, fixed_size, format))
+            })
+            .collect();
+        Self { jobs, threads }
+    }
+
+    fn queue(&self) -> EncodeQueue {
+        EncodeQueue {
+            jobs: self.jobs.clone(),
+        }
+    }
+
+    // Waits for all pending images to be written, returns if all of them were.
+    // All queues must have been dropped before calling this.
+    fn finish(self) -> bool {
+        drop(self.jobs);
+        let mut ok = true;
+        for t in self.threads {
+            ok = t.join().unwrap_or(false) && ok;
+        }
+        ok
+    }
+}
+
+struct EncodeQueue {
+    jobs: SyncSender<EncodeJob>,
+}
+
+impl EncodeQueue {
+    fn submit(&self, img: Image, path: String) -> Result<()> {
+        self.jobs
+            .send(EncodeJob { img, path })
+            .map_err(|_| anyhow!("Encoder threads went away"))
+    }
+}
+
+fn run_encoder(
+    receiver: &Mutex<Receiver<EncodeJob>>,
+    max_size: Option<ImageSize>,
+    fixed_size: bool,
+    format: OutputFormat,
+) -> bool {
+    let mut dc = DrawContext::default();
+    let mut ok = true;
+    loop {
+        let job = match receiver.lock().unwrap().recv() {
+            Ok(job) => job,
+            Err(_) => return ok,
+        };
+        if let Err(e) = write_flat_image(job.img, &mut dc, max_size, fixed_size, format, &job.path)
+        {
+            eprintln!("Error writing {}: {}", job.path, e);
+            ok = false;
+        }
+    }
+}
+
 fn dump_recordings(
     input_paths: &Vec<String>,
     acl_override: bool,
     every: Every,
     steps: i64,
-    max_size: Option<ImageSize>,
-    fixed_size: bool,
     format: OutputFormat,
     out_pattern: &str,
+    encoder: &Encoder,
 ) -> Result<()> {
+    let queue = encoder.queue();
     let mut index = 1;
     for input_path in input_paths {
         dump_recording(
@@ -277,25 +479,76 @@ fn dump_recordings(
             acl_override,
             every,
             steps,
-            max_size,
-            fixed_size,
             format,
             out_pattern,
+            &queue,
         )?;
     }
     Ok(())
 }
 
+fn dump_recordings_batch(
+    input_paths: &[String],
+    out_patterns: &[String],
+    jobs: usize,
+    acl_override: bool,
+    every: Every,
+    steps: i64,
+    format: OutputFormat,
+    encoder: &Encoder,
+) -> Result<()> {
+    // Each job thread grabs the next input that nobody has started on yet. A
+    // broken input doesn't stop the others from being processed.
+    let next = AtomicUsize::new(0);
+    let failed = AtomicUsize::new(0);
+    thread::scope(|scope| {
+        for _ in 0..jobs.min(input_paths.len()) {
+            let queue = encoder.queue();
+            let (next, failed) = (&next, &failed);
+            scope.spawn(move || loop {
+                let i = next.fetch_add(1, Ordering::Relaxed);
+                if i >= input_paths.len() {
+                    break;
+                }
+                let mut index = 1;
+                if let Err(e) = dump_recording(
+                    &mut index,
+                    &input_paths[i],
+                    acl_override,
+                    every,
+                    steps,
+                    format,
+                    &out_patterns[i],
+                    &queue,
+                ) {
+                    eprintln!("{}: {}", input_paths[i], e);
+                    failed.fetch_add(1, Ordering::Relaxed);
+                }
+            });
+        }
+    });
+
+    let failed_count = failed.load(Ordering::Relaxed);
+    if failed_count == 0 {
+        Ok(())
+    } else {
+        Err(anyhow!(
+            "{} of {} input(s) failed",
+            failed_count,
+            input_paths.len()
+        ))
+    }
+}
+
 fn dump_recording(
     index: &mut i32,
     input_path: &String,
     acl_override: bool,
     every: Every,
     steps: i64,
-    max_size: Option<ImageSize>,
-    fixed_size: bool,
     format: OutputFormat,
     out_pattern: &str,
+    queue: &EncodeQueue,
 ) -> Result<()> {
     let mut player = make_player(input_path).and_then(Player::check_compatible)?;
     player.set_acl_override(acl_override);
@@ -303,6 +556,7 @@ fn dump_recording(
     let mut pe = PaintEngine::new(Some(player));
     pe.begin_playback()?;
 
+    let mut initial = true;
     loop {
         let pos = match every {
             Every::None => skip_playback_to_end(&mut pe)?,
@@ -310,14 +564,21 @@ fn dump_recording(
             Every::UndoPoint => pe.skip_playback(steps)?,
         };
 
-        pe.render();
+        // The rendered image is kept around between exports, so only what
+        // changed in between needs to be rendered again.
+        if initial {
+            pe.render();
+            initial = false;
+        } else {
+            pe.render_changes();
+        }
         let path = out_pattern.replace(":idx:", &index.to_string());
         *index += 1;
 
         match format {
             OutputFormat::Ora => pe.write_ora(&path)?,
             OutputFormat::Png | OutputFormat::Jpg | OutputFormat::Jpeg => {
-                write_flat_image(&mut pe, max_size, fixed_size, format, &path)?;
+                queue.submit(pe.to_image()?, path)?
             }
             OutputFormat::Guess => panic!("Unhandled output format"),
         }
@@ -346,30 +607,29 @@ fn skip_playback_to_end(pe: &mut PaintEngine) -> Result<i64> {
 }
 
 fn write_flat_image(
-    pe: &mut PaintEngine,
+    img: Image,
+    dc: &mut DrawContext,
     max_size: Option<ImageSize>,
     fixed_size: bool,
     format: OutputFormat,
     path: &str,
 ) -> Result<()> {
-    let result = if let Some(ImageSize { width, height }) = max_size {
+    let img = if let Some(ImageSize { width, height }) = max_size {
+        let (w, h) = (img.width(), img.height());
         if fixed_size {
-            pe.to_scaled_image(width, height, true)
-        } else if pe.render_width() <= width && pe.render_height() < height {
-            pe.to_image()
+            Image::new_from_pixels_scaled(w, h, img.pixels(), width, height, true, dc)?
+        } else if w <= width && h < height {
+            img
         } else {
-            pe.to_scaled_image(width, height, false)
+            Image::new_from_pixels_scaled(w, h, img.pixels(), width, height, false, dc)?
         }
     } else {
-        pe.to_image()
+        img
     };
-    match result {
-        Ok(img) => match format {
-            OutputFormat::Png => img.write_png(path)?,
-            OutputFormat::Jpg | OutputFormat::Jpeg => img.write_jpeg(path)?,
-            _ => panic!("Unhandled output format"),
-        },
-        Err(e) => eprintln!("Warning: {}", e),
+    match format {
+        OutputFormat::Png => img.write_png(path)?,
+        OutputFormat::Jpg | OutputFormat::Jpeg => img.write_jpeg(path)?,
+        _ => panic!("Unhandled output format"),
     }
     Ok(())
 }
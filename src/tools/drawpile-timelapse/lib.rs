@@ -2,19 +2,27 @@
 use anyhow::{anyhow, Result};
 use drawdance::{
     dp_cmake_config_version,
-    engine::{Image, PaintEngine, Player},
+    engine::{DrawContext, Image, PaintEngine, Player},
     DP_UPixel8, DP_PLAYER_TYPE_GUESS, DP_PROTOCOL_VERSION,
 };
 use regex::Regex;
 use std::{
-    collections::{HashMap, VecDeque},
+    collections::{BTreeMap, HashMap, VecDeque},
     env::consts::EXE_SUFFIX,
     ffi::{c_char, c_int, CStr, OsStr},
     fmt::Display,
     fs::File,
     io::{self, stdout},
+    mem::size_of,
+    num::NonZeroUsize,
     process::{Command, Stdio},
     str::FromStr,
+    sync::{
+        mpsc::{channel, Receiver, Sender},
+        Arc, Mutex,
+    },
+    thread::{self, JoinHandle},
+    time::Instant,
 };
 
 #[derive(Copy, Clone, Debug)]
@@ -340,6 +348,9 @@ pub extern "C" fn drawpile_timelapse_main(default_logo_path: *const c_char) -> c
         /// croppings depending on resolution of the form
         /// "CANVAS_WIDTH:CANVAS_HEIGHT=X:Y:WIDTH:HEIGHT".
         optional -x,--crop crop: Crop
+        /// Number of threads to crop and scale frames on while the recording
+        /// keeps playing. Defaults to the number of available CPU cores.
+        optional -j,--threads threads: usize
         /// Input recording file(s).
         repeated input: String
     };
@@ -464,6 +475,16 @@ pub extern "C" fn drawpile_timelapse_main(default_logo_path: *const c_char) -> c
         return 2;
     }
 
+    let threads = flags.threads.unwrap_or_else(|| {
+        thread::available_parallelism()
+            .map(NonZeroUsize::get)
+            .unwrap_or(1)
+    });
+    if threads < 1 {
+        eprintln!("Invalid thread count {}", threads);
+        return 2;
+    }
+
     let acl_override = !flags.acl;
     let reveal_censored = flags.uncensor;
 
@@ -486,6 +507,7 @@ pub extern "C" fn drawpile_timelapse_main(default_logo_path: *const c_char) -> c
         eprintln!("linger time:\n    {} sec", linger_time);
         eprintln!("filter acls:\n    {}", !acl_override);
         eprintln!("reveal censored layers:\n    {}", reveal_censored);
+        eprintln!("threads:\n    {}", threads);
         if let Some(crop) = flags.crop {
             eprintln!("crop:\n    {}", crop.to_arg());
         }
@@ -525,6 +547,7 @@ pub extern "C" fn drawpile_timelapse_main(default_logo_path: *const c_char) -> c
             flash,
             linger_time,
             &flags.crop,
+            threads,
         )
     } else if flags.out == "-" {
         timelapse(
@@ -539,6 +562,7 @@ pub extern "C" fn drawpile_timelapse_main(default_logo_path: *const c_char) -> c
             flash,
             linger_time,
             &flags.crop,
+            threads,
         )
     } else {
         make_timelapse_raw(
@@ -553,6 +577,7 @@ pub extern "C" fn drawpile_timelapse_main(default_logo_path: *const c_char) -> c
             flash,
             linger_time,
             &flags.crop,
+            threads,
         )
     };
 
@@ -577,6 +602,7 @@ fn make_timelapse_command(
     flash: Option<u32>,
     linger_time: f64,
     crop: &Option<Crop>,
+    threads: usize,
 ) -> Result<()> {
     let mut child = match command.spawn() {
         Ok(c) => c,
@@ -604,6 +630,7 @@ fn make_timelapse_command(
         flash,
         linger_time,
         crop,
+        threads,
     )?;
     drop(pipe);
     let status = child.wait()?;
@@ -626,6 +653,7 @@ fn make_timelapse_raw(
     flash: Option<u32>,
     linger_time: f64,
     crop: &Option<Crop>,
+    threads: usize,
 ) -> Result<()> {
     let mut f = File::create(path)?;
     timelapse(
@@ -640,6 +668,7 @@ fn make_timelapse_raw(
         flash,
         linger_time,
         crop,
+        threads,
     )?;
     Ok(())
 }
@@ -663,6 +692,179 @@ impl<'a> TimelapseContext<'a> {
     }
 }
 
+struct FrameJob {
+    index: usize,
+    width: usize,
+    height: usize,
+    pixels: Vec<u32>,
+    area: Option<CropArea>,
+}
+
+struct FrameResult {
+    index: usize,
+    bytes: usize,
+    result: Result<Image>,
+}
+
+// How much memory the full canvas copies of unfinished frames may take up
+// together. Large canvases get fewer frames in flight, small ones more.
+const MAX_FRAME_BYTES_IN_FLIGHT: usize = 256 * 1024 * 1024;
+
+// Crops and scales rendered frames on a pool of threads while the paint engine
+// carries on playing back the recording. Frames are handed to the timelapse
+// context in the same order they were submitted in.
+struct FramePool {
+    jobs: Option<Sender<FrameJob>>,
+    results: Receiver<FrameResult>,
+    threads: Vec<JoinHandle<()>>,
+    bytes_in_flight: usize,
+    submitted: usize,
+    finished: usize,
+    pending: BTreeMap<usize, FrameResult>,
+}
+
+impl FramePool {
+    fn new(thread_count: usize, width: usize, height: usize) -> Self {
+        let (jobs, job_receiver) = channel::<FrameJob>();
+        let job_receiver = Arc::new(Mutex::new(job_receiver));
+        let (result_sender, results) = channel();
+        let threads = (0..thread_count)
+            .map(|_| {
+                let job_receiver = Arc::clone(&job_receiver);
+                let result_sender = result_sender.clone();
+                thread::spawn(move || {
+                    let mut dc = DrawContext::default();
+                    loop {
+                        let job = match job_receiver.lock().unwrap().recv() {
+                            Ok(job) => job,
+                            Err(_) => return,
+                        };
+                        let result = FrameResult {
+                            index: job.index,
+                            bytes: frame_bytes(&job.pixels),
+                            result: scale_frame(&job, width, height, &mut dc),
+                        };
+                        // Free the canvas copy before it's accounted as gone.
+                        drop(job);
+                        if result_sender.send(result).is_err() {
+                            return;
+                        }
+                    }
+                })
+            })
+            .collect();
+        Self {
+            jobs: Some(jobs),
+            results,
+            threads,
+            bytes_in_flight: 0,
+            submitted: 0,
+            finished: 0,
+            pending: BTreeMap::new(),
+        }
+    }
+
+    fn frame_count(&self) -> usize {
+        self.finished
+    }
+
+    fn submit(
+        &mut self,
+        ctx: &mut TimelapseContext,
+        width: usize,
+        height: usize,
+        pixels: &[u32],
+        area: Option<CropArea>,
+    ) -> Result<()> {
+        while let Ok(result) = self.results.try_recv() {
+            self.collect(ctx, result)?;
+        }
+
+        // Wait for earlier frames before copying the canvas if the copy would
+        // go over the budget. A frame larger than the whole budget still gets
+        // through, it just has to be the only one.
+        let bytes = frame_bytes(pixels);
+        while self.bytes_in_flight > 0 && self.bytes_in_flight + bytes > MAX_FRAME_BYTES_IN_FLIGHT {
+            self.receive(ctx)?;
+        }
+
+        let job = FrameJob {
+            index: self.submitted,
+            width,
+            height,
+            pixels: pixels.to_vec(),
+            area,
+        };
+        self.submitted += 1;
+        self.bytes_in_flight += bytes;
+        self.jobs
+            .as_ref()
+            .unwrap()
+            .send(job)
+            .map_err(|_| anyhow!("Frame threads went away"))
+    }
+
+    fn finish(&mut self, ctx: &mut TimelapseContext) -> Result<()> {
+        self.jobs = None;
+        while self.finished < self.submitted {
+            self.receive(ctx)?;
+        }
+        for t in self.threads.drain(..) {
+            t.join().map_err(|_| anyhow!("Frame thread panicked"))?;
+        }
+        Ok(())
+    }
+
+    fn receive(&mut self, ctx: &mut TimelapseContext) -> Result<()> {
+        let result = self
+            .results
+            .recv()
+            .map_err(|_| anyhow!("Frame threads went away"))?;
+        self.collect(ctx, result)
+    }
+
+    // Results that arrive out of order wait in pending and keep counting against
+    // the budget until they've been handed on in order.
+    fn collect(&mut self, ctx: &mut TimelapseContext, result: FrameResult) -> Result<()> {
+        self.pending.insert(result.index, result);
+        while let Some(FrameResult { bytes, result, .. }) = self.pending.remove(&self.finished) {
+            self.finished += 1;
+            self.bytes_in_flight -= bytes;
+            match result {
+                Ok(img) => ctx.push(img)?,
+                Err(e) => eprintln!("Warning: {}", e),
+            }
+        }
+        Ok(())
+    }
+}
+
+fn frame_bytes(pixels: &[u32]) -> usize {
+    pixels.len() * size_of::<u32>()
+}
+
+fn scale_frame(job: &FrameJob, width: usize, height: usize, dc: &mut DrawContext) -> Result<Image> {
+    if let Some(area) = job.area {
+        let img = Image::new_from_pixels(job.width, job.height, &job.pixels)?.cropped(
+            area.x,
+            area.y,
+            area.width,
+            area.height,
+        )?;
+        Image::new_from_pixels_scaled(
+            img.width(),
+            img.height(),
+            img.pixels(),
+            width,
+            height,
+            true,
+            dc,
+        )
+    } else {
+        Image::new_from_pixels_scaled(job.width, job.height, &job.pixels, width, height, true, dc)
+    }
+}
+
 fn timelapse(
     writer: &mut dyn io::Write,
     input_paths: &Vec<String>,
@@ -675,24 +877,40 @@ fn timelapse(
     flash: Option<u32>,
     linger_time: f64,
     crop: &Option<Crop>,
+    threads: usize,
 ) -> Result<()> {
     let mut ctx = TimelapseContext {
         writer,
         images: VecDeque::new(),
     };
 
+    let start = Instant::now();
+    let mut pool = FramePool::new(threads, width, height);
     for input_path in input_paths {
         timelapse_recording(
             &mut ctx,
+            &mut pool,
             input_path,
             acl_override,
             reveal_censored,
             interval,
-            width,
-            height,
             crop,
         )?;
     }
+    pool.finish(&mut ctx)?;
+
+    let frame_count = pool.frame_count();
+    let secs = start.elapsed().as_secs_f64();
+    eprintln!(
+        "Rendered {} frame(s) in {:.2} seconds ({:.2} frames per second)",
+        frame_count,
+        secs,
+        if secs > 0.0 {
+            frame_count as f64 / secs
+        } else {
+            0.0
+        }
+    );
 
     if !ctx.images.is_empty() {
         let fr = f64::from(framerate);
@@ -713,12 +931,11 @@ fn timelapse(
 
 fn timelapse_recording(
     ctx: &mut TimelapseContext,
+    pool: &mut FramePool,
     input_path: &String,
     acl_override: bool,
     reveal_censored: bool,
     interval: i64,
-    width: usize,
-    height: usize,
     crop: &Option<Crop>,
 ) -> Result<()> {
     let mut player = make_player(input_path).and_then(Player::check_compatible)?;
@@ -737,14 +954,25 @@ fn timelapse_recording(
             pe.play_playback_timelapse(interval, last_area.map(|a| a.to_tuple()))
         }?;
 
-        pe.render();
-        match to_image(&mut pe, width, height, crop) {
-            Ok((img, area)) => {
-                last_area = area;
-                ctx.push(img)?;
-                initial = false;
-            }
-            Err(e) => eprintln!("Warning: {}", e),
+        // The rendered image sticks around between frames, so after the first
+        // one only the tiles that changed in between need to be composited.
+        if initial {
+            pe.render();
+        } else {
+            pe.render_changes();
+        }
+
+        let render_width = pe.render_width();
+        let render_height = pe.render_height();
+        if render_width == 0 || render_height == 0 {
+            eprintln!("Warning: Empty source image");
+        } else {
+            let area = crop
+                .as_ref()
+                .map(|c| *c.get_area(render_width, render_height));
+            pool.submit(ctx, render_width, render_height, pe.render_pixels(), area)?;
+            last_area = area;
+            initial = false;
         }
 
         if pos == -1 {
@@ -753,23 +981,6 @@ fn timelapse_recording(
     }
 }
 
-fn to_image(
-    pe: &mut PaintEngine,
-    width: usize,
-    height: usize,
-    crop: &Option<Crop>,
-) -> Result<(Image, Option<CropArea>)> {
-    if let Some(ref c) = crop {
-        let area = c.get_area(pe.render_width(), pe.render_height());
-        Ok((
-            pe.to_scaled_image_crop(width, height, true, area.x, area.y, area.width, area.height)?,
-            Some(*area),
-        ))
-    } else {
-        Ok((pe.to_scaled_image(width, height, true)?, None))
-    }
-}
-
 fn make_player(input_path: &String) -> Result<Player> {
     if input_path == "-" {
         Player::new_from_stdin(DP_PLAYER_TYPE_GUESS)